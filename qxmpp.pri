@@ -53,6 +53,11 @@ android {
     QXMPP_INTERNAL_LIBS += -lvpx
 }
 
+!isEmpty(QXMPP_USE_ZLIB) {
+    DEFINES += QXMPP_USE_ZLIB
+    QXMPP_INTERNAL_LIBS += -lz
+}
+
 # Libraries for apps which use QXmpp
 QXMPP_LIBS = -l$${QXMPP_LIBRARY_NAME}
 contains(QXMPP_LIBRARY_TYPE,staticlib) {
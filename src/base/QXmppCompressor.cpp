@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifdef QXMPP_USE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "QXmppCompressor_p.h"
+
+#ifdef QXMPP_USE_ZLIB
+// the output buffer grows by this amount while (de)compressing
+static const int chunkSize = 16384;
+
+static QString zlibError(z_stream *stream, int code)
+{
+    if (stream->msg)
+        return QString::fromLatin1(stream->msg);
+    return QString("zlib error %1").arg(code);
+}
+#endif
+
+QXmppCompressor::QXmppCompressor()
+    : m_deflate(0)
+    , m_inflate(0)
+    , m_inflateOutputPending(false)
+{
+}
+
+QXmppCompressor::~QXmppCompressor()
+{
+    stop();
+}
+
+/// Returns true if QXmpp was built with zlib support.
+
+bool QXmppCompressor::isSupported()
+{
+#ifdef QXMPP_USE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+/// Creates the compression and decompression contexts.
+///
+/// \param level the zlib compression level, from 1 (fastest) to 9 (best)
+/// \param memoryLevel the zlib memory level, from 1 to 9. The compression
+/// context uses 128 KiB plus 2^(memoryLevel + 9) bytes.
+
+bool QXmppCompressor::start(int level, int memoryLevel)
+{
+    stop();
+    m_errorString.clear();
+
+#ifdef QXMPP_USE_ZLIB
+    m_deflate = new z_stream;
+    m_deflate->zalloc = Z_NULL;
+    m_deflate->zfree = Z_NULL;
+    m_deflate->opaque = Z_NULL;
+    int ret = deflateInit2(m_deflate, level, Z_DEFLATED, MAX_WBITS, memoryLevel, Z_DEFAULT_STRATEGY);
+    if (ret != Z_OK) {
+        m_errorString = zlibError(m_deflate, ret);
+        delete m_deflate;
+        m_deflate = 0;
+        return false;
+    }
+
+    // the peer may use any window size, so decompression uses the largest
+    m_inflate = new z_stream;
+    m_inflate->zalloc = Z_NULL;
+    m_inflate->zfree = Z_NULL;
+    m_inflate->opaque = Z_NULL;
+    m_inflate->next_in = Z_NULL;
+    m_inflate->avail_in = 0;
+    ret = inflateInit2(m_inflate, MAX_WBITS);
+    if (ret != Z_OK) {
+        m_errorString = zlibError(m_inflate, ret);
+        delete m_inflate;
+        m_inflate = 0;
+        stop();
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(level);
+    Q_UNUSED(memoryLevel);
+    m_errorString = QLatin1String("zlib support is not available");
+    return false;
+#endif
+}
+
+/// Releases the compression and decompression contexts.
+
+void QXmppCompressor::stop()
+{
+#ifdef QXMPP_USE_ZLIB
+    if (m_deflate) {
+        deflateEnd(m_deflate);
+        delete m_deflate;
+        m_deflate = 0;
+    }
+    if (m_inflate) {
+        inflateEnd(m_inflate);
+        delete m_inflate;
+        m_inflate = 0;
+    }
+#endif
+    m_inflateInput.clear();
+    m_inflateOutputPending = false;
+}
+
+/// Returns true if the contexts were created with start().
+
+bool QXmppCompressor::isActive() const
+{
+    return m_deflate != 0 && m_inflate != 0;
+}
+
+/// Compresses \a data into \a output.
+///
+/// Returns false if an error occurred.
+
+bool QXmppCompressor::compress(const QByteArray &data, QByteArray &output)
+{
+    output.clear();
+#ifdef QXMPP_USE_ZLIB
+    if (!m_deflate)
+        return false;
+
+    m_deflate->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.constData()));
+    m_deflate->avail_in = data.size();
+    do {
+        const int offset = output.size();
+        output.resize(offset + chunkSize);
+        m_deflate->next_out = reinterpret_cast<Bytef*>(output.data() + offset);
+        m_deflate->avail_out = chunkSize;
+
+        const int ret = deflate(m_deflate, Z_SYNC_FLUSH);
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            m_errorString = zlibError(m_deflate, ret);
+            output.clear();
+            return false;
+        }
+        output.resize(offset + chunkSize - m_deflate->avail_out);
+    } while (m_deflate->avail_out == 0);
+    return true;
+#else
+    Q_UNUSED(data);
+    return false;
+#endif
+}
+
+/// Decompresses \a data into \a output.
+///
+/// If \a maximumSize is not 0, at most \a maximumSize bytes are output
+/// and the rest of the input is kept for the next call, which may pass
+/// empty data. hasPendingData() tells whether any input is left.
+///
+/// Returns false if the data is corrupt.
+
+bool QXmppCompressor::decompress(const QByteArray &data, QByteArray &output, int maximumSize)
+{
+    output.clear();
+#ifdef QXMPP_USE_ZLIB
+    if (!m_inflate)
+        return false;
+
+    m_inflateInput += data;
+    m_inflate->next_in = reinterpret_cast<Bytef*>(m_inflateInput.data());
+    m_inflate->avail_in = m_inflateInput.size();
+    do {
+        const int offset = output.size();
+        const int size = maximumSize > 0 ? qMin(chunkSize, maximumSize - offset) : chunkSize;
+        output.resize(offset + size);
+        m_inflate->next_out = reinterpret_cast<Bytef*>(output.data() + offset);
+        m_inflate->avail_out = size;
+
+        const int ret = inflate(m_inflate, Z_SYNC_FLUSH);
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            m_errorString = zlibError(m_inflate, ret);
+            m_inflateInput.clear();
+            m_inflateOutputPending = false;
+            output.clear();
+            return false;
+        }
+        output.resize(offset + size - m_inflate->avail_out);
+    } while (m_inflate->avail_out == 0 && (maximumSize <= 0 || output.size() < maximumSize));
+
+    // a full output buffer means zlib may hold more output, even once all
+    // the input has been consumed
+    m_inflateInput.remove(0, m_inflateInput.size() - m_inflate->avail_in);
+    m_inflateOutputPending = (m_inflate->avail_out == 0);
+    return true;
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(maximumSize);
+    return false;
+#endif
+}
+
+/// Returns true if decompress() stopped at its size limit before all of
+/// its input was decompressed.
+
+bool QXmppCompressor::hasPendingData() const
+{
+    return !m_inflateInput.isEmpty() || m_inflateOutputPending;
+}
+
+/// Returns a description of the last error.
+
+QString QXmppCompressor::errorString() const
+{
+    return m_errorString;
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef QXMPPCOMPRESSOR_P_H
+#define QXMPPCOMPRESSOR_P_H
+
+#include <QByteArray>
+#include <QString>
+
+#include "QXmppGlobal.h"
+
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QXmpp API.  It exists for the convenience
+// of the QXmppStream class.
+//
+// This header file may change from version to version without notice,
+// or even be removed.
+//
+// We mean it.
+//
+
+struct z_stream_s;
+
+/// \brief The QXmppCompressor class holds the zlib contexts used to
+/// compress an XMPP stream (XEP-0138).
+///
+/// Each call to compress() ends with a sync flush, so the peer can decode
+/// the data right away. The contexts are kept for the lifetime of the
+/// stream, which lets later data refer to earlier data.
+///
+/// Decompression can be bounded, in which case the input which was not
+/// decompressed yet is kept for the next call to decompress().
+
+class QXMPP_AUTOTEST_EXPORT QXmppCompressor
+{
+public:
+    QXmppCompressor();
+    ~QXmppCompressor();
+
+    static bool isSupported();
+
+    bool start(int level, int memoryLevel);
+    void stop();
+    bool isActive() const;
+
+    bool compress(const QByteArray &data, QByteArray &output);
+    bool decompress(const QByteArray &data, QByteArray &output, int maximumSize = 0);
+
+    bool hasPendingData() const;
+
+    QString errorString() const;
+
+private:
+    Q_DISABLE_COPY(QXmppCompressor)
+
+    z_stream_s *m_deflate;
+    z_stream_s *m_inflate;
+    QByteArray m_inflateInput;
+    bool m_inflateOutputPending;
+    QString m_errorString;
+};
+
+#endif
@@ -114,6 +114,8 @@ const char* ns_media_element = "urn:xmpp:media-element";
 const char* ns_attention = "urn:xmpp:attention:0";
 // XEP-0231: Bits of Binary
 const char* ns_bob = "urn:xmpp:bob";
+// XEP-0237: Roster Versioning
+const char* ns_rosterver = "urn:xmpp:features:rosterver";
 // XEP-0249: Direct MUC Invitations
 const char* ns_conference = "jabber:x:conference";
 // XEP-0280: Message Carbons
@@ -0,0 +1,364 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QMutexLocker>
+
+#include "QXmppDnsCache_p.h"
+
+// entries beyond this count cause expired entries to be purged
+static const int maximumEntries = 4096;
+
+Q_GLOBAL_STATIC(QXmppDnsCache, dnsCache)
+
+QXmppDnsResult::QXmppDnsResult()
+    : error(QDnsLookup::NoError)
+{
+}
+
+QXmppDnsReply::QXmppDnsReply(QXmppDnsCache *cache, QDnsLookup::Type type, const QString &name)
+    : m_cache(cache)
+    , m_type(type)
+    , m_name(name)
+    , m_source(NetworkSource)
+    , m_finished(false)
+{
+}
+
+QXmppDnsReply::~QXmppDnsReply()
+{
+    // stop waiting for the query in progress
+    if (!m_finished)
+        m_cache->cancel(this);
+}
+
+/// Returns the type of error that occurred, if any.
+
+QDnsLookup::Error QXmppDnsReply::error() const
+{
+    return m_result.error;
+}
+
+/// Returns a human-readable description of the error, if any.
+
+QString QXmppDnsReply::errorString() const
+{
+    return m_result.errorString;
+}
+
+/// Returns the name which was looked up.
+
+QString QXmppDnsReply::name() const
+{
+    return m_name;
+}
+
+/// Returns the type of the lookup.
+
+QDnsLookup::Type QXmppDnsReply::type() const
+{
+    return m_type;
+}
+
+/// Returns where the result of the lookup came from.
+
+QXmppDnsReply::Source QXmppDnsReply::source() const
+{
+    return m_source;
+}
+
+/// Returns true once the lookup has finished.
+
+bool QXmppDnsReply::isFinished() const
+{
+    return m_finished;
+}
+
+/// Returns the A and AAAA records of the reply.
+
+QList<QDnsHostAddressRecord> QXmppDnsReply::hostAddressRecords() const
+{
+    return m_result.hostAddressRecords;
+}
+
+/// Returns the SRV records of the reply.
+
+QList<QDnsServiceRecord> QXmppDnsReply::serviceRecords() const
+{
+    return m_result.serviceRecords;
+}
+
+void QXmppDnsReply::_q_finished(const QXmppDnsResult &result)
+{
+    m_result = result;
+    m_finished = true;
+    emit finished();
+}
+
+/// Constructs a new DNS cache and starts the thread which sends its
+/// queries.
+///
+/// Most code should use the shared instance() instead.
+
+QXmppDnsCache::QXmppDnsCache()
+    : m_maximumTimeToLive(3600)
+    , m_negativeTimeToLive(60)
+    , m_hits(0)
+    , m_misses(0)
+    , m_coalesced(0)
+{
+    qRegisterMetaType<QXmppDnsResult>("QXmppDnsResult");
+
+    m_clock.start();
+    m_thread.start();
+    moveToThread(&m_thread);
+}
+
+/// Stops the thread of the cache.
+///
+/// The replies of the cache must have been deleted beforehand.
+
+QXmppDnsCache::~QXmppDnsCache()
+{
+    m_thread.quit();
+    m_thread.wait();
+}
+
+/// Returns the cache shared by all streams of the process.
+
+QXmppDnsCache *QXmppDnsCache::instance()
+{
+    return dnsCache();
+}
+
+/// Looks up the records of the given \a type for \a name.
+///
+/// The returned reply lives in the calling thread and emits finished()
+/// once the result is available.
+
+QXmppDnsReply *QXmppDnsCache::lookup(QDnsLookup::Type type, const QString &name)
+{
+    QXmppDnsReply *reply = new QXmppDnsReply(this, type, name);
+    const QString entryKey = key(type, name);
+
+    QMutexLocker locker(&m_mutex);
+
+    // serve the reply from the cache
+    QHash<QString, Entry>::iterator it = m_entries.find(entryKey);
+    if (it != m_entries.end()) {
+        if (it.value().expiry > m_clock.elapsed()) {
+            m_hits++;
+            reply->m_source = QXmppDnsReply::CacheSource;
+            reply->m_result = it.value().result;
+            reply->m_finished = true;
+            locker.unlock();
+            QMetaObject::invokeMethod(reply, "finished", Qt::QueuedConnection);
+            return reply;
+        }
+        m_entries.erase(it);
+    }
+
+    // share the result of a query in progress
+    QHash<QString, QList<QXmppDnsReply*> >::iterator pending = m_pending.find(entryKey);
+    if (pending != m_pending.end()) {
+        m_coalesced++;
+        reply->m_source = QXmppDnsReply::PendingSource;
+        pending.value() << reply;
+        return reply;
+    }
+
+    // send a new query from the thread of the cache, so that it completes
+    // even if the calling thread exits
+    m_misses++;
+    m_pending[entryKey] << reply;
+    locker.unlock();
+
+    QMetaObject::invokeMethod(this, "_q_lookup", Qt::QueuedConnection,
+                              Q_ARG(int, type),
+                              Q_ARG(QString, name));
+    return reply;
+}
+
+/// Removes all the cached entries.
+///
+/// Queries in progress are not affected.
+
+void QXmppDnsCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_entries.clear();
+}
+
+/// Returns the maximum time in seconds for which a successful lookup is
+/// cached, regardless of the time-to-live of its records.
+
+int QXmppDnsCache::maximumTimeToLive() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_maximumTimeToLive;
+}
+
+/// Sets the maximum time in seconds for which a successful lookup is
+/// cached.
+///
+/// \param secs
+
+void QXmppDnsCache::setMaximumTimeToLive(int secs)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maximumTimeToLive = secs;
+}
+
+/// Returns the time in seconds for which a failed or empty lookup is cached.
+
+int QXmppDnsCache::negativeTimeToLive() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_negativeTimeToLive;
+}
+
+/// Sets the time in seconds for which a failed or empty lookup is cached.
+///
+/// Set it to 0 to disable negative caching.
+///
+/// \param secs
+
+void QXmppDnsCache::setNegativeTimeToLive(int secs)
+{
+    QMutexLocker locker(&m_mutex);
+    m_negativeTimeToLive = secs;
+}
+
+/// Returns the number of cached entries, including expired ones which
+/// were not purged yet.
+
+int QXmppDnsCache::size() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_entries.size();
+}
+
+/// Returns the number of lookups which were served from the cache.
+
+qint64 QXmppDnsCache::hits() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_hits;
+}
+
+/// Returns the number of lookups which caused a query to be sent.
+
+qint64 QXmppDnsCache::misses() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_misses;
+}
+
+/// Returns the number of lookups which shared the result of a query in
+/// progress.
+
+qint64 QXmppDnsCache::coalesced() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_coalesced;
+}
+
+void QXmppDnsCache::_q_lookup(int type, const QString &name)
+{
+    QDnsLookup *dns = new QDnsLookup(QDnsLookup::Type(type), name, this);
+    bool check;
+    Q_UNUSED(check);
+    check = connect(dns, SIGNAL(finished()),
+                    this, SLOT(_q_lookupFinished()));
+    Q_ASSERT(check);
+    dns->lookup();
+}
+
+void QXmppDnsCache::_q_lookupFinished()
+{
+    QDnsLookup *dns = qobject_cast<QDnsLookup*>(sender());
+    if (!dns)
+        return;
+    dns->deleteLater();
+
+    Entry entry;
+    entry.result.error = dns->error();
+    entry.result.errorString = dns->errorString();
+    entry.result.hostAddressRecords = dns->hostAddressRecords();
+    entry.result.serviceRecords = dns->serviceRecords();
+
+    // the entry expires with its first record
+    qint64 ttl = -1;
+    foreach (const QDnsHostAddressRecord &record, entry.result.hostAddressRecords) {
+        if (ttl < 0 || record.timeToLive() < ttl)
+            ttl = record.timeToLive();
+    }
+    foreach (const QDnsServiceRecord &record, entry.result.serviceRecords) {
+        if (ttl < 0 || record.timeToLive() < ttl)
+            ttl = record.timeToLive();
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (entry.result.error != QDnsLookup::NoError || ttl < 0)
+        ttl = m_negativeTimeToLive;
+    else
+        ttl = qMin(ttl, qint64(m_maximumTimeToLive));
+
+    const qint64 now = m_clock.elapsed();
+    const QString entryKey = key(dns->type(), dns->name());
+    if (ttl > 0) {
+        if (m_entries.size() >= maximumEntries) {
+            QHash<QString, Entry>::iterator it = m_entries.begin();
+            while (it != m_entries.end()) {
+                if (it.value().expiry <= now)
+                    it = m_entries.erase(it);
+                else
+                    ++it;
+            }
+            if (m_entries.size() >= maximumEntries)
+                m_entries.clear();
+        }
+        entry.expiry = now + ttl * 1000;
+        m_entries.insert(entryKey, entry);
+    }
+
+    // the replies live in other threads, so deliver them asynchronously;
+    // holding the mutex keeps them from being deleted in the meantime, and
+    // deleting them afterwards discards the queued call
+    const QList<QXmppDnsReply*> replies = m_pending.take(entryKey);
+    foreach (QXmppDnsReply *reply, replies) {
+        QMetaObject::invokeMethod(reply, "_q_finished", Qt::QueuedConnection,
+                                  Q_ARG(QXmppDnsResult, entry.result));
+    }
+}
+
+void QXmppDnsCache::cancel(QXmppDnsReply *reply)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // the query carries on, so that its result gets cached
+    QHash<QString, QList<QXmppDnsReply*> >::iterator it = m_pending.find(key(reply->m_type, reply->m_name));
+    if (it != m_pending.end())
+        it.value().removeAll(reply);
+}
+
+QString QXmppDnsCache::key(QDnsLookup::Type type, const QString &name)
+{
+    return QString::number(type) + QLatin1Char(':') + name.toLower();
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef QXMPPDNSCACHE_P_H
+#define QXMPPDNSCACHE_P_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMetaType>
+#include <QMutex>
+#include <QThread>
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 0, 0))
+#include <QDnsLookup>
+#else
+#include "qdnslookup.h"
+#endif
+
+#include "QXmppGlobal.h"
+
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QXmpp API.  It exists for the convenience
+// of the QXmppOutgoingClient and QXmppOutgoingServer classes.
+//
+// This header file may change from version to version without notice,
+// or even be removed.
+//
+// We mean it.
+//
+
+class QXmppDnsCache;
+
+/// \brief The QXmppDnsResult class holds the records found by a lookup.
+
+struct QXmppDnsResult
+{
+    QXmppDnsResult();
+
+    QDnsLookup::Error error;
+    QString errorString;
+    QList<QDnsHostAddressRecord> hostAddressRecords;
+    QList<QDnsServiceRecord> serviceRecords;
+};
+
+Q_DECLARE_METATYPE(QXmppDnsResult)
+
+/// \brief The QXmppDnsReply class holds the result of a lookup made with
+/// QXmppDnsCache.
+///
+/// The finished() signal is always emitted asynchronously, even when the
+/// result comes from the cache. The reply belongs to the caller, who must
+/// delete it once finished and before the cache itself. Deleting a reply
+/// before it has finished cancels it.
+
+class QXMPP_AUTOTEST_EXPORT QXmppDnsReply : public QObject
+{
+    Q_OBJECT
+
+public:
+    /// This enum describes where the result of a lookup came from.
+    enum Source
+    {
+        NetworkSource = 0,  ///< A new query was sent.
+        CacheSource,        ///< The result was cached.
+        PendingSource       ///< The result of an identical query in progress was reused.
+    };
+
+    QDnsLookup::Error error() const;
+    QString errorString() const;
+    QString name() const;
+    QDnsLookup::Type type() const;
+    Source source() const;
+    bool isFinished() const;
+
+    QList<QDnsHostAddressRecord> hostAddressRecords() const;
+    QList<QDnsServiceRecord> serviceRecords() const;
+
+    ~QXmppDnsReply();
+
+signals:
+    /// This signal is emitted when the lookup has finished.
+    void finished();
+
+private slots:
+    void _q_finished(const QXmppDnsResult &result);
+
+private:
+    QXmppDnsReply(QXmppDnsCache *cache, QDnsLookup::Type type, const QString &name);
+    friend class QXmppDnsCache;
+
+    QXmppDnsCache *m_cache;
+    QDnsLookup::Type m_type;
+    QString m_name;
+    Source m_source;
+    bool m_finished;
+    QXmppDnsResult m_result;
+};
+
+/// \brief The QXmppDnsCache class is a process-wide cache for SRV, A and
+/// AAAA lookups.
+///
+/// Results are kept for the smallest time-to-live of their records, up to
+/// maximumTimeToLive(). Failed lookups are kept for negativeTimeToLive().
+/// Identical lookups which are made while a query is in progress share
+/// its result instead of sending another query.
+///
+/// The queries are sent from a thread owned by the cache, so the cache can
+/// be used from any thread. Each reply is delivered in the thread which
+/// requested it.
+
+class QXMPP_AUTOTEST_EXPORT QXmppDnsCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    QXmppDnsCache();
+    ~QXmppDnsCache();
+
+    static QXmppDnsCache *instance();
+
+    QXmppDnsReply *lookup(QDnsLookup::Type type, const QString &name);
+    void clear();
+
+    int maximumTimeToLive() const;
+    void setMaximumTimeToLive(int secs);
+
+    int negativeTimeToLive() const;
+    void setNegativeTimeToLive(int secs);
+
+    int size() const;
+    qint64 hits() const;
+    qint64 misses() const;
+    qint64 coalesced() const;
+
+private slots:
+    void _q_lookup(int type, const QString &name);
+    void _q_lookupFinished();
+
+private:
+    struct Entry
+    {
+        qint64 expiry;
+        QXmppDnsResult result;
+    };
+
+    Q_DISABLE_COPY(QXmppDnsCache)
+    void cancel(QXmppDnsReply *reply);
+    static QString key(QDnsLookup::Type type, const QString &name);
+    friend class QXmppDnsReply;
+
+    mutable QMutex m_mutex;
+    QThread m_thread;
+    QElapsedTimer m_clock;
+    QHash<QString, Entry> m_entries;
+    QHash<QString, QList<QXmppDnsReply*> > m_pending;
+    int m_maximumTimeToLive;
+    int m_negativeTimeToLive;
+    qint64 m_hits;
+    qint64 m_misses;
+    qint64 m_coalesced;
+};
+
+#endif
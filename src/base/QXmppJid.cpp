@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include "QXmppJid.h"
+
+static uint hashString(const QStringRef &str)
+{
+#if (QT_VERSION >= QT_VERSION_CHECK(4, 8, 0))
+    return qHash(str);
+#else
+    // qHash(QStringRef) was only added in Qt 4.8
+    return qHash(str.toString());
+#endif
+}
+
+/// Constructs an empty JID.
+
+QXmppJid::QXmppJid()
+    : m_at(-1)
+    , m_slash(0)
+    , m_hash(0)
+    , m_bareHash(0)
+{
+}
+
+/// Constructs a JID by parsing the given string.
+///
+/// The string is implicitly shared, not copied.
+///
+/// \param jid
+
+QXmppJid::QXmppJid(const QString &jid)
+    : m_jid(jid)
+{
+    m_slash = m_jid.indexOf(QLatin1Char('/'));
+    if (m_slash < 0)
+        m_slash = m_jid.size();
+    m_at = m_jid.indexOf(QLatin1Char('@'));
+    if (m_at >= m_slash)
+        m_at = -1;
+
+    m_bareHash = hashString(bareJid());
+    m_hash = (m_slash < m_jid.size()) ? qHash(m_jid) : m_bareHash;
+}
+
+/// Returns true if the JID is empty.
+
+bool QXmppJid::isEmpty() const
+{
+    return m_jid.isEmpty();
+}
+
+/// Returns true if the JID has no resource part.
+
+bool QXmppJid::isBare() const
+{
+    return m_slash >= m_jid.size();
+}
+
+/// Returns the JID as a string.
+
+QString QXmppJid::toString() const
+{
+    return m_jid;
+}
+
+/// Returns the user part of the JID, or an empty reference if there is
+/// none.
+
+QStringRef QXmppJid::user() const
+{
+    return m_at >= 0 ? m_jid.midRef(0, m_at) : QStringRef();
+}
+
+/// Returns the domain part of the JID.
+
+QStringRef QXmppJid::domain() const
+{
+    return m_jid.midRef(m_at + 1, m_slash - m_at - 1);
+}
+
+/// Returns the resource part of the JID, or an empty reference if there
+/// is none.
+
+QStringRef QXmppJid::resource() const
+{
+    return m_slash < m_jid.size() ? m_jid.midRef(m_slash + 1) : QStringRef();
+}
+
+/// Returns the bare JID, i.e. the JID without its resource part.
+
+QStringRef QXmppJid::bareJid() const
+{
+    return m_jid.midRef(0, m_slash);
+}
+
+/// Returns the hash of the full JID.
+
+uint QXmppJid::hash() const
+{
+    return m_hash;
+}
+
+/// Returns the hash of the bare JID.
+
+uint QXmppJid::bareHash() const
+{
+    return m_bareHash;
+}
+
+/// Returns true if both JIDs have the same bare JID.
+///
+/// \param other
+
+bool QXmppJid::isSameBareJid(const QXmppJid &other) const
+{
+    return m_bareHash == other.m_bareHash && bareJid() == other.bareJid();
+}
+
+/// Returns true if both JIDs are identical.
+///
+/// \param other
+
+bool QXmppJid::operator==(const QXmppJid &other) const
+{
+    return m_hash == other.m_hash && m_jid == other.m_jid;
+}
+
+/// Returns true if the JIDs differ.
+///
+/// \param other
+
+bool QXmppJid::operator!=(const QXmppJid &other) const
+{
+    return !(*this == other);
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef QXMPPJID_H
+#define QXMPPJID_H
+
+#include <QHash>
+#include <QString>
+
+#include "QXmppGlobal.h"
+
+/// \brief The QXmppJid class represents a parsed Jabber ID.
+///
+/// The JID is split into its user, domain and resource parts once, on
+/// construction. The parts are returned as QStringRef objects referring
+/// to the original string, so accessing them does not allocate memory,
+/// unlike the QXmppUtils::jidTo*() functions.
+///
+/// The hashes of the full and bare JIDs are also computed on construction,
+/// which makes QXmppJid a cheap key for QHash and allows bare JIDs to be
+/// compared quickly using isSameBareJid().
+
+class QXMPP_EXPORT QXmppJid
+{
+public:
+    QXmppJid();
+    explicit QXmppJid(const QString &jid);
+
+    bool isEmpty() const;
+    bool isBare() const;
+    QString toString() const;
+
+    QStringRef user() const;
+    QStringRef domain() const;
+    QStringRef resource() const;
+    QStringRef bareJid() const;
+
+    uint hash() const;
+    uint bareHash() const;
+    bool isSameBareJid(const QXmppJid &other) const;
+
+    bool operator==(const QXmppJid &other) const;
+    bool operator!=(const QXmppJid &other) const;
+
+private:
+    QString m_jid;
+    int m_at;
+    int m_slash;
+    uint m_hash;
+    uint m_bareHash;
+};
+
+inline uint qHash(const QXmppJid &jid)
+{
+    return jid.hash();
+}
+
+#endif
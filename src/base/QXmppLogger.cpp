@@ -187,6 +187,21 @@ void QXmppLogger::setMessageTypes(QXmppLogger::MessageTypes types)
     d->messageTypes = types;
 }
 
+/// Returns the types of messages which the given \a logger actually
+/// records, taking its logging type into account.
+///
+/// If \a logger is null or does not log anything, returns
+/// QXmppLogger::NoMessage.
+///
+/// \param logger
+
+QXmppLogger::MessageTypes QXmppLogger::loggedMessageTypes(QXmppLogger *logger)
+{
+    if (!logger || logger->loggingType() == QXmppLogger::NoLogging)
+        return QXmppLogger::NoMessage;
+    return logger->messageTypes();
+}
+
 /// Add a logging message.
 ///
 /// \param type
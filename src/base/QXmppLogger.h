@@ -88,6 +88,8 @@ public:
     QXmppLogger::MessageTypes messageTypes();
     void setMessageTypes(QXmppLogger::MessageTypes types);
 
+    static QXmppLogger::MessageTypes loggedMessageTypes(QXmppLogger *logger);
+
 public slots:
     virtual void setGauge(const QString &gauge, double value);
     virtual void updateCounter(const QString &counter, qint64 amount);
@@ -29,6 +29,7 @@
 
 #include "QXmppConstants_p.h"
 #include "QXmppMessage.h"
+#include "QXmppStreamParser_p.h"
 #include "QXmppUtils.h"
 
 static const char* chat_states[] = {
@@ -476,6 +477,22 @@ bool QXmppMessage::isXmppStanza() const
 }
 
 /// \cond
+static QString xhtmlFromElement(const QDomElement &htmlElement)
+{
+    QString xhtml;
+    QDomElement bodyElement = htmlElement.firstChildElement("body");
+    if (!bodyElement.isNull() && bodyElement.namespaceURI() == ns_xhtml) {
+        QTextStream stream(&xhtml, QIODevice::WriteOnly);
+        bodyElement.save(stream, 0);
+
+        xhtml = xhtml.mid(xhtml.indexOf('>') + 1);
+        xhtml.replace(" xmlns=\"http://www.w3.org/1999/xhtml\"", "");
+        xhtml.replace("</body>", "");
+        xhtml = xhtml.trimmed();
+    }
+    return xhtml;
+}
+
 void QXmppMessage::parse(const QDomElement &element)
 {
     QXmppStanza::parse(element);
@@ -494,6 +511,7 @@ void QXmppMessage::parse(const QDomElement &element)
     d->thread = element.firstChildElement("thread").text();
 
     // chat states
+    d->state = None;
     for (int i = Active; i <= Paused; i++)
     {
         QDomElement stateElement = element.firstChildElement(chat_states[i]);
@@ -507,18 +525,8 @@ void QXmppMessage::parse(const QDomElement &element)
 
     // XEP-0071: XHTML-IM
     QDomElement htmlElement = element.firstChildElement("html");
-    if (!htmlElement.isNull() && htmlElement.namespaceURI() == ns_xhtml_im) {
-        QDomElement bodyElement = htmlElement.firstChildElement("body");
-        if (!bodyElement.isNull() && bodyElement.namespaceURI() == ns_xhtml) {
-            QTextStream stream(&d->xhtml, QIODevice::WriteOnly);
-            bodyElement.save(stream, 0);
-
-            d->xhtml = d->xhtml.mid(d->xhtml.indexOf('>') + 1);
-            d->xhtml.replace(" xmlns=\"http://www.w3.org/1999/xhtml\"", "");
-            d->xhtml.replace("</body>", "");
-            d->xhtml = d->xhtml.trimmed();
-        }
-    }
+    if (!htmlElement.isNull() && htmlElement.namespaceURI() == ns_xhtml_im)
+        d->xhtml = xhtmlFromElement(htmlElement);
 
     // XEP-0184: Message Delivery Receipts
     QDomElement receivedElement = element.firstChildElement("received");
@@ -576,9 +584,7 @@ void QXmppMessage::parse(const QDomElement &element)
     }
 
     // XEP-0280: Message Carbons
-    QDomElement privateElement = element.firstChildElement("private");
-    if (!privateElement.isNull())
-        d->privatemsg = true;
+    d->privatemsg = !element.firstChildElement("private").isNull();
 
     const QList<QPair<QString, QString> > &knownElems = knownMessageSubelems();
 
@@ -618,6 +624,164 @@ void QXmppMessage::parse(const QDomElement &element)
     setExtensions(extensions);
 }
 
+void QXmppMessage::parse(QXmlStreamReader &reader)
+{
+    parseAttributes(reader);
+
+    const QString type = reader.attributes().value("type").toString();
+    d->type = Normal;
+    for (int i = Error; i <= Headline; i++) {
+        if (type == QLatin1String(message_types[i])) {
+            d->type = static_cast<Type>(i);
+            break;
+        }
+    }
+
+    bool hasBody = false;
+    bool hasSubject = false;
+    bool hasThread = false;
+    bool hasReceipt = false;
+    bool hasLegacyStamp = false;
+    QDateTime legacyStamp;
+
+    // reset the fields which are only set when their element is present
+    d->body = QString();
+    d->subject = QString();
+    d->thread = QString();
+    d->state = None;
+    d->receiptId = QString();
+    d->receiptRequested = false;
+    d->attentionRequested = false;
+    d->privatemsg = false;
+
+    // the stanza's children are visited in a single pass, only unknown
+    // extensions and complex payloads are turned into DOM elements
+    QXmppElementList extensions;
+    while (reader.readNextStartElement()) {
+        const QStringRef name = reader.name();
+        const QStringRef ns = reader.namespaceUri();
+
+        int state = None;
+        for (int i = Active; i <= Paused; i++) {
+            if (name == QLatin1String(chat_states[i])) {
+                state = i;
+                break;
+            }
+        }
+
+        if (name == QLatin1String("body")) {
+            if (!hasBody) {
+                d->body = reader.readElementText(QXmlStreamReader::IncludeChildElements);
+                hasBody = true;
+            } else {
+                reader.skipCurrentElement();
+            }
+        } else if (name == QLatin1String("subject")) {
+            if (!hasSubject) {
+                d->subject = reader.readElementText(QXmlStreamReader::IncludeChildElements);
+                hasSubject = true;
+            } else {
+                reader.skipCurrentElement();
+            }
+        } else if (name == QLatin1String("thread")) {
+            if (!hasThread) {
+                d->thread = reader.readElementText(QXmlStreamReader::IncludeChildElements);
+                hasThread = true;
+            } else {
+                reader.skipCurrentElement();
+            }
+        } else if (state != None) {
+            // chat states
+            if (d->state == None && ns == QLatin1String(ns_chat_states))
+                d->state = static_cast<QXmppMessage::State>(state);
+            reader.skipCurrentElement();
+        } else if (name == QLatin1String("html")) {
+            // XEP-0071: XHTML-IM
+            if (ns == QLatin1String(ns_xhtml_im))
+                d->xhtml = xhtmlFromElement(QXmppStreamParser::readElement(reader));
+            else
+                reader.skipCurrentElement();
+        } else if (name == QLatin1String("received") && ns == QLatin1String(ns_message_receipts)) {
+            // XEP-0184: Message Delivery Receipts
+            if (!hasReceipt) {
+                d->receiptId = reader.attributes().value("id").toString();
+
+                // compatibility with old-style XEP
+                if (d->receiptId.isEmpty())
+                    d->receiptId = id();
+                hasReceipt = true;
+            }
+            reader.skipCurrentElement();
+        } else if (name == QLatin1String("request")) {
+            if (ns == QLatin1String(ns_message_receipts))
+                d->receiptRequested = true;
+            reader.skipCurrentElement();
+        } else if (name == QLatin1String("delay")) {
+            // XEP-0203: Delayed Delivery
+            if (ns == QLatin1String(ns_delayed_delivery)) {
+                d->stamp = QXmppUtils::datetimeFromString(reader.attributes().value("stamp").toString());
+                d->stampType = DelayedDelivery;
+            }
+            reader.skipCurrentElement();
+        } else if (name == QLatin1String("attention")) {
+            // XEP-0224: Attention
+            if (ns == QLatin1String(ns_attention))
+                d->attentionRequested = true;
+            reader.skipCurrentElement();
+        } else if (name == QLatin1String("addresses")) {
+            parseExtendedAddresses(reader);
+        } else if (name == QLatin1String("private") && ns == QLatin1String(ns_carbons)) {
+            // XEP-0280: Message Carbons
+            d->privatemsg = true;
+            reader.skipCurrentElement();
+        } else if (name == QLatin1String("x") && ns == QLatin1String(ns_legacy_delayed_delivery)) {
+            // XEP-0091: Legacy Delayed Delivery, only used if XEP-0203 is absent
+            legacyStamp = QDateTime::fromString(reader.attributes().value("stamp").toString(), "yyyyMMddThh:mm:ss");
+            legacyStamp.setTimeSpec(Qt::UTC);
+            hasLegacyStamp = true;
+            reader.skipCurrentElement();
+        } else if (name == QLatin1String("x") && ns == QLatin1String(ns_conference)) {
+            // XEP-0249: Direct MUC Invitations
+            const QXmlStreamAttributes attributes = reader.attributes();
+            d->mucInvitationJid = attributes.value("jid").toString();
+            d->mucInvitationPassword = attributes.value("password").toString();
+            d->mucInvitationReason = attributes.value("reason").toString();
+            reader.skipCurrentElement();
+        } else {
+            const QDomElement element = QXmppStreamParser::readElement(reader);
+            const QString tagName = element.tagName();
+            if (tagName == QLatin1String("error")) {
+                QXmppStanza::Error error;
+                error.parse(element);
+                setError(error);
+            } else if (tagName == QLatin1String("private")) {
+                d->privatemsg = true;
+            } else if (tagName == QLatin1String("markable")) {
+                // XEP-0333: Chat Markers
+                d->markable = true;
+            } else if (d->marker == NoMarker && element.namespaceURI() == ns_chat_markers) {
+                for (int i = Received; i <= Acknowledged; i++) {
+                    if (tagName == QLatin1String(marker_types[i])) {
+                        d->marker = static_cast<QXmppMessage::Marker>(i);
+                        d->markedId = element.attribute("id");
+                        d->markedThread = element.attribute("thread");
+                        break;
+                    }
+                }
+            }
+
+            // other extensions
+            extensions << QXmppElement(element);
+        }
+    }
+
+    if (hasLegacyStamp && d->stamp.isNull()) {
+        d->stamp = legacyStamp;
+        d->stampType = LegacyDelayedDelivery;
+    }
+    setExtensions(extensions);
+}
+
 void QXmppMessage::toXml(QXmlStreamWriter *xmlWriter) const
 {
     xmlWriter->writeStartElement("message");
@@ -137,6 +137,7 @@ public:
 
     /// \cond
     void parse(const QDomElement &element);
+    void parse(QXmlStreamReader &reader);
     void toXml(QXmlStreamWriter *writer) const;
     /// \endcond
 
@@ -23,6 +23,7 @@
 
 
 #include "QXmppPresence.h"
+#include "QXmppStreamParser_p.h"
 #include "QXmppUtils.h"
 #include <QtDebug>
 #include <QDomElement>
@@ -278,6 +279,119 @@ void QXmppPresence::parse(const QDomElement &element)
     setExtensions(extensions);
 }
 
+void QXmppPresence::parse(QXmlStreamReader &reader)
+{
+    parseAttributes(reader);
+
+    const QString type = reader.attributes().value("type").toString();
+    for (int i = Error; i <= Probe; i++) {
+        if (type == QLatin1String(presence_types[i])) {
+            d->type = static_cast<Type>(i);
+            break;
+        }
+    }
+
+    bool hasShow = false;
+    bool hasStatus = false;
+    bool hasPriority = false;
+    QString show;
+    d->statusText = QString();
+    d->priority = 0;
+
+    // the stanza's children are visited in a single pass, only unknown
+    // extensions and complex payloads are turned into DOM elements
+    QXmppElementList extensions;
+    d->vCardUpdateType = VCardUpdateNone;
+    while (reader.readNextStartElement()) {
+        const QStringRef name = reader.name();
+        const QStringRef ns = reader.namespaceUri();
+
+        if (ns == QLatin1String(ns_muc)) {
+            // XEP-0045: Multi-User Chat
+            d->mucSupported = true;
+            d->mucPassword = QString();
+            while (reader.readNextStartElement()) {
+                if (d->mucPassword.isEmpty() && reader.name() == QLatin1String("password"))
+                    d->mucPassword = reader.readElementText(QXmlStreamReader::IncludeChildElements);
+                else
+                    reader.skipCurrentElement();
+            }
+        } else if (ns == QLatin1String(ns_muc_user)) {
+            const QDomElement xElement = QXmppStreamParser::readElement(reader);
+            d->mucItem.parse(xElement.firstChildElement("item"));
+            QDomElement statusElement = xElement.firstChildElement("status");
+            d->mucStatusCodes.clear();
+            while (!statusElement.isNull()) {
+                d->mucStatusCodes << statusElement.attribute("code").toInt();
+                statusElement = statusElement.nextSiblingElement("status");
+            }
+        } else if (ns == QLatin1String(ns_vcard_update)) {
+            // XEP-0153: vCard-Based Avatars
+            d->photoHash = QByteArray();
+            d->vCardUpdateType = VCardUpdateNotReady;
+            bool hasPhoto = false;
+            while (reader.readNextStartElement()) {
+                if (!hasPhoto && reader.name() == QLatin1String("photo")) {
+                    d->photoHash = QByteArray::fromHex(reader.readElementText(QXmlStreamReader::IncludeChildElements).toLatin1());
+                    if (d->photoHash.isEmpty())
+                        d->vCardUpdateType = VCardUpdateNoPhoto;
+                    else
+                        d->vCardUpdateType = VCardUpdateValidPhoto;
+                    hasPhoto = true;
+                } else {
+                    reader.skipCurrentElement();
+                }
+            }
+        } else if (name == QLatin1String("c") && ns == QLatin1String(ns_capabilities)) {
+            // XEP-0115: Entity Capabilities
+            const QXmlStreamAttributes attributes = reader.attributes();
+            d->capabilityNode = attributes.value("node").toString();
+            d->capabilityVer = QByteArray::fromBase64(attributes.value("ver").toString().toLatin1());
+            d->capabilityHash = attributes.value("hash").toString();
+            d->capabilityExt = attributes.value("ext").toString().split(" ", QString::SkipEmptyParts);
+            reader.skipCurrentElement();
+        } else if (name == QLatin1String("addresses")) {
+            parseExtendedAddresses(reader);
+        } else if (name == QLatin1String("error")) {
+            QXmppStanza::Error error;
+            error.parse(QXmppStreamParser::readElement(reader));
+            setError(error);
+        } else if (name == QLatin1String("show")) {
+            if (!hasShow) {
+                show = reader.readElementText(QXmlStreamReader::IncludeChildElements);
+                hasShow = true;
+            } else {
+                reader.skipCurrentElement();
+            }
+        } else if (name == QLatin1String("status")) {
+            if (!hasStatus) {
+                d->statusText = reader.readElementText(QXmlStreamReader::IncludeChildElements);
+                hasStatus = true;
+            } else {
+                reader.skipCurrentElement();
+            }
+        } else if (name == QLatin1String("priority")) {
+            if (!hasPriority) {
+                d->priority = reader.readElementText(QXmlStreamReader::IncludeChildElements).toInt();
+                hasPriority = true;
+            } else {
+                reader.skipCurrentElement();
+            }
+        } else {
+            // other extensions
+            extensions << QXmppElement(QXmppStreamParser::readElement(reader));
+        }
+    }
+
+    for (int i = Online; i <= Invisible; i++) {
+        if (show == QLatin1String(presence_shows[i])) {
+            d->availableStatusType = static_cast<AvailableStatusType>(i);
+            break;
+        }
+    }
+    setExtensions(extensions);
+}
+
 void QXmppPresence::toXml(QXmlStreamWriter *xmlWriter) const
 {
     xmlWriter->writeStartElement("presence");
@@ -45,6 +45,25 @@ QList<QXmppRosterIq::Item> QXmppRosterIq::items() const
     return m_items;
 }
 
+/// Returns the roster version (XEP-0237).
+///
+/// A null string means the version is not set, whereas an empty string
+/// asks the server for the whole roster.
+
+QString QXmppRosterIq::version() const
+{
+    return m_version;
+}
+
+/// Sets the roster version (XEP-0237).
+///
+/// \param version
+
+void QXmppRosterIq::setVersion(const QString &version)
+{
+    m_version = version;
+}
+
 /// \cond
 bool QXmppRosterIq::isRosterIq(const QDomElement &element)
 {
@@ -53,9 +72,16 @@ bool QXmppRosterIq::isRosterIq(const QDomElement &element)
 
 void QXmppRosterIq::parseElementFromChild(const QDomElement &element)
 {
-    QDomElement itemElement = element.
-                              firstChildElement("query").
-                              firstChildElement("item");
+    const QDomElement queryElement = element.firstChildElement("query");
+    m_version = QString();
+    if (queryElement.hasAttribute("ver")) {
+        // an empty version must not be confused with no version
+        m_version = queryElement.attribute("ver");
+        if (m_version.isNull())
+            m_version = QLatin1String("");
+    }
+
+    QDomElement itemElement = queryElement.firstChildElement("item");
     while(!itemElement.isNull())
     {
         QXmppRosterIq::Item item;
@@ -69,6 +95,8 @@ void QXmppRosterIq::toXmlElementFromChild(QXmlStreamWriter *writer) const
 {
     writer->writeStartElement("query");
     writer->writeAttribute( "xmlns", ns_roster);
+    if (!m_version.isNull())
+        writer->writeAttribute("ver", m_version);
 
     for(int i = 0; i < m_items.count(); ++i)
         m_items.at(i).toXml(writer);
@@ -91,6 +91,9 @@ public:
     void addItem(const Item&);
     QList<Item> items() const;
 
+    QString version() const;
+    void setVersion(const QString &version);
+
     /// \cond
     static bool isRosterIq(const QDomElement &element);
     /// \endcond
@@ -103,6 +106,7 @@ protected:
 
 private:
     QList<Item> m_items;
+    QString m_version;
 };
 
 #endif // QXMPPROSTERIQ_H
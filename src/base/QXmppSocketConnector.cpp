@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QHostInfo>
+#include <QNetworkProxy>
+#include <QSslSocket>
+#include <QTimer>
+
+#include "QXmppSocketConnector_p.h"
+
+/// Constructs a new connector.
+///
+/// \param parent
+
+QXmppSocketConnector::QXmppSocketConnector(QObject *parent)
+    : QXmppLoggable(parent)
+    , m_lastFailed(0)
+    , m_attemptDelay(250)
+    , m_attempts(0)
+    , m_running(false)
+{
+    bool check;
+    Q_UNUSED(check);
+
+    m_attemptTimer = new QTimer(this);
+    m_attemptTimer->setSingleShot(true);
+    check = connect(m_attemptTimer, SIGNAL(timeout()),
+                    this, SLOT(_q_attemptTimeout()));
+    Q_ASSERT(check);
+}
+
+/// Destroys the connector, cancelling any attempt in progress.
+
+QXmppSocketConnector::~QXmppSocketConnector()
+{
+    stop();
+}
+
+/// Adds a host to connect to.
+///
+/// Targets must be added before calling start(), in order of preference.
+///
+/// \param host a host name or an IP address
+/// \param port
+
+void QXmppSocketConnector::addTarget(const QString &host, quint16 port)
+{
+    Target target;
+    target.host = host;
+    target.port = port;
+    target.lookupId = -1;
+    m_targets << target;
+}
+
+/// Resolves the targets and starts connecting to them.
+
+void QXmppSocketConnector::start()
+{
+    m_running = true;
+    m_attempts = 0;
+
+    for (int i = 0; i < m_targets.size(); ++i) {
+        Target &target = m_targets[i];
+        QHostAddress address;
+        if (address.setAddress(target.host))
+            target.addresses << address;
+        else
+            target.lookupId = QHostInfo::lookupHost(target.host, this, SLOT(_q_hostFound(QHostInfo)));
+    }
+
+    startAttempt();
+    checkFailed();
+}
+
+/// Cancels all the attempts in progress.
+///
+/// Neither connected() nor failed() will be emitted.
+
+void QXmppSocketConnector::abort()
+{
+    stop();
+}
+
+/// Returns true if the connector was started and has not finished yet.
+
+bool QXmppSocketConnector::isRunning() const
+{
+    return m_running;
+}
+
+/// Returns the delay in milliseconds after which a new attempt is
+/// started while the previous ones are still in progress.
+
+int QXmppSocketConnector::attemptDelay() const
+{
+    return m_attemptDelay;
+}
+
+/// Sets the delay in milliseconds after which a new attempt is started
+/// while the previous ones are still in progress.
+///
+/// RFC 8305 recommends 250 milliseconds.
+///
+/// \param msecs
+
+void QXmppSocketConnector::setAttemptDelay(int msecs)
+{
+    m_attemptDelay = qMax(10, msecs);
+}
+
+/// Returns the number of attempts which were started.
+
+int QXmppSocketConnector::attempts() const
+{
+    return m_attempts;
+}
+
+/// Returns the name of the latency histogram bucket for \a msecs, which
+/// is the upper bound of the bucket in milliseconds or "inf".
+
+QString QXmppSocketConnector::latencyBucket(qint64 msecs)
+{
+    static const int bounds[] = {50, 100, 250, 500, 1000, 2500, 5000, 10000};
+    for (unsigned int i = 0; i < sizeof(bounds) / sizeof(bounds[0]); ++i) {
+        if (msecs <= bounds[i])
+            return QString::number(bounds[i]);
+    }
+    return QLatin1String("inf");
+}
+
+void QXmppSocketConnector::_q_attemptTimeout()
+{
+    startAttempt();
+}
+
+void QXmppSocketConnector::_q_hostFound(const QHostInfo &info)
+{
+    for (int i = 0; i < m_targets.size(); ++i) {
+        Target &target = m_targets[i];
+        if (target.lookupId != info.lookupId())
+            continue;
+
+        target.lookupId = -1;
+        if (info.error() != QHostInfo::NoError || info.addresses().isEmpty()) {
+            warning(QString("Lookup for host %1 failed: %2").arg(target.host, info.errorString()));
+            break;
+        }
+
+        // alternate between address families, starting with the family
+        // the resolver prefers
+        QList<QHostAddress> preferred;
+        QList<QHostAddress> other;
+        const QAbstractSocket::NetworkLayerProtocol protocol = info.addresses().first().protocol();
+        foreach (const QHostAddress &address, info.addresses()) {
+            if (address.protocol() == protocol)
+                preferred << address;
+            else
+                other << address;
+        }
+        while (!preferred.isEmpty() || !other.isEmpty()) {
+            if (!preferred.isEmpty())
+                target.addresses << preferred.takeFirst();
+            if (!other.isEmpty())
+                target.addresses << other.takeFirst();
+        }
+        break;
+    }
+
+    if (!m_attemptTimer->isActive())
+        startAttempt();
+    checkFailed();
+}
+
+void QXmppSocketConnector::_q_socketConnected()
+{
+    QSslSocket *socket = qobject_cast<QSslSocket*>(sender());
+    if (!socket || !m_sockets.removeAll(socket))
+        return;
+
+    debug(QString("Connected to %1 %2 after %3 attempt(s)").arg(
+        socket->peerAddress().toString(),
+        QString::number(socket->peerPort()),
+        QString::number(m_attempts)));
+
+    socket->disconnect(this);
+    socket->setParent(0);
+    stop();
+    emit connected(socket);
+}
+
+void QXmppSocketConnector::_q_socketError(QAbstractSocket::SocketError error)
+{
+    Q_UNUSED(error);
+
+    QSslSocket *socket = qobject_cast<QSslSocket*>(sender());
+    if (!socket || !m_sockets.removeAll(socket))
+        return;
+
+    debug(QString("Connection attempt to %1 %2 failed: %3").arg(
+        socket->peerName(),
+        QString::number(socket->peerPort()),
+        socket->errorString()));
+
+    socket->disconnect(this);
+    if (m_lastFailed)
+        m_lastFailed->deleteLater();
+    m_lastFailed = socket;
+
+    // a failure starts the next attempt right away
+    m_attemptTimer->stop();
+    startAttempt();
+    checkFailed();
+}
+
+void QXmppSocketConnector::checkFailed()
+{
+    if (!m_running || !m_sockets.isEmpty())
+        return;
+
+    foreach (const Target &target, m_targets) {
+        if (target.lookupId != -1 || !target.addresses.isEmpty())
+            return;
+    }
+
+    QSslSocket *socket = m_lastFailed;
+    m_lastFailed = 0;
+    if (socket)
+        socket->setParent(0);
+    stop();
+    emit failed(socket);
+}
+
+bool QXmppSocketConnector::startAttempt()
+{
+    for (int i = 0; i < m_targets.size(); ++i) {
+        Target &target = m_targets[i];
+        if (target.addresses.isEmpty())
+            continue;
+
+        const QHostAddress address = target.addresses.takeFirst();
+        debug(QString("Connecting to %1 %2 (%3)").arg(
+            address.toString(),
+            QString::number(target.port),
+            target.host));
+
+        bool check;
+        Q_UNUSED(check);
+
+        QSslSocket *socket = new QSslSocket(this);
+        socket->setProxy(QNetworkProxy::NoProxy);
+        check = connect(socket, SIGNAL(connected()),
+                        this, SLOT(_q_socketConnected()));
+        Q_ASSERT(check);
+
+        check = connect(socket, SIGNAL(error(QAbstractSocket::SocketError)),
+                        this, SLOT(_q_socketError(QAbstractSocket::SocketError)));
+        Q_ASSERT(check);
+
+        m_sockets << socket;
+        m_attempts++;
+        m_attemptTimer->start(m_attemptDelay);
+        socket->connectToHost(address, target.port);
+        return true;
+    }
+    return false;
+}
+
+void QXmppSocketConnector::stop()
+{
+    m_running = false;
+    m_attemptTimer->stop();
+
+    foreach (const Target &target, m_targets) {
+        if (target.lookupId != -1)
+            QHostInfo::abortHostLookup(target.lookupId);
+    }
+    m_targets.clear();
+
+    foreach (QSslSocket *socket, m_sockets) {
+        socket->disconnect(this);
+        socket->abort();
+        socket->deleteLater();
+    }
+    m_sockets.clear();
+
+    if (m_lastFailed) {
+        m_lastFailed->deleteLater();
+        m_lastFailed = 0;
+    }
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef QXMPPSOCKETCONNECTOR_P_H
+#define QXMPPSOCKETCONNECTOR_P_H
+
+#include <QAbstractSocket>
+#include <QHostAddress>
+
+#include "QXmppLogger.h"
+
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QXmpp API.  It exists for the convenience
+// of the QXmppOutgoingClient and QXmppOutgoingServer classes.
+//
+// This header file may change from version to version without notice,
+// or even be removed.
+//
+// We mean it.
+//
+
+class QHostInfo;
+class QSslSocket;
+class QTimer;
+
+/// \brief The QXmppSocketConnector class races connection attempts to a
+/// list of hosts, in the manner of "Happy Eyeballs" (RFC 8305).
+///
+/// Targets are tried in the order they were added, and the addresses of
+/// each target alternate between address families. A new attempt is
+/// started every attemptDelay() milliseconds, or as soon as an attempt
+/// fails, while the earlier attempts are left running. The first socket
+/// to connect wins and the other attempts are cancelled.
+
+class QXMPP_AUTOTEST_EXPORT QXmppSocketConnector : public QXmppLoggable
+{
+    Q_OBJECT
+
+public:
+    QXmppSocketConnector(QObject *parent = 0);
+    ~QXmppSocketConnector();
+
+    void addTarget(const QString &host, quint16 port);
+    void start();
+    void abort();
+    bool isRunning() const;
+
+    int attemptDelay() const;
+    void setAttemptDelay(int msecs);
+
+    int attempts() const;
+
+    static QString latencyBucket(qint64 msecs);
+
+signals:
+    /// This signal is emitted when a \a socket has connected.
+    ///
+    /// The socket has no parent, the receiver takes ownership of it.
+    void connected(QSslSocket *socket);
+
+    /// This signal is emitted when all the attempts failed.
+    ///
+    /// \a socket is the last attempt which failed, or 0 if no address
+    /// could be found. The receiver takes ownership of it.
+    void failed(QSslSocket *socket);
+
+private slots:
+    void _q_attemptTimeout();
+    void _q_hostFound(const QHostInfo &info);
+    void _q_socketConnected();
+    void _q_socketError(QAbstractSocket::SocketError error);
+
+private:
+    struct Target
+    {
+        QString host;
+        quint16 port;
+        int lookupId;
+        QList<QHostAddress> addresses;
+    };
+
+    Q_DISABLE_COPY(QXmppSocketConnector)
+    void checkFailed();
+    bool startAttempt();
+    void stop();
+
+    QList<Target> m_targets;
+    QList<QSslSocket*> m_sockets;
+    QSslSocket *m_lastFailed;
+    QTimer *m_attemptTimer;
+    int m_attemptDelay;
+    int m_attempts;
+    bool m_running;
+};
+
+#endif
@@ -26,6 +26,7 @@
 
 #include "QXmppStanza.h"
 #include "QXmppStanza_p.h"
+#include "QXmppStreamParser_p.h"
 #include "QXmppUtils.h"
 #include "QXmppConstants_p.h"
 
@@ -147,6 +148,16 @@ void QXmppExtendedAddress::parse(const QDomElement &element)
     d->type = element.attribute("type");
 }
 
+void QXmppExtendedAddress::parse(QXmlStreamReader &reader)
+{
+    const QXmlStreamAttributes attributes = reader.attributes();
+    d->delivered = attributes.value("delivered") == QLatin1String("true");
+    d->description = attributes.value("desc").toString();
+    d->jid = attributes.value("jid").toString();
+    d->type = attributes.value("type").toString();
+    reader.skipCurrentElement();
+}
+
 void QXmppExtendedAddress::toXml(QXmlStreamWriter *xmlWriter) const
 {
     xmlWriter->writeStartElement("address");
@@ -507,7 +518,7 @@ void QXmppStanza::parse(const QDomElement &element)
     d->from = element.attribute("from");
     d->to = element.attribute("to");
     d->id = element.attribute("id");
-    d->lang = element.attribute("lang");
+    d->lang = element.attribute("xml:lang");
 
     QDomElement errorElement = element.firstChildElement("error");
     if(!errorElement.isNull())
@@ -524,6 +535,42 @@ void QXmppStanza::parse(const QDomElement &element)
     }
 }
 
+/// Parses the stanza from a QXmlStreamReader positioned on its start
+/// element. When this method returns, the reader is positioned on the
+/// stanza's end element.
+///
+/// This builds a DOM tree and calls the DOM-based parse(), subclasses
+/// can provide their own overload to avoid this overhead.
+
+void QXmppStanza::parse(QXmlStreamReader &reader)
+{
+    parse(QXmppStreamParser::readElement(reader));
+}
+
+void QXmppStanza::parseAttributes(QXmlStreamReader &reader)
+{
+    const QXmlStreamAttributes attributes = reader.attributes();
+    d->from = attributes.value("from").toString();
+    d->to = attributes.value("to").toString();
+    d->id = attributes.value("id").toString();
+    d->lang = attributes.value("xml:lang").toString();
+}
+
+void QXmppStanza::parseExtendedAddresses(QXmlStreamReader &reader)
+{
+    // XEP-0033: Extended Stanza Addressing
+    while (reader.readNextStartElement()) {
+        if (reader.name() == QLatin1String("address")) {
+            QXmppExtendedAddress address;
+            address.parse(reader);
+            if (address.isValid())
+                d->extendedAddresses << address;
+        } else {
+            reader.skipCurrentElement();
+        }
+    }
+}
+
 void QXmppStanza::extensionsToXml(QXmlStreamWriter *xmlWriter) const
 {
     // XEP-0033: Extended Stanza Addressing
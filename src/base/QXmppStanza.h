@@ -72,6 +72,7 @@ public:
 
     /// \cond
     void parse(const QDomElement &element);
+    void parse(QXmlStreamReader &reader);
     void toXml(QXmlStreamWriter *writer) const;
     /// \endcond
 
@@ -193,9 +194,12 @@ public:
 
     /// \cond
     virtual void parse(const QDomElement &element);
+    void parse(QXmlStreamReader &reader);
     virtual void toXml(QXmlStreamWriter *writer) const = 0;
 
 protected:
+    void parseAttributes(QXmlStreamReader &reader);
+    void parseExtendedAddresses(QXmlStreamReader &reader);
     void extensionsToXml(QXmlStreamWriter *writer) const;
     void generateAndSetNextId();
     /// \endcond
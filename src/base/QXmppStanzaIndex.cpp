@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QDomElement>
+
+#include "QXmppStanzaIndex_p.h"
+
+/// Registers a handler for the given tag names.
+///
+/// Handlers must be added in ascending order. If \a namespaces is empty,
+/// the handler receives all stanzas with the given tag names, otherwise
+/// it only receives those with a child element in one of the namespaces.
+///
+/// \param handler
+/// \param tagNames
+/// \param namespaces
+
+void QXmppStanzaIndex::addHandler(int handler, const QStringList &tagNames, const QStringList &namespaces)
+{
+    foreach (const QString &tagName, tagNames) {
+        Entry &entry = m_entries[tagName];
+        if (!entry.all.isEmpty() && entry.all.last() == handler)
+            continue;
+        entry.all << handler;
+
+        if (namespaces.isEmpty()) {
+            entry.wildcard << handler;
+            QHash<QString, QList<int> >::iterator it;
+            for (it = entry.byNamespace.begin(); it != entry.byNamespace.end(); ++it)
+                it.value() << handler;
+        } else {
+            foreach (const QString &ns, namespaces) {
+                QHash<QString, QList<int> >::iterator it = entry.byNamespace.find(ns);
+                if (it == entry.byNamespace.end())
+                    it = entry.byNamespace.insert(ns, entry.wildcard);
+                if (it.value().isEmpty() || it.value().last() != handler)
+                    it.value() << handler;
+            }
+        }
+    }
+}
+
+/// Removes all handlers.
+
+void QXmppStanzaIndex::clear()
+{
+    m_entries.clear();
+}
+
+/// Returns the handlers which may process the given stanza, in ascending
+/// order.
+///
+/// \param element
+
+QList<int> QXmppStanzaIndex::handlers(const QDomElement &element) const
+{
+    QHash<QString, Entry>::const_iterator it = m_entries.constFind(element.tagName());
+    if (it == m_entries.constEnd())
+        return QList<int>();
+
+    const Entry &entry = it.value();
+    QDomElement child = element.firstChildElement();
+    if (entry.byNamespace.isEmpty() || child.isNull() ||
+        element.attribute("type") == QLatin1String("error"))
+        return entry.all;
+
+    // most stanzas, and all IQ requests, have a single payload
+    QDomElement next = child.nextSiblingElement();
+    if (next.isNull())
+        return entry.byNamespace.value(child.namespaceURI(), entry.wildcard);
+
+    QList<int> result = entry.wildcard;
+    int matches = 0;
+    for (; !child.isNull(); child = child.nextSiblingElement()) {
+        QHash<QString, QList<int> >::const_iterator ns = entry.byNamespace.constFind(child.namespaceURI());
+        if (ns != entry.byNamespace.constEnd()) {
+            if (!matches++)
+                result = ns.value();
+            else
+                result += ns.value();
+        }
+    }
+
+    // merge the handlers found for several namespaces
+    if (matches > 1) {
+        qSort(result);
+        for (int i = result.size() - 1; i > 0; --i) {
+            if (result.at(i) == result.at(i - 1))
+                result.removeAt(i);
+        }
+    }
+    return result;
+}
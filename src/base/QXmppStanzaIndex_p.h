@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef QXMPPSTANZAINDEX_P_H
+#define QXMPPSTANZAINDEX_P_H
+
+#include <QHash>
+#include <QList>
+#include <QStringList>
+
+#include "QXmppGlobal.h"
+
+class QDomElement;
+
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QXmpp API.  It exists for the convenience
+// of the QXmppClient and QXmppServer classes.
+//
+// This header file may change from version to version without notice,
+// or even be removed.
+//
+// We mean it.
+//
+
+/// \brief The QXmppStanzaIndex class maps incoming stanzas to the handlers
+/// which may process them, based on the stanza's tag name and the
+/// namespaces of its child elements.
+///
+/// Handlers are identified by their position in the caller's list of
+/// handlers, and handlers() returns positions in ascending order, so that
+/// handlers are tried in the same order as with a linear scan.
+///
+/// Stanzas without any child element, as well as errors, are offered to
+/// every handler registered for their tag name since they carry no
+/// namespace to dispatch on.
+
+class QXMPP_AUTOTEST_EXPORT QXmppStanzaIndex
+{
+public:
+    void addHandler(int handler, const QStringList &tagNames, const QStringList &namespaces);
+    void clear();
+
+    QList<int> handlers(const QDomElement &element) const;
+
+private:
+    class Entry
+    {
+    public:
+        // all the handlers for the tag name
+        QList<int> all;
+
+        // the handlers which did not restrict namespaces
+        QList<int> wildcard;
+
+        // for each namespace, its handlers and the wildcard handlers
+        QHash<QString, QList<int> > byNamespace;
+    };
+
+    QHash<QString, Entry> m_entries;
+};
+
+#endif
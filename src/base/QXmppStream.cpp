@@ -23,45 +23,115 @@
  */
 
 
+#include "QXmppCompressor_p.h"
 #include "QXmppConstants_p.h"
 #include "QXmppLogger.h"
 #include "QXmppStanza.h"
 #include "QXmppStream.h"
 #include "QXmppStreamManagement_p.h"
+#include "QXmppStreamParser_p.h"
 #include "QXmppUtils.h"
 
 #include <QBuffer>
 #include <QDomDocument>
+#include <QElapsedTimer>
 #include <QHostAddress>
-#include <QMap>
-#include <QRegExp>
 #include <QSslSocket>
 #include <QStringList>
+#include <QTextCodec>
 #include <QTime>
+#include <QTimer>
 #include <QXmlStreamWriter>
 
 static bool randomSeeded = false;
 static const QByteArray streamRootElementEnd = "</stream:stream>";
 
+// the socket's read buffer size while reading is paused, beyond which
+// TCP flow control pushes back on the peer
+static const qint64 pausedReadBufferSize = 64 * 1024;
+
+// compressed data is decompressed and parsed in chunks of this size
+static const int decompressedChunkSize = 64 * 1024;
+
+static qint64 elapsedNsecs(const QElapsedTimer &timer)
+{
+#if (QT_VERSION >= QT_VERSION_CHECK(4, 8, 0))
+    return timer.nsecsElapsed();
+#else
+    return timer.elapsed() * 1000000;
+#endif
+}
+
+static bool isWhitespace(const QByteArray &data)
+{
+    const char *ptr = data.constData();
+    const char *end = ptr + data.size();
+    for (; ptr != end; ++ptr) {
+        if (*ptr != ' ' && *ptr != '\t' && *ptr != '\n' && *ptr != '\r')
+            return false;
+    }
+    return true;
+}
+
 class QXmppStreamPrivate
 {
 public:
     QXmppStreamPrivate();
 
-    QByteArray dataBuffer;
     QSslSocket* socket;
 
+    // the types of packets which are formatted for the logger
+    QXmppLogger::MessageTypes loggedMessageTypes;
+
+    // decodes the received data for the logger, keeping the bytes of a
+    // character which is split across reads
+    QTextDecoder *receivedDecoder;
+
     // incoming stream state
-    QByteArray streamStart;
+    QXmppStreamParser parser;
+    bool readingPaused;
+    bool stanzaHandlingPaused;
+
+    // outgoing data is written once per event loop iteration
+    QByteArray writeBuffer;
+    bool flushScheduled;
+
+    // stream compression (XEP-0138)
+    QXmppCompressor compressor;
+    int compressionLevel;
+    int compressionMemoryLevel;
 
     bool streamManagementEnabled;
-    QMap<unsigned, QByteArray> unacknowledgedStanzas;
-    unsigned lastOutgoingSequenceNumber;
+    QXmppStreamManagementQueue unacknowledgedStanzas;
+    bool ackWindowFull;
+
+    // stanzas held back while the acknowledgement window is full
+    QList<QByteArray> heldStanzas;
     unsigned lastIncomingSequenceNumber;
+
+    // stanzas sent since the last acknowledgement request
+    int unrequestedStanzas;
+    int ackRequestThreshold;
+    int ackRequestInterval;
+    QTimer *ackRequestTimer;
 };
 
 QXmppStreamPrivate::QXmppStreamPrivate()
-    : socket(0), streamManagementEnabled(false), lastOutgoingSequenceNumber(0), lastIncomingSequenceNumber(0)
+    : socket(0)
+    , loggedMessageTypes(QXmppLogger::AnyMessage)
+    , receivedDecoder(0)
+    , readingPaused(false)
+    , stanzaHandlingPaused(false)
+    , flushScheduled(false)
+    , compressionLevel(0)
+    , compressionMemoryLevel(8)
+    , streamManagementEnabled(false)
+    , ackWindowFull(false)
+    , lastIncomingSequenceNumber(0)
+    , unrequestedStanzas(0)
+    , ackRequestThreshold(1)
+    , ackRequestInterval(0)
+    , ackRequestTimer(0)
 {
 }
 
@@ -79,12 +149,23 @@ QXmppStream::QXmppStream(QObject *parent)
         qsrand(QTime(0,0,0).msecsTo(QTime::currentTime()) ^ reinterpret_cast<quintptr>(this));
         randomSeeded = true;
     }
+
+    d->ackRequestTimer = new QTimer(this);
+    d->ackRequestTimer->setSingleShot(true);
+    bool check;
+    Q_UNUSED(check);
+    check = connect(d->ackRequestTimer, SIGNAL(timeout()),
+                    this, SLOT(_q_ackRequestTimeout()));
+    Q_ASSERT(check);
+
+    d->receivedDecoder = QTextCodec::codecForName("UTF-8")->makeDecoder();
 }
 
 /// Destroys a base XMPP stream.
 
 QXmppStream::~QXmppStream()
 {
+    delete d->receivedDecoder;
     delete d;
 }
 
@@ -94,9 +175,12 @@ QXmppStream::~QXmppStream()
 void QXmppStream::disconnectFromHost()
 {
     d->streamManagementEnabled = false;
+    d->unrequestedStanzas = 0;
+    d->ackRequestTimer->stop();
     if (d->socket) {
         if (d->socket->state() == QAbstractSocket::ConnectedState) {
             sendData(streamRootElementEnd);
+            flushData();
             d->socket->flush();
         }
         // FIXME: according to RFC 6120 section 4.4, we should wait for
@@ -113,8 +197,12 @@ void QXmppStream::disconnectFromHost()
 void QXmppStream::handleStart()
 {
     d->streamManagementEnabled = false;
-    d->dataBuffer.clear();
-    d->streamStart.clear();
+    d->unrequestedStanzas = 0;
+    d->ackRequestTimer->stop();
+    d->parser.clear();
+
+    delete d->receivedDecoder;
+    d->receivedDecoder = QTextCodec::codecForName("UTF-8")->makeDecoder();
 }
 
 /// Returns true if the stream is connected.
@@ -128,13 +216,66 @@ bool QXmppStream::isConnected() const
 
 /// Sends raw data to the peer.
 ///
+/// The data is not written to the socket immediately: all the data sent
+/// until control returns to the event loop is written at once. Call
+/// flushData() if the data must reach the socket right away.
+///
 /// \param data
 
 bool QXmppStream::sendData(const QByteArray &data)
 {
-    logSent(QString::fromUtf8(data));
+    // only format the message if the logger wants it
+    if (d->loggedMessageTypes.testFlag(QXmppLogger::SentMessage))
+        logSent(QString::fromUtf8(data));
+    if (!d->socket || d->socket->state() != QAbstractSocket::ConnectedState)
+        return false;
+
+    d->writeBuffer += data;
+    if (!d->flushScheduled) {
+        d->flushScheduled = true;
+        QMetaObject::invokeMethod(this, "_q_flushData", Qt::QueuedConnection);
+    }
+    return true;
+}
+
+/// Writes the data queued by sendData() to the socket.
+///
+/// If stream management is enabled and stanzas were sent since the last
+/// acknowledgement request, a request is appended to the data.
+///
+/// Returns true if all the data was written.
+
+bool QXmppStream::flushData()
+{
+    if (d->unrequestedStanzas > 0) {
+        if (d->unrequestedStanzas >= d->ackRequestThreshold || d->ackRequestInterval <= 0)
+            sendAcknowledgementRequest();
+        else if (!d->ackRequestTimer->isActive())
+            d->ackRequestTimer->start(d->ackRequestInterval);
+    }
+
+    if (d->writeBuffer.isEmpty())
+        return true;
+    QByteArray data = d->writeBuffer;
+    d->writeBuffer.clear();
     if (!d->socket || d->socket->state() != QAbstractSocket::ConnectedState)
         return false;
+
+    // the whole batch is compressed at once
+    if (d->compressor.isActive()) {
+        QElapsedTimer timer;
+        timer.start();
+        QByteArray compressed;
+        if (!d->compressor.compress(data, compressed)) {
+            warning(QString("Could not compress data: %1").arg(d->compressor.errorString()));
+            d->socket->abort();
+            return false;
+        }
+        updateCounter("stream-compression.sent.nsecs", elapsedNsecs(timer));
+        updateCounter("stream-compression.sent.uncompressed", data.size());
+        updateCounter("stream-compression.sent.compressed", compressed.size());
+        data = compressed;
+    }
     return d->socket->write(data) == data.size();
 }
 
@@ -149,17 +290,436 @@ bool QXmppStream::sendPacket(const QXmppStanza &packet)
     QXmlStreamWriter xmlStream(&data);
     packet.toXml(&xmlStream);
 
-    bool isXmppStanza = packet.isXmppStanza();
-    if (isXmppStanza && d->streamManagementEnabled)
-        d->unacknowledgedStanzas[++d->lastOutgoingSequenceNumber] = data;
+    if (packet.isXmppStanza())
+        return sendStanzaData(data);
+    else
+        return sendData(data);
+}
 
-    // send packet
-    bool success = sendData(data);
-    if (isXmppStanza)
+/// Sends a serialized XMPP stanza (message, presence or iq) to the peer.
+///
+/// Unlike sendData(), the stanza is accounted for by Stream Management
+/// (XEP-0198): it is kept until the peer acknowledges it, and resent if
+/// the stream is resumed.
+///
+/// \param data
+
+bool QXmppStream::sendStanzaData(const QByteArray &data)
+{
+    if (!d->streamManagementEnabled)
+        return sendData(data);
+
+    // hold the stanza back until the peer acknowledges earlier ones
+    if (d->ackWindowFull) {
+        d->heldStanzas << data;
+        updateCounter("stream-management.held.stanzas");
+        return true;
+    }
+
+    const bool success = transmitStanza(data);
+    if (d->ackWindowFull) {
+        warning(QString("Stream management window is full with %1 unacknowledged stanzas").arg(d->unacknowledgedStanzas.size()));
+        emit ackWindowFull();
+    }
+    return success;
+}
+
+/// Sends a stanza and keeps it until the peer acknowledges it (XEP-0198).
+///
+/// \param data
+
+bool QXmppStream::transmitStanza(const QByteArray &data)
+{
+    const qint64 peakBytes = d->unacknowledgedStanzas.peakBytes();
+    d->unacknowledgedStanzas.append(data);
+    if (d->unacknowledgedStanzas.peakBytes() > peakBytes)
+        setGauge("stream-management.unacked.peak-bytes", d->unacknowledgedStanzas.peakBytes());
+
+    // send packet, the acknowledgement request is sent when the
+    // batch of outgoing data is written
+    const bool success = sendData(data);
+    d->unrequestedStanzas++;
+
+    // ask for an acknowledgement right away if the window is full
+    if (d->unacknowledgedStanzas.isFull()) {
+        d->ackWindowFull = true;
         sendAcknowledgementRequest();
+    }
     return success;
 }
 
+/// Returns the tag names of the top-level elements which are delivered
+/// to handleRawStanza() instead of handleStanza().
+
+QStringList QXmppStream::rawStanzaTagNames() const
+{
+    return d->parser.rawTagNames().toList();
+}
+
+/// Sets the tag names of the top-level elements which are delivered to
+/// handleRawStanza() instead of handleStanza().
+///
+/// No DOM tree is built for such elements, which allows subclasses to
+/// parse them directly using QXmlStreamReader or to forward them as-is.
+///
+/// \param tagNames
+
+void QXmppStream::setRawStanzaTagNames(const QStringList &tagNames)
+{
+    d->parser.setRawTagNames(tagNames.toSet());
+}
+
+/// Returns the maximum size of an incoming stanza, in bytes.
+///
+/// The default value of 0 means there is no limit.
+
+int QXmppStream::maximumStanzaSize() const
+{
+    return d->parser.maximumStanzaSize();
+}
+
+/// Sets the maximum size of an incoming stanza, in bytes.
+///
+/// The stream is closed with a policy-violation error as soon as a
+/// stanza crosses the limit, without waiting for it to complete.
+///
+/// \param bytes
+
+void QXmppStream::setMaximumStanzaSize(int bytes)
+{
+    d->parser.setMaximumStanzaSize(bytes);
+}
+
+/// Returns the maximum nesting depth of the elements in an incoming
+/// stanza.
+///
+/// The default value of 0 means there is no limit.
+
+int QXmppStream::maximumStanzaDepth() const
+{
+    return d->parser.maximumDepth();
+}
+
+/// Sets the maximum nesting depth of the elements in an incoming
+/// stanza, the stanza's top-level element having a depth of 1.
+///
+/// \param depth
+
+void QXmppStream::setMaximumStanzaDepth(int depth)
+{
+    d->parser.setMaximumDepth(depth);
+}
+
+/// Returns the types of sent and received packets which are formatted
+/// and emitted through logMessage().
+
+QXmppLogger::MessageTypes QXmppStream::loggedMessageTypes() const
+{
+    return d->loggedMessageTypes;
+}
+
+/// Sets the types of sent and received packets which are formatted and
+/// emitted through logMessage().
+///
+/// Formatting every packet is costly, so the owner of the stream should
+/// set this to the message types which its logger actually records, see
+/// QXmppLogger::loggedMessageTypes(). The default is
+/// QXmppLogger::AnyMessage.
+///
+/// \param types
+
+void QXmppStream::setLoggedMessageTypes(QXmppLogger::MessageTypes types)
+{
+    d->loggedMessageTypes = types;
+}
+
+/// Returns the maximum amount of incoming data, in bytes, which is held
+/// while waiting for a stanza to complete.
+///
+/// The default value of 0 means there is no limit.
+
+int QXmppStream::maximumBufferSize() const
+{
+    return d->parser.maximumBufferSize();
+}
+
+/// Sets the maximum amount of incoming data, in bytes, which is held
+/// while waiting for a stanza to complete.
+///
+/// The limit applies to the data received since the end of the last
+/// complete stanza, so it also protects against a peer which never
+/// closes a tag, without limiting bursts of small stanzas. On a
+/// compressed stream it applies to the decompressed data. It should be
+/// larger than maximumStanzaSize().
+///
+/// \param bytes
+
+void QXmppStream::setMaximumBufferSize(int bytes)
+{
+    d->parser.setMaximumBufferSize(bytes);
+}
+
+/// Returns true if the stream is compressed (XEP-0138).
+
+bool QXmppStream::isCompressed() const
+{
+    return d->compressor.isActive();
+}
+
+/// Returns true if QXmpp was built with support for stream compression
+/// (XEP-0138).
+
+bool QXmppStream::isCompressionSupported()
+{
+    return QXmppCompressor::isSupported();
+}
+
+/// Returns the zlib level used to compress the stream (XEP-0138).
+///
+/// The default value of 0 means compression is not negotiated.
+
+int QXmppStream::compressionLevel() const
+{
+    return d->compressionLevel;
+}
+
+/// Sets the zlib level used to compress the stream (XEP-0138), from 1
+/// (fastest) to 9 (smallest), or 0 not to negotiate compression.
+///
+/// The level must be set before compression is negotiated.
+///
+/// \param level
+
+void QXmppStream::setCompressionLevel(int level)
+{
+    d->compressionLevel = qBound(0, level, 9);
+}
+
+/// Returns the zlib memory level used to compress the stream (XEP-0138).
+
+int QXmppStream::compressionMemoryLevel() const
+{
+    return d->compressionMemoryLevel;
+}
+
+/// Sets the zlib memory level used to compress the stream (XEP-0138),
+/// from 1 to 9.
+///
+/// Each compressed stream holds about 128 KiB plus 2^(level + 9) bytes
+/// for compression and 32 KiB for decompression. The default is 8.
+///
+/// \param level
+
+void QXmppStream::setCompressionMemoryLevel(int level)
+{
+    d->compressionMemoryLevel = qBound(1, level, 9);
+}
+
+/// Returns the number of stanzas after which an acknowledgement request
+/// is sent (XEP-0198).
+
+int QXmppStream::ackRequestThreshold() const
+{
+    return d->ackRequestThreshold;
+}
+
+/// Sets the number of stanzas after which an acknowledgement request
+/// is sent (XEP-0198).
+///
+/// At most one request is sent per batch of outgoing data. If a batch
+/// contains fewer stanzas, the request is delayed by ackRequestInterval()
+/// milliseconds. The default is 1, i.e. every batch containing a stanza
+/// ends with a request.
+///
+/// \param stanzas
+
+void QXmppStream::setAckRequestThreshold(int stanzas)
+{
+    d->ackRequestThreshold = qMax(1, stanzas);
+}
+
+/// Returns the maximum delay in milliseconds before an acknowledgement
+/// request is sent for stanzas below the threshold (XEP-0198).
+
+int QXmppStream::ackRequestInterval() const
+{
+    return d->ackRequestInterval;
+}
+
+/// Sets the maximum delay in milliseconds before an acknowledgement
+/// request is sent for stanzas below the threshold (XEP-0198).
+///
+/// If \a msecs is 0, the threshold is ignored and every batch containing
+/// a stanza ends with a request.
+///
+/// \param msecs
+
+void QXmppStream::setAckRequestInterval(int msecs)
+{
+    d->ackRequestInterval = msecs;
+}
+
+/// Returns the maximum number of unacknowledged stanzas (XEP-0198),
+/// 0 meaning no limit.
+
+int QXmppStream::ackWindowStanzas() const
+{
+    return d->unacknowledgedStanzas.maxCount();
+}
+
+/// Sets the maximum number of unacknowledged stanzas (XEP-0198),
+/// 0 meaning no limit.
+///
+/// Once the limit is reached, ackWindowFull() is emitted and the stanzas
+/// passed to sendPacket() are held back until the peer acknowledges some
+/// of the earlier ones. The default is no limit.
+///
+/// \param stanzas
+
+void QXmppStream::setAckWindowStanzas(int stanzas)
+{
+    d->unacknowledgedStanzas.setMaxCount(stanzas);
+}
+
+/// Returns the maximum total size of the unacknowledged stanzas
+/// (XEP-0198), 0 meaning no limit.
+
+qint64 QXmppStream::ackWindowBytes() const
+{
+    return d->unacknowledgedStanzas.maxBytes();
+}
+
+/// Sets the maximum total size of the unacknowledged stanzas
+/// (XEP-0198), 0 meaning no limit.
+///
+/// \sa setAckWindowStanzas()
+///
+/// \param bytes
+
+void QXmppStream::setAckWindowBytes(qint64 bytes)
+{
+    d->unacknowledgedStanzas.setMaxBytes(bytes);
+}
+
+/// Handles the peer exceeding one of the limits set with
+/// setMaximumStanzaSize(), setMaximumStanzaDepth() or
+/// setMaximumBufferSize().
+///
+/// This is called right before the stream is closed with a
+/// policy-violation error. The default implementation does nothing.
+///
+/// \param limit One of "stanza-size", "stanza-depth" or "buffer-size".
+
+void QXmppStream::handleLimitExceeded(const QString &limit)
+{
+    Q_UNUSED(limit);
+}
+
+/// Handles data read from the socket, before it is parsed.
+///
+/// Subclasses can use this to account for incoming traffic, for instance
+/// to pause further reads with setReadingPaused(). The data is parsed
+/// regardless. The default implementation does nothing.
+///
+/// \param bytes The number of bytes read.
+
+void QXmppStream::handleDataReceived(qint64 bytes)
+{
+    Q_UNUSED(bytes);
+}
+
+/// Starts compressing the stream (XEP-0138).
+///
+/// This must be called right after the <compressed/> element was sent
+/// or received. Data which was queued with sendData() is written
+/// uncompressed first.
+///
+/// Returns false if the compression contexts could not be created.
+
+bool QXmppStream::startCompression()
+{
+    flushData();
+    if (!d->compressor.start(d->compressionLevel, d->compressionMemoryLevel)) {
+        warning(QString("Could not start compression: %1").arg(d->compressor.errorString()));
+        return false;
+    }
+    debug("Stream compression started");
+    updateCounter("stream-compression.started");
+    return true;
+}
+
+/// Returns true if reading from the socket is paused.
+
+bool QXmppStream::isReadingPaused() const
+{
+    return d->readingPaused;
+}
+
+/// Pauses or resumes reading from the socket.
+///
+/// While reading is paused, no more data is read from the socket, but the
+/// data which was already read is still parsed and its stanzas handled.
+/// The socket's read buffer is capped, so that the peer eventually stops
+/// sending.
+///
+/// \param paused
+
+void QXmppStream::setReadingPaused(bool paused)
+{
+    if (paused == d->readingPaused)
+        return;
+    d->readingPaused = paused;
+    updateReading(paused);
+}
+
+/// Returns true if the handling of incoming stanzas is paused.
+
+bool QXmppStream::isStanzaHandlingPaused() const
+{
+    return d->stanzaHandlingPaused;
+}
+
+/// Pauses or resumes the handling of incoming stanzas.
+///
+/// While stanza handling is paused, the stanzas which were received are
+/// kept until it resumes, and no data is read from the socket so that
+/// they do not pile up.
+///
+/// \param paused
+
+void QXmppStream::setStanzaHandlingPaused(bool paused)
+{
+    if (paused == d->stanzaHandlingPaused)
+        return;
+    d->stanzaHandlingPaused = paused;
+    updateReading(paused);
+}
+
+void QXmppStream::updateReading(bool paused)
+{
+    if (d->socket)
+        d->socket->setReadBufferSize((d->readingPaused || d->stanzaHandlingPaused) ? pausedReadBufferSize : 0);
+
+    // readyRead() is not emitted again for data which is already buffered
+    if (!paused)
+        QMetaObject::invokeMethod(this, "_q_socketReadyRead", Qt::QueuedConnection);
+}
+
+/// Handles an incoming XMPP stanza which was selected using
+/// setRawStanzaTagNames().
+///
+/// The default implementation builds a DOM tree and passes it to
+/// handleStanza().
+///
+/// \param data A self-contained XML fragment holding the stanza.
+
+void QXmppStream::handleRawStanza(const QByteArray &data)
+{
+    QDomDocument document;
+    if (document.setContent(data, true))
+        handleStanza(document.documentElement());
+}
+
 /// Returns the QSslSocket used for this stream.
 ///
 
@@ -177,6 +737,7 @@ void QXmppStream::setSocket(QSslSocket *socket)
     Q_UNUSED(check);
 
     d->socket = socket;
+    d->compressor.stop();
     if (!d->socket)
         return;
 
@@ -198,11 +759,25 @@ void QXmppStream::setSocket(QSslSocket *socket)
     Q_ASSERT(check);
 }
 
+void QXmppStream::_q_ackRequestTimeout()
+{
+    sendAcknowledgementRequest();
+    flushData();
+}
+
+void QXmppStream::_q_flushData()
+{
+    // an acknowledgement request is part of the current batch
+    flushData();
+    d->flushScheduled = false;
+}
+
 void QXmppStream::_q_socketConnected()
 {
     info(QString("Socket connected to %1 %2").arg(
         d->socket->peerAddress().toString(),
         QString::number(d->socket->peerPort())));
+    d->compressor.stop();
     handleStart();
 }
 
@@ -220,72 +795,102 @@ void QXmppStream::_q_socketError(QAbstractSocket::SocketError socketError)
 
 void QXmppStream::_q_socketReadyRead()
 {
-    d->dataBuffer.append(d->socket->readAll());
+    if (!d->socket || d->stanzaHandlingPaused || d->parser.hasError())
+        return;
 
-    // handle whitespace pings
-    if (!d->dataBuffer.isEmpty() && d->dataBuffer.trimmed().isEmpty()) {
-        d->dataBuffer.clear();
-        handleStanza(QDomElement());
-    }
+    // data which was already read is parsed even while reading is paused,
+    // as it has already been accounted for by handleDataReceived()
+    QByteArray input;
+    if (!d->readingPaused)
+        input = d->socket->readAll();
 
-    // FIXME : maybe these QRegExps could be static?
-    QRegExp startStreamRegex("^(<\\?xml.*\\?>)?\\s*<stream:stream.*>");
-    startStreamRegex.setMinimal(true);
-    QRegExp endStreamRegex("</stream:stream>$");
-    endStreamRegex.setMinimal(true);
-
-    // check whether we need to add stream start / end elements
-    //
-    // NOTE: as we may only have partial XML content, do not alter the stream's
-    // state until we have a valid XML document!
-    QByteArray completeXml = d->dataBuffer;
-    const QString strData = QString::fromUtf8(d->dataBuffer);
-    bool streamStart = false;
-    if (d->streamStart.isEmpty() && strData.contains(startStreamRegex))
-        streamStart = true;
-    else
-        completeXml.prepend(d->streamStart);
-    bool streamEnd = false;
-    if (strData.contains(endStreamRegex))
-        streamEnd = true;
-    else
-        completeXml.append(streamRootElementEnd);
+    // compressed data is decompressed in bounded chunks and each chunk is
+    // parsed before the next one, so that the buffer limit applies to the
+    // unfinished stanza rather than to whatever a read expands to
+    do {
+        QByteArray data;
+        if (!d->compressor.isActive()) {
+            data = input;
+        } else if (!input.isEmpty() || d->compressor.hasPendingData()) {
+            QElapsedTimer timer;
+            timer.start();
+            if (!d->compressor.decompress(input, data, decompressedChunkSize)) {
+                warning(QString("Could not decompress data: %1").arg(d->compressor.errorString()));
+                sendData("<stream:error><undefined-condition xmlns='urn:ietf:params:xml:ns:xmpp-streams'/></stream:error>");
+                disconnectFromHost();
+                return;
+            }
+            updateCounter("stream-compression.received.nsecs", elapsedNsecs(timer));
+            updateCounter("stream-compression.received.compressed", input.size());
+            updateCounter("stream-compression.received.uncompressed", data.size());
+        }
+        input.clear();
 
-    // check whether we have a valid XML document
-    QDomDocument doc;
-    if (!doc.setContent(completeXml, true))
-        return;
+        if (!data.isEmpty()) {
+            if (d->loggedMessageTypes.testFlag(QXmppLogger::ReceivedMessage))
+                logReceived(d->receivedDecoder->toUnicode(data));
+            handleDataReceived(data.size());
 
-    // remove data from buffer
-    logReceived(strData);
-    d->dataBuffer.clear();
+            // handle whitespace pings
+            if (!d->parser.isInsideStanza() && isWhitespace(data))
+                handleStanza(QDomElement());
 
-    // process stream start
-    if (streamStart) {
-        d->streamStart = startStreamRegex.cap(0).toUtf8();
-        handleStream(doc.documentElement());
-    }
+            // feed the incremental parser, each stanza is reported exactly
+            // once when its closing tag has been received
+            d->parser.addData(data);
+        }
 
-    // process stanzas
-    QDomElement nodeRecv = doc.documentElement().firstChildElement();
-    while (!nodeRecv.isNull()) {
-        if (QXmppStreamManagementAck::isStreamManagementAck(nodeRecv))
-            handleAcknowledgement(nodeRecv);
-        else if (QXmppStreamManagementReq::isStreamManagementReq(nodeRecv))
-            sendAcknowledgement();
-        else {
-            handleStanza(nodeRecv);
-            if(nodeRecv.tagName() == QLatin1String("message") ||
-               nodeRecv.tagName() == QLatin1String("presence") ||
-               nodeRecv.tagName() == QLatin1String("iq"))
+        // stanzas which were already received are kept in the parser while
+        // stanza handling is paused
+        while (!d->stanzaHandlingPaused) {
+            const QXmppStreamParser::Event event = d->parser.readNext();
+            if (event == QXmppStreamParser::NoEvent) {
+                break;
+            } else if (event == QXmppStreamParser::StreamStart) {
+                handleStream(d->parser.element());
+            } else if (event == QXmppStreamParser::Stanza) {
+                QDomElement nodeRecv = d->parser.element();
+                if (QXmppStreamManagementAck::isStreamManagementAck(nodeRecv))
+                    handleAcknowledgement(nodeRecv);
+                else if (QXmppStreamManagementReq::isStreamManagementReq(nodeRecv))
+                    sendAcknowledgement();
+                else {
+                    handleStanza(nodeRecv);
+                    if(nodeRecv.tagName() == QLatin1String("message") ||
+                       nodeRecv.tagName() == QLatin1String("presence") ||
+                       nodeRecv.tagName() == QLatin1String("iq"))
+                        ++d->lastIncomingSequenceNumber;
+                }
+            } else if (event == QXmppStreamParser::RawStanza) {
+                handleRawStanza(d->parser.rawStanza());
                 ++d->lastIncomingSequenceNumber;
+            } else if (event == QXmppStreamParser::StreamEnd) {
+                disconnectFromHost();
+                break;
+            } else if (event == QXmppStreamParser::LimitExceeded) {
+                warning(QString("Received too much data: %1").arg(d->parser.errorString()));
+                switch (d->parser.exceededLimit()) {
+                case QXmppStreamParser::StanzaSizeLimit:
+                    handleLimitExceeded("stanza-size");
+                    break;
+                case QXmppStreamParser::DepthLimit:
+                    handleLimitExceeded("stanza-depth");
+                    break;
+                default:
+                    handleLimitExceeded("buffer-size");
+                    break;
+                }
+                sendData("<stream:error><policy-violation xmlns='urn:ietf:params:xml:ns:xmpp-streams'/></stream:error>");
+                disconnectFromHost();
+                break;
+            } else {
+                warning(QString("Received invalid XML: %1").arg(d->parser.errorString()));
+                sendData("<stream:error><not-well-formed xmlns='urn:ietf:params:xml:ns:xmpp-streams'/></stream:error>");
+                disconnectFromHost();
+                break;
+            }
         }
-        nodeRecv = nodeRecv.nextSiblingElement();
-    }
-
-    // process stream end
-    if (streamEnd)
-        disconnectFromHost();
+    } while (!d->stanzaHandlingPaused && !d->parser.hasError() && d->compressor.hasPendingData());
 }
 
 /// Enables Stream Management acks / reqs (XEP-0198).
@@ -297,26 +902,18 @@ void QXmppStream::enableStreamManagement(bool resetSequenceNumber)
     d->streamManagementEnabled = true;
 
     if (resetSequenceNumber) {
-        d->lastOutgoingSequenceNumber = 0;
+        d->unacknowledgedStanzas.resetSequenceNumbers();
         d->lastIncomingSequenceNumber = 0;
+    }
 
-        // resend unacked stanzas
-        if (!d->unacknowledgedStanzas.empty()) {
-            QMap<unsigned, QByteArray> oldUnackedStanzas = d->unacknowledgedStanzas;
-            d->unacknowledgedStanzas.clear();
-            for (QMap<unsigned, QByteArray>::iterator it = oldUnackedStanzas.begin(); it != oldUnackedStanzas.end(); ++it) {
-                d->unacknowledgedStanzas[++d->lastOutgoingSequenceNumber] = it.value();
-                sendData(it.value());
-            }
-            sendAcknowledgementRequest();
-        }
-    } else {
-        // resend unacked stanzas
-        if (!d->unacknowledgedStanzas.empty()) {
-            for (QMap<unsigned, QByteArray>::iterator it = d->unacknowledgedStanzas.begin(); it != d->unacknowledgedStanzas.end(); ++it)
-                sendData(it.value());
-            sendAcknowledgementRequest();
-        }
+    // resend unacked stanzas
+    if (!d->unacknowledgedStanzas.isEmpty()) {
+        d->unacknowledgedStanzas.recordResend();
+        updateCounter("stream-management.resent.stanzas", d->unacknowledgedStanzas.size());
+        updateCounter("stream-management.resent.bytes", d->unacknowledgedStanzas.bytes());
+        for (int i = 0; i < d->unacknowledgedStanzas.size(); ++i)
+            sendData(d->unacknowledgedStanzas.at(i));
+        sendAcknowledgementRequest();
     }
 }
 
@@ -326,15 +923,73 @@ unsigned QXmppStream::lastIncomingSequenceNumber() const
     return d->lastIncomingSequenceNumber;
 }
 
+/// Returns true if Stream Management is enabled (XEP-0198).
+///
+/// Stream Management is disabled when the stream is restarted or
+/// closed using disconnectFromHost().
+
+bool QXmppStream::isStreamManagementEnabled() const
+{
+    return d->streamManagementEnabled;
+}
+
+/// Returns the sequence number of the last outgoing stanza (XEP-0198).
+///
+/// Stanzas held back because the acknowledgement window is full are
+/// numbered after those which were sent.
+
+unsigned QXmppStream::lastOutgoingSequenceNumber() const
+{
+    return d->unacknowledgedStanzas.lastSequenceNumber() + d->heldStanzas.size();
+}
+
+/// Returns the outgoing stanzas which were not acknowledged yet (XEP-0198),
+/// followed by those which were held back because the acknowledgement
+/// window is full.
+
+QList<QByteArray> QXmppStream::unacknowledgedStanzas() const
+{
+    QList<QByteArray> stanzas;
+    for (int i = 0; i < d->unacknowledgedStanzas.size(); ++i)
+        stanzas << d->unacknowledgedStanzas.at(i);
+    return stanzas + d->heldStanzas;
+}
+
+/// Takes over the Stream Management state of a previous stream and
+/// resends the stanzas it had not received acknowledgements for
+/// (XEP-0198).
+///
+/// \param lastIncomingSequenceNumber The sequence number of the last stanza received on the previous stream.
+/// \param lastOutgoingSequenceNumber The sequence number of the last stanza sent on the previous stream.
+/// \param unacknowledgedStanzas The stanzas which were not acknowledged, the last one having lastOutgoingSequenceNumber.
+
+void QXmppStream::resumeStreamManagement(unsigned lastIncomingSequenceNumber,
+                                         unsigned lastOutgoingSequenceNumber,
+                                         const QList<QByteArray> &unacknowledgedStanzas)
+{
+    d->unacknowledgedStanzas.clear();
+    d->heldStanzas.clear();
+    d->ackWindowFull = false;
+    foreach (const QByteArray &stanza, unacknowledgedStanzas)
+        d->unacknowledgedStanzas.append(stanza);
+    d->unacknowledgedStanzas.setLastSequenceNumber(lastOutgoingSequenceNumber);
+    d->lastIncomingSequenceNumber = lastIncomingSequenceNumber;
+    enableStreamManagement(false);
+}
+
 /// Sets the last acknowledged sequence number for outgoing stanzas (XEP-0198).
 void QXmppStream::setAcknowledgedSequenceNumber(unsigned sequenceNumber)
 {
-    for (QMap<unsigned, QByteArray>::iterator it = d->unacknowledgedStanzas.begin(); it != d->unacknowledgedStanzas.end(); ) {
-        if (it.key() <= sequenceNumber)
-            it = d->unacknowledgedStanzas.erase(it);
-        else
-            ++it;
-    }
+    d->unacknowledgedStanzas.acknowledge(sequenceNumber);
+    if (!d->ackWindowFull || d->unacknowledgedStanzas.isFull())
+        return;
+
+    // send the stanzas which were held back, they may fill the window again
+    d->ackWindowFull = false;
+    while (!d->heldStanzas.isEmpty() && !d->ackWindowFull)
+        transmitStanza(d->heldStanzas.takeFirst());
+    if (!d->ackWindowFull)
+        emit ackWindowAvailable();
 }
 
 /// Handles an incoming acknowledgement from XEP-0198.
@@ -369,6 +1024,8 @@ void QXmppStream::sendAcknowledgement()
 /// Sends an acknowledgement request as defined in XEP-0198.
 void QXmppStream::sendAcknowledgementRequest()
 {
+    d->unrequestedStanzas = 0;
+    d->ackRequestTimer->stop();
     if (!d->streamManagementEnabled)
         return;
 
@@ -28,6 +28,7 @@
 
 #include <QAbstractSocket>
 #include <QObject>
+#include <QStringList>
 #include "QXmppLogger.h"
 
 class QDomElement;
@@ -49,6 +50,41 @@ public:
     virtual bool isConnected() const;
     bool sendPacket(const QXmppStanza&);
 
+    QStringList rawStanzaTagNames() const;
+
+    QXmppLogger::MessageTypes loggedMessageTypes() const;
+    void setLoggedMessageTypes(QXmppLogger::MessageTypes types);
+
+    int maximumStanzaSize() const;
+    void setMaximumStanzaSize(int bytes);
+
+    int maximumStanzaDepth() const;
+    void setMaximumStanzaDepth(int depth);
+
+    int maximumBufferSize() const;
+    void setMaximumBufferSize(int bytes);
+
+    bool isCompressed() const;
+    static bool isCompressionSupported();
+
+    int compressionLevel() const;
+    void setCompressionLevel(int level);
+
+    int compressionMemoryLevel() const;
+    void setCompressionMemoryLevel(int level);
+
+    int ackRequestThreshold() const;
+    void setAckRequestThreshold(int stanzas);
+
+    int ackRequestInterval() const;
+    void setAckRequestInterval(int msecs);
+
+    int ackWindowStanzas() const;
+    void setAckWindowStanzas(int stanzas);
+
+    qint64 ackWindowBytes() const;
+    void setAckWindowBytes(qint64 bytes);
+
 signals:
     /// This signal is emitted when the stream is connected.
     void connected();
@@ -56,6 +92,17 @@ signals:
     /// This signal is emitted when the stream is disconnected.
     void disconnected();
 
+    /// This signal is emitted when the unacknowledged stanzas reach the
+    /// limits set with setAckWindowStanzas() or setAckWindowBytes().
+    ///
+    /// Until ackWindowAvailable() is emitted, the stanzas passed to
+    /// sendPacket() are held back by the stream.
+    void ackWindowFull();
+
+    /// This signal is emitted when the peer acknowledged enough stanzas
+    /// for sendPacket() to accept stanzas again.
+    void ackWindowAvailable();
+
 protected:
     // Access to underlying socket
     QSslSocket *socket() const;
@@ -74,6 +121,20 @@ protected:
     /// \param element
     virtual void handleStream(const QDomElement &element) = 0;
 
+    virtual void handleRawStanza(const QByteArray &data);
+    virtual void handleLimitExceeded(const QString &limit);
+    virtual void handleDataReceived(qint64 bytes);
+
+    bool startCompression();
+
+    bool isReadingPaused() const;
+    void setReadingPaused(bool paused);
+
+    bool isStanzaHandlingPaused() const;
+    void setStanzaHandlingPaused(bool paused);
+
+    bool flushData();
+
     /// Enables Stream Management acks / reqs (XEP-0198).
     ///
     /// \param resetSeqno Indicates if the sequence numbers should be resetted.
@@ -83,6 +144,13 @@ protected:
     /// Returns the sequence number of the last incoming stanza (XEP-0198).
     unsigned lastIncomingSequenceNumber() const;
 
+    bool isStreamManagementEnabled() const;
+    unsigned lastOutgoingSequenceNumber() const;
+    QList<QByteArray> unacknowledgedStanzas() const;
+    void resumeStreamManagement(unsigned lastIncomingSequenceNumber,
+                                unsigned lastOutgoingSequenceNumber,
+                                const QList<QByteArray> &unacknowledgedStanzas);
+
     /// Sets the last acknowledged sequence number for outgoing stanzas (XEP-0198).
     void setAcknowledgedSequenceNumber(unsigned sequenceNumber);
 
@@ -98,11 +166,18 @@ private:
     /// Sends an acknowledgement request as defined in XEP-0198.
     void sendAcknowledgementRequest();
 
+    bool transmitStanza(const QByteArray &data);
+    void updateReading(bool paused);
+
 public slots:
     virtual void disconnectFromHost();
     virtual bool sendData(const QByteArray&);
+    virtual bool sendStanzaData(const QByteArray &data);
+    void setRawStanzaTagNames(const QStringList &tagNames);
 
 private slots:
+    void _q_ackRequestTimeout();
+    void _q_flushData();
     void _q_socketConnected();
     void _q_socketEncrypted();
     void _q_socketError(QAbstractSocket::SocketError error);
@@ -65,6 +65,9 @@ public:
     /// \pa mode The mode to set.
     void setStreamManagementMode(Mode mode);
 
+    Mode rosterVersioningMode() const;
+    void setRosterVersioningMode(Mode mode);
+
     /// \cond
     void parse(const QDomElement &element);
     void toXml(QXmlStreamWriter *writer) const;
@@ -78,6 +81,7 @@ private:
     Mode m_nonSaslAuthMode;
     Mode m_tlsMode;
     Mode m_streamManagementMode;
+    Mode m_rosterVersioningMode;
     QStringList m_authMechanisms;
     QStringList m_compressionMethods;
 };
@@ -136,8 +136,10 @@ void QXmppStreamManagementEnabled::parse(const QDomElement &element)
 
 void QXmppStreamManagementEnabled::toXml(QXmlStreamWriter *writer) const
 {
-    writer->writeStartElement("enable");
+    writer->writeStartElement("enabled");
     writer->writeAttribute("xmlns", ns_stream_management);
+    if (!m_id.isEmpty())
+        writer->writeAttribute("id", m_id);
     if (m_resume)
         writer->writeAttribute("resume", "true");
     if (m_max > 0)
@@ -232,6 +234,7 @@ void QXmppStreamManagementResumed::parse(const QDomElement &element)
 void QXmppStreamManagementResumed::toXml(QXmlStreamWriter *writer) const
 {
     writer->writeStartElement("resumed");
+    writer->writeAttribute("xmlns", ns_stream_management);
     writer->writeAttribute("h", QString::number(m_h));
     writer->writeAttribute("previd", m_previd);
     writer->writeEndElement();
@@ -323,3 +326,215 @@ void QXmppStreamManagementReq::toXml(QXmlStreamWriter *writer)
     writer->writeAttribute("xmlns", ns_stream_management);
     writer->writeEndElement();
 }
+
+/// Constructs an empty queue, without any limits.
+
+QXmppStreamManagementQueue::QXmppStreamManagementQueue()
+    : m_head(0)
+    , m_count(0)
+    , m_bytes(0)
+    , m_lastSequenceNumber(0)
+    , m_maxCount(0)
+    , m_maxBytes(0)
+    , m_peakBytes(0)
+    , m_resentBytes(0)
+    , m_resentStanzas(0)
+{
+}
+
+/// Appends a stanza, which gets the next sequence number.
+///
+/// \param data
+
+void QXmppStreamManagementQueue::append(const QByteArray &data)
+{
+    // the capacity is kept a power of two
+    if (m_count == m_items.size()) {
+        QVector<QByteArray> items(qMax(16, m_items.size() * 2));
+        for (int i = 0; i < m_count; ++i)
+            items[i] = at(i);
+        m_items = items;
+        m_head = 0;
+    }
+
+    m_items[(m_head + m_count) & (m_items.size() - 1)] = data;
+    m_count++;
+    m_bytes += data.size();
+    m_lastSequenceNumber++;
+    if (m_bytes > m_peakBytes)
+        m_peakBytes = m_bytes;
+}
+
+/// Removes the stanzas up to and including the given \a sequenceNumber.
+///
+/// Sequence numbers wrap around as described in XEP-0198.
+///
+/// Returns the number of stanzas which were removed.
+///
+/// \param sequenceNumber
+
+int QXmppStreamManagementQueue::acknowledge(unsigned sequenceNumber)
+{
+    // number of stanzas which remain unacknowledged, an acknowledgement
+    // for stanzas we have not sent yet acknowledges everything
+    const unsigned pending = m_lastSequenceNumber - sequenceNumber;
+    int count;
+    if (pending > 0x7fffffffu)
+        count = m_count;
+    else if (pending >= unsigned(m_count))
+        return 0;
+    else
+        count = m_count - int(pending);
+
+    for (int i = 0; i < count; ++i) {
+        QByteArray &item = m_items[m_head];
+        m_bytes -= item.size();
+        item = QByteArray();
+        m_head = (m_head + 1) & (m_items.size() - 1);
+    }
+    m_count -= count;
+    return count;
+}
+
+/// Removes all the stanzas, keeping the sequence numbers.
+
+void QXmppStreamManagementQueue::clear()
+{
+    m_items.clear();
+    m_head = 0;
+    m_count = 0;
+    m_bytes = 0;
+}
+
+/// Renumbers the stanzas in the queue starting from 1, as required
+/// when stream management is enabled on a new stream.
+
+void QXmppStreamManagementQueue::resetSequenceNumbers()
+{
+    m_lastSequenceNumber = m_count;
+}
+
+/// Renumbers the stanzas in the queue so that the last one has the given
+/// \a sequenceNumber, as required when a stream is resumed.
+///
+/// \param sequenceNumber
+
+void QXmppStreamManagementQueue::setLastSequenceNumber(unsigned sequenceNumber)
+{
+    m_lastSequenceNumber = sequenceNumber;
+}
+
+/// Returns the stanza at index position \a i, the oldest stanza
+/// being at index 0.
+///
+/// \param i
+
+QByteArray QXmppStreamManagementQueue::at(int i) const
+{
+    Q_ASSERT(i >= 0 && i < m_count);
+    return m_items.at((m_head + i) & (m_items.size() - 1));
+}
+
+/// Returns the number of stanzas in the queue.
+
+int QXmppStreamManagementQueue::size() const
+{
+    return m_count;
+}
+
+/// Returns true if the queue holds no stanzas.
+
+bool QXmppStreamManagementQueue::isEmpty() const
+{
+    return m_count == 0;
+}
+
+/// Returns true if the queue reached one of its limits.
+
+bool QXmppStreamManagementQueue::isFull() const
+{
+    return (m_maxCount > 0 && m_count >= m_maxCount) ||
+           (m_maxBytes > 0 && m_bytes >= m_maxBytes);
+}
+
+/// Returns the total size of the stanzas in the queue.
+
+qint64 QXmppStreamManagementQueue::bytes() const
+{
+    return m_bytes;
+}
+
+/// Returns the sequence number of the oldest stanza in the queue.
+
+unsigned QXmppStreamManagementQueue::firstSequenceNumber() const
+{
+    return m_lastSequenceNumber - m_count + 1;
+}
+
+/// Returns the sequence number of the last stanza which was appended.
+
+unsigned QXmppStreamManagementQueue::lastSequenceNumber() const
+{
+    return m_lastSequenceNumber;
+}
+
+/// Returns the maximum number of stanzas, 0 meaning no limit.
+
+int QXmppStreamManagementQueue::maxCount() const
+{
+    return m_maxCount;
+}
+
+/// Sets the maximum number of stanzas, 0 meaning no limit.
+///
+/// \param count
+
+void QXmppStreamManagementQueue::setMaxCount(int count)
+{
+    m_maxCount = count;
+}
+
+/// Returns the maximum total size of the stanzas, 0 meaning no limit.
+
+qint64 QXmppStreamManagementQueue::maxBytes() const
+{
+    return m_maxBytes;
+}
+
+/// Sets the maximum total size of the stanzas, 0 meaning no limit.
+///
+/// \param bytes
+
+void QXmppStreamManagementQueue::setMaxBytes(qint64 bytes)
+{
+    m_maxBytes = bytes;
+}
+
+/// Returns the highest total size the queue ever reached.
+
+qint64 QXmppStreamManagementQueue::peakBytes() const
+{
+    return m_peakBytes;
+}
+
+/// Returns the total size of the stanzas which were resent.
+
+qint64 QXmppStreamManagementQueue::resentBytes() const
+{
+    return m_resentBytes;
+}
+
+/// Returns the number of stanzas which were resent.
+
+qint64 QXmppStreamManagementQueue::resentStanzas() const
+{
+    return m_resentStanzas;
+}
+
+/// Records that all the stanzas in the queue are being resent.
+
+void QXmppStreamManagementQueue::recordResend()
+{
+    m_resentBytes += m_bytes;
+    m_resentStanzas += m_count;
+}
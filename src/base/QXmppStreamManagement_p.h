@@ -28,6 +28,7 @@
 #include "QXmppStanza.h"
 
 #include <QDomDocument>
+#include <QVector>
 #include <QXmlStreamWriter>
 
 //  W A R N I N G
@@ -191,4 +192,56 @@ public:
     /// \endcond
 };
 
+/// \brief The QXmppStreamManagementQueue class holds the outgoing stanzas
+/// which were not acknowledged by the peer yet (XEP-0198).
+///
+/// Stanzas are stored in a ring buffer indexed by sequence number, so
+/// appending a stanza is O(1) and acknowledging k stanzas is O(k). The
+/// queue is full once it holds maxCount() stanzas or maxBytes() bytes.
+
+class QXMPP_AUTOTEST_EXPORT QXmppStreamManagementQueue
+{
+public:
+    QXmppStreamManagementQueue();
+
+    void append(const QByteArray &data);
+    int acknowledge(unsigned sequenceNumber);
+    void clear();
+    void resetSequenceNumbers();
+    void setLastSequenceNumber(unsigned sequenceNumber);
+
+    QByteArray at(int i) const;
+    int size() const;
+    bool isEmpty() const;
+    bool isFull() const;
+    qint64 bytes() const;
+    unsigned firstSequenceNumber() const;
+    unsigned lastSequenceNumber() const;
+
+    int maxCount() const;
+    void setMaxCount(int count);
+
+    qint64 maxBytes() const;
+    void setMaxBytes(qint64 bytes);
+
+    qint64 peakBytes() const;
+    qint64 resentBytes() const;
+    qint64 resentStanzas() const;
+    void recordResend();
+
+private:
+    QVector<QByteArray> m_items;
+    int m_head;
+    int m_count;
+    qint64 m_bytes;
+    unsigned m_lastSequenceNumber;
+
+    int m_maxCount;
+    qint64 m_maxBytes;
+
+    qint64 m_peakBytes;
+    qint64 m_resentBytes;
+    qint64 m_resentStanzas;
+};
+
 #endif
@@ -0,0 +1,474 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QDomDocument>
+
+#include "QXmppStreamParser_p.h"
+
+static bool isWhitespace(const QString &text)
+{
+    const QChar *ptr = text.constData();
+    const QChar *end = ptr + text.size();
+    for (; ptr != end; ++ptr) {
+        if (!ptr->isSpace())
+            return false;
+    }
+    return true;
+}
+
+// Returns the number of UTF-16 code units QXmlStreamReader decodes from
+// the given UTF-8 data, without decoding it.
+static qint64 utf16Length(const QByteArray &data)
+{
+    qint64 length = 0;
+    const uchar *ptr = reinterpret_cast<const uchar*>(data.constData());
+    const uchar *end = ptr + data.size();
+    for (; ptr != end; ++ptr) {
+        // continuation bytes do not start a character, and four-byte
+        // sequences are decoded to surrogate pairs
+        if ((*ptr & 0xc0) != 0x80)
+            length++;
+        if (*ptr >= 0xf0)
+            length++;
+    }
+    return length;
+}
+
+/// Constructs a new stream parser.
+
+QXmppStreamParser::QXmppStreamParser()
+    : m_depth(0)
+    , m_maximumStanzaSize(0)
+    , m_maximumDepth(0)
+    , m_maximumBufferSize(0)
+    , m_exceededLimit(NoLimit)
+    , m_receivedCharacters(0)
+    , m_stanzaOffset(0)
+    , m_stanzaEndOffset(0)
+    , m_rawWriter(&m_rawBuffer)
+    , m_rawActive(false)
+{
+    m_rawBuffer.open(QIODevice::WriteOnly);
+}
+
+/// Appends the given \a data to the parser's input.
+///
+/// \param data
+
+void QXmppStreamParser::addData(const QByteArray &data)
+{
+    m_reader.addData(data);
+    m_receivedCharacters += utf16Length(data);
+}
+
+/// Resets the parser, discarding any pending input.
+///
+/// This must be called whenever the stream is restarted, for instance
+/// after STARTTLS or SASL authentication.
+
+void QXmppStreamParser::clear()
+{
+    m_reader.clear();
+    m_current = QDomElement();
+    m_element = QDomElement();
+    m_rootName.clear();
+    m_rootNamespace.clear();
+    m_rootNamespaceDeclarations.clear();
+    m_text.clear();
+    m_depth = 0;
+    m_rawActive = false;
+    m_exceededLimit = NoLimit;
+    m_receivedCharacters = 0;
+    m_stanzaOffset = 0;
+    m_stanzaEndOffset = 0;
+}
+
+/// Returns the element associated with the last event.
+///
+/// For StreamStart this is the stream's root element, for Stanza
+/// it is the completed top-level element.
+
+QDomElement QXmppStreamParser::element() const
+{
+    return m_element;
+}
+
+/// Returns the serialized top-level element associated with the last
+/// RawStanza event.
+///
+/// The returned data is a self-contained XML fragment: the namespace
+/// declarations inherited from the stream's root element are repeated
+/// on the top-level element.
+
+QByteArray QXmppStreamParser::rawStanza() const
+{
+    return m_rawBuffer.data();
+}
+
+/// Returns the description of the last parse error.
+
+QString QXmppStreamParser::errorString() const
+{
+    switch (m_exceededLimit) {
+    case StanzaSizeLimit:
+        return QString("Stanza exceeds %1 bytes").arg(m_maximumStanzaSize);
+    case DepthLimit:
+        return QString("Elements are nested deeper than %1 levels").arg(m_maximumDepth);
+    case BufferSizeLimit:
+        return QString("Pending data exceeds %1 bytes").arg(m_maximumBufferSize);
+    default:
+        return m_reader.errorString();
+    }
+}
+
+/// Returns true if the input is not well-formed XML, or if it exceeds
+/// one of the parser's limits.
+
+bool QXmppStreamParser::hasError() const
+{
+    return m_exceededLimit != NoLimit || (m_reader.hasError() &&
+           m_reader.error() != QXmlStreamReader::PrematureEndOfDocument);
+}
+
+/// Returns true if the parser is in the middle of a top-level element.
+
+bool QXmppStreamParser::isInsideStanza() const
+{
+    return m_depth > 1;
+}
+
+/// Returns the limit which was exceeded by the input, if any.
+
+QXmppStreamParser::Limit QXmppStreamParser::exceededLimit() const
+{
+    return m_exceededLimit;
+}
+
+/// Returns the maximum size of a stanza, in bytes.
+///
+/// The default value of 0 means there is no limit.
+
+int QXmppStreamParser::maximumStanzaSize() const
+{
+    return m_maximumStanzaSize;
+}
+
+/// Sets the maximum size of a stanza, in bytes.
+///
+/// The size is measured in decoded characters from the stanza's opening
+/// tag, which matches the number of bytes for ASCII data and can only be
+/// smaller otherwise.
+///
+/// \param size
+
+void QXmppStreamParser::setMaximumStanzaSize(int size)
+{
+    m_maximumStanzaSize = size;
+}
+
+/// Returns the maximum nesting depth of the elements in a stanza.
+///
+/// The default value of 0 means there is no limit.
+
+int QXmppStreamParser::maximumDepth() const
+{
+    return m_maximumDepth;
+}
+
+/// Sets the maximum nesting depth of the elements in a stanza.
+///
+/// The stanza's top-level element has a depth of 1.
+///
+/// \param depth
+
+void QXmppStreamParser::setMaximumDepth(int depth)
+{
+    m_maximumDepth = depth;
+}
+
+/// Returns the maximum amount of input, in bytes, which is held while
+/// waiting for a stanza to complete.
+///
+/// The default value of 0 means there is no limit.
+
+int QXmppStreamParser::maximumBufferSize() const
+{
+    return m_maximumBufferSize;
+}
+
+/// Sets the maximum amount of input, in bytes, which is held while
+/// waiting for a stanza to complete.
+///
+/// The input is counted from the end of the last completed stanza once
+/// all the available input was parsed, so unlike maximumStanzaSize()
+/// this also catches a peer which never closes a tag, while a burst of
+/// complete stanzas is not limited. Like maximumStanzaSize(), the size
+/// is measured in decoded characters.
+///
+/// \param size
+
+void QXmppStreamParser::setMaximumBufferSize(int size)
+{
+    m_maximumBufferSize = size;
+}
+
+/// Returns the tag names of the top-level elements which are reported
+/// as RawStanza events.
+
+QSet<QString> QXmppStreamParser::rawTagNames() const
+{
+    return m_rawTagNames;
+}
+
+/// Sets the tag names of the top-level elements which are reported as
+/// RawStanza events instead of Stanza events.
+///
+/// Only elements in the stream's default namespace are concerned.
+///
+/// \param tagNames
+
+void QXmppStreamParser::setRawTagNames(const QSet<QString> &tagNames)
+{
+    m_rawTagNames = tagNames;
+}
+
+/// Processes the pending input until the next event is found.
+///
+/// Returns NoEvent once all available input has been consumed.
+
+QXmppStreamParser::Event QXmppStreamParser::readNext()
+{
+    if (m_exceededLimit != NoLimit)
+        return LimitExceeded;
+
+    while (true) {
+        const qint64 offset = m_reader.characterOffset();
+        const QXmlStreamReader::TokenType token = m_reader.readNext();
+
+        if (m_depth > 1 && m_maximumStanzaSize > 0 &&
+            m_reader.characterOffset() - m_stanzaOffset > m_maximumStanzaSize)
+            return exceed(StanzaSizeLimit);
+
+        switch (token) {
+        case QXmlStreamReader::StartElement:
+            if (m_maximumDepth > 0 && m_depth > m_maximumDepth)
+                return exceed(DepthLimit);
+            if (m_depth == 1) {
+                m_stanzaOffset = offset;
+                if (m_maximumStanzaSize > 0 &&
+                    m_reader.characterOffset() - m_stanzaOffset > m_maximumStanzaSize)
+                    return exceed(StanzaSizeLimit);
+            }
+
+            if (m_depth == 0) {
+                // stream start
+                QDomDocument document;
+                m_element = createElement(m_reader, document);
+                document.appendChild(m_element);
+                m_rootName = m_reader.qualifiedName().toString();
+                m_rootNamespace = m_reader.namespaceUri().toString();
+                m_rootNamespaceDeclarations = m_reader.namespaceDeclarations();
+                m_depth = 1;
+                m_stanzaEndOffset = m_reader.characterOffset();
+                return StreamStart;
+            } else if (m_rawActive) {
+                writeRawStartElement(false);
+                m_depth++;
+            } else if (m_depth == 1 && !m_rawTagNames.isEmpty() &&
+                       m_reader.prefix().isEmpty() &&
+                       m_rawTagNames.contains(m_reader.name().toString())) {
+                m_rawBuffer.buffer().clear();
+                m_rawBuffer.seek(0);
+                m_rawActive = true;
+                writeRawStartElement(true);
+                m_depth++;
+            } else {
+                flushText();
+                if (m_depth == 1) {
+                    // each stanza lives in its own document, below a copy
+                    // of the stream's root element so that namespace
+                    // lookups behave as they would for the whole stream
+                    QDomDocument document;
+                    m_current = document.createElementNS(m_rootNamespace, m_rootName);
+                    document.appendChild(m_current);
+                }
+                QDomDocument document = m_current.ownerDocument();
+                QDomElement element = createElement(m_reader, document);
+                m_current.appendChild(element);
+                m_current = element;
+                m_depth++;
+            }
+            break;
+
+        case QXmlStreamReader::EndElement:
+            m_depth--;
+            if (m_rawActive) {
+                m_rawWriter.writeEndElement();
+                if (m_depth == 1) {
+                    m_rawActive = false;
+                    m_element = QDomElement();
+                    m_stanzaEndOffset = m_reader.characterOffset();
+                    return RawStanza;
+                }
+                break;
+            }
+            flushText();
+            if (m_depth == 0) {
+                m_element = QDomElement();
+                return StreamEnd;
+            } else if (m_depth == 1) {
+                m_element = m_current;
+                m_current = QDomElement();
+                m_stanzaEndOffset = m_reader.characterOffset();
+                return Stanza;
+            }
+            m_current = m_current.parentNode().toElement();
+            break;
+
+        case QXmlStreamReader::Characters:
+            // character data between stanzas is not significant
+            if (m_depth <= 1)
+                m_stanzaEndOffset = m_reader.characterOffset();
+            else if (m_rawActive)
+                m_rawWriter.writeCharacters(m_reader.text().toString());
+            else if (m_depth > 1)
+                m_text += m_reader.text();
+            break;
+
+        case QXmlStreamReader::Invalid:
+            if (m_reader.error() != QXmlStreamReader::PrematureEndOfDocument)
+                return Error;
+
+            // all the input was parsed, what is left belongs to the
+            // stanza being received
+            if (m_maximumBufferSize > 0 &&
+                m_receivedCharacters - m_stanzaEndOffset > m_maximumBufferSize)
+                return exceed(BufferSizeLimit);
+            return NoEvent;
+
+        case QXmlStreamReader::EndDocument:
+            return NoEvent;
+
+        default:
+            break;
+        }
+    }
+}
+
+/// Reads the element at the reader's current StartElement into a DOM
+/// element, leaving the reader on the matching EndElement.
+///
+/// This allows code working on a QXmlStreamReader to hand over parts
+/// of a stanza to DOM-based parsers.
+///
+/// \param reader
+
+QDomElement QXmppStreamParser::readElement(QXmlStreamReader &reader)
+{
+    QDomDocument document;
+    QDomElement root = createElement(reader, document);
+    document.appendChild(root);
+
+    QDomElement current = root;
+    while (!reader.atEnd()) {
+        switch (reader.readNext()) {
+        case QXmlStreamReader::StartElement: {
+            QDomElement element = createElement(reader, document);
+            current.appendChild(element);
+            current = element;
+            break;
+        }
+        case QXmlStreamReader::EndElement:
+            if (current == root)
+                return root;
+            current = current.parentNode().toElement();
+            break;
+        case QXmlStreamReader::Characters:
+            if (!isWhitespace(reader.text().toString()))
+                current.appendChild(document.createTextNode(reader.text().toString()));
+            break;
+        default:
+            break;
+        }
+    }
+    return root;
+}
+
+QDomElement QXmppStreamParser::createElement(QXmlStreamReader &reader, QDomDocument &document)
+{
+    QDomElement element = document.createElementNS(
+        reader.namespaceUri().toString(),
+        reader.qualifiedName().toString());
+    foreach (const QXmlStreamAttribute &attr, reader.attributes())
+        element.setAttributeNS(attr.namespaceUri().toString(),
+                               attr.qualifiedName().toString(),
+                               attr.value().toString());
+    return element;
+}
+
+QXmppStreamParser::Event QXmppStreamParser::exceed(Limit limit)
+{
+    m_exceededLimit = limit;
+    m_current = QDomElement();
+    m_element = QDomElement();
+    m_text.clear();
+    return LimitExceeded;
+}
+
+void QXmppStreamParser::flushText()
+{
+    // text nodes consisting only of whitespace are stripped,
+    // as QDomDocument::setContent() does
+    if (m_text.isEmpty())
+        return;
+    if (!isWhitespace(m_text))
+        m_current.appendChild(m_current.ownerDocument().createTextNode(m_text));
+    m_text.clear();
+}
+
+void QXmppStreamParser::writeRawStartElement(bool topLevel)
+{
+    m_rawWriter.writeStartElement(m_reader.qualifiedName().toString());
+
+    QSet<QString> declared;
+    foreach (const QXmlStreamNamespaceDeclaration &ns, m_reader.namespaceDeclarations()) {
+        const QString prefix = ns.prefix().toString();
+        declared << prefix;
+        m_rawWriter.writeAttribute(prefix.isEmpty() ? QString("xmlns") : QString("xmlns:") + prefix,
+                                   ns.namespaceUri().toString());
+    }
+
+    // repeat the declarations inherited from the stream's root element,
+    // so that the fragment can be parsed on its own
+    if (topLevel) {
+        if (!declared.contains(QString()))
+            m_rawWriter.writeAttribute("xmlns", m_reader.namespaceUri().toString());
+        foreach (const QXmlStreamNamespaceDeclaration &ns, m_rootNamespaceDeclarations) {
+            const QString prefix = ns.prefix().toString();
+            if (prefix.isEmpty() || declared.contains(prefix) ||
+                ns.namespaceUri() == m_rootNamespace)
+                continue;
+            m_rawWriter.writeAttribute(QString("xmlns:") + prefix, ns.namespaceUri().toString());
+        }
+    }
+
+    foreach (const QXmlStreamAttribute &attr, m_reader.attributes())
+        m_rawWriter.writeAttribute(attr.qualifiedName().toString(), attr.value().toString());
+}
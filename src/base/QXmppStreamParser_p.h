@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef QXMPPSTREAMPARSER_P_H
+#define QXMPPSTREAMPARSER_P_H
+
+#include <QBuffer>
+#include <QDomElement>
+#include <QSet>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+
+#include "QXmppGlobal.h"
+
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QXmpp API.  It exists for the convenience
+// of the QXmppStream class.
+//
+// This header file may change from version to version without notice,
+// or even be removed.
+//
+// We mean it.
+//
+
+/// \brief The QXmppStreamParser class is an incremental parser for XMPP
+/// streams.
+///
+/// Data is pushed into the parser as it is read from the network, and
+/// the parser keeps its state between calls so that every byte is only
+/// parsed once. Each top-level stanza is reported exactly once, when its
+/// closing tag has been received.
+///
+/// Top-level elements whose tag name was registered with setRawTagNames()
+/// are not turned into a DOM tree. They are instead re-serialized to a
+/// self-contained XML fragment, which can be fed to a QXmlStreamReader.
+///
+/// The size and nesting depth of stanzas, as well as the amount of input
+/// held while waiting for a stanza to complete, can be limited. Limits
+/// are checked as data comes in, and crossing one of them is reported as
+/// a LimitExceeded event.
+
+class QXMPP_AUTOTEST_EXPORT QXmppStreamParser
+{
+public:
+    /// This enum describes the events reported by readNext().
+    enum Event
+    {
+        NoEvent = 0,    ///< More data is needed.
+        StreamStart,    ///< The stream's root element was opened.
+        Stanza,         ///< A top-level element was completed.
+        RawStanza,      ///< A top-level element was completed, without building a DOM tree.
+        StreamEnd,      ///< The stream's root element was closed.
+        Error,          ///< The data is not well-formed XML.
+        LimitExceeded   ///< The data exceeds one of the parser's limits.
+    };
+
+    /// This enum describes the limits enforced by the parser.
+    enum Limit
+    {
+        NoLimit = 0,        ///< No limit was exceeded.
+        StanzaSizeLimit,    ///< A stanza is larger than maximumStanzaSize().
+        DepthLimit,         ///< Elements are nested deeper than maximumDepth().
+        BufferSizeLimit     ///< Pending input is larger than maximumBufferSize().
+    };
+
+    QXmppStreamParser();
+
+    void addData(const QByteArray &data);
+    void clear();
+    Event readNext();
+
+    QDomElement element() const;
+    QByteArray rawStanza() const;
+    QString errorString() const;
+    bool hasError() const;
+    bool isInsideStanza() const;
+    Limit exceededLimit() const;
+
+    int maximumStanzaSize() const;
+    void setMaximumStanzaSize(int size);
+
+    int maximumDepth() const;
+    void setMaximumDepth(int depth);
+
+    int maximumBufferSize() const;
+    void setMaximumBufferSize(int size);
+
+    QSet<QString> rawTagNames() const;
+    void setRawTagNames(const QSet<QString> &tagNames);
+
+    static QDomElement readElement(QXmlStreamReader &reader);
+
+private:
+    Q_DISABLE_COPY(QXmppStreamParser)
+    static QDomElement createElement(QXmlStreamReader &reader, QDomDocument &document);
+    Event exceed(Limit limit);
+    void flushText();
+    void writeRawStartElement(bool topLevel);
+
+    QXmlStreamReader m_reader;
+    QDomElement m_current;
+    QDomElement m_element;
+    QString m_rootName;
+    QString m_rootNamespace;
+    QXmlStreamNamespaceDeclarations m_rootNamespaceDeclarations;
+    QString m_text;
+    int m_depth;
+
+    // limits
+    int m_maximumStanzaSize;
+    int m_maximumDepth;
+    int m_maximumBufferSize;
+    Limit m_exceededLimit;
+    qint64 m_receivedCharacters;
+    qint64 m_stanzaOffset;
+    qint64 m_stanzaEndOffset;
+
+    // raw stanzas
+    QSet<QString> m_rawTagNames;
+    QBuffer m_rawBuffer;
+    QXmlStreamWriter m_rawWriter;
+    bool m_rawActive;
+};
+
+#endif
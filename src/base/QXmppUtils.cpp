@@ -190,7 +190,9 @@ QString QXmppUtils::timezoneOffsetToString(int secs)
 
 QString QXmppUtils::jidToDomain(const QString &jid)
 {
-    return jidToBareJid(jid).split("@").last();
+    // the domain follows the last '@' of the bare JID
+    const QString bareJid = jidToBareJid(jid);
+    return bareJid.mid(bareJid.lastIndexOf(QLatin1Char('@')) + 1);
 }
 
 /// Returns the resource for the given \a jid.
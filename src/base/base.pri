@@ -11,6 +11,7 @@ INSTALL_HEADERS += \
     base/QXmppGlobal.h \
     base/QXmppIbbIq.h \
     base/QXmppIq.h \
+    base/QXmppJid.h \
     base/QXmppJingleIq.h \
     base/QXmppLogger.h \
     base/QXmppMamIq.h \
@@ -39,10 +40,15 @@ INSTALL_HEADERS += \
 
 HEADERS += \
     base/QXmppCodec_p.h \
+    base/QXmppCompressor_p.h \
     base/QXmppConstants_p.h \
+    base/QXmppDnsCache_p.h \
     base/QXmppSasl_p.h \
+    base/QXmppSocketConnector_p.h \
     base/QXmppStanza_p.h \
+    base/QXmppStanzaIndex_p.h \
     base/QXmppStreamInitiationIq_p.h \
+    base/QXmppStreamParser_p.h \
     base/QXmppStun_p.h
 
 # Source files
@@ -52,14 +58,17 @@ SOURCES += \
     base/QXmppBookmarkSet.cpp \
     base/QXmppByteStreamIq.cpp \
     base/QXmppCodec.cpp \
+    base/QXmppCompressor.cpp \
     base/QXmppConstants.cpp \
     base/QXmppDataForm.cpp \
     base/QXmppDiscoveryIq.cpp \
+    base/QXmppDnsCache.cpp \
     base/QXmppElement.cpp \
     base/QXmppEntityTimeIq.cpp \
     base/QXmppGlobal.cpp \
     base/QXmppIbbIq.cpp \
     base/QXmppIq.cpp \
+    base/QXmppJid.cpp \
     base/QXmppJingleIq.cpp \
     base/QXmppLogger.cpp \
     base/QXmppMamIq.cpp \
@@ -78,12 +87,15 @@ SOURCES += \
     base/QXmppRtpPacket.cpp \
     base/QXmppSasl.cpp \
     base/QXmppSessionIq.cpp \
+    base/QXmppSocketConnector.cpp \
     base/QXmppSocks.cpp \
     base/QXmppStanza.cpp \
+    base/QXmppStanzaIndex.cpp \
     base/QXmppStream.cpp \
     base/QXmppStreamFeatures.cpp \
     base/QXmppStreamInitiationIq.cpp \
     base/QXmppStreamManagement.cpp \
+    base/QXmppStreamParser.cpp \
     base/QXmppStun.cpp \
     base/QXmppUtils.cpp \
     base/QXmppVCardIq.cpp \
@@ -28,6 +28,13 @@
 #include "QXmppClient.h"
 #include "QXmppConstants_p.h"
 
+/// Constructs a QXmppArchiveManager.
+
+QXmppArchiveManager::QXmppArchiveManager()
+{
+    setHandledStanzaTags(QStringList() << "iq");
+}
+
 /// \cond
 QStringList QXmppArchiveManager::discoveryFeatures() const
 {
@@ -55,6 +55,8 @@ class QXMPP_EXPORT QXmppArchiveManager : public QXmppClientExtension
     Q_OBJECT
 
 public:
+    QXmppArchiveManager();
+
     void listCollections(const QString &jid, const QDateTime &start = QDateTime(), const QDateTime &end = QDateTime(),
                          const QXmppResultSetQuery &rsm = QXmppResultSetQuery());
     void listCollections(const QString &jid, const QDateTime &start, const QDateTime &end, int max);
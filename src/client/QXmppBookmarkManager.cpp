@@ -97,6 +97,9 @@ QXmppBookmarkManager::QXmppBookmarkManager()
     : d(new QXmppBookmarkManagerPrivate)
 {
     d->bookmarksReceived = false;
+
+    setHandledStanzaTags(QStringList() << "iq");
+    setHandledStanzaNamespaces(QStringList() << ns_private);
 }
 
 /// Destroys a bookmark manager.
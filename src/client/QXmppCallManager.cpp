@@ -721,6 +721,9 @@ QXmppCall *QXmppCallManagerPrivate::findCall(const QString &sid, QXmppCall::Dire
 QXmppCallManager::QXmppCallManager()
 {
     d = new QXmppCallManagerPrivate(this);
+
+    setHandledStanzaTags(QStringList() << "iq");
+    setHandledStanzaNamespaces(QStringList() << ns_jingle);
 }
 
 /// Destroys the QXmppCallManager object.
@@ -34,7 +34,8 @@
 QXmppCarbonManager::QXmppCarbonManager()
     : m_carbonsEnabled(false)
 {
-
+    setHandledStanzaTags(QStringList() << "message");
+    setHandledStanzaNamespaces(QStringList() << ns_carbons);
 }
 
 QXmppCarbonManager::~QXmppCarbonManager()
@@ -38,6 +38,7 @@
 #include "QXmppEntityTimeManager.h"
 #include "QXmppDiscoveryManager.h"
 #include "QXmppDiscoveryIq.h"
+#include "QXmppStanzaIndex_p.h"
 
 class QXmppClientPrivate
 {
@@ -46,6 +47,7 @@ public:
 
     QXmppPresence clientPresence;                   ///< Current presence of the client
     QList<QXmppClientExtension*> extensions;
+    QXmppStanzaIndex extensionIndex;
     QXmppLogger *logger;
     QXmppOutgoingClient *stream;                    ///< Pointer to the XMPP stream
 
@@ -55,7 +57,10 @@ public:
     QTimer *reconnectionTimer;
 
     void addProperCapability(QXmppPresence& presence);
+    void invalidateCapabilities();
     int getNextReconnectTime() const;
+    void updateExtensionIndex();
+    void updateRawStanzaTagNames();
 
 private:
     QXmppClient *q;
@@ -78,10 +83,18 @@ void QXmppClientPrivate::addProperCapability(QXmppPresence& presence)
     if(ext) {
         presence.setCapabilityHash("sha-1");
         presence.setCapabilityNode(ext->clientCapabilitiesNode());
-        presence.setCapabilityVer(ext->capabilities().verificationString());
+        presence.setCapabilityVer(ext->capabilitiesVerificationString());
     }
 }
 
+void QXmppClientPrivate::invalidateCapabilities()
+{
+    // the features and identities advertised depend on the extensions
+    QXmppDiscoveryManager* ext = q->findExtension<QXmppDiscoveryManager>();
+    if (ext)
+        ext->invalidateCapabilities();
+}
+
 int QXmppClientPrivate::getNextReconnectTime() const
 {
     if (reconnectionTries < 5)
@@ -94,6 +107,28 @@ int QXmppClientPrivate::getNextReconnectTime() const
         return 60 * 1000;
 }
 
+void QXmppClientPrivate::updateExtensionIndex()
+{
+    extensionIndex.clear();
+    for (int i = 0; i < extensions.size(); ++i) {
+        QXmppClientExtension *extension = extensions.at(i);
+        extensionIndex.addHandler(i, extension->handledStanzaTags(), extension->handledStanzaNamespaces());
+    }
+}
+
+void QXmppClientPrivate::updateRawStanzaTagNames()
+{
+    // messages and presences which no extension asks for are parsed
+    // directly from the stream, bypassing the DOM
+    QStringList tagNames;
+    tagNames << "message" << "presence";
+    foreach (QXmppClientExtension *extension, extensions) {
+        foreach (const QString &tagName, extension->handledStanzaTags())
+            tagNames.removeAll(tagName);
+    }
+    stream->setRawStanzaTagNames(tagNames);
+}
+
 /// Creates a QXmppClient object.
 /// \param parent is passed to the QObject's constructor.
 /// The default value is 0.
@@ -128,7 +163,7 @@ QXmppClient::QXmppClient(QObject *parent)
                     this, SIGNAL(sslErrors(QList<QSslError>)));
     Q_ASSERT(check);
 
-    check = connect(d->stream->socket(), SIGNAL(stateChanged(QAbstractSocket::SocketState)),
+    check = connect(d->stream, SIGNAL(socketStateChanged(QAbstractSocket::SocketState)),
                     this, SLOT(_q_socketStateChanged(QAbstractSocket::SocketState)));
     Q_ASSERT(check);
 
@@ -194,6 +229,9 @@ bool QXmppClient::insertExtension(int index, QXmppClientExtension *extension)
     extension->setParent(this);
     extension->setClient(this);
     d->extensions.insert(index, extension);
+    d->updateExtensionIndex();
+    d->updateRawStanzaTagNames();
+    d->invalidateCapabilities();
     return true;
 }
 
@@ -208,6 +246,9 @@ bool QXmppClient::removeExtension(QXmppClientExtension* extension)
     {
         d->extensions.removeAll(extension);
         delete extension;
+        d->updateExtensionIndex();
+        d->updateRawStanzaTagNames();
+        d->invalidateCapabilities();
         return true;
     } else {
         qWarning("Cannot remove extension, it was never added");
@@ -246,6 +287,8 @@ void QXmppClient::connectToServer(const QXmppConfiguration& config,
     d->clientPresence = initialPresence;
     d->addProperCapability(d->clientPresence);
 
+    // the logger may have been reconfigured since it was set
+    d->stream->setLoggedMessageTypes(QXmppLogger::loggedMessageTypes(d->logger));
     d->stream->connectToHost();
 }
 
@@ -320,6 +363,14 @@ bool QXmppClient::isConnected() const
     return d->stream->isConnected();
 }
 
+/// Returns true if the server supports roster versioning (XEP-0237).
+///
+
+bool QXmppClient::isRosterVersioningSupported() const
+{
+    return d->stream->isRosterVersioningSupported();
+}
+
 /// Returns the reference to QXmppRosterManager object of the client.
 /// \return Reference to the roster object of the connected client. Use this to
 /// get the list of friends in the roster and their presence information.
@@ -360,8 +411,8 @@ QXmppClient::State QXmppClient::state() const
 {
     if (d->stream->isConnected())
         return QXmppClient::ConnectedState;
-    else if (d->stream->socket()->state() != QAbstractSocket::UnconnectedState &&
-             d->stream->socket()->state() != QAbstractSocket::ClosingState)
+    else if (d->stream->socketState() != QAbstractSocket::UnconnectedState &&
+             d->stream->socketState() != QAbstractSocket::ClosingState)
         return QXmppClient::ConnectingState;
     else
         return QXmppClient::DisconnectedState;
@@ -460,9 +511,11 @@ QXmppVersionManager& QXmppClient::versionManager()
 
 void QXmppClient::_q_elementReceived(const QDomElement &element, bool &handled)
 {
-    foreach (QXmppClientExtension *extension, d->extensions)
+    // only offer the stanza to the extensions which may handle it
+    const QList<int> candidates = d->extensionIndex.handlers(element);
+    foreach (int index, candidates)
     {
-        if (extension->handleStanza(element))
+        if (d->extensions.at(index)->handleStanza(element))
         {
             handled = true;
             return;
@@ -557,6 +610,7 @@ void QXmppClient::setLogger(QXmppLogger *logger)
             connect(this, SIGNAL(updateCounter(QString,qint64)),
                     d->logger, SLOT(updateCounter(QString,qint64)));
         }
+        d->stream->setLoggedMessageTypes(QXmppLogger::loggedMessageTypes(d->logger));
 
         emit loggerChanged(d->logger);
     }
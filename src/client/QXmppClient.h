@@ -139,6 +139,7 @@ public:
 
     bool isAuthenticated() const;
     bool isConnected() const;
+    bool isRosterVersioningSupported() const;
 
     QXmppPresence clientPresence() const;
     void setClientPresence(const QXmppPresence &presence);
@@ -29,6 +29,8 @@ class QXmppClientExtensionPrivate
 {
 public:
     QXmppClient *client;
+    QStringList handledStanzaTags;
+    QStringList handledStanzaNamespaces;
 };
 
 /// Constructs a QXmppClient extension.
@@ -38,6 +40,7 @@ QXmppClientExtension::QXmppClientExtension()
     : d(new QXmppClientExtensionPrivate)
 {
     d->client = 0;
+    d->handledStanzaTags << "message" << "presence" << "iq";
 }
 
 /// Destroys a QXmppClient extension.
@@ -56,6 +59,59 @@ QStringList QXmppClientExtension::discoveryFeatures() const
     return QStringList();
 }
 
+/// Returns the tag names of the stanzas this extension wants to see in
+/// handleStanza().
+///
+/// By default the extension sees all stanzas.
+
+QStringList QXmppClientExtension::handledStanzaTags() const
+{
+    return d->handledStanzaTags;
+}
+
+/// Sets the tag names of the stanzas this extension wants to see in
+/// handleStanza().
+///
+/// Incoming messages and presences which no extension asks for are
+/// parsed directly from the stream, without building a DOM tree, so
+/// call this if your extension only handles some kinds of stanzas.
+///
+/// The value is read when the extension is added to the client, so this
+/// should be called from the extension's constructor.
+///
+/// \param tags
+
+void QXmppClientExtension::setHandledStanzaTags(const QStringList &tags)
+{
+    d->handledStanzaTags = tags;
+}
+
+/// Returns the namespaces of the stanza payloads this extension handles.
+///
+/// By default the list is empty, meaning the extension sees all the
+/// stanzas whose tag names are listed in handledStanzaTags().
+
+QStringList QXmppClientExtension::handledStanzaNamespaces() const
+{
+    return d->handledStanzaNamespaces;
+}
+
+/// Sets the namespaces of the stanza payloads this extension handles.
+///
+/// QXmppClient only passes a stanza to handleStanza() if one of its child
+/// elements is in one of these namespaces, with the exception of errors
+/// and stanzas without any child element, which are always passed on.
+///
+/// The value is read when the extension is added to the client, so this
+/// should be called from the extension's constructor.
+///
+/// \param namespaces
+
+void QXmppClientExtension::setHandledStanzaNamespaces(const QStringList &namespaces)
+{
+    d->handledStanzaNamespaces = namespaces;
+}
+
 /// Returns the discovery identities to add to the client.
 ///
 
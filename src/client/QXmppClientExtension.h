@@ -63,10 +63,16 @@ public:
     /// the stanza.
     virtual bool handleStanza(const QDomElement &stanza) = 0;
 
+    QStringList handledStanzaTags() const;
+    QStringList handledStanzaNamespaces() const;
+
 protected:
     QXmppClient *client();
     virtual void setClient(QXmppClient *client);
 
+    void setHandledStanzaTags(const QStringList &tags);
+    void setHandledStanzaNamespaces(const QStringList &namespaces);
+
 private:
     QXmppClientExtensionPrivate * const d;
 
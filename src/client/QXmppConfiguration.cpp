@@ -74,6 +74,10 @@ public:
     QNetworkProxy networkProxy;
 
     QList<QSslCertificate> caCertificates;
+
+    // zlib level, if zero won't compress the stream
+    int streamCompressionLevel;
+    int streamCompressionMemoryLevel;
 };
 
 QXmppConfigurationPrivate::QXmppConfigurationPrivate()
@@ -91,6 +95,8 @@ QXmppConfigurationPrivate::QXmppConfigurationPrivate()
     , streamSecurityMode(QXmppConfiguration::TLSEnabled)
     , nonSASLAuthMechanism(QXmppConfiguration::NonSASLDigest)
     , saslAuthMechanism("DIGEST-MD5")
+    , streamCompressionLevel(0)
+    , streamCompressionMemoryLevel(8)
 {
 }
 
@@ -596,3 +602,44 @@ QList<QSslCertificate> QXmppConfiguration::caCertificates() const
 {
     return d->caCertificates;
 }
+
+/// Returns the zlib level used to compress the stream (XEP-0138).
+///
+/// The default value is 0, meaning the stream is not compressed.
+
+int QXmppConfiguration::streamCompressionLevel() const
+{
+    return d->streamCompressionLevel;
+}
+
+/// Specifies the zlib level used to compress the stream (XEP-0138), from
+/// 1 (fastest) to 9 (smallest).
+///
+/// If set to zero, or if the server does not offer zlib compression, the
+/// stream is not compressed. Compression is only available if QXmpp was
+/// built with zlib support.
+
+void QXmppConfiguration::setStreamCompressionLevel(int level)
+{
+    d->streamCompressionLevel = level;
+}
+
+/// Returns the zlib memory level used to compress the stream (XEP-0138).
+///
+/// The default value is 8.
+
+int QXmppConfiguration::streamCompressionMemoryLevel() const
+{
+    return d->streamCompressionMemoryLevel;
+}
+
+/// Specifies the zlib memory level used to compress the stream
+/// (XEP-0138), from 1 to 9.
+///
+/// Lower values use less memory per stream at the expense of the
+/// compression ratio.
+
+void QXmppConfiguration::setStreamCompressionMemoryLevel(int level)
+{
+    d->streamCompressionMemoryLevel = level;
+}
@@ -150,6 +150,12 @@ public:
     QList<QSslCertificate> caCertificates() const;
     void setCaCertificates(const QList<QSslCertificate> &);
 
+    int streamCompressionLevel() const;
+    void setStreamCompressionLevel(int level);
+
+    int streamCompressionMemoryLevel() const;
+    void setStreamCompressionMemoryLevel(int level);
+
 private:
     QSharedDataPointer<QXmppConfigurationPrivate> d;
 };
@@ -23,28 +23,283 @@
 
 #include "QXmppDiscoveryManager.h"
 
+#include <QDateTime>
+#include <QDir>
+#include <QDomDocument>
 #include <QDomElement>
 #include <QCoreApplication>
+#include <QFile>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+#include <QXmlStreamWriter>
 
 #include "QXmppClient.h"
 #include "QXmppConstants_p.h"
 #include "QXmppDataForm.h"
 #include "QXmppDiscoveryIq.h"
+#include "QXmppPresence.h"
 #include "QXmppStream.h"
 #include "QXmppGlobal.h"
 
+// seconds after which an unanswered capabilities request is retried
+// with the next entity advertising the same capabilities
+static const int capabilitiesRequestTimeout = 30;
+
+class QXmppCapabilitiesRequest
+{
+public:
+    QString id;
+    QString jid;
+    QString node;
+    QDateTime stamp;
+
+    // entities waiting for the response
+    QSet<QString> jids;
+};
+
 class QXmppDiscoveryManagerPrivate
 {
 public:
+    QXmppDiscoveryManagerPrivate(QXmppDiscoveryManager *qq);
+    bool findCapabilities(const QByteArray &ver, QXmppDiscoveryIq &info);
+    void storeCapabilities(const QByteArray &ver, const QXmppDiscoveryIq &info);
+    QString capabilitiesFileName(const QByteArray &ver) const;
+    void updateLocalCapabilities();
+    void requestCapabilities(const QByteArray &ver, QXmppCapabilitiesRequest &request, const QString &jid);
+    void handleCapabilities(const QXmppDiscoveryIq &iq);
+    void failCapabilities(QHash<QByteArray, QXmppCapabilitiesRequest>::iterator it);
+    void scheduleCapabilitiesTimeout();
+
     QString clientCapabilitiesNode;
     QString clientCategory;
     QString clientType;
     QString clientName;
     QXmppDataForm clientInfoForm;
+
+    // the local client's capabilities, built on first use
+    QXmppDiscoveryIq localCapabilities;
+    QByteArray localVerificationString;
+    bool localCapabilitiesValid;
+
+    // XEP-0115 capabilities cache, indexed by verification string
+    bool capabilitiesCacheEnabled;
+    QString capabilitiesCachePath;
+    QHash<QByteArray, QXmppDiscoveryIq> capabilities;
+    QHash<QByteArray, QXmppCapabilitiesRequest> capabilitiesRequests;
+    QHash<QString, QByteArray> capabilitiesRequestIds;
+    QTimer *capabilitiesTimer;
+
+private:
+    QXmppDiscoveryManager *q;
 };
 
+QXmppDiscoveryManagerPrivate::QXmppDiscoveryManagerPrivate(QXmppDiscoveryManager *qq)
+    : localCapabilitiesValid(false)
+    , capabilitiesCacheEnabled(false)
+    , capabilitiesTimer(0)
+    , q(qq)
+{
+}
+
+bool QXmppDiscoveryManagerPrivate::findCapabilities(const QByteArray &ver, QXmppDiscoveryIq &info)
+{
+    if (localCapabilitiesValid && ver == localVerificationString) {
+        info = localCapabilities;
+        return true;
+    }
+
+    QHash<QByteArray, QXmppDiscoveryIq>::const_iterator it = capabilities.constFind(ver);
+    if (it != capabilities.constEnd()) {
+        info = it.value();
+        return true;
+    }
+
+    // fall back to the capabilities stored on disk
+    if (capabilitiesCachePath.isEmpty())
+        return false;
+    QFile file(capabilitiesFileName(ver));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDomDocument doc;
+    if (doc.setContent(&file, true)) {
+        info.parse(doc.documentElement());
+        if (info.verificationString() == ver) {
+            capabilities.insert(ver, info);
+            return true;
+        }
+    }
+
+    // the file is corrupt or was tampered with
+    q->warning(QString("Discarding invalid capabilities from %1").arg(file.fileName()));
+    file.remove();
+    return false;
+}
+
+void QXmppDiscoveryManagerPrivate::storeCapabilities(const QByteArray &ver, const QXmppDiscoveryIq &info)
+{
+    capabilities.insert(ver, info);
+    if (capabilitiesCachePath.isEmpty() || !QDir().mkpath(capabilitiesCachePath))
+        return;
+
+    QFile file(capabilitiesFileName(ver));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        q->warning(QString("Could not write capabilities to %1").arg(file.fileName()));
+        return;
+    }
+    QXmlStreamWriter writer(&file);
+    info.toXml(&writer);
+}
+
+QString QXmppDiscoveryManagerPrivate::capabilitiesFileName(const QByteArray &ver) const
+{
+    return QDir(capabilitiesCachePath).filePath(QString::fromLatin1(ver.toHex()) + QLatin1String(".xml"));
+}
+
+void QXmppDiscoveryManagerPrivate::requestCapabilities(const QByteArray &ver, QXmppCapabilitiesRequest &request, const QString &jid)
+{
+    QXmppDiscoveryIq iq;
+    iq.setType(QXmppIq::Get);
+    iq.setQueryType(QXmppDiscoveryIq::InfoQuery);
+    iq.setTo(jid);
+    iq.setQueryNode(request.node + QLatin1Char('#') + QString::fromLatin1(ver.toBase64()));
+
+    capabilitiesRequestIds.remove(request.id);
+    request.id = iq.id();
+    request.jid = jid;
+    request.stamp = QDateTime::currentDateTime();
+    capabilitiesRequestIds.insert(request.id, ver);
+    q->client()->sendPacket(iq);
+    scheduleCapabilitiesTimeout();
+}
+
+void QXmppDiscoveryManagerPrivate::handleCapabilities(const QXmppDiscoveryIq &iq)
+{
+    const QByteArray ver = capabilitiesRequestIds.take(iq.id());
+    QHash<QByteArray, QXmppCapabilitiesRequest>::iterator it = capabilitiesRequests.find(ver);
+    if (it == capabilitiesRequests.end())
+        return;
+
+    QXmppCapabilitiesRequest &request = it.value();
+    request.jids.remove(request.jid);
+    if (iq.type() == QXmppIq::Result && iq.verificationString() == ver) {
+        // only keep the information which is covered by the hash
+        QXmppDiscoveryIq info;
+        info.setType(QXmppIq::Result);
+        info.setQueryType(QXmppDiscoveryIq::InfoQuery);
+        info.setIdentities(iq.identities());
+        info.setFeatures(iq.features());
+        info.setForm(iq.form());
+        storeCapabilities(ver, info);
+
+        const QString jid = request.jid;
+        const QSet<QString> jids = request.jids;
+        capabilitiesRequests.erase(it);
+
+        emit q->capabilitiesReceived(jid, info);
+        foreach (const QString &waiting, jids)
+            emit q->capabilitiesReceived(waiting, info);
+        return;
+    }
+
+    if (iq.type() == QXmppIq::Result) {
+        q->warning(QString("Capabilities of %1 do not match their verification string").arg(iq.from()));
+        q->updateCounter("capabilities-cache.invalid", 1);
+    }
+
+    failCapabilities(it);
+}
+
+/// Gives up on the entity the given capabilities request was sent to, and
+/// asks the next entity advertising the same capabilities.
+
+void QXmppDiscoveryManagerPrivate::failCapabilities(QHash<QByteArray, QXmppCapabilitiesRequest>::iterator it)
+{
+    QXmppCapabilitiesRequest &request = it.value();
+    request.jids.remove(request.jid);
+    if (request.jids.isEmpty()) {
+        capabilitiesRequestIds.remove(request.id);
+        capabilitiesRequests.erase(it);
+    } else {
+        requestCapabilities(it.key(), request, *request.jids.constBegin());
+    }
+}
+
+/// Starts the timer for the oldest pending capabilities request.
+
+void QXmppDiscoveryManagerPrivate::scheduleCapabilitiesTimeout()
+{
+    if (capabilitiesRequests.isEmpty()) {
+        capabilitiesTimer->stop();
+        return;
+    }
+
+    QDateTime oldest = capabilitiesRequests.constBegin()->stamp;
+    foreach (const QXmppCapabilitiesRequest &request, capabilitiesRequests)
+        oldest = qMin(oldest, request.stamp);
+
+    const qint64 remaining = qint64(capabilitiesRequestTimeout) * 1000 - oldest.msecsTo(QDateTime::currentDateTime());
+    capabilitiesTimer->start(int(qMax(qint64(0), remaining)));
+}
+
+void QXmppDiscoveryManagerPrivate::updateLocalCapabilities()
+{
+    if (localCapabilitiesValid)
+        return;
+
+    QXmppDiscoveryIq iq;
+    iq.setType(QXmppIq::Result);
+    iq.setQueryType(QXmppDiscoveryIq::InfoQuery);
+
+    // features
+    QStringList features;
+    features
+        << ns_data              // XEP-0004: Data Forms
+        << ns_rsm               // XEP-0059: Result Set Management
+        << ns_xhtml_im          // XEP-0071: XHTML-IM
+        << ns_chat_states       // XEP-0085: Chat State Notifications
+        << ns_capabilities      // XEP-0115: Entity Capabilities
+        << ns_ping              // XEP-0199: XMPP Ping
+        << ns_attention         // XEP-0224: Attention
+        << ns_chat_markers;     // XEP-0333: Chat Markers
+
+    foreach(QXmppClientExtension* extension, q->client()->extensions())
+    {
+        if(extension)
+            features << extension->discoveryFeatures();
+    }
+
+    iq.setFeatures(features);
+
+    // identities
+    QList<QXmppDiscoveryIq::Identity> identities;
+
+    QXmppDiscoveryIq::Identity identity;
+    identity.setCategory(clientCategory);
+    identity.setType(clientType);
+    identity.setName(clientName);
+    identities << identity;
+
+    foreach(QXmppClientExtension* extension, q->client()->extensions())
+    {
+        if(extension)
+            identities << extension->discoveryIdentities();
+    }
+
+    iq.setIdentities(identities);
+
+    // extended information
+    if (!clientInfoForm.isNull())
+        iq.setForm(clientInfoForm);
+
+    localCapabilities = iq;
+    localVerificationString = iq.verificationString();
+    localCapabilitiesValid = true;
+}
+
 QXmppDiscoveryManager::QXmppDiscoveryManager()
-    : d(new QXmppDiscoveryManagerPrivate)
+    : d(new QXmppDiscoveryManagerPrivate(this))
 {
     d->clientCapabilitiesNode = "https://github.com/qxmpp-project/qxmpp";
     d->clientCategory = "client";
@@ -53,6 +308,18 @@ QXmppDiscoveryManager::QXmppDiscoveryManager()
         d->clientName = QString("%1 %2").arg("Based on QXmpp", QXmppVersion());
     else
         d->clientName = QString("%1 %2").arg(qApp->applicationName(), qApp->applicationVersion());
+
+    bool check;
+    Q_UNUSED(check);
+
+    d->capabilitiesTimer = new QTimer(this);
+    d->capabilitiesTimer->setSingleShot(true);
+    check = connect(d->capabilitiesTimer, SIGNAL(timeout()),
+                    this, SLOT(_q_capabilitiesTimeout()));
+    Q_ASSERT(check);
+
+    setHandledStanzaTags(QStringList() << "iq");
+    setHandledStanzaNamespaces(QStringList() << ns_disco_info << ns_disco_items);
 }
 
 QXmppDiscoveryManager::~QXmppDiscoveryManager()
@@ -99,55 +366,29 @@ QString QXmppDiscoveryManager::requestItems(const QString& jid, const QString& n
 }
 
 /// Returns the client's full capabilities.
+///
+/// The capabilities are only collected from the client's extensions again
+/// after an extension was added or removed, or the client's identity or
+/// information form changed.
 
 QXmppDiscoveryIq QXmppDiscoveryManager::capabilities()
 {
-    QXmppDiscoveryIq iq;
-    iq.setType(QXmppIq::Result);
-    iq.setQueryType(QXmppDiscoveryIq::InfoQuery);
-
-    // features
-    QStringList features;
-    features
-        << ns_data              // XEP-0004: Data Forms
-        << ns_rsm               // XEP-0059: Result Set Management
-        << ns_xhtml_im          // XEP-0071: XHTML-IM
-        << ns_chat_states       // XEP-0085: Chat State Notifications
-        << ns_capabilities      // XEP-0115: Entity Capabilities
-        << ns_ping              // XEP-0199: XMPP Ping
-        << ns_attention         // XEP-0224: Attention
-        << ns_chat_markers;     // XEP-0333: Chat Markers
-
-    foreach(QXmppClientExtension* extension, client()->extensions())
-    {
-        if(extension)
-            features << extension->discoveryFeatures();
-    }
-
-    iq.setFeatures(features);
-
-    // identities
-    QList<QXmppDiscoveryIq::Identity> identities;
-
-    QXmppDiscoveryIq::Identity identity;
-    identity.setCategory(clientCategory());
-    identity.setType(clientType());
-    identity.setName(clientName());
-    identities << identity;
-
-    foreach(QXmppClientExtension* extension, client()->extensions())
-    {
-        if(extension)
-            identities << extension->discoveryIdentities();
-    }
+    d->updateLocalCapabilities();
+    return d->localCapabilities;
+}
 
-    iq.setIdentities(identities);
+/// Returns the verification string of the client's capabilities,
+/// as defined by XEP-0115: Entity Capabilities.
 
-    // extended information
-    if (!d->clientInfoForm.isNull())
-        iq.setForm(d->clientInfoForm);
+QByteArray QXmppDiscoveryManager::capabilitiesVerificationString()
+{
+    d->updateLocalCapabilities();
+    return d->localVerificationString;
+}
 
-    return iq;
+void QXmppDiscoveryManager::invalidateCapabilities()
+{
+    d->localCapabilitiesValid = false;
 }
 
 /// Sets the capabilities node of the local XMPP client.
@@ -169,6 +410,7 @@ void QXmppDiscoveryManager::setClientCapabilitiesNode(const QString &node)
 void QXmppDiscoveryManager::setClientCategory(const QString& category)
 {
     d->clientCategory = category;
+    d->localCapabilitiesValid = false;
 }
 
 /// Sets the type of the local XMPP client.
@@ -181,6 +423,7 @@ void QXmppDiscoveryManager::setClientCategory(const QString& category)
 void QXmppDiscoveryManager::setClientType(const QString& type)
 {
     d->clientType = type;
+    d->localCapabilitiesValid = false;
 }
 
 /// Sets the name of the local XMPP client.
@@ -190,6 +433,7 @@ void QXmppDiscoveryManager::setClientType(const QString& type)
 void QXmppDiscoveryManager::setClientName(const QString& name)
 {
     d->clientName = name;
+    d->localCapabilitiesValid = false;
 }
 
 /// Returns the capabilities node of the local XMPP client.
@@ -242,6 +486,75 @@ QXmppDataForm QXmppDiscoveryManager::clientInfoForm() const
 void QXmppDiscoveryManager::setClientInfoForm(const QXmppDataForm &form)
 {
     d->clientInfoForm = form;
+    d->localCapabilitiesValid = false;
+}
+
+/// Returns true if the capabilities advertised in received presences
+/// are resolved and cached (XEP-0115).
+
+bool QXmppDiscoveryManager::isCapabilitiesCacheEnabled() const
+{
+    return d->capabilitiesCacheEnabled;
+}
+
+/// Sets whether the capabilities advertised in received presences
+/// should be resolved and cached (XEP-0115).
+///
+/// The default value is false.
+///
+/// \param enabled
+
+void QXmppDiscoveryManager::setCapabilitiesCacheEnabled(bool enabled)
+{
+    d->capabilitiesCacheEnabled = enabled;
+}
+
+/// Returns the directory in which the capabilities cache is persisted.
+
+QString QXmppDiscoveryManager::capabilitiesCachePath() const
+{
+    return d->capabilitiesCachePath;
+}
+
+/// Sets the directory in which the capabilities cache is persisted.
+///
+/// If the path is empty, which is the default, capabilities are only
+/// cached in memory.
+///
+/// \param path
+
+void QXmppDiscoveryManager::setCapabilitiesCachePath(const QString &path)
+{
+    d->capabilitiesCachePath = path;
+}
+
+/// Returns true if the capabilities with the given verification string
+/// are cached.
+///
+/// \param ver
+
+bool QXmppDiscoveryManager::hasCachedCapabilities(const QByteArray &ver)
+{
+    QXmppDiscoveryIq info;
+    return d->findCapabilities(ver, info);
+}
+
+/// Returns the cached capabilities with the given verification string.
+///
+/// If the capabilities are not cached, an information response without
+/// identities nor features is returned.
+///
+/// \param ver
+
+QXmppDiscoveryIq QXmppDiscoveryManager::cachedCapabilities(const QByteArray &ver)
+{
+    QXmppDiscoveryIq info;
+    if (!d->findCapabilities(ver, info)) {
+        info = QXmppDiscoveryIq();
+        info.setType(QXmppIq::Result);
+        info.setQueryType(QXmppDiscoveryIq::InfoQuery);
+    }
+    return info;
 }
 
 /// \cond
@@ -277,6 +590,12 @@ bool QXmppDiscoveryManager::handleStanza(const QDomElement &element)
 
         case QXmppIq::Result:
         case QXmppIq::Error:
+            // handle replies to capabilities requests
+            if (d->capabilitiesRequestIds.contains(receivedIq.id())) {
+                d->handleCapabilities(receivedIq);
+                return true;
+            }
+
             // handle all replies
             if (receivedIq.queryType() == QXmppDiscoveryIq::InfoQuery) {
                 emit infoReceived(receivedIq);
@@ -292,4 +611,75 @@ bool QXmppDiscoveryManager::handleStanza(const QDomElement &element)
     }
     return false;
 }
+
+void QXmppDiscoveryManager::setClient(QXmppClient *client)
+{
+    bool check;
+    Q_UNUSED(check);
+
+    QXmppClientExtension::setClient(client);
+
+    check = connect(client, SIGNAL(disconnected()),
+                    this, SLOT(_q_disconnected()));
+    Q_ASSERT(check);
+
+    check = connect(client, SIGNAL(presenceReceived(QXmppPresence)),
+                    this, SLOT(_q_presenceReceived(QXmppPresence)));
+    Q_ASSERT(check);
+}
 /// \endcond
+
+void QXmppDiscoveryManager::_q_disconnected()
+{
+    d->capabilitiesRequests.clear();
+    d->capabilitiesRequestIds.clear();
+    d->capabilitiesTimer->stop();
+}
+
+void QXmppDiscoveryManager::_q_presenceReceived(const QXmppPresence &presence)
+{
+    const QByteArray ver = presence.capabilityVer();
+    if (!d->capabilitiesCacheEnabled ||
+        presence.type() != QXmppPresence::Available ||
+        presence.capabilityHash() != QLatin1String("sha-1") ||
+        presence.capabilityNode().isEmpty() || ver.isEmpty())
+        return;
+
+    const QString jid = presence.from();
+    QXmppDiscoveryIq info;
+    if (d->findCapabilities(ver, info)) {
+        updateCounter("capabilities-cache.hits", 1);
+        emit capabilitiesReceived(jid, info);
+        return;
+    }
+
+    // only one request is sent for any given verification string
+    QHash<QByteArray, QXmppCapabilitiesRequest>::iterator it = d->capabilitiesRequests.find(ver);
+    if (it != d->capabilitiesRequests.end()) {
+        QXmppCapabilitiesRequest &request = it.value();
+        if (jid != request.jid)
+            request.jids.insert(jid);
+        updateCounter("capabilities-cache.coalesced", 1);
+        return;
+    }
+
+    updateCounter("capabilities-cache.misses", 1);
+    QXmppCapabilitiesRequest request;
+    request.node = presence.capabilityNode();
+    it = d->capabilitiesRequests.insert(ver, request);
+    d->requestCapabilities(ver, it.value(), jid);
+}
+
+void QXmppDiscoveryManager::_q_capabilitiesTimeout()
+{
+    const QDateTime now = QDateTime::currentDateTime();
+    foreach (const QByteArray &ver, d->capabilitiesRequests.keys()) {
+        QHash<QByteArray, QXmppCapabilitiesRequest>::iterator it = d->capabilitiesRequests.find(ver);
+        if (it.value().stamp.msecsTo(now) >= qint64(capabilitiesRequestTimeout) * 1000) {
+            warning(QString("Capabilities request to %1 timed out").arg(it.value().jid));
+            updateCounter("capabilities-cache.timeouts", 1);
+            d->failCapabilities(it);
+        }
+    }
+    d->scheduleCapabilitiesTimeout();
+}
@@ -29,10 +29,20 @@
 class QXmppDataForm;
 class QXmppDiscoveryIq;
 class QXmppDiscoveryManagerPrivate;
+class QXmppPresence;
 
 /// \brief The QXmppDiscoveryManager class makes it possible to discover information
 /// about other entities as defined by XEP-0030: Service Discovery.
 ///
+/// If the capabilities cache is enabled using setCapabilitiesCacheEnabled(),
+/// the manager also resolves the entity capabilities (XEP-0115) advertised in
+/// received presences. A single information request is sent for each
+/// verification string, and the response is only cached once it was checked
+/// against the verification string. If the entity does not answer within
+/// 30 seconds, the request is sent to another entity advertising the same
+/// verification string. The capabilitiesReceived() signal is emitted for
+/// each entity whose capabilities are known.
+///
 /// \ingroup Managers
 
 class QXMPP_EXPORT QXmppDiscoveryManager : public QXmppClientExtension
@@ -44,6 +54,7 @@ public:
     ~QXmppDiscoveryManager();
 
     QXmppDiscoveryIq capabilities();
+    QByteArray capabilitiesVerificationString();
 
     QString requestInfo(const QString& jid, const QString& node = QString());
     QString requestItems(const QString& jid, const QString& node = QString());
@@ -64,6 +75,15 @@ public:
     QXmppDataForm clientInfoForm() const;
     void setClientInfoForm(const QXmppDataForm &form);
 
+    bool isCapabilitiesCacheEnabled() const;
+    void setCapabilitiesCacheEnabled(bool enabled);
+
+    QString capabilitiesCachePath() const;
+    void setCapabilitiesCachePath(const QString &path);
+
+    bool hasCachedCapabilities(const QByteArray &ver);
+    QXmppDiscoveryIq cachedCapabilities(const QByteArray &ver);
+
     /// \cond
     QStringList discoveryFeatures() const;
     bool handleStanza(const QDomElement &element);
@@ -76,8 +96,27 @@ signals:
     /// This signal is emitted when an items response is received.
     void itemsReceived(const QXmppDiscoveryIq&);
 
+    /// This signal is emitted when the capabilities advertised by an entity
+    /// in its presence are known, either from the cache or after querying
+    /// the entity.
+    void capabilitiesReceived(const QString &jid, const QXmppDiscoveryIq &info);
+
+protected:
+    /// \cond
+    void setClient(QXmppClient *client);
+    /// \endcond
+
+private slots:
+    void _q_disconnected();
+    void _q_presenceReceived(const QXmppPresence &presence);
+    void _q_capabilitiesTimeout();
+
 private:
+    void invalidateCapabilities();
+
     QXmppDiscoveryManagerPrivate *d;
+    friend class QXmppClient;
+    friend class QXmppDiscoveryManagerPrivate;
 };
 
 #endif // QXMPPDISCOVERYMANAGER_H
@@ -32,6 +32,14 @@
 #include "QXmppEntityTimeIq.h"
 #include "QXmppUtils.h"
 
+/// Constructs a QXmppEntityTimeManager.
+
+QXmppEntityTimeManager::QXmppEntityTimeManager()
+{
+    setHandledStanzaTags(QStringList() << "iq");
+    setHandledStanzaNamespaces(QStringList() << ns_entity_time);
+}
+
 /// Request the time from an XMPP entity.
 ///
 /// \param jid
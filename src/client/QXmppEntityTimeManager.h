@@ -39,6 +39,8 @@ class QXMPP_EXPORT QXmppEntityTimeManager : public QXmppClientExtension
     Q_OBJECT
 
 public:
+    QXmppEntityTimeManager();
+
     QString requestTime(const QString& jid);
 
     /// \cond
@@ -31,6 +31,14 @@
 #include "QXmppMessage.h"
 #include "QXmppUtils.h"
 
+/// Constructs a QXmppMamManager.
+
+QXmppMamManager::QXmppMamManager()
+{
+    setHandledStanzaTags(QStringList() << "message" << "iq");
+    setHandledStanzaNamespaces(QStringList() << ns_mam);
+}
+
 /// \cond
 QStringList QXmppMamManager::discoveryFeatures() const
 {
@@ -49,6 +49,8 @@ class QXMPP_EXPORT QXmppMamManager : public QXmppClientExtension
     Q_OBJECT
 
 public:
+    QXmppMamManager();
+
     QString retrieveArchivedMessages(const QString &to = QString(),
                                      const QString &node = QString(),
                                      const QString &jid = QString(),
@@ -36,6 +36,8 @@
 QXmppMessageReceiptManager::QXmppMessageReceiptManager()
     : QXmppClientExtension()
 {
+    setHandledStanzaTags(QStringList() << "message");
+    setHandledStanzaNamespaces(QStringList() << ns_message_receipts);
 }
 
 /// \cond
@@ -27,6 +27,7 @@
 #include "QXmppClient.h"
 #include "QXmppConstants_p.h"
 #include "QXmppDiscoveryManager.h"
+#include "QXmppJid.h"
 #include "QXmppMessage.h"
 #include "QXmppMucIq.h"
 #include "QXmppMucManager.h"
@@ -60,6 +61,9 @@ public:
 QXmppMucManager::QXmppMucManager()
 {
     d = new QXmppMucManagerPrivate;
+
+    setHandledStanzaTags(QStringList() << "iq");
+    setHandledStanzaNamespaces(QStringList() << ns_muc_admin << ns_muc_owner);
 }
 
 /// Destroys a QXmppMucManager.
@@ -238,7 +242,7 @@ QXmppMucRoom::Actions QXmppMucRoom::allowedActions() const
 
 bool QXmppMucRoom::ban(const QString &jid, const QString &reason)
 {
-    if (!QXmppUtils::jidToResource(jid).isEmpty()) {
+    if (!QXmppJid(jid).resource().isEmpty()) {
         qWarning("QXmppMucRoom::ban expects a bare JID");
         return false;
     }
@@ -604,7 +608,7 @@ void QXmppMucRoom::_q_discoveryInfoReceived(const QXmppDiscoveryIq &iq)
 
 void QXmppMucRoom::_q_messageReceived(const QXmppMessage &message)
 {
-    if (QXmppUtils::jidToBareJid(message.from())!= d->jid)
+    if (QXmppJid(message.from()).bareJid() != d->jid)
         return;
 
     // handle message subject
@@ -628,7 +632,7 @@ void QXmppMucRoom::_q_presenceReceived(const QXmppPresence &presence)
         d->client->sendPacket(packet);
     }
 
-    if (QXmppUtils::jidToBareJid(jid) != d->jid)
+    if (QXmppJid(jid).bareJid() != d->jid)
         return;
 
     if (presence.type() == QXmppPresence::Available) {
@@ -23,17 +23,14 @@
  */
 
 #include <QCryptographicHash>
+#include <QElapsedTimer>
 #include <QNetworkProxy>
 #include <QSslSocket>
 #include <QUrl>
-#if (QT_VERSION >= QT_VERSION_CHECK(5, 0, 0))
-#include <QDnsLookup>
-#else
-#include "qdnslookup.h"
-#endif
 
 #include "QXmppConfiguration.h"
 #include "QXmppConstants_p.h"
+#include "QXmppDnsCache_p.h"
 #include "QXmppIq.h"
 #include "QXmppLogger.h"
 #include "QXmppMessage.h"
@@ -43,6 +40,7 @@
 #include "QXmppStreamManagement_p.h"
 #include "QXmppNonSASLAuth.h"
 #include "QXmppSasl_p.h"
+#include "QXmppSocketConnector_p.h"
 #include "QXmppUtils.h"
 
 // IQ types
@@ -64,12 +62,17 @@ class QXmppOutgoingClientPrivate
 public:
     QXmppOutgoingClientPrivate(QXmppOutgoingClient *q);
     void connectToHost(const QString &host, quint16 port);
+    void connectToHosts(const QList<QPair<QString, quint16> > &hosts);
+    void connectDirectly(const QString &host, quint16 port);
+    void recordConnect(bool success);
+    void setSocket(QSslSocket *socket);
 
     void sendNonSASLAuth(bool plaintext);
     void sendNonSASLAuthQuery();
     void sendBind();
     void sendSessionStart();
     void sendStreamManagementEnable();
+    void startSession();
 
     // This object provides the configuration
     // required for connecting to the XMPP server.
@@ -77,7 +80,13 @@ public:
     QXmppStanza::Error::Condition xmppStreamError;
 
     // DNS
-    QDnsLookup dns;
+    QXmppDnsReply *dns;
+
+    // Connection attempts
+    QXmppSocketConnector *connector;
+    QList<QPair<QString, quint16> > connectHosts;
+    QString connectStrategy;
+    QElapsedTimer connectClock;
 
     // Stream
     QString streamId;
@@ -94,6 +103,7 @@ public:
     bool bindModeAvailable;
     bool sessionAvailable;
     bool sessionStarted;
+    bool rosterVersioningAvailable;
 
     // Authentication
     bool isAuthenticated;
@@ -117,10 +127,13 @@ private:
 };
 
 QXmppOutgoingClientPrivate::QXmppOutgoingClientPrivate(QXmppOutgoingClient *qq)
-    : redirectPort(0)
+    : dns(0)
+    , connector(0)
+    , redirectPort(0)
     , bindModeAvailable(false)
     , sessionAvailable(false)
     , sessionStarted(false)
+    , rosterVersioningAvailable(false)
     , isAuthenticated(false)
     , saslClient(0)
     , streamManagementAvailable(false)
@@ -134,8 +147,43 @@ QXmppOutgoingClientPrivate::QXmppOutgoingClientPrivate(QXmppOutgoingClient *qq)
 }
 
 void QXmppOutgoingClientPrivate::connectToHost(const QString &host, quint16 port)
+{
+    QList<QPair<QString, quint16> > hosts;
+    hosts << qMakePair(host, port);
+    connectToHosts(hosts);
+}
+
+void QXmppOutgoingClientPrivate::connectToHosts(const QList<QPair<QString, quint16> > &hosts)
+{
+    connector->abort();
+    connectHosts = hosts;
+
+    // attempts can only be raced for plain TCP connections which do
+    // not go through a proxy
+    QNetworkProxy proxy = config.networkProxy();
+    if (proxy.type() == QNetworkProxy::DefaultProxy)
+        proxy = QNetworkProxy::applicationProxy();
+    if (proxy.type() != QNetworkProxy::NoProxy ||
+        config.streamSecurityMode() == QXmppConfiguration::LegacySSL) {
+        connectDirectly(hosts.first().first, hosts.first().second);
+        return;
+    }
+
+    for (int i = 0; i < hosts.size(); ++i) {
+        q->info(QString("Connecting to %1:%2").arg(hosts[i].first, QString::number(hosts[i].second)));
+        connector->addTarget(hosts[i].first, hosts[i].second);
+    }
+    connectStrategy = "parallel";
+    connectClock.start();
+    emit q->socketStateChanged(QAbstractSocket::ConnectingState);
+    connector->start();
+}
+
+void QXmppOutgoingClientPrivate::connectDirectly(const QString &host, quint16 port)
 {
     q->info(QString("Connecting to %1:%2").arg(host, QString::number(port)));
+    connectStrategy = "direct";
+    connectClock.start();
 
     // override CA certificates if requested
     if (!config.caCertificates().isEmpty())
@@ -162,6 +210,55 @@ void QXmppOutgoingClientPrivate::connectToHost(const QString &host, quint16 port
     }
 }
 
+void QXmppOutgoingClientPrivate::recordConnect(bool success)
+{
+    if (connectStrategy.isEmpty())
+        return;
+
+    const QString prefix = "outgoing-client.connect." + connectStrategy;
+    if (success) {
+        const qint64 msecs = connectClock.elapsed();
+        emit q->updateCounter(prefix + ".success");
+        emit q->updateCounter(prefix + ".msecs", msecs);
+        emit q->updateCounter(prefix + ".latency." + QXmppSocketConnector::latencyBucket(msecs));
+    } else {
+        emit q->updateCounter(prefix + ".failure");
+    }
+    if (connectStrategy == "parallel")
+        emit q->updateCounter(prefix + ".attempts", connector->attempts());
+    connectStrategy.clear();
+}
+
+void QXmppOutgoingClientPrivate::setSocket(QSslSocket *socket)
+{
+    bool check;
+    Q_UNUSED(check);
+
+    QSslSocket *previous = q->socket();
+    if (previous) {
+        previous->disconnect(q);
+        previous->deleteLater();
+    }
+    socket->setParent(q);
+    q->setSocket(socket);
+
+    check = QObject::connect(socket, SIGNAL(disconnected()),
+                             q, SLOT(_q_socketDisconnected()));
+    Q_ASSERT(check);
+
+    check = QObject::connect(socket, SIGNAL(sslErrors(QList<QSslError>)),
+                             q, SLOT(socketSslErrors(QList<QSslError>)));
+    Q_ASSERT(check);
+
+    check = QObject::connect(socket, SIGNAL(error(QAbstractSocket::SocketError)),
+                             q, SLOT(socketError(QAbstractSocket::SocketError)));
+    Q_ASSERT(check);
+
+    check = QObject::connect(socket, SIGNAL(stateChanged(QAbstractSocket::SocketState)),
+                             q, SIGNAL(socketStateChanged(QAbstractSocket::SocketState)));
+    Q_ASSERT(check);
+}
+
 /// Constructs an outgoing client stream.
 ///
 /// \param parent
@@ -174,24 +271,16 @@ QXmppOutgoingClient::QXmppOutgoingClient(QObject *parent)
     Q_UNUSED(check);
 
     // initialise socket
-    QSslSocket *socket = new QSslSocket(this);
-    setSocket(socket);
+    d->setSocket(new QSslSocket(this));
 
-    check = connect(socket, SIGNAL(disconnected()),
-                    this, SLOT(_q_socketDisconnected()));
+    // connection attempts
+    d->connector = new QXmppSocketConnector(this);
+    check = connect(d->connector, SIGNAL(connected(QSslSocket*)),
+                    this, SLOT(_q_connectorConnected(QSslSocket*)));
     Q_ASSERT(check);
 
-    check = connect(socket, SIGNAL(sslErrors(QList<QSslError>)),
-                    this, SLOT(socketSslErrors(QList<QSslError>)));
-    Q_ASSERT(check);
-
-    check = connect(socket, SIGNAL(error(QAbstractSocket::SocketError)),
-                    this, SLOT(socketError(QAbstractSocket::SocketError)));
-    Q_ASSERT(check);
-
-    // DNS lookups
-    check = connect(&d->dns, SIGNAL(finished()),
-                    this, SLOT(_q_dnsLookupFinished()));
+    check = connect(d->connector, SIGNAL(failed(QSslSocket*)),
+                    this, SLOT(_q_connectorFailed(QSslSocket*)));
     Q_ASSERT(check);
 
     // XEP-0199: XMPP Ping
@@ -233,6 +322,9 @@ QXmppConfiguration& QXmppOutgoingClient::configuration()
 
 void QXmppOutgoingClient::connectToHost()
 {
+    setCompressionLevel(d->config.streamCompressionLevel());
+    setCompressionMemoryLevel(d->config.streamCompressionMemoryLevel());
+
     // if a host for resumption is available, connect to it
     if (d->canResume && !d->resumeHost.isEmpty() && d->resumePort) {
         d->connectToHost(d->resumeHost, d->resumePort);
@@ -248,29 +340,93 @@ void QXmppOutgoingClient::connectToHost()
     // otherwise, lookup server
     const QString domain = configuration().domain();
     debug(QString("Looking up server for domain %1").arg(domain));
-    d->dns.setName("_xmpp-client._tcp." + domain);
-    d->dns.setType(QDnsLookup::SRV);
-    d->dns.lookup();
+    delete d->dns;
+    d->dns = QXmppDnsCache::instance()->lookup(QDnsLookup::SRV, "_xmpp-client._tcp." + domain);
+    d->dns->setParent(this);
+
+    bool check;
+    Q_UNUSED(check);
+    check = connect(d->dns, SIGNAL(finished()),
+                    this, SLOT(_q_dnsLookupFinished()));
+    Q_ASSERT(check);
 }
 
 void QXmppOutgoingClient::disconnectFromHost()
 {
     d->canResume = false;
+    delete d->dns;
+    d->dns = 0;
+    if (d->connector->isRunning()) {
+        d->connector->abort();
+        d->connectStrategy.clear();
+        emit socketStateChanged(socketState());
+    }
     QXmppStream::disconnectFromHost();
 }
 
+void QXmppOutgoingClient::_q_connectorConnected(QSslSocket *socket)
+{
+    // override CA certificates if requested
+    if (!d->config.caCertificates().isEmpty())
+        socket->setCaCertificates(d->config.caCertificates());
+
+#if (QT_VERSION >= QT_VERSION_CHECK(4, 8, 0))
+    // set the name the SSL certificate should match
+    socket->setPeerVerifyName(d->config.domain());
+#endif
+
+    d->setSocket(socket);
+    emit socketStateChanged(socket->state());
+
+    info(QString("Socket connected to %1 %2").arg(
+        socket->peerAddress().toString(),
+        QString::number(socket->peerPort())));
+    handleStart();
+}
+
+void QXmppOutgoingClient::_q_connectorFailed(QSslSocket *socket)
+{
+    d->recordConnect(false);
+
+    // if no address was found, let the socket report the lookup error
+    if (!socket) {
+        d->connectDirectly(d->connectHosts.first().first, d->connectHosts.first().second);
+        return;
+    }
+
+    d->setSocket(socket);
+    emit socketStateChanged(socket->state());
+
+    warning(QString("Socket error: " + socket->errorString()));
+    emit error(QXmppClient::SocketError);
+}
+
 void QXmppOutgoingClient::_q_dnsLookupFinished()
 {
-    if (d->dns.error() == QDnsLookup::NoError &&
-        !d->dns.serviceRecords().isEmpty()) {
-        // take the first returned record
-        d->connectToHost(
-            d->dns.serviceRecords().first().target(),
-            d->dns.serviceRecords().first().port());
+    QXmppDnsReply *dns = d->dns;
+    if (!dns)
+        return;
+    d->dns = 0;
+    dns->deleteLater();
+
+    if (dns->source() == QXmppDnsReply::CacheSource)
+        emit updateCounter("dns.cache.hits");
+    else if (dns->source() == QXmppDnsReply::PendingSource)
+        emit updateCounter("dns.cache.coalesced");
+    else
+        emit updateCounter("dns.cache.misses");
+
+    if (dns->error() == QDnsLookup::NoError &&
+        !dns->serviceRecords().isEmpty()) {
+        // try the records in the order they were returned
+        QList<QPair<QString, quint16> > hosts;
+        foreach (const QDnsServiceRecord &record, dns->serviceRecords())
+            hosts << qMakePair(record.target(), record.port());
+        d->connectToHosts(hosts);
     } else {
         // as a fallback, use domain as the host name
         warning(QString("Lookup for domain %1 failed: %2")
-                .arg(d->dns.name(), d->dns.errorString()));
+                .arg(dns->name(), dns->errorString()));
         d->connectToHost(d->config.domain(), d->config.port());
     }
 }
@@ -289,6 +445,25 @@ bool QXmppOutgoingClient::isConnected() const
     return QXmppStream::isConnected() && d->sessionStarted;
 }
 
+/// Returns the state of the connection to the server.
+///
+/// While connection attempts are being raced, this is
+/// QAbstractSocket::ConnectingState even though socket() is not connected.
+
+QAbstractSocket::SocketState QXmppOutgoingClient::socketState() const
+{
+    if (d->connector->isRunning())
+        return QAbstractSocket::ConnectingState;
+    return socket()->state();
+}
+
+/// Returns true if the server advertised roster versioning (XEP-0237).
+
+bool QXmppOutgoingClient::isRosterVersioningSupported() const
+{
+    return d->rosterVersioningAvailable;
+}
+
 void QXmppOutgoingClient::_q_socketDisconnected()
 {
     debug("Socket disconnected");
@@ -320,6 +495,7 @@ void QXmppOutgoingClient::socketSslErrors(const QList<QSslError> &errors)
 void QXmppOutgoingClient::socketError(QAbstractSocket::SocketError socketError)
 {
     Q_UNUSED(socketError);
+    d->recordConnect(false);
     emit error(QXmppClient::SocketError);
 }
 
@@ -327,6 +503,7 @@ void QXmppOutgoingClient::socketError(QAbstractSocket::SocketError socketError)
 void QXmppOutgoingClient::handleStart()
 {
     QXmppStream::handleStart();
+    d->recordConnect(true);
 
     // reset stream information
     d->streamId.clear();
@@ -370,6 +547,34 @@ void QXmppOutgoingClient::handleStream(const QDomElement &streamElement)
     }
 }
 
+void QXmppOutgoingClient::handleRawStanza(const QByteArray &data)
+{
+    // if we receive any kind of data, stop the timeout timer
+    d->timeoutTimer->stop();
+
+    // messages and presences which no extension is interested in
+    // are parsed straight from the stream
+    QXmlStreamReader reader(data);
+    if (!reader.readNextStartElement())
+        return;
+
+    if (reader.name() == QLatin1String("message")) {
+        QXmppMessage message;
+        message.parse(reader);
+
+        // emit message
+        emit messageReceived(message);
+    } else if (reader.name() == QLatin1String("presence")) {
+        QXmppPresence presence;
+        presence.parse(reader);
+
+        // emit presence
+        emit presenceReceived(presence);
+    } else {
+        QXmppStream::handleRawStanza(data);
+    }
+}
+
 void QXmppOutgoingClient::handleStanza(const QDomElement &nodeRecv)
 {
     // if we receive any kind of data, stop the timeout timer
@@ -492,33 +697,17 @@ void QXmppOutgoingClient::handleStanza(const QDomElement &nodeRecv)
         d->sessionAvailable = (features.sessionMode() != QXmppStreamFeatures::Disabled);
         d->bindModeAvailable = (features.bindMode() != QXmppStreamFeatures::Disabled);
         d->streamManagementAvailable = (features.streamManagementMode() != QXmppStreamFeatures::Disabled);
+        d->rosterVersioningAvailable = (features.rosterVersioningMode() != QXmppStreamFeatures::Disabled);
 
-        // chech whether the stream can be resumed
-        if (d->streamManagementAvailable && d->canResume) {
-            d->isResuming = true;
-            QXmppStreamManagementResume streamManagementResume(lastIncomingSequenceNumber(), d->smId);
-            QByteArray data;
-            QXmlStreamWriter xmlStream(&data);
-            streamManagementResume.toXml(&xmlStream);
-            sendData(data);
-            return;
-        }
-
-        // check whether bind is available
-        if (d->bindModeAvailable) {
-            d->sendBind();
-            return;
-        }
-
-        // check whether session is available
-        if (d->sessionAvailable) {
-            d->sendSessionStart();
+        // negotiate stream compression (XEP-0138)
+        if (!isCompressed() && compressionLevel() > 0 && isCompressionSupported() &&
+            features.compressionMethods().contains("zlib"))
+        {
+            sendData(QString("<compress xmlns='%1'><method>zlib</method></compress>").arg(ns_compress).toUtf8());
             return;
         }
 
-        // otherwise we are done
-        d->sessionStarted = true;
-        emit connected();
+        d->startSession();
     }
     else if(ns == ns_stream && nodeRecv.tagName() == "error")
     {
@@ -540,6 +729,22 @@ void QXmppOutgoingClient::handleStanza(const QDomElement &nodeRecv)
             d->xmppStreamError = QXmppStanza::Error::UndefinedCondition;
         emit error(QXmppClient::XmppStreamError);
     }
+    else if(ns == ns_compress)
+    {
+        if(nodeRecv.tagName() == "compressed")
+        {
+            // restart the stream over the compressed transport
+            if (startCompression())
+                handleStart();
+            else
+                disconnectFromHost();
+        }
+        else if(nodeRecv.tagName() == "failure")
+        {
+            warning("Stream compression failed, continuing without it");
+            d->startSession();
+        }
+    }
     else if(ns == ns_tls)
     {
         if(nodeRecv.tagName() == "proceed")
@@ -905,6 +1110,36 @@ void QXmppOutgoingClientPrivate::sendStreamManagementEnable()
     q->sendData(data);
 }
 
+void QXmppOutgoingClientPrivate::startSession()
+{
+    // chech whether the stream can be resumed
+    if (streamManagementAvailable && canResume) {
+        isResuming = true;
+        QXmppStreamManagementResume streamManagementResume(q->lastIncomingSequenceNumber(), smId);
+        QByteArray data;
+        QXmlStreamWriter xmlStream(&data);
+        streamManagementResume.toXml(&xmlStream);
+        q->sendData(data);
+        return;
+    }
+
+    // check whether bind is available
+    if (bindModeAvailable) {
+        sendBind();
+        return;
+    }
+
+    // check whether session is available
+    if (sessionAvailable) {
+        sendSessionStart();
+        return;
+    }
+
+    // otherwise we are done
+    sessionStarted = true;
+    emit q->connected();
+}
+
 /// Returns the type of the last XMPP stream error that occured.
 
 QXmppStanza::Error::Condition QXmppOutgoingClient::xmppStreamError()
@@ -55,6 +55,8 @@ public:
     void connectToHost();
     bool isAuthenticated() const;
     bool isConnected() const;
+    bool isRosterVersioningSupported() const;
+    QAbstractSocket::SocketState socketState() const;
 
     QSslSocket *socket() const { return QXmppStream::socket(); };
     QXmppStanza::Error::Condition xmppStreamError();
@@ -65,6 +67,10 @@ signals:
     /// This signal is emitted when an error is encountered.
     void error(QXmppClient::Error);
 
+    /// This signal is emitted when the state of the connection to the
+    /// server changes.
+    void socketStateChanged(QAbstractSocket::SocketState state);
+
     /// This signal is emitted when an element is received.
     void elementReceived(const QDomElement &element, bool &handled);
 
@@ -86,12 +92,15 @@ protected:
     virtual void handleStart();
     virtual void handleStanza(const QDomElement &element);
     virtual void handleStream(const QDomElement &element);
+    virtual void handleRawStanza(const QByteArray &data);
     /// \endcond
 
 public slots:
     virtual void disconnectFromHost();
 
 private slots:
+    void _q_connectorConnected(QSslSocket *socket);
+    void _q_connectorFailed(QSslSocket *socket);
     void _q_dnsLookupFinished();
     void _q_socketDisconnected();
     void socketError(QAbstractSocket::SocketError);
@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QMap>
+
+#include "QXmppRosterCache.h"
+
+static const quint32 rosterCacheMagic = 0x51524331;
+
+enum RecordType
+{
+    SnapshotRecord = 1,
+    UpdateRecord = 2
+};
+
+static void writeRecord(QDataStream &stream, RecordType type, const QString &version, const QList<QXmppRosterIq::Item> &items)
+{
+    stream << quint8(type) << version.toUtf8() << quint32(items.size());
+    foreach (const QXmppRosterIq::Item &item, items) {
+        const QSet<QString> groups = item.groups();
+        stream << item.bareJid().toUtf8()
+               << item.name().toUtf8()
+               << quint8(item.subscriptionType())
+               << item.subscriptionStatus().toUtf8()
+               << quint32(groups.size());
+        foreach (const QString &group, groups)
+            stream << group.toUtf8();
+    }
+}
+
+static bool readRecord(QDataStream &stream, quint8 &type, QString &version, QList<QXmppRosterIq::Item> &items)
+{
+    QByteArray bytes;
+    quint32 count;
+    stream >> type >> bytes >> count;
+    if (stream.status() != QDataStream::Ok)
+        return false;
+    version = QString::fromUtf8(bytes);
+
+    items.clear();
+    for (quint32 i = 0; i < count; ++i) {
+        QByteArray jid, name, status;
+        quint8 subscription;
+        quint32 groupCount;
+        stream >> jid >> name >> subscription >> status >> groupCount;
+        if (stream.status() != QDataStream::Ok)
+            return false;
+
+        QSet<QString> groups;
+        for (quint32 j = 0; j < groupCount; ++j) {
+            stream >> bytes;
+            groups << QString::fromUtf8(bytes);
+        }
+        if (stream.status() != QDataStream::Ok)
+            return false;
+
+        QXmppRosterIq::Item item;
+        item.setBareJid(QString::fromUtf8(jid));
+        item.setName(QString::fromUtf8(name));
+        item.setSubscriptionType(static_cast<QXmppRosterIq::Item::SubscriptionType>(subscription));
+        item.setSubscriptionStatus(QString::fromUtf8(status));
+        item.setGroups(groups);
+        items << item;
+    }
+    return true;
+}
+
+QXmppRosterCache::~QXmppRosterCache()
+{
+}
+
+class QXmppRosterFileCachePrivate
+{
+public:
+    QString fileName(const QString &bareJid) const;
+
+    QString path;
+};
+
+QString QXmppRosterFileCachePrivate::fileName(const QString &bareJid) const
+{
+    // JIDs may contain characters which are not valid in file names
+    const QByteArray hash = QCryptographicHash::hash(bareJid.toLower().toUtf8(), QCryptographicHash::Sha1);
+    return QDir(path).filePath(QString::fromLatin1(hash.toHex()) + QLatin1String(".roster"));
+}
+
+/// Constructs a new roster cache storing its files in the given directory.
+///
+/// \param path
+
+QXmppRosterFileCache::QXmppRosterFileCache(const QString &path)
+    : d(new QXmppRosterFileCachePrivate)
+{
+    d->path = path;
+}
+
+QXmppRosterFileCache::~QXmppRosterFileCache()
+{
+    delete d;
+}
+
+/// Returns the directory in which the rosters are stored.
+
+QString QXmppRosterFileCache::path() const
+{
+    return d->path;
+}
+
+/// Sets the directory in which the rosters are stored.
+///
+/// \param path
+
+void QXmppRosterFileCache::setPath(const QString &path)
+{
+    d->path = path;
+}
+
+/// \cond
+bool QXmppRosterFileCache::load(const QString &bareJid, QString &version, QList<QXmppRosterIq::Item> &items)
+{
+    QFile file(d->fileName(bareJid));
+    if (d->path.isEmpty() || !file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    quint32 magic;
+    stream >> magic;
+    if (stream.status() != QDataStream::Ok || magic != rosterCacheMagic)
+        return false;
+
+    QMap<QString, QXmppRosterIq::Item> entries;
+    QString currentVersion;
+    bool hasSnapshot = false;
+    bool isComplete = true;
+    int snapshotSize = 0;
+    int journalSize = 0;
+
+    while (!stream.atEnd()) {
+        quint8 type;
+        QString recordVersion;
+        QList<QXmppRosterIq::Item> recordItems;
+        if (!readRecord(stream, type, recordVersion, recordItems)) {
+            // the last record was only partially written
+            isComplete = false;
+            break;
+        }
+
+        if (type == SnapshotRecord) {
+            entries.clear();
+            foreach (const QXmppRosterIq::Item &item, recordItems)
+                entries.insert(item.bareJid(), item);
+            hasSnapshot = true;
+            snapshotSize = recordItems.size();
+            journalSize = 0;
+        } else if (type == UpdateRecord && hasSnapshot) {
+            foreach (const QXmppRosterIq::Item &item, recordItems) {
+                if (item.subscriptionType() == QXmppRosterIq::Item::Remove)
+                    entries.remove(item.bareJid());
+                else
+                    entries.insert(item.bareJid(), item);
+            }
+            journalSize += recordItems.size();
+        } else {
+            isComplete = false;
+            break;
+        }
+        currentVersion = recordVersion;
+    }
+    file.close();
+
+    if (!hasSnapshot)
+        return false;
+
+    version = currentVersion;
+    items = entries.values();
+
+    // fold the journal into a new snapshot once it outgrows it, or if
+    // a truncated record would get in the way of further updates
+    if (!isComplete || journalSize > snapshotSize)
+        save(bareJid, version, items);
+    return true;
+}
+
+bool QXmppRosterFileCache::save(const QString &bareJid, const QString &version, const QList<QXmppRosterIq::Item> &items)
+{
+    if (d->path.isEmpty() || !QDir().mkpath(d->path))
+        return false;
+
+    // write the new snapshot aside, then swap it in
+    const QString fileName = d->fileName(bareJid);
+    const QString tempName = fileName + QLatin1String(".tmp");
+    QFile file(tempName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QDataStream stream(&file);
+    stream << rosterCacheMagic;
+    writeRecord(stream, SnapshotRecord, version, items);
+    file.close();
+    if (stream.status() != QDataStream::Ok || file.error() != QFile::NoError) {
+        QFile::remove(tempName);
+        return false;
+    }
+
+    QFile::remove(fileName);
+    return QFile::rename(tempName, fileName);
+}
+
+bool QXmppRosterFileCache::update(const QString &bareJid, const QString &version, const QList<QXmppRosterIq::Item> &items)
+{
+    QFile file(d->fileName(bareJid));
+    if (d->path.isEmpty() || !file.exists() || !file.open(QIODevice::WriteOnly | QIODevice::Append))
+        return false;
+
+    // serialize the record first so that it is appended in a single write
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    writeRecord(stream, UpdateRecord, version, items);
+    return file.write(data) == data.size();
+}
+
+void QXmppRosterFileCache::clear(const QString &bareJid)
+{
+    if (!d->path.isEmpty())
+        QFile::remove(d->fileName(bareJid));
+}
+/// \endcond
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef QXMPPROSTERCACHE_H
+#define QXMPPROSTERCACHE_H
+
+#include <QList>
+#include <QString>
+
+#include "QXmppRosterIq.h"
+
+class QXmppRosterFileCachePrivate;
+
+/// \brief The QXmppRosterCache class is the base class for persistent
+/// roster storage used by QXmppRosterManager (XEP-0237).
+///
+/// A cache holds, for each account, the last roster version the server
+/// sent along with the matching roster items. On login, QXmppRosterManager
+/// loads the cached roster and only asks the server for the changes since
+/// that version.
+///
+/// \ingroup Managers
+
+class QXMPP_EXPORT QXmppRosterCache
+{
+public:
+    virtual ~QXmppRosterCache();
+
+    /// Loads the cached roster of the given account.
+    ///
+    /// Returns false if there is no usable roster for this account.
+    ///
+    /// \param bareJid
+    /// \param version
+    /// \param items
+    virtual bool load(const QString &bareJid, QString &version, QList<QXmppRosterIq::Item> &items) = 0;
+
+    /// Replaces the cached roster of the given account.
+    ///
+    /// \param bareJid
+    /// \param version
+    /// \param items
+    virtual bool save(const QString &bareJid, const QString &version, const QList<QXmppRosterIq::Item> &items) = 0;
+
+    /// Applies a roster push to the cached roster of the given account.
+    ///
+    /// Items whose subscription type is QXmppRosterIq::Item::Remove are
+    /// removed, the others are added or replaced.
+    ///
+    /// \param bareJid
+    /// \param version
+    /// \param items
+    virtual bool update(const QString &bareJid, const QString &version, const QList<QXmppRosterIq::Item> &items) = 0;
+
+    /// Removes the cached roster of the given account.
+    ///
+    /// \param bareJid
+    virtual void clear(const QString &bareJid) = 0;
+};
+
+/// \brief The QXmppRosterFileCache class stores rosters in compact binary
+/// files, one per account.
+///
+/// Each file holds a snapshot of the roster followed by a journal of the
+/// roster pushes received since, so that a push only costs an append. The
+/// journal is folded into a new snapshot when loading the roster once it
+/// grows larger than the snapshot itself.
+///
+/// \ingroup Managers
+
+class QXMPP_EXPORT QXmppRosterFileCache : public QXmppRosterCache
+{
+public:
+    QXmppRosterFileCache(const QString &path = QString());
+    ~QXmppRosterFileCache();
+
+    QString path() const;
+    void setPath(const QString &path);
+
+    /// \cond
+    bool load(const QString &bareJid, QString &version, QList<QXmppRosterIq::Item> &items);
+    bool save(const QString &bareJid, const QString &version, const QList<QXmppRosterIq::Item> &items);
+    bool update(const QString &bareJid, const QString &version, const QList<QXmppRosterIq::Item> &items);
+    void clear(const QString &bareJid);
+    /// \endcond
+
+private:
+    QXmppRosterFileCachePrivate * const d;
+};
+
+#endif
@@ -23,23 +23,58 @@
  */
 
 #include <QDomElement>
+#include <QHash>
 
 #include "QXmppClient.h"
+#include "QXmppConstants_p.h"
+#include "QXmppJid.h"
 #include "QXmppPresence.h"
+#include "QXmppRosterCache.h"
 #include "QXmppRosterIq.h"
 #include "QXmppRosterManager.h"
 #include "QXmppUtils.h"
 
+// Returns true if a resource with the first presence should be preferred
+// to one with the second presence.
+static bool isBetterPresence(const QXmppPresence &a, const QXmppPresence &b)
+{
+    static const int availabilityRanks[] = {
+        3,  // Online
+        2,  // Away
+        1,  // XA
+        0,  // DND
+        4,  // Chat
+        0   // Invisible
+    };
+
+    if (a.priority() != b.priority())
+        return a.priority() > b.priority();
+    return availabilityRanks[a.availableStatusType()] > availabilityRanks[b.availableStatusType()];
+}
+
+class QXmppContactPresences
+{
+public:
+    // presences indexed by resource, handed out as shallow copies
+    QMap<QString, QXmppPresence> resources;
+
+    // resource with the highest priority, then the highest availability
+    QString bestResource;
+};
+
 class QXmppRosterManagerPrivate
 {
 public:
     QXmppRosterManagerPrivate(QXmppRosterManager *qq);
+    void loadCache();
+    void setPresence(const QString &bareJid, const QString &resource, const QXmppPresence &presence);
+    void removePresence(const QString &bareJid, const QString &resource);
 
     // map of bareJid and its rosterEntry
     QMap<QString, QXmppRosterIq::Item> entries;
 
-    // map of resources of the jid and map of resources and presences
-    QMap<QString, QMap<QString, QXmppPresence> > presences;
+    // presences of the contacts, indexed by bareJid
+    QHash<QString, QXmppContactPresences> presences;
 
     // flag to store that the roster has been populated
     bool isRosterReceived;
@@ -47,16 +82,81 @@ public:
     // id of the initial roster request
     QString rosterReqId;
 
+    // roster version (XEP-0237) and its persistent storage
+    QString version;
+    QXmppRosterCache *cache;
+
 private:
     QXmppRosterManager *q;
 };
 
 QXmppRosterManagerPrivate::QXmppRosterManagerPrivate(QXmppRosterManager *qq)
     : isRosterReceived(false),
+    cache(0),
     q(qq)
 {
 }
 
+void QXmppRosterManagerPrivate::loadCache()
+{
+    QList<QXmppRosterIq::Item> items;
+    entries.clear();
+    version = QString();
+    if (!cache || !cache->load(q->client()->configuration().jidBare(), version, items)) {
+        version = QString();
+        return;
+    }
+
+    foreach (const QXmppRosterIq::Item &item, items)
+        entries.insert(item.bareJid(), item);
+}
+
+static void updateBestResource(QXmppContactPresences &contact)
+{
+    QMap<QString, QXmppPresence>::const_iterator best = contact.resources.constBegin();
+    QMap<QString, QXmppPresence>::const_iterator it;
+    for (it = best + 1; it != contact.resources.constEnd(); ++it) {
+        if (isBetterPresence(it.value(), best.value()))
+            best = it;
+    }
+    contact.bestResource = best.key();
+}
+
+void QXmppRosterManagerPrivate::setPresence(const QString &bareJid, const QString &resource, const QXmppPresence &presence)
+{
+    QHash<QString, QXmppContactPresences>::iterator it = presences.find(bareJid);
+    if (it == presences.end()) {
+        // share the JID's storage with the roster entry if there is one
+        QMap<QString, QXmppRosterIq::Item>::const_iterator entry = entries.constFind(bareJid);
+        it = presences.insert(entry != entries.constEnd() ? entry.key() : bareJid, QXmppContactPresences());
+    }
+
+    QXmppContactPresences &contact = it.value();
+    contact.resources.insert(resource, presence);
+    if (contact.resources.size() == 1) {
+        contact.bestResource = resource;
+    } else if (resource == contact.bestResource) {
+        // the best resource may have lowered its priority
+        updateBestResource(contact);
+    } else if (isBetterPresence(presence, contact.resources.value(contact.bestResource))) {
+        contact.bestResource = resource;
+    }
+}
+
+void QXmppRosterManagerPrivate::removePresence(const QString &bareJid, const QString &resource)
+{
+    QHash<QString, QXmppContactPresences>::iterator it = presences.find(bareJid);
+    if (it == presences.end())
+        return;
+
+    QXmppContactPresences &contact = it.value();
+    contact.resources.remove(resource);
+    if (contact.resources.isEmpty())
+        presences.erase(it);
+    else if (resource == contact.bestResource)
+        updateBestResource(contact);
+}
+
 /// Constructs a roster manager.
 
 QXmppRosterManager::QXmppRosterManager(QXmppClient* client)
@@ -77,6 +177,9 @@ QXmppRosterManager::QXmppRosterManager(QXmppClient* client)
     check = connect(client, SIGNAL(presenceReceived(QXmppPresence)),
                     this, SLOT(_q_presenceReceived(QXmppPresence)));
     Q_ASSERT(check);
+
+    setHandledStanzaTags(QStringList() << "iq");
+    setHandledStanzaNamespaces(QStringList() << ns_roster);
 }
 
 QXmppRosterManager::~QXmppRosterManager()
@@ -104,6 +207,13 @@ void QXmppRosterManager::_q_connected()
     QXmppRosterIq roster;
     roster.setType(QXmppIq::Get);
     roster.setFrom(client()->configuration().jid());
+
+    // only ask for the changes since the cached roster (XEP-0237)
+    if (client()->isRosterVersioningSupported()) {
+        d->loadCache();
+        roster.setVersion(d->version.isNull() ? QLatin1String("") : d->version);
+    }
+
     d->rosterReqId = roster.id();
     if (client()->isAuthenticated())
         client()->sendPacket(roster);
@@ -114,24 +224,32 @@ void QXmppRosterManager::_q_disconnected()
     d->entries.clear();
     d->presences.clear();
     d->isRosterReceived = false;
+    d->version = QString();
 }
 
 /// \cond
 bool QXmppRosterManager::handleStanza(const QDomElement &element)
 {
-    if (element.tagName() != "iq" || !QXmppRosterIq::isRosterIq(element))
+    if (element.tagName() != "iq")
+        return false;
+
+    // an empty result to the initial request means the cached roster
+    // is up to date, changes will follow as roster pushes (XEP-0237)
+    const bool isInitial = !d->rosterReqId.isEmpty() && element.attribute("id") == d->rosterReqId;
+    if (!QXmppRosterIq::isRosterIq(element) &&
+        !(isInitial && element.attribute("type") == "result"))
         return false;
 
     // Security check: only server should send this iq
     // from() should be either empty or bareJid of the user
     const QString fromJid = element.attribute("from");
-    if (!fromJid.isEmpty() && QXmppUtils::jidToBareJid(fromJid) != client()->configuration().jidBare())
+    if (!fromJid.isEmpty() && QXmppJid(fromJid).bareJid() != client()->configuration().jidBare())
         return false;
 
     QXmppRosterIq rosterIq;
     rosterIq.parse(element);
 
-    bool isInitial = (d->rosterReqId == rosterIq.id());
+    const QString accountJid = client()->configuration().jidBare();
     switch(rosterIq.type())
     {
     case QXmppIq::Set:
@@ -162,10 +280,22 @@ bool QXmppRosterManager::handleStanza(const QDomElement &element)
                     }
                 }
             }
+
+            // record the push in the cache
+            if (!rosterIq.version().isNull()) {
+                d->version = rosterIq.version();
+                if (d->cache)
+                    d->cache->update(accountJid, d->version, items);
+            }
         }
         break;
     case QXmppIq::Result:
         {
+            // a full roster replaces the cached one
+            const bool isFull = QXmppRosterIq::isRosterIq(element);
+            if (isInitial && isFull)
+                d->entries.clear();
+
             const QList<QXmppRosterIq::Item> items = rosterIq.items();
             foreach (const QXmppRosterIq::Item &item, items) {
                 const QString bareJid = item.bareJid();
@@ -173,6 +303,11 @@ bool QXmppRosterManager::handleStanza(const QDomElement &element)
             }
             if (isInitial)
             {
+                if (isFull) {
+                    d->version = rosterIq.version();
+                    if (d->cache && !d->version.isNull())
+                        d->cache->save(accountJid, d->version, d->entries.values());
+                }
                 d->isRosterReceived = true;
                 emit rosterReceived();
             }
@@ -188,9 +323,9 @@ bool QXmppRosterManager::handleStanza(const QDomElement &element)
 
 void QXmppRosterManager::_q_presenceReceived(const QXmppPresence& presence)
 {
-    const QString jid = presence.from();
-    const QString bareJid = QXmppUtils::jidToBareJid(jid);
-    const QString resource = QXmppUtils::jidToResource(jid);
+    const QXmppJid jid(presence.from());
+    const QString bareJid = jid.bareJid().toString();
+    const QString resource = jid.resource().toString();
 
     if (bareJid.isEmpty())
         return;
@@ -198,11 +333,11 @@ void QXmppRosterManager::_q_presenceReceived(const QXmppPresence& presence)
     switch(presence.type())
     {
     case QXmppPresence::Available:
-        d->presences[bareJid][resource] = presence;
+        d->setPresence(bareJid, resource, presence);
         emit presenceChanged(bareJid, resource);
         break;
     case QXmppPresence::Unavailable:
-        d->presences[bareJid].remove(resource);
+        d->removePresence(bareJid, resource);
         emit presenceChanged(bareJid, resource);
         break;
     case QXmppPresence::Subscribe:
@@ -361,16 +496,37 @@ QXmppRosterIq::Item QXmppRosterManager::getRosterEntry(
 
 QStringList QXmppRosterManager::getResources(const QString& bareJid) const
 {
-    if(d->presences.contains(bareJid))
-        return d->presences[bareJid].keys();
+    QHash<QString, QXmppContactPresences>::const_iterator it = d->presences.constFind(bareJid);
+    if (it != d->presences.constEnd())
+        return it.value().resources.keys();
     else
         return QStringList();
 }
 
+/// Returns the resource of the given bareJid which should preferably be
+/// used to contact it, that is the one with the highest priority and
+/// then the highest availability.
+///
+/// If the bareJid has no available resource, a null string is returned.
+///
+/// \param bareJid as a QString
+
+QString QXmppRosterManager::getBestResource(const QString &bareJid) const
+{
+    QHash<QString, QXmppContactPresences>::const_iterator it = d->presences.constFind(bareJid);
+    if (it != d->presences.constEnd())
+        return it.value().bestResource;
+    else
+        return QString();
+}
+
 /// Get all the presences of all the resources of the given bareJid. A bareJid
 /// can have multiple resources and each resource will have a presence
 /// associated with it.
 ///
+/// The returned map shares its data with the roster manager, so this
+/// does not copy the presences.
+///
 /// \param bareJid as a QString
 /// \return Map of resource and its respective presence QMap<QString, QXmppPresence>
 ///
@@ -378,14 +534,45 @@ QStringList QXmppRosterManager::getResources(const QString& bareJid) const
 QMap<QString, QXmppPresence> QXmppRosterManager::getAllPresencesForBareJid(
         const QString& bareJid) const
 {
-    if(d->presences.contains(bareJid))
-        return d->presences[bareJid];
+    QHash<QString, QXmppContactPresences>::const_iterator it = d->presences.constFind(bareJid);
+    if (it != d->presences.constEnd())
+        return it.value().resources;
     else
         return QMap<QString, QXmppPresence>();
 }
 
+/// Returns the cache used to store the roster across sessions, or 0
+/// if there is none.
+
+QXmppRosterCache *QXmppRosterManager::cache() const
+{
+    return d->cache;
+}
+
+/// Sets the cache used to store the roster across sessions.
+///
+/// The cache is only used if the server supports roster versioning
+/// (XEP-0237). The roster manager does not take ownership of the cache.
+///
+/// \param cache
+
+void QXmppRosterManager::setCache(QXmppRosterCache *cache)
+{
+    d->cache = cache;
+}
+
+/// Returns the version of the roster (XEP-0237), or a null string if
+/// the server does not support roster versioning.
+
+QString QXmppRosterManager::rosterVersion() const
+{
+    return d->version;
+}
+
 /// Get the presence of the given resource of the given bareJid.
 ///
+/// The returned presence shares its data with the roster manager.
+///
 /// \param bareJid as a QString
 /// \param resource as a QString
 /// \return QXmppPresence
@@ -394,14 +581,16 @@ QMap<QString, QXmppPresence> QXmppRosterManager::getAllPresencesForBareJid(
 QXmppPresence QXmppRosterManager::getPresence(const QString& bareJid,
                                        const QString& resource) const
 {
-    if(d->presences.contains(bareJid) && d->presences[bareJid].contains(resource))
-        return d->presences[bareJid][resource];
-    else
-    {
-        QXmppPresence presence;
-        presence.setType(QXmppPresence::Unavailable);
-        return presence;
+    QHash<QString, QXmppContactPresences>::const_iterator it = d->presences.constFind(bareJid);
+    if (it != d->presences.constEnd()) {
+        QMap<QString, QXmppPresence>::const_iterator presence = it.value().resources.constFind(resource);
+        if (presence != it.value().resources.constEnd())
+            return presence.value();
     }
+
+    QXmppPresence presence;
+    presence.setType(QXmppPresence::Unavailable);
+    return presence;
 }
 
 /// Function to check whether the roster has been received or not.
@@ -33,6 +33,7 @@
 #include "QXmppPresence.h"
 #include "QXmppRosterIq.h"
 
+class QXmppRosterCache;
 class QXmppRosterManagerPrivate;
 
 /// \brief The QXmppRosterManager class provides access to a connected client's roster.
@@ -59,6 +60,10 @@ class QXmppRosterManagerPrivate;
 ///
 /// The presenceChanged() signal is emitted whenever the presence for a roster item changes.
 ///
+/// If the server supports roster versioning (XEP-0237) and a cache was set
+/// using setCache(), the roster is loaded from the cache on login and only
+/// the changes since the cached version are requested from the server.
+///
 /// \ingroup Managers
 
 class QXMPP_EXPORT QXmppRosterManager : public QXmppClientExtension
@@ -74,11 +79,17 @@ public:
     QXmppRosterIq::Item getRosterEntry(const QString& bareJid) const;
 
     QStringList getResources(const QString& bareJid) const;
+    QString getBestResource(const QString &bareJid) const;
     QMap<QString, QXmppPresence> getAllPresencesForBareJid(
             const QString& bareJid) const;
     QXmppPresence getPresence(const QString& bareJid,
                               const QString& resource) const;
 
+    QXmppRosterCache *cache() const;
+    void setCache(QXmppRosterCache *cache);
+
+    QString rosterVersion() const;
+
     /// \cond
     bool handleStanza(const QDomElement &element);
     /// \endcond
@@ -130,6 +141,7 @@ private slots:
 
 private:
     QXmppRosterManagerPrivate *d;
+    friend class QXmppRosterManagerPrivate;
 };
 
 #endif // QXMPPROSTER_H
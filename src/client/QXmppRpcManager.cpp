@@ -32,6 +32,8 @@
 
 QXmppRpcManager::QXmppRpcManager()
 {
+    setHandledStanzaTags(QStringList() << "iq");
+    setHandledStanzaNamespaces(QStringList() << ns_rpc);
 }
 
 /// Adds a local interface which can be queried using RPC.
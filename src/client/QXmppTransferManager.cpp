@@ -36,6 +36,7 @@
 #include "QXmppClient.h"
 #include "QXmppConstants_p.h"
 #include "QXmppIbbIq.h"
+#include "QXmppJid.h"
 #include "QXmppSocks.h"
 #include "QXmppStreamInitiationIq_p.h"
 #include "QXmppStun.h"
@@ -802,6 +803,9 @@ QXmppTransferManager::QXmppTransferManager()
     if (!d->socksServer->listen()) {
         qWarning("QXmppSocksServer could not start listening");
     }
+
+    setHandledStanzaTags(QStringList() << "iq");
+    setHandledStanzaNamespaces(QStringList() << ns_ibb << ns_bytestreams << ns_stream_initiation);
 }
 
 QXmppTransferManager::~QXmppTransferManager()
@@ -1295,7 +1299,7 @@ void QXmppTransferManager::_q_jobStateChanged(QXmppTransferJob::State state)
 
 QXmppTransferJob *QXmppTransferManager::sendFile(const QString &jid, const QString &filePath, const QString &description)
 {
-    if (QXmppUtils::jidToResource(jid).isEmpty()) {
+    if (QXmppJid(jid).resource().isEmpty()) {
         warning("The file recipient's JID must be a full JID");
         return 0;
     }
@@ -1353,7 +1357,7 @@ QXmppTransferJob *QXmppTransferManager::sendFile(const QString &jid, QIODevice *
     bool check;
     Q_UNUSED(check);
 
-    if (QXmppUtils::jidToResource(jid).isEmpty()) {
+    if (QXmppJid(jid).resource().isEmpty()) {
         warning("The file recipient's JID must be a full JID");
         return 0;
     }
@@ -39,6 +39,9 @@ QXmppVCardManager::QXmppVCardManager()
     : d(new QXmppVCardManagerPrivate)
 {
     d->isClientVCardReceived = false;
+
+    setHandledStanzaTags(QStringList() << "iq");
+    setHandledStanzaNamespaces(QStringList() << ns_vcard);
 }
 
 QXmppVCardManager::~QXmppVCardManager()
@@ -58,6 +58,9 @@ QXmppVersionManager::QXmppVersionManager()
     d->clientVersion = qApp->applicationVersion();
     if (d->clientVersion.isEmpty())
         d->clientVersion = QXmppVersion();
+
+    setHandledStanzaTags(QStringList() << "iq");
+    setHandledStanzaNamespaces(QStringList() << ns_version);
 }
 
 QXmppVersionManager::~QXmppVersionManager()
@@ -15,6 +15,7 @@ INSTALL_HEADERS += \
     client/QXmppMucManager.h \
     client/QXmppOutgoingClient.h \
     client/QXmppRemoteMethod.h \
+    client/QXmppRosterCache.h \
     client/QXmppRosterManager.h \
     client/QXmppRpcManager.h \
     client/QXmppTransferManager.h \
@@ -39,6 +40,7 @@ SOURCES += \
     client/QXmppMucManager.cpp \
     client/QXmppOutgoingClient.cpp \
     client/QXmppRemoteMethod.cpp \
+    client/QXmppRosterCache.cpp \
     client/QXmppRosterManager.cpp \
     client/QXmppRpcManager.cpp \
     client/QXmppTransferManager.cpp \
@@ -0,0 +1,377 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QTime>
+
+#include "QXmppAsyncPasswordChecker.h"
+#include "QXmppAsyncPasswordChecker_p.h"
+#include "QXmppUtils.h"
+
+struct QXmppPasswordWaiter
+{
+    QXmppPasswordNotifier *notifier;
+    QXmppPasswordRequest request;
+    bool digest;
+};
+
+/// The credentials derived from a password, which is not kept in memory.
+
+struct QXmppPasswordCacheEntry
+{
+    QXmppPasswordCacheEntry() {}
+    QXmppPasswordCacheEntry(const QXmppPasswordRequest &request, const QString &password);
+
+    static QByteArray hash(const QByteArray &salt, const QString &password);
+
+    QByteArray digest;
+    QByteArray salt;
+    QByteArray passwordHash;
+    QDateTime expiry;
+};
+
+QXmppPasswordCacheEntry::QXmppPasswordCacheEntry(const QXmppPasswordRequest &request, const QString &password)
+{
+    digest = QCryptographicHash::hash(
+        (request.username() + ":" + request.domain() + ":" + password).toUtf8(),
+        QCryptographicHash::Md5);
+    salt = QXmppUtils::generateRandomBytes(16);
+    passwordHash = hash(salt, password);
+}
+
+QByteArray QXmppPasswordCacheEntry::hash(const QByteArray &salt, const QString &password)
+{
+#if QT_VERSION >= 0x050000
+    return QCryptographicHash::hash(salt + password.toUtf8(), QCryptographicHash::Sha256);
+#else
+    return QCryptographicHash::hash(salt + password.toUtf8(), QCryptographicHash::Sha1);
+#endif
+}
+
+class QXmppAsyncPasswordCheckerPrivate
+{
+public:
+    QXmppAsyncPasswordCheckerPrivate();
+
+    static QString key(const QXmppPasswordRequest &request);
+    static void finish(const QXmppPasswordWaiter &waiter, QXmppPasswordReply::Error error, const QXmppPasswordCacheEntry &entry);
+
+    QThreadPool pool;
+
+    // the following members are protected by the mutex
+    QMutex mutex;
+    int cacheTimeout;
+    QHash<QString, QXmppPasswordCacheEntry> cache;
+    QHash<QString, QList<QXmppPasswordWaiter> > pending;
+};
+
+QXmppAsyncPasswordCheckerPrivate::QXmppAsyncPasswordCheckerPrivate()
+    : cacheTimeout(60000)
+{
+}
+
+QString QXmppAsyncPasswordCheckerPrivate::key(const QXmppPasswordRequest &request)
+{
+    return request.username() + QLatin1Char('@') + request.domain();
+}
+
+/// Completes the reply of a waiting request, from any thread.
+///
+/// The reply itself is only touched in its own thread, as it may be
+/// deleted there at any time.
+///
+/// \param waiter
+/// \param error
+/// \param entry The credentials derived from the user's password.
+
+void QXmppAsyncPasswordCheckerPrivate::finish(const QXmppPasswordWaiter &waiter, QXmppPasswordReply::Error error, const QXmppPasswordCacheEntry &entry)
+{
+    QByteArray digest;
+    if (error != QXmppPasswordReply::NoError) {
+        // keep the error
+    } else if (waiter.digest) {
+        digest = entry.digest;
+    } else if (QXmppPasswordCacheEntry::hash(entry.salt, waiter.request.password()) != entry.passwordHash) {
+        error = QXmppPasswordReply::AuthorizationError;
+    }
+
+    QMetaObject::invokeMethod(waiter.notifier, "finish", Qt::QueuedConnection,
+                              Q_ARG(int, error),
+                              Q_ARG(QByteArray, digest));
+}
+
+QXmppPasswordNotifier::QXmppPasswordNotifier(QXmppPasswordReply *reply)
+    : m_reply(reply)
+{
+}
+
+/// Completes the reply, unless it was deleted, and deletes the notifier.
+///
+/// \param error
+/// \param digest
+
+void QXmppPasswordNotifier::finish(int error, const QByteArray &digest)
+{
+    if (m_reply) {
+        if (error != QXmppPasswordReply::NoError)
+            m_reply->setError(QXmppPasswordReply::Error(error));
+        else if (!digest.isEmpty())
+            m_reply->setDigest(digest);
+        m_reply->finish();
+    }
+    delete this;
+}
+
+/// \brief The QXmppPasswordLookup class runs a backend lookup for
+/// QXmppAsyncPasswordChecker on its thread pool.
+///
+
+class QXmppPasswordLookup : public QRunnable
+{
+public:
+    QXmppPasswordLookup(QXmppAsyncPasswordChecker *checker, const QXmppPasswordRequest &request);
+    void run();
+
+private:
+    QXmppAsyncPasswordChecker *m_checker;
+    QXmppPasswordRequest m_request;
+};
+
+QXmppPasswordLookup::QXmppPasswordLookup(QXmppAsyncPasswordChecker *checker, const QXmppPasswordRequest &request)
+    : m_checker(checker)
+    , m_request(request)
+{
+    // the lookup is shared by requests with different passwords
+    m_request.setPassword(QString());
+}
+
+void QXmppPasswordLookup::run()
+{
+    QXmppAsyncPasswordCheckerPrivate *d = m_checker->d;
+
+    QTime elapsed;
+    elapsed.start();
+    QString password;
+    const QXmppPasswordReply::Error error = m_checker->getPassword(m_request, password);
+    const int latency = elapsed.elapsed();
+
+    // only the credentials derived from the password are kept
+    QXmppPasswordCacheEntry entry;
+    if (error == QXmppPasswordReply::NoError)
+        entry = QXmppPasswordCacheEntry(m_request, password);
+    password.clear();
+
+    const QString key = QXmppAsyncPasswordCheckerPrivate::key(m_request);
+    QList<QXmppPasswordWaiter> waiters;
+    int queued;
+    {
+        QMutexLocker locker(&d->mutex);
+        waiters = d->pending.take(key);
+        queued = d->pending.size();
+        if (error == QXmppPasswordReply::NoError && d->cacheTimeout > 0) {
+            entry.expiry = QDateTime::currentDateTime().addMSecs(d->cacheTimeout);
+            d->cache.insert(key, entry);
+        }
+    }
+
+    foreach (const QXmppPasswordWaiter &waiter, waiters)
+        QXmppAsyncPasswordCheckerPrivate::finish(waiter, error, entry);
+
+    m_checker->setGauge("password-checker.queue", queued);
+    m_checker->setGauge("password-checker.latency", latency);
+}
+
+/// Constructs a new asynchronous password checker.
+///
+/// \param parent
+
+QXmppAsyncPasswordChecker::QXmppAsyncPasswordChecker(QObject *parent)
+    : QXmppLoggable(parent)
+    , d(new QXmppAsyncPasswordCheckerPrivate)
+{
+}
+
+/// Destroys the password checker, waiting for the lookups in progress
+/// to complete.
+///
+/// Subclasses must call waitForDone() in their own destructor, as
+/// getPassword() must not be called once they have been destroyed.
+
+QXmppAsyncPasswordChecker::~QXmppAsyncPasswordChecker()
+{
+    d->pool.waitForDone();
+    delete d;
+}
+
+/// Checks that the given credentials are valid.
+///
+/// This method is thread-safe, the reply is finished in the calling
+/// thread.
+///
+/// \param request
+
+QXmppPasswordReply *QXmppAsyncPasswordChecker::checkPassword(const QXmppPasswordRequest &request)
+{
+    return lookup(request, false);
+}
+
+/// Retrieves the MD5 digest for the given username.
+///
+/// This method is thread-safe, the reply is finished in the calling
+/// thread.
+///
+/// \param request
+
+QXmppPasswordReply *QXmppAsyncPasswordChecker::getDigest(const QXmppPasswordRequest &request)
+{
+    return lookup(request, true);
+}
+
+/// Returns true, as digests are computed from the passwords returned
+/// by getPassword().
+
+bool QXmppAsyncPasswordChecker::hasGetPassword() const
+{
+    return true;
+}
+
+/// Returns the number of milliseconds during which the results of
+/// getPassword() are cached.
+
+int QXmppAsyncPasswordChecker::cacheTimeout() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->cacheTimeout;
+}
+
+/// Sets the number of milliseconds during which the results of
+/// getPassword() are cached. Failed lookups are never cached.
+///
+/// The default is one minute, set \a msecs to 0 to disable caching.
+///
+/// \param msecs
+
+void QXmppAsyncPasswordChecker::setCacheTimeout(int msecs)
+{
+    QMutexLocker locker(&d->mutex);
+    d->cacheTimeout = msecs;
+    if (msecs <= 0)
+        d->cache.clear();
+}
+
+/// Returns the maximum number of threads used for backend lookups.
+
+int QXmppAsyncPasswordChecker::maxThreadCount() const
+{
+    return d->pool.maxThreadCount();
+}
+
+/// Sets the maximum number of threads used for backend lookups.
+///
+/// The default is QThread::idealThreadCount().
+///
+/// \param count
+
+void QXmppAsyncPasswordChecker::setMaxThreadCount(int count)
+{
+    d->pool.setMaxThreadCount(count);
+}
+
+/// Waits for the lookups in progress to complete.
+///
+/// Subclasses must call this from their destructor.
+
+void QXmppAsyncPasswordChecker::waitForDone()
+{
+    d->pool.waitForDone();
+}
+
+/// Discards the cached credentials, for instance after a password change.
+
+void QXmppAsyncPasswordChecker::clearCache()
+{
+    QMutexLocker locker(&d->mutex);
+    d->cache.clear();
+}
+
+/// Retrieves the password for the given username.
+///
+/// Reimplement this method to query your backend. It is called from
+/// the thread pool, so it must be thread-safe, and the request's
+/// password is always empty.
+///
+/// \param request
+/// \param password
+
+QXmppPasswordReply::Error QXmppAsyncPasswordChecker::getPassword(const QXmppPasswordRequest &request, QString &password)
+{
+    Q_UNUSED(request);
+    Q_UNUSED(password);
+    return QXmppPasswordReply::TemporaryError;
+}
+
+QXmppPasswordReply *QXmppAsyncPasswordChecker::lookup(const QXmppPasswordRequest &request, bool digest)
+{
+    // the reply and its notifier live in the calling thread
+    QXmppPasswordReply *reply = new QXmppPasswordReply;
+    QXmppPasswordWaiter waiter;
+    waiter.notifier = new QXmppPasswordNotifier(reply);
+    waiter.request = request;
+    waiter.digest = digest;
+
+    const QString key = QXmppAsyncPasswordCheckerPrivate::key(request);
+    bool start;
+    int queued;
+    {
+        QMutexLocker locker(&d->mutex);
+
+        // answer from the cache
+        QHash<QString, QXmppPasswordCacheEntry>::iterator it = d->cache.find(key);
+        if (it != d->cache.end()) {
+            if (it.value().expiry > QDateTime::currentDateTime()) {
+                const QXmppPasswordCacheEntry entry = it.value();
+                locker.unlock();
+                QXmppAsyncPasswordCheckerPrivate::finish(waiter, QXmppPasswordReply::NoError, entry);
+                updateCounter("password-checker.cache.hits", 1);
+                return reply;
+            }
+            d->cache.erase(it);
+        }
+
+        // join the lookup in progress for this user, if any
+        QList<QXmppPasswordWaiter> &waiters = d->pending[key];
+        start = waiters.isEmpty();
+        waiters << waiter;
+        queued = d->pending.size();
+    }
+
+    if (start) {
+        d->pool.start(new QXmppPasswordLookup(this, request));
+        setGauge("password-checker.queue", queued);
+    } else {
+        updateCounter("password-checker.coalesced", 1);
+    }
+    return reply;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef QXMPPASYNCPASSWORDCHECKER_H
+#define QXMPPASYNCPASSWORDCHECKER_H
+
+#include "QXmppLogger.h"
+#include "QXmppPasswordChecker.h"
+
+class QXmppAsyncPasswordCheckerPrivate;
+
+/// \brief The QXmppAsyncPasswordChecker class is a password checker which
+/// performs backend lookups on a thread pool.
+///
+/// Reimplement getPassword() to look up the password from your backend,
+/// it is called from the thread pool and must be thread-safe. Subclasses
+/// must call waitForDone() from their destructor, so that no lookup runs
+/// while they are being destroyed.
+///
+/// Concurrent requests for the same user share a single lookup, and
+/// the results are cached for cacheTimeout() milliseconds. The cache
+/// holds the DIGEST-MD5 digest and a salted hash of each password, never
+/// the password itself.
+///
+/// The "password-checker.queue" gauge reports the number of lookups in
+/// progress, and "password-checker.latency" the duration in milliseconds
+/// of the last lookup.
+
+class QXMPP_EXPORT QXmppAsyncPasswordChecker : public QXmppLoggable, public QXmppPasswordChecker
+{
+    Q_OBJECT
+
+public:
+    QXmppAsyncPasswordChecker(QObject *parent = 0);
+    ~QXmppAsyncPasswordChecker();
+
+    QXmppPasswordReply *checkPassword(const QXmppPasswordRequest &request);
+    QXmppPasswordReply *getDigest(const QXmppPasswordRequest &request);
+    bool hasGetPassword() const;
+
+    int cacheTimeout() const;
+    void setCacheTimeout(int msecs);
+
+    int maxThreadCount() const;
+    void setMaxThreadCount(int count);
+
+    void clearCache();
+    void waitForDone();
+
+protected:
+    virtual QXmppPasswordReply::Error getPassword(const QXmppPasswordRequest &request, QString &password);
+
+private:
+    QXmppPasswordReply *lookup(const QXmppPasswordRequest &request, bool digest);
+
+    QXmppAsyncPasswordCheckerPrivate * const d;
+    friend class QXmppPasswordLookup;
+};
+
+#endif
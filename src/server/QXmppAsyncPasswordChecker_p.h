@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef QXMPPASYNCPASSWORDCHECKER_P_H
+#define QXMPPASYNCPASSWORDCHECKER_P_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QPointer>
+
+#include "QXmppPasswordChecker.h"
+
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QXmpp API.  It exists for the convenience
+// of the QXmppAsyncPasswordChecker class.
+//
+// This header file may change from version to version without notice,
+// or even be removed.
+//
+// We mean it.
+//
+
+/// \brief The QXmppPasswordNotifier class completes a QXmppPasswordReply
+/// in the reply's thread, with a result computed in another thread.
+///
+/// The notifier is created in the thread of the reply and deletes itself
+/// once it has delivered the result. The reply may have been deleted in
+/// the meantime, in which case the result is discarded.
+
+class QXmppPasswordNotifier : public QObject
+{
+    Q_OBJECT
+
+public:
+    QXmppPasswordNotifier(QXmppPasswordReply *reply);
+
+public slots:
+    void finish(int error, const QByteArray &digest);
+
+private:
+    QPointer<QXmppPasswordReply> m_reply;
+};
+
+#endif
@@ -21,23 +21,110 @@
  *
  */
 
+#include <QAtomicInt>
 #include <QDomElement>
+#include <QElapsedTimer>
 #include <QHostAddress>
 #include <QSslKey>
 #include <QSslSocket>
 #include <QTimer>
+#include <QXmlStreamReader>
 
 #include "QXmppBindIq.h"
 #include "QXmppConstants_p.h"
+#include "QXmppJid.h"
 #include "QXmppMessage.h"
 #include "QXmppPasswordChecker.h"
 #include "QXmppSasl_p.h"
 #include "QXmppSessionIq.h"
 #include "QXmppStreamFeatures.h"
+#include "QXmppStreamManagement_p.h"
 #include "QXmppUtils.h"
 
 #include "QXmppIncomingClient.h"
 
+static QByteArray escapeAttribute(const QString &value)
+{
+    QByteArray escaped = value.toUtf8();
+    escaped.replace('&', "&amp;");
+    escaped.replace('<', "&lt;");
+    escaped.replace('>', "&gt;");
+    escaped.replace('"', "&quot;");
+    return escaped;
+}
+
+// Returns the offset right after the name of the first start tag in
+// data, or -1 if data does not start with the start tag of a tagName
+// element.
+
+static int startTagNameEnd(const QByteArray &data, const QString &tagName)
+{
+    const char *ptr = data.constData();
+    const char *end = ptr + data.size();
+
+    // skip whitespace and find the opening bracket
+    while (ptr < end && (*ptr == ' ' || *ptr == '\t' || *ptr == '\r' || *ptr == '\n'))
+        ++ptr;
+    if (ptr == end || *ptr != '<')
+        return -1;
+    const char *nameStart = ++ptr;
+
+    // the name ends at whitespace, '/' or '>'
+    while (ptr < end && *ptr != ' ' && *ptr != '\t' && *ptr != '\r' &&
+           *ptr != '\n' && *ptr != '/' && *ptr != '>')
+        ++ptr;
+    if (ptr == end)
+        return -1;
+
+    // strip the namespace prefix, if any
+    QByteArray name(nameStart, ptr - nameStart);
+    const int colon = name.indexOf(':');
+    if (colon >= 0)
+        name = name.mid(colon + 1);
+    if (name != tagName.toLatin1())
+        return -1;
+
+    return ptr - data.constData();
+}
+
+// the number of throttled client connections in the process
+static QAtomicInt throttledClients;
+
+/// A token bucket which holds up to one second worth of tokens. It may
+/// go into debt, in which case the traffic must pause until the debt
+/// has been paid back.
+
+class QXmppTokenBucket
+{
+public:
+    QXmppTokenBucket()
+        : rate(0), tokens(0)
+    {
+    }
+
+    void setRate(int tokensPerSecond)
+    {
+        rate = tokensPerSecond;
+        tokens = rate;
+    }
+
+    void refill(qint64 msecs)
+    {
+        if (rate > 0)
+            tokens = qMin(double(rate), tokens + rate * msecs / 1000.0);
+    }
+
+    int msecsUntilAvailable() const
+    {
+        if (rate <= 0 || tokens >= 0)
+            return 0;
+        return int(-tokens * 1000.0 / rate) + 1;
+    }
+
+    int rate;
+    double tokens;
+};
+
 class QXmppIncomingClientPrivate
 {
 public:
@@ -45,12 +132,36 @@ public:
     QTimer *idleTimer;
 
     QString domain;
-    QString jid;
+    QXmppJid jid;
     QString resource;
     QXmppPasswordChecker *passwordChecker;
     QXmppSaslServer *saslServer;
 
+    // whether the last broadcast presence was available with a
+    // non-negative priority
+    bool available;
+
+    // stream management
+    int resumptionTimeout;
+    bool rosterVersioning;
+    QString streamManagementId;
+    bool resuming;
+    QList<QByteArray> resumePending;
+
+    // whether disconnected() was emitted, so it is only emitted once
+    bool disconnectSignalled;
+
+    // rate limiting
+    QXmppTokenBucket byteBucket;
+    QXmppTokenBucket stanzaBucket;
+    QElapsedTimer refillTimer;
+    QTimer *throttleTimer;
+    bool throttled;
+
     void checkCredentials(const QByteArray &response);
+    void consume(QXmppTokenBucket &bucket, qint64 tokens, const QString &counter);
+    void refillBuckets();
+    void setThrottled(bool throttled);
     QString origin() const;
 
 private:
@@ -61,10 +172,70 @@ QXmppIncomingClientPrivate::QXmppIncomingClientPrivate(QXmppIncomingClient *qq)
     : idleTimer(0)
     , passwordChecker(0)
     , saslServer(0)
+    , available(false)
+    , resumptionTimeout(0)
+    , rosterVersioning(false)
+    , resuming(false)
+    , disconnectSignalled(false)
+    , throttleTimer(0)
+    , throttled(false)
     , q(qq)
 {
 }
 
+/// Takes tokens from the given bucket, and throttles the stream until
+/// the bucket's debt has been paid back.
+///
+/// Bytes over the rate only stop further reads from the socket, the data
+/// which was read is still handled. Stanzas over the rate are kept in the
+/// parser.
+
+void QXmppIncomingClientPrivate::consume(QXmppTokenBucket &bucket, qint64 tokens, const QString &counter)
+{
+    if (bucket.rate <= 0)
+        return;
+
+    refillBuckets();
+    bucket.tokens -= tokens;
+    if (bucket.tokens >= 0)
+        return;
+
+    if (&bucket == &stanzaBucket) {
+        if (q->isStanzaHandlingPaused())
+            return;
+        q->setStanzaHandlingPaused(true);
+    } else {
+        if (q->isReadingPaused())
+            return;
+        q->setReadingPaused(true);
+    }
+    q->updateCounter(counter);
+    setThrottled(true);
+    throttleTimer->start(qMax(byteBucket.msecsUntilAvailable(), stanzaBucket.msecsUntilAvailable()));
+}
+
+void QXmppIncomingClientPrivate::refillBuckets()
+{
+    const qint64 elapsed = refillTimer.restart();
+    byteBucket.refill(elapsed);
+    stanzaBucket.refill(elapsed);
+}
+
+void QXmppIncomingClientPrivate::setThrottled(bool value)
+{
+    if (value == throttled)
+        return;
+    throttled = value;
+    if (!value) {
+        q->setReadingPaused(false);
+        q->setStanzaHandlingPaused(false);
+    }
+
+    // fetchAndAddOrdered() returns the previous value
+    const int count = throttledClients.fetchAndAddOrdered(value ? 1 : -1) + (value ? 1 : -1);
+    q->setGauge("incoming-client.throttled", count);
+}
+
 void QXmppIncomingClientPrivate::checkCredentials(const QByteArray &response)
 {
     QXmppPasswordRequest request;
@@ -129,6 +300,19 @@ QXmppIncomingClient::QXmppIncomingClient(QSslSocket *socket, const QString &doma
     check = connect(d->idleTimer, SIGNAL(timeout()),
                     this, SLOT(onTimeout()));
     Q_ASSERT(check);
+
+    // create throttle timer
+    d->throttleTimer = new QTimer(this);
+    d->throttleTimer->setSingleShot(true);
+    check = connect(d->throttleTimer, SIGNAL(timeout()),
+                    this, SLOT(onThrottleTimeout()));
+    Q_ASSERT(check);
+    d->refillTimer.start();
+
+    // do not let a peer make us hold arbitrary amounts of data
+    setMaximumStanzaSize(256 * 1024);
+    setMaximumStanzaDepth(64);
+    setMaximumBufferSize(512 * 1024);
 }
 
 /// Destroys the current stream.
@@ -136,6 +320,7 @@ QXmppIncomingClient::QXmppIncomingClient(QSslSocket *socket, const QString &doma
 
 QXmppIncomingClient::~QXmppIncomingClient()
 {
+    d->setThrottled(false);
     delete d;
 }
 
@@ -155,7 +340,7 @@ bool QXmppIncomingClient::isConnected() const
 
 QString QXmppIncomingClient::jid() const
 {
-    return d->jid;
+    return d->jid.toString();
 }
 
 /// Sets the number of seconds after which a client will be disconnected
@@ -169,6 +354,51 @@ void QXmppIncomingClient::setInactivityTimeout(int secs)
         d->idleTimer->start();
 }
 
+/// Returns the maximum number of bytes per second read from the client.
+///
+/// The default value of 0 means there is no limit.
+
+int QXmppIncomingClient::bytesPerSecond() const
+{
+    return d->byteBucket.rate;
+}
+
+/// Sets the maximum number of bytes per second read from the client.
+///
+/// The client may send up to one second worth of data in a burst, after
+/// which reading from the socket pauses until its average rate drops
+/// below the limit. Data is never discarded.
+///
+/// \param bytes
+
+void QXmppIncomingClient::setBytesPerSecond(int bytes)
+{
+    d->byteBucket.setRate(bytes);
+}
+
+/// Returns the maximum number of stanzas per second handled for the
+/// client.
+///
+/// The default value of 0 means there is no limit.
+
+int QXmppIncomingClient::stanzasPerSecond() const
+{
+    return d->stanzaBucket.rate;
+}
+
+/// Sets the maximum number of stanzas per second handled for the client.
+///
+/// The client may send up to one second worth of stanzas in a burst,
+/// after which reading from the socket pauses until its average rate
+/// drops below the limit. Stanzas are never discarded.
+///
+/// \param stanzas
+
+void QXmppIncomingClient::setStanzasPerSecond(int stanzas)
+{
+    d->stanzaBucket.setRate(stanzas);
+}
+
 /// Sets the password checker used to verify client credentials.
 ///
 /// \param checker
@@ -179,6 +409,92 @@ void QXmppIncomingClient::setPasswordChecker(QXmppPasswordChecker *checker)
     d->passwordChecker = checker;
 }
 
+/// Returns the number of seconds during which the server keeps the
+/// session of a disconnected client so that it can be resumed (XEP-0198).
+
+int QXmppIncomingClient::streamResumptionTimeout() const
+{
+    return d->resumptionTimeout;
+}
+
+/// Sets the number of seconds during which the server keeps the session
+/// of a disconnected client so that it can be resumed (XEP-0198).
+///
+/// If \a secs is 0, which is the default, Stream Management is not
+/// offered to the client.
+///
+/// \param secs
+
+void QXmppIncomingClient::setStreamResumptionTimeout(int secs)
+{
+    d->resumptionTimeout = secs;
+}
+
+/// Returns true if roster versioning is advertised to the client (XEP-0237).
+
+bool QXmppIncomingClient::isRosterVersioningEnabled() const
+{
+    return d->rosterVersioning;
+}
+
+/// Sets whether roster versioning is advertised to the client (XEP-0237).
+///
+/// \param enabled
+
+void QXmppIncomingClient::setRosterVersioningEnabled(bool enabled)
+{
+    d->rosterVersioning = enabled;
+}
+
+/// Returns true if the client enabled Stream Management with resumption,
+/// and the stream was not closed cleanly.
+///
+/// This must be called from the stream's thread, other threads should
+/// track the resumableChanged() signal instead.
+
+bool QXmppIncomingClient::isResumable() const
+{
+    return isStreamManagementEnabled() && !d->streamManagementId.isEmpty();
+}
+
+/// Returns the identifier of the Stream Management session, which the
+/// client uses to resume it.
+///
+/// This must be called from the stream's thread.
+
+QString QXmppIncomingClient::streamManagementId() const
+{
+    return d->streamManagementId;
+}
+
+/// Closes the stream cleanly, after which its Stream Management session
+/// can no longer be resumed.
+
+void QXmppIncomingClient::disconnectFromHost()
+{
+    if (!d->streamManagementId.isEmpty()) {
+        d->streamManagementId.clear();
+        emit resumableChanged(QString());
+    }
+    QXmppStream::disconnectFromHost();
+}
+
+/// Sends a serialized stanza to the client.
+///
+/// While a session is being resumed, stanzas are held back until the
+/// stanzas of the previous stream have been resent.
+///
+/// \param data
+
+bool QXmppIncomingClient::sendStanzaData(const QByteArray &data)
+{
+    if (d->resuming) {
+        d->resumePending << data;
+        return true;
+    }
+    return QXmppStream::sendStanzaData(data);
+}
+
 /// \cond
 void QXmppIncomingClient::handleStream(const QDomElement &streamElement)
 {
@@ -222,6 +538,14 @@ void QXmppIncomingClient::handleStream(const QDomElement &streamElement)
     {
         features.setBindMode(QXmppStreamFeatures::Required);
         features.setSessionMode(QXmppStreamFeatures::Enabled);
+        if (d->resumptionTimeout > 0)
+            features.setStreamManagementMode(QXmppStreamFeatures::Enabled);
+        if (d->rosterVersioning)
+            features.setRosterVersioningMode(QXmppStreamFeatures::Enabled);
+        // compression is negotiated after authentication and before
+        // resource binding (XEP-0138)
+        if (d->resource.isEmpty() && !isCompressed() && compressionLevel() > 0 && isCompressionSupported())
+            features.setCompressionMethods(QStringList() << "zlib");
     }
     else if (d->passwordChecker)
     {
@@ -241,13 +565,40 @@ void QXmppIncomingClient::handleStanza(const QDomElement &nodeRecv)
     if (d->idleTimer->interval())
         d->idleTimer->start();
 
+    // whitespace pings are not counted
+    if (!nodeRecv.isNull())
+        d->consume(d->stanzaBucket, 1, "incoming-client.throttled.stanzas");
+
     if (ns == ns_tls && nodeRecv.tagName() == QLatin1String("starttls"))
     {
         sendData("<proceed xmlns='urn:ietf:params:xml:ns:xmpp-tls'/>");
+        flushData();
         socket()->flush();
         socket()->startServerEncryption();
         return;
     }
+    else if (ns == ns_compress && nodeRecv.tagName() == QLatin1String("compress"))
+    {
+        const QString method = nodeRecv.firstChildElement("method").text();
+        if (d->jid.isEmpty() || !d->resource.isEmpty() || isCompressed() || compressionLevel() <= 0 ||
+            !isCompressionSupported() || method != QLatin1String("zlib"))
+        {
+            warning(QString("Refusing stream compression method '%1' from %2").arg(method, d->origin()));
+            updateCounter("incoming-client.compression.unsupported-method");
+            sendData(QString("<failure xmlns='%1'><unsupported-method/></failure>").arg(ns_compress).toUtf8());
+            return;
+        }
+
+        sendData(QString("<compressed xmlns='%1'/>").arg(ns_compress).toUtf8());
+        if (!startCompression()) {
+            updateCounter("incoming-client.compression.setup-failed");
+            disconnectFromHost();
+            return;
+        }
+        updateCounter("incoming-client.compression.success");
+        handleStart();
+        return;
+    }
     else if (ns == ns_sasl)
     {
         if (!d->passwordChecker) {
@@ -304,8 +655,8 @@ void QXmppIncomingClient::handleStanza(const QDomElement &nodeRecv)
                 d->checkCredentials(response.value());
             } else if (result == QXmppSaslServer::Succeeded) {
                 // authentication succeeded
-                d->jid = QString("%1@%2").arg(d->saslServer->username(), d->domain);
-                info(QString("Authentication succeeded for '%1' from %2").arg(d->jid, d->origin()));
+                d->jid = QXmppJid(QString("%1@%2").arg(d->saslServer->username(), d->domain));
+                info(QString("Authentication succeeded for '%1' from %2").arg(d->jid.toString(), d->origin()));
                 updateCounter("incoming-client.auth.success");
                 sendPacket(QXmppSaslSuccess());
                 handleStart();
@@ -316,6 +667,46 @@ void QXmppIncomingClient::handleStanza(const QDomElement &nodeRecv)
             }
         }
     }
+    else if (ns == ns_stream_management)
+    {
+        if (QXmppStreamManagementEnable::isStreamManagementEnable(nodeRecv) &&
+            !d->resource.isEmpty() && d->resumptionTimeout > 0)
+        {
+            QXmppStreamManagementEnable enable;
+            enable.parse(nodeRecv);
+            if (enable.resume())
+                d->streamManagementId = QXmppUtils::generateStanzaHash();
+
+            QByteArray data;
+            QXmlStreamWriter xmlStream(&data);
+            QXmppStreamManagementEnabled enabled(enable.resume(), d->streamManagementId,
+                                                 enable.resume() ? d->resumptionTimeout : 0);
+            enabled.toXml(&xmlStream);
+            sendData(data);
+
+            enableStreamManagement(true);
+            if (enable.resume())
+                emit resumableChanged(d->streamManagementId);
+        }
+        else if (QXmppStreamManagementResume::isStreamManagementResume(nodeRecv) &&
+                 !d->jid.isEmpty() && d->resource.isEmpty() && d->resumptionTimeout > 0)
+        {
+            QXmppStreamManagementResume resume;
+            resume.parse(nodeRecv);
+
+            // the server answers with exportSession() or rejectResume()
+            d->resuming = true;
+            emit resumeRequested(d->jid.toString(), resume.prevId(), resume.h());
+        }
+        else
+        {
+            QByteArray data;
+            QXmlStreamWriter xmlStream(&data);
+            QXmppStreamManagementFailed failed(QXmppStanza::Error::UnexpectedRequest);
+            failed.toXml(&xmlStream);
+            sendData(data);
+        }
+    }
     else if (ns == ns_client)
     {
         if (nodeRecv.tagName() == QLatin1String("iq"))
@@ -328,15 +719,16 @@ void QXmppIncomingClient::handleStanza(const QDomElement &nodeRecv)
                 d->resource = bindSet.resource().trimmed();
                 if (d->resource.isEmpty())
                     d->resource = QXmppUtils::generateStanzaHash();
-                d->jid = QString("%1/%2").arg(QXmppUtils::jidToBareJid(d->jid), d->resource);
+                d->jid = QXmppJid(QString("%1/%2").arg(d->jid.bareJid().toString(), d->resource));
 
                 QXmppBindIq bindResult;
                 bindResult.setType(QXmppIq::Result);
                 bindResult.setId(bindSet.id());
-                bindResult.setJid(d->jid);
+                bindResult.setJid(d->jid.toString());
                 sendPacket(bindResult);
 
                 // bound
+                emit resourceBound(d->jid.toString());
                 emit connected();
                 return;
             }
@@ -348,7 +740,7 @@ void QXmppIncomingClient::handleStanza(const QDomElement &nodeRecv)
                 QXmppIq sessionResult;
                 sessionResult.setType(QXmppIq::Result);
                 sessionResult.setId(sessionSet.id());
-                sessionResult.setTo(d->jid);
+                sessionResult.setTo(d->jid.toString());
                 sendPacket(sessionResult);
                 return;
             }
@@ -356,12 +748,26 @@ void QXmppIncomingClient::handleStanza(const QDomElement &nodeRecv)
 
         // check the sender is legitimate
         const QString from = nodeRecv.attribute("from");
-        if (!from.isEmpty() && from != d->jid && from != QXmppUtils::jidToBareJid(d->jid))
+        if (!from.isEmpty() && from != d->jid.toString() && d->jid.bareJid() != from)
         {
             warning(QString("Received a stanza from unexpected JID %1").arg(from));
             return;
         }
 
+        // track the client's broadcast presence
+        if (nodeRecv.tagName() == QLatin1String("presence") && nodeRecv.attribute("to").isEmpty())
+        {
+            const QString type = nodeRecv.attribute("type");
+            if (type.isEmpty() || type == QLatin1String("unavailable"))
+            {
+                const bool available = type.isEmpty() &&
+                    nodeRecv.firstChildElement("priority").text().toInt() >= 0;
+                if (available && !d->available)
+                    emit availablePresenceReceived(d->jid.toString());
+                d->available = available;
+            }
+        }
+
         // process unhandled stanzas
         if (nodeRecv.tagName() == QLatin1String("iq") ||
             nodeRecv.tagName() == QLatin1String("message") ||
@@ -375,9 +781,9 @@ void QXmppIncomingClient::handleStanza(const QDomElement &nodeRecv)
                 if (nodeFull.tagName() == QLatin1String("presence") &&
                     (nodeFull.attribute("type") == QLatin1String("subscribe") ||
                     nodeFull.attribute("type") == QLatin1String("subscribed")))
-                    nodeFull.setAttribute("from", QXmppUtils::jidToBareJid(d->jid));
+                    nodeFull.setAttribute("from", d->jid.bareJid().toString());
                 else
-                    nodeFull.setAttribute("from", d->jid);
+                    nodeFull.setAttribute("from", d->jid.toString());
             }
 
             // if the recipient is empty, set it to the local domain
@@ -389,6 +795,72 @@ void QXmppIncomingClient::handleStanza(const QDomElement &nodeRecv)
         }
     }
 }
+
+void QXmppIncomingClient::handleRawStanza(const QByteArray &data)
+{
+    if (d->idleTimer->interval())
+        d->idleTimer->start();
+
+    QXmlStreamReader reader(data);
+    if (!reader.readNextStartElement())
+        return;
+    const QString tagName = reader.name().toString();
+    const QXmlStreamAttributes attributes = reader.attributes();
+    const QString from = attributes.value("from").toString();
+    const QString to = attributes.value("to").toString();
+
+    // stanzas from unauthenticated clients or addressed to the
+    // server itself go through the regular DOM-based processing, as do
+    // those whose start tag we cannot rewrite
+    int pos = -1;
+    if (from.isEmpty() && !attributes.hasAttribute("from"))
+        pos = startTagNameEnd(data, tagName);
+    if (d->jid.isEmpty() || to.isEmpty() || to == d->domain || (from.isEmpty() && pos < 0)) {
+        QXmppStream::handleRawStanza(data);
+        return;
+    }
+
+    d->consume(d->stanzaBucket, 1, "incoming-client.throttled.stanzas");
+
+    // check the sender is legitimate
+    if (!from.isEmpty() && from != d->jid.toString() && d->jid.bareJid() != from) {
+        warning(QString("Received a stanza from unexpected JID %1").arg(from));
+        return;
+    }
+
+    if (!from.isEmpty()) {
+        emit rawStanzaReceived(data, to);
+        return;
+    }
+
+    // if the sender is empty, set it to the appropriate JID
+    QString sender = d->jid.toString();
+    if (tagName == QLatin1String("presence")) {
+        const QStringRef type = attributes.value("type");
+        if (type == QLatin1String("subscribe") || type == QLatin1String("subscribed"))
+            sender = d->jid.bareJid().toString();
+    }
+
+    // insert the attribute right after the element name
+    const QByteArray attribute = " from=\"" + escapeAttribute(sender) + "\"";
+
+    QByteArray fullData;
+    fullData.reserve(data.size() + attribute.size());
+    fullData.append(data.constData(), pos);
+    fullData.append(attribute);
+    fullData.append(data.constData() + pos, data.size() - pos);
+    emit rawStanzaReceived(fullData, to);
+}
+
+void QXmppIncomingClient::handleLimitExceeded(const QString &limit)
+{
+    updateCounter("incoming-client.limits." + limit);
+}
+
+void QXmppIncomingClient::handleDataReceived(qint64 bytes)
+{
+    d->consume(d->byteBucket, bytes, "incoming-client.throttled.bytes");
+}
 /// \endcond
 
 void QXmppIncomingClient::onDigestReply()
@@ -432,8 +904,8 @@ void QXmppIncomingClient::onPasswordReply()
     const QString jid = QString("%1@%2").arg(d->saslServer->username(), d->domain);
     switch (reply->error()) {
     case QXmppPasswordReply::NoError:
-        d->jid = jid;
-        info(QString("Authentication succeeded for '%1' from %2").arg(d->jid, d->origin()));
+        d->jid = QXmppJid(jid);
+        info(QString("Authentication succeeded for '%1' from %2").arg(jid, d->origin()));
         updateCounter("incoming-client.auth.success");
         sendPacket(QXmppSaslSuccess());
         handleStart();
@@ -453,19 +925,137 @@ void QXmppIncomingClient::onPasswordReply()
     }
 }
 
+/// Hands the state of this detached session over to the stream \a target,
+/// which resumes it, then destroys this stream.
+///
+/// \param target
+/// \param h The sequence number of the last stanza received by the client.
+
+void QXmppIncomingClient::exportSession(QObject *target, uint h)
+{
+    // the client moved to another connection, drop this one if the
+    // server did not notice it was dead yet
+    d->idleTimer->stop();
+    if (socket())
+        socket()->abort();
+
+    setAcknowledgedSequenceNumber(h);
+
+    QVariantList stanzas;
+    foreach (const QByteArray &stanza, unacknowledgedStanzas())
+        stanzas << stanza;
+
+    QVariantMap session;
+    session.insert("jid", d->jid.toString());
+    session.insert("id", d->streamManagementId);
+    session.insert("available", d->available);
+    session.insert("incoming", lastIncomingSequenceNumber());
+    session.insert("outgoing", lastOutgoingSequenceNumber());
+    session.insert("stanzas", stanzas);
+    QMetaObject::invokeMethod(target, "importSession", Qt::QueuedConnection,
+                              Q_ARG(QVariantMap, session));
+
+    deleteLater();
+}
+
+/// Resumes the session described by \a session.
+///
+/// \param session
+
+void QXmppIncomingClient::importSession(const QVariantMap &session)
+{
+    d->jid = QXmppJid(session.value("jid").toString());
+    d->resource = d->jid.resource().toString();
+    d->streamManagementId = session.value("id").toString();
+    d->available = session.value("available").toBool();
+    const unsigned incoming = session.value("incoming").toUInt();
+    const unsigned outgoing = session.value("outgoing").toUInt();
+
+    QList<QByteArray> stanzas;
+    foreach (const QVariant &stanza, session.value("stanzas").toList())
+        stanzas << stanza.toByteArray();
+    info(QString("Resuming session for '%1' from %2, resending %3 stanzas").arg(
+        d->jid.toString(), d->origin(), QString::number(stanzas.size())));
+
+    QByteArray data;
+    QXmlStreamWriter xmlStream(&data);
+    QXmppStreamManagementResumed resumed(incoming, d->streamManagementId);
+    resumed.toXml(&xmlStream);
+    sendData(data);
+
+    resumeStreamManagement(incoming, outgoing, stanzas);
+    emit resumableChanged(d->streamManagementId);
+
+    // send the stanzas which were routed to us in the meantime
+    d->resuming = false;
+    foreach (const QByteArray &stanza, d->resumePending)
+        QXmppStream::sendStanzaData(stanza);
+    d->resumePending.clear();
+}
+
+/// Tells the client its session cannot be resumed.
+
+void QXmppIncomingClient::rejectResume()
+{
+    d->resuming = false;
+    d->resumePending.clear();
+
+    QByteArray data;
+    QXmlStreamWriter xmlStream(&data);
+    QXmppStreamManagementFailed failed(QXmppStanza::Error::ItemNotFound);
+    failed.toXml(&xmlStream);
+    sendData(data);
+}
+
 void QXmppIncomingClient::onSocketDisconnected()
 {
-    info(QString("Socket disconnected for '%1' from %2").arg(d->jid, d->origin()));
-    emit disconnected();
+    d->idleTimer->stop();
+    d->throttleTimer->stop();
+    d->setThrottled(false);
+    info(QString("Socket disconnected for '%1' from %2").arg(d->jid.toString(), d->origin()));
+    if (!d->disconnectSignalled) {
+        d->disconnectSignalled = true;
+        emit disconnected();
+    }
 }
 
 void QXmppIncomingClient::onTimeout()
 {
-    warning(QString("Idle timeout for '%1' from %2").arg(d->jid, d->origin()));
-    disconnectFromHost();
+    warning(QString("Idle timeout for '%1' from %2").arg(d->jid.toString(), d->origin()));
+
+    // a resumable session is only detached
+    if (isResumable() && socket())
+        socket()->disconnectFromHost();
+    else
+        disconnectFromHost();
 
     // make sure disconnected() gets emitted no matter what
-    QTimer::singleShot(30, this, SIGNAL(disconnected()));
+    QTimer::singleShot(30, this, SLOT(onDisconnectTimeout()));
+}
+
+void QXmppIncomingClient::onDisconnectTimeout()
+{
+    if (!d->disconnectSignalled) {
+        d->disconnectSignalled = true;
+        emit disconnected();
+    }
+}
+
+void QXmppIncomingClient::onThrottleTimeout()
+{
+    d->refillBuckets();
+
+    // each kind of throttling ends as soon as its own debt is paid back
+    if (d->byteBucket.msecsUntilAvailable() <= 0)
+        setReadingPaused(false);
+    if (d->stanzaBucket.msecsUntilAvailable() <= 0)
+        setStanzaHandlingPaused(false);
+
+    const int msecs = qMax(d->byteBucket.msecsUntilAvailable(), d->stanzaBucket.msecsUntilAvailable());
+    if (msecs > 0)
+        d->throttleTimer->start(msecs);
+    else
+        d->setThrottled(false);
 }
 
 
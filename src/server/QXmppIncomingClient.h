@@ -24,6 +24,8 @@
 #ifndef QXMPPINCOMINGCLIENT_H
 #define QXMPPINCOMINGCLIENT_H
 
+#include <QVariantMap>
+
 #include "QXmppStream.h"
 
 class QXmppIncomingClientPrivate;
@@ -48,23 +50,77 @@ public:
     QString jid() const;
 
     void setInactivityTimeout(int secs);
+
+    int bytesPerSecond() const;
+    void setBytesPerSecond(int bytes);
+
+    int stanzasPerSecond() const;
+    void setStanzasPerSecond(int stanzas);
+
     void setPasswordChecker(QXmppPasswordChecker *checker);
 
+    int streamResumptionTimeout() const;
+    void setStreamResumptionTimeout(int secs);
+
+    bool isRosterVersioningEnabled() const;
+    void setRosterVersioningEnabled(bool enabled);
+
+    bool isResumable() const;
+    QString streamManagementId() const;
+
+    bool sendStanzaData(const QByteArray &data);
+
 signals:
     /// This signal is emitted when an element is received.
     void elementReceived(const QDomElement &element);
 
+    /// This signal is emitted when the client binds a resource, \a jid
+    /// being its full JID. It is emitted right before connected().
+    void resourceBound(const QString &jid);
+
+    /// This signal is emitted when a stanza selected using
+    /// setRawStanzaTagNames() is received from the bound client
+    /// and should be routed to \a to without further processing.
+    void rawStanzaReceived(const QByteArray &data, const QString &to);
+
+    /// This signal is emitted when the client authenticated as \a jid
+    /// asks to resume the Stream Management session \a previd, having
+    /// received the stanzas up to sequence number \a h (XEP-0198).
+    void resumeRequested(const QString &jid, const QString &previd, uint h);
+
+    /// This signal is emitted when the client enables a resumable Stream
+    /// Management session with the given \a id, or with an empty \a id
+    /// when the session can no longer be resumed (XEP-0198).
+    void resumableChanged(const QString &id);
+
+    /// This signal is emitted when the client bound as \a jid sends an
+    /// available presence with a non-negative priority while it was not
+    /// available, after which it accepts messages addressed to its bare
+    /// JID (RFC 6121).
+    void availablePresenceReceived(const QString &jid);
+
+public slots:
+    void disconnectFromHost();
+
 protected:
     /// \cond
     void handleStream(const QDomElement &element);
     void handleStanza(const QDomElement &element);
+    void handleRawStanza(const QByteArray &data);
+    void handleLimitExceeded(const QString &limit);
+    void handleDataReceived(qint64 bytes);
     /// \endcond
 
 private slots:
+    void exportSession(QObject *target, uint h);
+    void importSession(const QVariantMap &session);
+    void rejectResume();
     void onDigestReply();
     void onPasswordReply();
     void onSocketDisconnected();
     void onTimeout();
+    void onDisconnectTimeout();
+    void onThrottleTimeout();
 
 private:
     Q_DISABLE_COPY(QXmppIncomingClient)
@@ -29,6 +29,7 @@
 #include "QXmppConstants_p.h"
 #include "QXmppDialback.h"
 #include "QXmppIncomingServer.h"
+#include "QXmppJid.h"
 #include "QXmppOutgoingServer.h"
 #include "QXmppStreamFeatures.h"
 #include "QXmppUtils.h"
@@ -86,6 +87,11 @@ QXmppIncomingServer::QXmppIncomingServer(QSslSocket *socket, const QString &doma
     }
 
     info(QString("Incoming server connection from %1").arg(d->origin()));
+
+    // do not let a peer make us hold arbitrary amounts of data
+    setMaximumStanzaSize(512 * 1024);
+    setMaximumStanzaDepth(64);
+    setMaximumBufferSize(1024 * 1024);
 }
 
 /// Destroys the current stream.
@@ -135,6 +141,7 @@ void QXmppIncomingServer::handleStanza(const QDomElement &stanza)
     if (ns == ns_tls && stanza.tagName() == QLatin1String("starttls"))
     {
         sendData("<proceed xmlns='urn:ietf:params:xml:ns:xmpp-tls'/>");
+        flushData();
         socket()->flush();
         socket()->startServerEncryption();
         return;
@@ -174,7 +181,7 @@ void QXmppIncomingServer::handleStanza(const QDomElement &stanza)
         }
 
     }
-    else if (d->authenticated.contains(QXmppUtils::jidToDomain(stanza.attribute("from"))))
+    else if (d->authenticated.contains(QXmppJid(stanza.attribute("from")).domain().toString()))
     {
         // relay stanza if the remote party is authenticated
         emit elementReceived(stanza);
@@ -183,6 +190,11 @@ void QXmppIncomingServer::handleStanza(const QDomElement &stanza)
         disconnectFromHost();
     }
 }
+
+void QXmppIncomingServer::handleLimitExceeded(const QString &limit)
+{
+    updateCounter("incoming-server.limits." + limit);
+}
 /// \endcond
 
 /// Returns true if the socket is connected and the remote server is
@@ -56,6 +56,7 @@ protected:
     /// \cond
     void handleStanza(const QDomElement &stanzaElement);
     void handleStream(const QDomElement &streamElement);
+    void handleLimitExceeded(const QString &limit);
     /// \endcond
 
 private slots:
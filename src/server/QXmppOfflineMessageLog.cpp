@@ -0,0 +1,448 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <cstring>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <QtEndian>
+
+#include "QXmppOfflineMessageLog_p.h"
+
+// Each record starts with a 16-byte header holding the magic number, the
+// record type and the sizes of the bare JID and of the data which follow.
+// The magic number is written last, so that an interrupted write leaves
+// no valid record behind.
+static const quint32 recordMagic = 0x514d4c31;
+static const int recordHeaderSize = 16;
+
+// A remove record holds the number of messages it discards, oldest
+// first, or no data if it discards all of them. A checkpoint record
+// starts a segment written by compaction, which replaces all the
+// segments before it.
+enum RecordType {
+    MessageRecord = 1,
+    RemoveRecord = 2,
+    CheckpointRecord = 3
+};
+
+static QString segmentName(int number, const char *suffix = ".log")
+{
+    return QString("%1%2").arg(number, 8, 10, QLatin1Char('0')).arg(QLatin1String(suffix));
+}
+
+static qint64 recordSize(const uchar *header)
+{
+    return recordHeaderSize + qFromLittleEndian<quint32>(header + 8) + qFromLittleEndian<quint32>(header + 12);
+}
+
+/// Constructs a closed log.
+
+QXmppOfflineMessageLog::QXmppOfflineMessageLog()
+    : m_segmentSize(16 * 1024 * 1024)
+    , m_size(0)
+{
+}
+
+/// Destroys the log, closing it if needed.
+
+QXmppOfflineMessageLog::~QXmppOfflineMessageLog()
+{
+    close();
+}
+
+/// Opens the log stored in the directory \a path, which is created if
+/// needed, and rebuilds the index from the existing segments.
+///
+/// \param path
+
+bool QXmppOfflineMessageLog::open(const QString &path)
+{
+    close();
+
+    QDir dir(path);
+    if (!dir.exists() && !dir.mkpath("."))
+        return false;
+    m_path = dir.absolutePath();
+
+    // remove the output of an interrupted compaction
+    foreach (const QString &name, dir.entryList(QStringList() << "*.tmp", QDir::Files))
+        dir.remove(name);
+
+    foreach (const QString &name, dir.entryList(QStringList() << "*.log", QDir::Files, QDir::Name)) {
+        bool ok;
+        const int number = QFileInfo(name).completeBaseName().toInt(&ok);
+        if (!ok)
+            continue;
+        if (!openSegment(number, 0)) {
+            close();
+            return false;
+        }
+        scanSegment(m_segments.last());
+    }
+
+    if (m_segments.isEmpty() && !openSegment(0, m_segmentSize)) {
+        close();
+        return false;
+    }
+
+    reclaim();
+    return true;
+}
+
+/// Closes the log.
+
+void QXmppOfflineMessageLog::close()
+{
+    foreach (Segment *segment, m_segments)
+        closeSegment(segment, false);
+    m_segments.clear();
+    m_index.clear();
+    m_path.clear();
+    m_size = 0;
+}
+
+/// Returns true if the log is open.
+
+bool QXmppOfflineMessageLog::isOpen() const
+{
+    return !m_segments.isEmpty();
+}
+
+/// Appends a message for the given bare JID.
+///
+/// \param bareJid
+/// \param data
+
+bool QXmppOfflineMessageLog::append(const QString &bareJid, const QByteArray &data)
+{
+    return write(MessageRecord, bareJid, data);
+}
+
+/// Returns the messages stored for the given bare JID, oldest first.
+///
+/// \param bareJid
+
+QList<QByteArray> QXmppOfflineMessageLog::messages(const QString &bareJid) const
+{
+    QList<QByteArray> messages;
+    const QVector<Location> locations = m_index.value(bareJid);
+    foreach (const Location &location, locations) {
+        const Segment *seg = segment(location.segment);
+        const uchar *header = seg->data + location.offset;
+        const quint32 jidSize = qFromLittleEndian<quint32>(header + 8);
+        const quint32 dataSize = qFromLittleEndian<quint32>(header + 12);
+        messages << QByteArray(reinterpret_cast<const char*>(header + recordHeaderSize + jidSize), dataSize);
+    }
+    return messages;
+}
+
+/// Removes the \a count oldest messages stored for the given bare JID,
+/// or all of them if \a count is negative.
+///
+/// Returns false if the removal could not be recorded, in which case
+/// the messages are kept.
+///
+/// \param bareJid
+/// \param count
+
+bool QXmppOfflineMessageLog::remove(const QString &bareJid, int count)
+{
+    if (!m_index.contains(bareJid) || !count)
+        return true;
+
+    QByteArray data;
+    if (count > 0 && count < m_index.value(bareJid).size()) {
+        data.resize(4);
+        qToLittleEndian<quint32>(count, reinterpret_cast<uchar*>(data.data()));
+    }
+    if (!write(RemoveRecord, bareJid, data))
+        return false;
+
+    discard(bareJid, count);
+    reclaim();
+    return true;
+}
+
+/// Returns the number of messages stored for the given bare JID.
+///
+/// \param bareJid
+
+int QXmppOfflineMessageLog::count(const QString &bareJid) const
+{
+    return m_index.value(bareJid).size();
+}
+
+/// Returns the total number of messages stored.
+
+int QXmppOfflineMessageLog::size() const
+{
+    return m_size;
+}
+
+/// Returns the number of segment files.
+
+int QXmppOfflineMessageLog::segmentCount() const
+{
+    return m_segments.size();
+}
+
+/// Returns the size of new segment files in bytes.
+
+qint64 QXmppOfflineMessageLog::segmentSize() const
+{
+    return m_segmentSize;
+}
+
+/// Sets the size of new segment files in bytes.
+///
+/// The default is 16MB. A record which does not fit in a segment of
+/// this size gets a segment of its own.
+///
+/// \param size
+
+void QXmppOfflineMessageLog::setSegmentSize(qint64 size)
+{
+    m_segmentSize = size;
+}
+
+bool QXmppOfflineMessageLog::openSegment(int number, qint64 size)
+{
+    QFile *file = new QFile(QDir(m_path).filePath(segmentName(number)));
+    if (!file->open(QIODevice::ReadWrite)) {
+        delete file;
+        return false;
+    }
+
+    // new segments are zero-filled, which marks the end of the records
+    if (!file->size() && !size)
+        size = m_segmentSize;
+    if (file->size() < size && !file->resize(size)) {
+        delete file;
+        return false;
+    }
+
+    uchar *data = file->map(0, file->size());
+    if (!data) {
+        delete file;
+        return false;
+    }
+
+    Segment *segment = new Segment;
+    segment->number = number;
+    segment->file = file;
+    segment->data = data;
+    segment->size = file->size();
+    segment->used = 0;
+    segment->live = 0;
+    segment->liveBytes = 0;
+    m_segments << segment;
+    return true;
+}
+
+void QXmppOfflineMessageLog::closeSegment(Segment *segment, bool remove)
+{
+    segment->file->unmap(segment->data);
+    if (remove)
+        segment->file->remove();
+    delete segment->file;
+    delete segment;
+}
+
+void QXmppOfflineMessageLog::scanSegment(Segment *segment)
+{
+    qint64 offset = 0;
+    while (offset + recordHeaderSize <= segment->size) {
+        uchar *header = segment->data + offset;
+        const quint32 jidSize = qFromLittleEndian<quint32>(header + 8);
+        const quint32 dataSize = qFromLittleEndian<quint32>(header + 12);
+        const qint64 end = offset + recordHeaderSize + jidSize + dataSize;
+
+        if (qFromLittleEndian<quint32>(header) != recordMagic || end > segment->size) {
+            // wipe the remains of an interrupted write
+            if (jidSize || dataSize)
+                memset(header, 0, qMin(end, segment->size) - offset);
+            break;
+        }
+
+        const QString bareJid = QString::fromUtf8(reinterpret_cast<const char*>(header + recordHeaderSize), jidSize);
+        const quint32 type = qFromLittleEndian<quint32>(header + 4);
+        if (type == MessageRecord) {
+            Location location;
+            location.segment = segment->number;
+            location.offset = offset;
+            m_index[bareJid] << location;
+            segment->live++;
+            segment->liveBytes += end - offset;
+            m_size++;
+        } else if (type == RemoveRecord) {
+            const int count = dataSize >= 4 ? int(qFromLittleEndian<quint32>(header + recordHeaderSize + jidSize)) : -1;
+            discard(bareJid, count);
+        } else if (type == CheckpointRecord) {
+            m_index.clear();
+            m_size = 0;
+            while (m_segments.first() != segment)
+                closeSegment(m_segments.takeFirst(), true);
+        }
+        offset = end;
+    }
+    segment->used = offset;
+}
+
+QXmppOfflineMessageLog::Segment *QXmppOfflineMessageLog::segment(int number) const
+{
+    if (m_segments.isEmpty())
+        return 0;
+    const int i = number - m_segments.first()->number;
+    return (i >= 0 && i < m_segments.size()) ? m_segments.at(i) : 0;
+}
+
+bool QXmppOfflineMessageLog::write(quint32 type, const QString &bareJid, const QByteArray &data)
+{
+    if (m_segments.isEmpty())
+        return false;
+
+    const QByteArray jid = bareJid.toUtf8();
+    const qint64 recordSize = recordHeaderSize + jid.size() + data.size();
+    Segment *seg = m_segments.last();
+    if (seg->used + recordSize > seg->size) {
+        if (!openSegment(seg->number + 1, qMax(m_segmentSize, recordSize)))
+            return false;
+        seg = m_segments.last();
+    }
+
+    const quint32 offset = seg->used;
+    uchar *header = seg->data + offset;
+    qToLittleEndian<quint32>(type, header + 4);
+    qToLittleEndian<quint32>(jid.size(), header + 8);
+    qToLittleEndian<quint32>(data.size(), header + 12);
+    memcpy(header + recordHeaderSize, jid.constData(), jid.size());
+    memcpy(header + recordHeaderSize + jid.size(), data.constData(), data.size());
+    qToLittleEndian<quint32>(recordMagic, header);
+    seg->used += recordSize;
+
+    if (type == MessageRecord) {
+        Location location;
+        location.segment = seg->number;
+        location.offset = offset;
+        m_index[bareJid] << location;
+        seg->live++;
+        seg->liveBytes += recordSize;
+        m_size++;
+    }
+    return true;
+}
+
+void QXmppOfflineMessageLog::discard(const QString &bareJid, int count)
+{
+    QHash<QString, QVector<Location> >::iterator it = m_index.find(bareJid);
+    if (it == m_index.end())
+        return;
+    if (count < 0 || count > it->size())
+        count = it->size();
+
+    for (int i = 0; i < count; ++i) {
+        const Location &location = it->at(i);
+        Segment *seg = segment(location.segment);
+        if (seg) {
+            seg->live--;
+            seg->liveBytes -= recordSize(seg->data + location.offset);
+        }
+    }
+    it->remove(0, count);
+    if (it->isEmpty())
+        m_index.erase(it);
+    m_size -= count;
+}
+
+/// Deletes the oldest segments as long as they hold no message, then
+/// compacts the log if less than half of it holds messages.
+///
+/// Only a prefix of the log can be deleted, as a remove record must
+/// outlive the messages it discards.
+
+void QXmppOfflineMessageLog::reclaim()
+{
+    while (m_segments.size() > 1 && !m_segments.first()->live)
+        closeSegment(m_segments.takeFirst(), true);
+
+    qint64 used = 0;
+    qint64 liveBytes = 0;
+    foreach (const Segment *seg, m_segments) {
+        used += seg->used;
+        liveBytes += seg->liveBytes;
+    }
+    if (m_segments.size() > 1 && 2 * liveBytes < used)
+        compact();
+}
+
+/// Copies the messages into a new segment starting with a checkpoint
+/// record, and deletes all the other segments.
+///
+/// The segment is written to a temporary file which is renamed once
+/// complete, so that an interrupted compaction leaves the log as it was.
+/// If the server stops before the old segments are deleted, the
+/// checkpoint discards them when the log is opened again.
+
+bool QXmppOfflineMessageLog::compact()
+{
+    const int number = m_segments.last()->number + 1;
+    QDir dir(m_path);
+    QFile file(dir.filePath(segmentName(number, ".tmp")));
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    uchar checkpoint[recordHeaderSize];
+    memset(checkpoint, 0, recordHeaderSize);
+    qToLittleEndian<quint32>(recordMagic, checkpoint);
+    qToLittleEndian<quint32>(CheckpointRecord, checkpoint + 4);
+    bool ok = file.write(reinterpret_cast<const char*>(checkpoint), recordHeaderSize) == recordHeaderSize;
+
+    QHash<QString, QVector<Location> >::const_iterator it;
+    for (it = m_index.constBegin(); ok && it != m_index.constEnd(); ++it) {
+        foreach (const Location &location, it.value()) {
+            const uchar *header = segment(location.segment)->data + location.offset;
+            const qint64 size = recordSize(header);
+            if (file.write(reinterpret_cast<const char*>(header), size) != size) {
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    // new segments are zero-filled, which marks the end of the records
+    if (ok && file.pos() < m_segmentSize)
+        ok = file.resize(m_segmentSize);
+    file.close();
+    if (!ok || !dir.rename(segmentName(number, ".tmp"), segmentName(number))) {
+        file.remove();
+        return false;
+    }
+
+    // scanning the new segment deletes the old ones
+    if (!openSegment(number, 0)) {
+        dir.remove(segmentName(number));
+        return false;
+    }
+    scanSegment(m_segments.last());
+    return true;
+}
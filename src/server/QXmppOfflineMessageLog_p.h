@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef QXMPPOFFLINEMESSAGELOG_P_H
+#define QXMPPOFFLINEMESSAGELOG_P_H
+
+#include <QHash>
+#include <QList>
+#include <QVector>
+
+#include "QXmppGlobal.h"
+
+class QFile;
+
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QXmpp API.  It exists for the convenience
+// of the QXmppOfflineMessageStore class.
+//
+// This header file may change from version to version without notice,
+// or even be removed.
+//
+// We mean it.
+//
+
+/// \brief The QXmppOfflineMessageLog class stores serialized messages in
+/// an append-only log of memory-mapped segment files.
+///
+/// Only the location of each message is kept in memory, indexed by bare
+/// JID. Removing the messages of a JID appends a record which discards
+/// them, and the oldest segments are deleted once they hold no message.
+/// When discarded records take up most of the log, the remaining messages
+/// are copied into a new segment which replaces all the others.
+///
+/// When the log is opened, the existing segments are scanned to rebuild
+/// the index, which only requires reading the record headers.
+
+class QXMPP_AUTOTEST_EXPORT QXmppOfflineMessageLog
+{
+public:
+    QXmppOfflineMessageLog();
+    ~QXmppOfflineMessageLog();
+
+    bool open(const QString &path);
+    void close();
+    bool isOpen() const;
+
+    bool append(const QString &bareJid, const QByteArray &data);
+    QList<QByteArray> messages(const QString &bareJid) const;
+    bool remove(const QString &bareJid, int count = -1);
+
+    int count(const QString &bareJid) const;
+    int size() const;
+    int segmentCount() const;
+
+    qint64 segmentSize() const;
+    void setSegmentSize(qint64 size);
+
+private:
+    struct Location
+    {
+        int segment;
+        quint32 offset;
+    };
+
+    struct Segment
+    {
+        int number;
+        QFile *file;
+        uchar *data;
+        qint64 size;
+        qint64 used;
+        int live;
+        qint64 liveBytes;
+    };
+
+    bool openSegment(int number, qint64 size);
+    void closeSegment(Segment *segment, bool remove);
+    void scanSegment(Segment *segment);
+    Segment *segment(int number) const;
+    bool write(quint32 type, const QString &bareJid, const QByteArray &data);
+    void discard(const QString &bareJid, int count);
+    void reclaim();
+    bool compact();
+
+    QString m_path;
+    qint64 m_segmentSize;
+    int m_size;
+    QList<Segment*> m_segments;
+    QHash<QString, QVector<Location> > m_index;
+};
+
+#endif
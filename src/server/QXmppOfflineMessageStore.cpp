@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QDateTime>
+#include <QDomElement>
+#include <QStringList>
+#include <QXmlStreamWriter>
+
+#include "QXmppMessage.h"
+#include "QXmppOfflineMessageLog_p.h"
+#include "QXmppOfflineMessageStore.h"
+#include "QXmppServer.h"
+#include "QXmppUtils.h"
+
+class QXmppOfflineMessageStorePrivate
+{
+public:
+    QXmppOfflineMessageStorePrivate();
+
+    QXmppOfflineMessageLog log;
+    QString path;
+    int maxMessages;
+};
+
+QXmppOfflineMessageStorePrivate::QXmppOfflineMessageStorePrivate()
+    : maxMessages(1000)
+{
+}
+
+/// Constructs a new offline message store.
+
+QXmppOfflineMessageStore::QXmppOfflineMessageStore()
+    : d(new QXmppOfflineMessageStorePrivate)
+{
+    setHandledStanzaTags(QStringList() << "message");
+    setHandledStanzaTargets(LocalUserTarget);
+}
+
+/// Destroys the offline message store.
+
+QXmppOfflineMessageStore::~QXmppOfflineMessageStore()
+{
+    delete d;
+}
+
+/// Returns the directory in which messages are stored.
+
+QString QXmppOfflineMessageStore::path() const
+{
+    return d->path;
+}
+
+/// Sets the directory in which messages are stored.
+///
+/// This must be called before the server is started.
+///
+/// \param path
+
+void QXmppOfflineMessageStore::setPath(const QString &path)
+{
+    d->path = path;
+}
+
+/// Returns the maximum number of messages stored for a user.
+
+int QXmppOfflineMessageStore::maxMessages() const
+{
+    return d->maxMessages;
+}
+
+/// Sets the maximum number of messages stored for a user, further
+/// messages are dropped. The default is 1000.
+///
+/// \param messages
+
+void QXmppOfflineMessageStore::setMaxMessages(int messages)
+{
+    d->maxMessages = messages;
+}
+
+/// Returns the number of messages stored for the given bare JID.
+///
+/// \param bareJid
+
+int QXmppOfflineMessageStore::messageCount(const QString &bareJid) const
+{
+    return d->log.count(bareJid);
+}
+
+/// \cond
+int QXmppOfflineMessageStore::extensionPriority() const
+{
+    // let the other extensions see messages first
+    return -1000;
+}
+
+QStringList QXmppOfflineMessageStore::discoveryFeatures() const
+{
+    return QStringList() << "msgoffline";
+}
+
+bool QXmppOfflineMessageStore::handleStanza(const QDomElement &element)
+{
+    if (element.tagName() != QLatin1String("message") || !d->log.isOpen())
+        return false;
+
+    // only store messages for local users
+    const QString to = element.attribute("to");
+    if (QXmppUtils::jidToDomain(to) != server()->domain() || QXmppUtils::jidToUser(to).isEmpty())
+        return false;
+
+    const QString type = element.attribute("type");
+    if (type == QLatin1String("error") || type == QLatin1String("groupchat") || type == QLatin1String("headline"))
+        return false;
+
+    // deliver the message if the user is online
+    if (server()->sendElement(element))
+        return true;
+
+    const QString bareJid = QXmppUtils::jidToBareJid(to);
+    if (d->log.count(bareJid) >= d->maxMessages) {
+        warning(QString("Offline storage for %1 is full").arg(bareJid));
+        updateCounter("offline.dropped", 1);
+        return false;
+    }
+
+    // record when the message was received (XEP-0203)
+    QXmppMessage message;
+    message.parse(element);
+    if (!message.stamp().isValid())
+        message.setStamp(QDateTime::currentDateTime().toUTC());
+
+    QByteArray data;
+    QXmlStreamWriter xmlStream(&data);
+    message.toXml(&xmlStream);
+    if (!d->log.append(bareJid, data)) {
+        warning(QString("Could not store offline message for %1").arg(bareJid));
+        return false;
+    }
+
+    updateCounter("offline.stored", 1);
+    setGauge("offline.messages", d->log.size());
+    return true;
+}
+
+bool QXmppOfflineMessageStore::start()
+{
+    bool check;
+    Q_UNUSED(check);
+
+    if (!d->log.open(d->path)) {
+        warning(QString("Could not open offline message store in %1").arg(d->path));
+        return false;
+    }
+    info(QString("Opened offline message store with %1 messages").arg(d->log.size()));
+    setGauge("offline.messages", d->log.size());
+
+    check = connect(server(), SIGNAL(clientAvailable(QString)),
+                    this, SLOT(_q_clientAvailable(QString)));
+    Q_ASSERT(check);
+    return true;
+}
+
+void QXmppOfflineMessageStore::stop()
+{
+    disconnect(server(), SIGNAL(clientAvailable(QString)),
+               this, SLOT(_q_clientAvailable(QString)));
+    d->log.close();
+}
+/// \endcond
+
+void QXmppOfflineMessageStore::_q_clientAvailable(const QString &jid)
+{
+    const QString bareJid = QXmppUtils::jidToBareJid(jid);
+    const QList<QByteArray> messages = d->log.messages(bareJid);
+    if (messages.isEmpty())
+        return;
+
+    // only forget the messages the client's stream accepted
+    const int delivered = server()->deliverData(jid, messages);
+    if (delivered < messages.size())
+        warning(QString("Delivered %1 of %2 offline messages to %3").arg(
+            QString::number(delivered), QString::number(messages.size()), jid));
+    if (!d->log.remove(bareJid, delivered))
+        warning(QString("Could not remove delivered offline messages for %1").arg(bareJid));
+
+    updateCounter("offline.delivered", delivered);
+    setGauge("offline.messages", d->log.size());
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef QXMPPOFFLINEMESSAGESTORE_H
+#define QXMPPOFFLINEMESSAGESTORE_H
+
+#include "QXmppServerExtension.h"
+
+class QXmppOfflineMessageStorePrivate;
+
+/// \brief The QXmppOfflineMessageStore class is a QXmppServer extension
+/// which stores the messages sent to local users who are offline, and
+/// delivers them when the user sends an available presence with a
+/// non-negative priority (XEP-0160).
+///
+/// The messages are written to an append-only log of memory-mapped
+/// files in the directory set with setPath(), so that they survive a
+/// restart of the server. Only their location is kept in memory, and
+/// a message is only removed once the user's stream accepted it.
+///
+/// Groupchat, headline and error messages are not stored.
+///
+/// \ingroup Core
+
+class QXMPP_EXPORT QXmppOfflineMessageStore : public QXmppServerExtension
+{
+    Q_OBJECT
+    Q_CLASSINFO("ExtensionName", "offline")
+
+public:
+    QXmppOfflineMessageStore();
+    ~QXmppOfflineMessageStore();
+
+    QString path() const;
+    void setPath(const QString &path);
+
+    int maxMessages() const;
+    void setMaxMessages(int messages);
+
+    int messageCount(const QString &bareJid) const;
+
+    /// \cond
+    int extensionPriority() const;
+    QStringList discoveryFeatures() const;
+    bool handleStanza(const QDomElement &element);
+    bool start();
+    void stop();
+    /// \endcond
+
+private slots:
+    void _q_clientAvailable(const QString &jid);
+
+private:
+    QXmppOfflineMessageStorePrivate * const d;
+};
+
+#endif
@@ -22,26 +22,43 @@
  */
 
 #include <QDomElement>
+#include <QElapsedTimer>
 #include <QSslKey>
 #include <QSslSocket>
 #include <QTimer>
-#if (QT_VERSION >= QT_VERSION_CHECK(5, 0, 0))
-#include <QDnsLookup>
-#else
-#include "qdnslookup.h"
-#endif
 
 #include "QXmppConstants_p.h"
 #include "QXmppDialback.h"
+#include "QXmppDnsCache_p.h"
 #include "QXmppOutgoingServer.h"
+#include "QXmppSocketConnector_p.h"
 #include "QXmppStreamFeatures.h"
 #include "QXmppUtils.h"
 
 class QXmppOutgoingServerPrivate
 {
 public:
-    QList<QByteArray> dataQueue;
-    QDnsLookup dns;
+    QXmppOutgoingServerPrivate(QXmppOutgoingServer *qq);
+    void dropData(const QByteArray &data, QXmppStanza::Error::Condition condition);
+    void dropQueue(QXmppStanza::Error::Condition condition);
+    void setSocket(QSslSocket *socket);
+
+    // data waiting for the stream to be ready
+    struct QueuedData
+    {
+        QByteArray data;
+        qint64 queued;
+    };
+    QList<QueuedData> dataQueue;
+    qint64 queueBytes;
+    int maximumQueueSize;
+    int queueTimeout;
+    QElapsedTimer queueClock;
+    QTimer *queueTimer;
+
+    QXmppDnsReply *dns;
+    QXmppSocketConnector *connector;
+    QElapsedTimer connectClock;
     QString localDomain;
     QString localStreamKey;
     QString remoteDomain;
@@ -49,8 +66,83 @@ public:
     QString verifyKey;
     QTimer *dialbackTimer;
     bool ready;
+
+private:
+    QXmppOutgoingServer *q;
 };
 
+QXmppOutgoingServerPrivate::QXmppOutgoingServerPrivate(QXmppOutgoingServer *qq)
+    : queueBytes(0)
+    , maximumQueueSize(1024 * 1024)
+    , queueTimeout(60)
+    , queueTimer(0)
+    , dns(0)
+    , connector(0)
+    , dialbackTimer(0)
+    , ready(false)
+    , q(qq)
+{
+}
+
+static bool isPresence(const QByteArray &data)
+{
+    return data.startsWith("<presence");
+}
+
+void QXmppOutgoingServerPrivate::dropData(const QByteArray &data, QXmppStanza::Error::Condition condition)
+{
+    if (condition == QXmppStanza::Error::RemoteServerTimeout)
+        q->updateCounter("outgoing-server.queue.expired");
+    else if (condition == QXmppStanza::Error::ResourceConstraint)
+        q->updateCounter("outgoing-server.queue.overflow");
+    else
+        q->updateCounter("outgoing-server.queue.undelivered");
+    emit q->queuedDataDropped(data, condition);
+}
+
+/// Drops all the queued data, for instance because the remote server
+/// could not be reached.
+
+void QXmppOutgoingServerPrivate::dropQueue(QXmppStanza::Error::Condition condition)
+{
+    if (dataQueue.isEmpty())
+        return;
+
+    const QList<QueuedData> dropped = dataQueue;
+    dataQueue.clear();
+    queueBytes = 0;
+    queueTimer->stop();
+    foreach (const QueuedData &item, dropped)
+        dropData(item.data, condition);
+    emit q->queueChanged();
+}
+
+void QXmppOutgoingServerPrivate::setSocket(QSslSocket *socket)
+{
+    bool check;
+    Q_UNUSED(check);
+
+    QSslSocket *previous = q->socket();
+    if (previous) {
+        previous->disconnect(q);
+        previous->deleteLater();
+    }
+    socket->setParent(q);
+    q->setSocket(socket);
+
+    check = QObject::connect(socket, SIGNAL(disconnected()),
+                             q, SLOT(_q_socketDisconnected()));
+    Q_ASSERT(check);
+
+    check = QObject::connect(socket, SIGNAL(error(QAbstractSocket::SocketError)),
+                             q, SLOT(socketError(QAbstractSocket::SocketError)));
+    Q_ASSERT(check);
+
+    check = QObject::connect(socket, SIGNAL(sslErrors(QList<QSslError>)),
+                             q, SLOT(slotSslErrors(QList<QSslError>)));
+    Q_ASSERT(check);
+}
+
 /// Constructs a new outgoing server-to-server stream.
 ///
 /// \param domain the local domain
@@ -59,26 +151,22 @@ public:
 
 QXmppOutgoingServer::QXmppOutgoingServer(const QString &domain, QObject *parent)
     : QXmppStream(parent),
-    d(new QXmppOutgoingServerPrivate)
+    d(new QXmppOutgoingServerPrivate(this))
 {
     bool check;
     Q_UNUSED(check);
 
     // socket initialisation
-    QSslSocket *socket = new QSslSocket(this);
-    setSocket(socket);
+    d->setSocket(new QSslSocket(this));
 
-    check = connect(socket, SIGNAL(disconnected()),
-                    this, SLOT(_q_socketDisconnected()));
+    // connection attempts
+    d->connector = new QXmppSocketConnector(this);
+    check = connect(d->connector, SIGNAL(connected(QSslSocket*)),
+                    this, SLOT(_q_connectorConnected(QSslSocket*)));
     Q_ASSERT(check);
 
-    check = connect(socket, SIGNAL(error(QAbstractSocket::SocketError)),
-                    this, SLOT(socketError(QAbstractSocket::SocketError)));
-    Q_ASSERT(check);
-
-    // DNS lookups
-    check = connect(&d->dns, SIGNAL(finished()),
-                    this, SLOT(_q_dnsLookupFinished()));
+    check = connect(d->connector, SIGNAL(failed(QSslSocket*)),
+                    this, SLOT(_q_connectorFailed(QSslSocket*)));
     Q_ASSERT(check);
 
     d->dialbackTimer = new QTimer(this);
@@ -88,12 +176,14 @@ QXmppOutgoingServer::QXmppOutgoingServer(const QString &domain, QObject *parent)
                     this, SLOT(sendDialback()));
     Q_ASSERT(check);
 
-    d->localDomain = domain;
-    d->ready = false;
-
-    check = connect(socket, SIGNAL(sslErrors(QList<QSslError>)),
-                    this, SLOT(slotSslErrors(QList<QSslError>)));
+    d->queueClock.start();
+    d->queueTimer = new QTimer(this);
+    d->queueTimer->setInterval(1000);
+    check = connect(d->queueTimer, SIGNAL(timeout()),
+                    this, SLOT(_q_expireQueue()));
     Q_ASSERT(check);
+
+    d->localDomain = domain;
 }
 
 /// Destroys the stream.
@@ -114,45 +204,130 @@ void QXmppOutgoingServer::connectToHost(const QString &domain)
 
     // lookup server for domain
     debug(QString("Looking up server for domain %1").arg(domain));
-    d->dns.setName("_xmpp-server._tcp." + domain);
-    d->dns.setType(QDnsLookup::SRV);
-    d->dns.lookup();
+    d->connector->abort();
+    delete d->dns;
+    d->dns = QXmppDnsCache::instance()->lookup(QDnsLookup::SRV, "_xmpp-server._tcp." + domain);
+    d->dns->setParent(this);
+
+    bool check;
+    Q_UNUSED(check);
+    check = connect(d->dns, SIGNAL(finished()),
+                    this, SLOT(_q_dnsLookupFinished()));
+    Q_ASSERT(check);
 }
 
-void QXmppOutgoingServer::_q_dnsLookupFinished()
+/// Disconnects from the remote server, cancelling any connection attempt
+/// in progress.
+
+void QXmppOutgoingServer::disconnectFromHost()
 {
-    QString host;
-    quint16 port;
+    delete d->dns;
+    d->dns = 0;
+    d->connector->abort();
+    QXmppStream::disconnectFromHost();
+}
 
-    if (d->dns.error() == QDnsLookup::NoError &&
-        !d->dns.serviceRecords().isEmpty()) {
-        // take the first returned record
-        host = d->dns.serviceRecords().first().target();
-        port = d->dns.serviceRecords().first().port();
+void QXmppOutgoingServer::_q_dnsLookupFinished()
+{
+    QXmppDnsReply *dns = d->dns;
+    if (!dns)
+        return;
+    d->dns = 0;
+    dns->deleteLater();
+
+    if (dns->source() == QXmppDnsReply::CacheSource)
+        emit updateCounter("dns.cache.hits");
+    else if (dns->source() == QXmppDnsReply::PendingSource)
+        emit updateCounter("dns.cache.coalesced");
+    else
+        emit updateCounter("dns.cache.misses");
+
+    d->connector->abort();
+    if (dns->error() == QDnsLookup::NoError &&
+        !dns->serviceRecords().isEmpty()) {
+        // try the records in the order they were returned
+        foreach (const QDnsServiceRecord &record, dns->serviceRecords()) {
+            info(QString("Connecting to %1:%2").arg(record.target(), QString::number(record.port())));
+            d->connector->addTarget(record.target(), record.port());
+        }
     } else {
         // as a fallback, use domain as the host name
         warning(QString("Lookup for domain %1 failed: %2")
-                .arg(d->dns.name(), d->dns.errorString()));
-        host = d->remoteDomain;
-        port = 5269;
+                .arg(dns->name(), dns->errorString()));
+        info(QString("Connecting to %1:%2").arg(d->remoteDomain, QString::number(5269)));
+        d->connector->addTarget(d->remoteDomain, 5269);
     }
 
+    // race the connection attempts
+    d->connectClock.start();
+    d->connector->start();
+}
+
+void QXmppOutgoingServer::_q_connectorConnected(QSslSocket *socket)
+{
+    const qint64 msecs = d->connectClock.elapsed();
+    emit updateCounter("outgoing-server.connect.parallel.success");
+    emit updateCounter("outgoing-server.connect.parallel.attempts", d->connector->attempts());
+    emit updateCounter("outgoing-server.connect.parallel.msecs", msecs);
+    emit updateCounter("outgoing-server.connect.parallel.latency." + QXmppSocketConnector::latencyBucket(msecs));
+
 #if (QT_VERSION >= QT_VERSION_CHECK(4, 8, 0))
     // set the name the SSL certificate should match
-    socket()->setPeerVerifyName(d->remoteDomain);
+    socket->setPeerVerifyName(d->remoteDomain);
 #endif
 
-    // connect to server
-    info(QString("Connecting to %1:%2").arg(host, QString::number(port)));
-    socket()->connectToHost(host, port);
+    d->setSocket(socket);
+    info(QString("Socket connected to %1 %2").arg(
+        socket->peerAddress().toString(),
+        QString::number(socket->peerPort())));
+    handleStart();
+}
+
+void QXmppOutgoingServer::_q_connectorFailed(QSslSocket *socket)
+{
+    emit updateCounter("outgoing-server.connect.parallel.failure");
+    emit updateCounter("outgoing-server.connect.parallel.attempts", d->connector->attempts());
+
+    QAbstractSocket::SocketError error = QAbstractSocket::HostNotFoundError;
+    if (socket) {
+        warning(QString("Socket error: " + socket->errorString()));
+        error = socket->error();
+        delete socket;
+    } else {
+        warning(QString("No address found for domain %1").arg(d->remoteDomain));
+    }
+    socketError(error);
 }
 
 void QXmppOutgoingServer::_q_socketDisconnected()
 {
     debug("Socket disconnected");
+    d->dropQueue(QXmppStanza::Error::RemoteServerNotFound);
     emit disconnected();
 }
 
+void QXmppOutgoingServer::_q_expireQueue()
+{
+    if (d->queueTimeout <= 0) {
+        d->queueTimer->stop();
+        return;
+    }
+
+    const qint64 cutoff = d->queueClock.elapsed() - qint64(d->queueTimeout) * 1000;
+    bool changed = false;
+    while (!d->dataQueue.isEmpty() && d->dataQueue.first().queued <= cutoff) {
+        const QByteArray data = d->dataQueue.takeFirst().data;
+        d->queueBytes -= data.size();
+        d->dropData(data, QXmppStanza::Error::RemoteServerTimeout);
+        changed = true;
+    }
+
+    if (d->dataQueue.isEmpty())
+        d->queueTimer->stop();
+    if (changed)
+        emit queueChanged();
+}
+
 /// \cond
 
 void QXmppOutgoingServer::handleStart()
@@ -239,9 +414,14 @@ void QXmppOutgoingServer::handleStanza(const QDomElement &stanza)
                 d->ready = true;
 
                 // send queued data
-                foreach (const QByteArray &data, d->dataQueue)
-                    sendData(data);
-                d->dataQueue.clear();
+                if (!d->dataQueue.isEmpty()) {
+                    foreach (const QXmppOutgoingServerPrivate::QueuedData &item, d->dataQueue)
+                        sendData(item.data);
+                    d->dataQueue.clear();
+                    d->queueBytes = 0;
+                    d->queueTimer->stop();
+                    emit queueChanged();
+                }
 
                 // emit signal
                 emit connected();
@@ -291,16 +471,109 @@ void QXmppOutgoingServer::setVerify(const QString &id, const QString &key)
     d->verifyKey = key;
 }
 
+/// Returns the maximum number of bytes queued while the stream is not
+/// ready.
+
+int QXmppOutgoingServer::maximumQueueSize() const
+{
+    return d->maximumQueueSize;
+}
+
+/// Sets the maximum number of bytes queued while the stream is not
+/// ready.
+///
+/// When the queue is full, queued presences are dropped first, oldest
+/// first, since they are superseded by newer ones. If there are none
+/// left, the new data is dropped. The default value is 1 MiB, 0 means
+/// there is no limit.
+///
+/// \param bytes
+
+void QXmppOutgoingServer::setMaximumQueueSize(int bytes)
+{
+    d->maximumQueueSize = bytes;
+}
+
+/// Returns the number of seconds after which queued data is dropped if
+/// the stream is still not ready.
+
+int QXmppOutgoingServer::queueTimeout() const
+{
+    return d->queueTimeout;
+}
+
+/// Sets the number of seconds after which queued data is dropped if the
+/// stream is still not ready.
+///
+/// The default value is 60 seconds, 0 means data never expires.
+///
+/// \param secs
+
+void QXmppOutgoingServer::setQueueTimeout(int secs)
+{
+    d->queueTimeout = secs;
+}
+
+/// Returns the number of stanzas waiting for the stream to be ready.
+
+int QXmppOutgoingServer::queuedStanzas() const
+{
+    return d->dataQueue.size();
+}
+
+/// Returns the number of bytes waiting for the stream to be ready.
+
+qint64 QXmppOutgoingServer::queuedBytes() const
+{
+    return d->queueBytes;
+}
+
 /// Sends or queues data until connected.
 ///
+/// Data which is dropped from the queue, because it expired or because the
+/// queue is full, is reported with the queuedDataDropped() signal.
+///
 /// \param data
 
 void QXmppOutgoingServer::queueData(const QByteArray &data)
 {
-    if (isConnected())
+    if (isConnected()) {
         sendData(data);
-    else
-        d->dataQueue.append(data);
+        return;
+    }
+
+    // make room for the new data
+    bool evicted = false;
+    if (d->maximumQueueSize > 0) {
+        while (d->queueBytes + data.size() > d->maximumQueueSize) {
+            int index = -1;
+            for (int i = 0; i < d->dataQueue.size(); ++i) {
+                if (isPresence(d->dataQueue.at(i).data)) {
+                    index = i;
+                    break;
+                }
+            }
+            if (index < 0) {
+                d->dropData(data, QXmppStanza::Error::ResourceConstraint);
+                if (evicted)
+                    emit queueChanged();
+                return;
+            }
+            const QByteArray dropped = d->dataQueue.takeAt(index).data;
+            d->queueBytes -= dropped.size();
+            d->dropData(dropped, QXmppStanza::Error::ResourceConstraint);
+            evicted = true;
+        }
+    }
+
+    QXmppOutgoingServerPrivate::QueuedData item;
+    item.data = data;
+    item.queued = d->queueClock.elapsed();
+    d->dataQueue.append(item);
+    d->queueBytes += data.size();
+    if (d->queueTimeout > 0 && !d->queueTimer->isActive())
+        d->queueTimer->start();
+    emit queueChanged();
 }
 
 /// Returns the remote server's domain.
@@ -348,6 +621,7 @@ void QXmppOutgoingServer::slotSslErrors(const QList<QSslError> &errors)
 void QXmppOutgoingServer::socketError(QAbstractSocket::SocketError error)
 {
     Q_UNUSED(error);
+    d->dropQueue(QXmppStanza::Error::RemoteServerNotFound);
     emit disconnected();
 }
 
@@ -26,6 +26,7 @@
 
 #include <QAbstractSocket>
 
+#include "QXmppStanza.h"
 #include "QXmppStream.h"
 
 class QSslError;
@@ -53,10 +54,27 @@ public:
 
     QString remoteDomain() const;
 
+    int maximumQueueSize() const;
+    void setMaximumQueueSize(int bytes);
+
+    int queueTimeout() const;
+    void setQueueTimeout(int secs);
+
+    int queuedStanzas() const;
+    qint64 queuedBytes() const;
+
 signals:
     /// This signal is emitted when a dialback verify response is received.
     void dialbackResponseReceived(const QXmppDialback &response);
 
+    /// This signal is emitted when data is added to or removed from the
+    /// queue of data waiting for the stream to be ready.
+    void queueChanged();
+
+    /// This signal is emitted when queued \a data is dropped without being
+    /// sent, \a condition tells why.
+    void queuedDataDropped(const QByteArray &data, QXmppStanza::Error::Condition condition);
+
 protected:
     /// \cond
     void handleStart();
@@ -66,10 +84,14 @@ protected:
 
 public slots:
     void connectToHost(const QString &domain);
+    virtual void disconnectFromHost();
     void queueData(const QByteArray &data);
 
 private slots:
+    void _q_connectorConnected(QSslSocket *socket);
+    void _q_connectorFailed(QSslSocket *socket);
     void _q_dnsLookupFinished();
+    void _q_expireQueue();
     void _q_socketDisconnected();
     void sendDialback();
     void slotSslErrors(const QList<QSslError> &errors);
@@ -78,6 +100,7 @@ private slots:
 private:
     Q_DISABLE_COPY(QXmppOutgoingServer)
     QXmppOutgoingServerPrivate* const d;
+    friend class QXmppOutgoingServerPrivate;
 };
 
 #endif
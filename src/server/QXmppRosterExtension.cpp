@@ -0,0 +1,713 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <algorithm>
+
+#include <QDomElement>
+#include <QMap>
+#include <QStringList>
+#include <QXmlStreamWriter>
+
+#include "QXmppConstants_p.h"
+#include "QXmppPresence.h"
+#include "QXmppRosterExtension.h"
+#include "QXmppServer.h"
+#include "QXmppUtils.h"
+
+// The subscription types None, From, To and Both are bit flags.
+static const quint8 subscriptionFrom = QXmppRosterIq::Item::From;
+static const quint8 subscriptionTo = QXmppRosterIq::Item::To;
+
+// Number of item removals remembered for roster deltas.
+static const int maxRemovals = 256;
+
+struct QXmppRosterEntry
+{
+    QXmppRosterEntry() : subscription(0), ask(false), version(0) {}
+
+    QString jid;
+    QString name;
+    QStringList groups;
+    quint8 subscription;
+    bool ask;
+    int version;
+};
+
+struct QXmppRosterRemoval
+{
+    QString jid;
+    int version;
+};
+
+struct QXmppUserRoster
+{
+    QXmppUserRoster() : version(0), horizon(0) {}
+
+    int version;
+    // the oldest version from which deltas can be computed
+    int horizon;
+    // the items, sorted by JID
+    QVector<QXmppRosterEntry> entries;
+    QVector<QXmppRosterRemoval> removals;
+    // the contacts which receive the user's presence, and those whose
+    // presence the user receives
+    QSet<QString> subscribers;
+    QSet<QString> subscriptions;
+};
+
+struct QXmppResourcePresence
+{
+    QXmppPresence presence;
+    QByteArray data;
+};
+
+static bool entryLessThan(const QXmppRosterEntry &entry, const QString &jid)
+{
+    return entry.jid < jid;
+}
+
+static QXmppRosterIq::Item entryToItem(const QXmppRosterEntry &entry)
+{
+    QXmppRosterIq::Item item;
+    item.setBareJid(entry.jid);
+    item.setName(entry.name);
+    item.setGroups(entry.groups.toSet());
+    item.setSubscriptionType(static_cast<QXmppRosterIq::Item::SubscriptionType>(entry.subscription));
+    if (entry.ask)
+        item.setSubscriptionStatus("subscribe");
+    return item;
+}
+
+class QXmppRosterExtensionPrivate
+{
+public:
+    QXmppRosterExtensionPrivate(QXmppRosterExtension *qq);
+
+    int indexOf(const QXmppUserRoster &roster, const QString &jid) const;
+    void updateEntry(const QString &bareJid, QXmppRosterEntry entry);
+    void removeEntry(const QString &bareJid, const QString &jid);
+    void push(const QString &to, const QXmppRosterIq::Item &item, int version);
+    QString versionString(int version) const;
+    bool parseVersion(const QString &ver, int &version) const;
+
+    bool isLocal(const QString &jid) const;
+    void handleRosterIq(const QDomElement &element);
+    void handleOutboundSubscription(const QString &from, const QString &to, QXmppPresence::Type type);
+    void handleInboundSubscription(const QString &from, const QString &to, QXmppPresence::Type type);
+    void sendSubscription(const QString &from, const QString &to, QXmppPresence::Type type);
+    void broadcast(const QString &jid, const QXmppPresence &presence);
+    void sendPresences(const QString &bareJid, const QString &to);
+    void sendUnavailable(const QString &bareJid, const QString &to);
+
+    QHash<QString, QXmppUserRoster> rosters;
+    QHash<QString, QHash<QString, QXmppResourcePresence> > presences;
+
+    // versions only count changes since the extension was created, so
+    // they are prefixed with a random epoch to tell them apart from the
+    // versions of an earlier run
+    QString epoch;
+
+private:
+    QXmppRosterExtension *q;
+};
+
+QXmppRosterExtensionPrivate::QXmppRosterExtensionPrivate(QXmppRosterExtension *qq)
+    : epoch(QXmppUtils::generateStanzaHash(8))
+    , q(qq)
+{
+}
+
+/// Returns the index of the item for \a jid, or -1 if there is none.
+
+int QXmppRosterExtensionPrivate::indexOf(const QXmppUserRoster &roster, const QString &jid) const
+{
+    QVector<QXmppRosterEntry>::const_iterator it = std::lower_bound(
+        roster.entries.constBegin(), roster.entries.constEnd(), jid, entryLessThan);
+    if (it != roster.entries.constEnd() && it->jid == jid)
+        return it - roster.entries.constBegin();
+    return -1;
+}
+
+/// Adds or updates a roster item, and pushes it to the user.
+
+void QXmppRosterExtensionPrivate::updateEntry(const QString &bareJid, QXmppRosterEntry entry)
+{
+    QXmppUserRoster &roster = rosters[bareJid];
+    entry.version = ++roster.version;
+
+    QVector<QXmppRosterEntry>::iterator it = std::lower_bound(
+        roster.entries.begin(), roster.entries.end(), entry.jid, entryLessThan);
+    if (it != roster.entries.end() && it->jid == entry.jid)
+        *it = entry;
+    else
+        roster.entries.insert(it, entry);
+
+    // the item supersedes its previous removal
+    for (int i = 0; i < roster.removals.size(); ++i) {
+        if (roster.removals[i].jid == entry.jid) {
+            roster.removals.remove(i);
+            break;
+        }
+    }
+
+    if (entry.subscription & subscriptionFrom)
+        roster.subscribers.insert(entry.jid);
+    else
+        roster.subscribers.remove(entry.jid);
+    if (entry.subscription & subscriptionTo)
+        roster.subscriptions.insert(entry.jid);
+    else
+        roster.subscriptions.remove(entry.jid);
+
+    push(bareJid, entryToItem(entry), entry.version);
+}
+
+/// Removes a roster item, and pushes the removal to the user.
+
+void QXmppRosterExtensionPrivate::removeEntry(const QString &bareJid, const QString &jid)
+{
+    QXmppUserRoster &roster = rosters[bareJid];
+    const int index = indexOf(roster, jid);
+    if (index < 0)
+        return;
+
+    roster.entries.remove(index);
+    roster.subscribers.remove(jid);
+    roster.subscriptions.remove(jid);
+
+    QXmppRosterRemoval removal;
+    removal.jid = jid;
+    removal.version = ++roster.version;
+    roster.removals << removal;
+    if (roster.removals.size() > maxRemovals) {
+        roster.horizon = roster.removals.first().version;
+        roster.removals.remove(0);
+    }
+
+    QXmppRosterIq::Item item;
+    item.setBareJid(jid);
+    item.setSubscriptionType(QXmppRosterIq::Item::Remove);
+    push(bareJid, item, removal.version);
+}
+
+/// Sends a roster push to \a to, which is the user's bare JID to reach
+/// all the user's resources.
+
+void QXmppRosterExtensionPrivate::push(const QString &to, const QXmppRosterIq::Item &item, int version)
+{
+    if (!q->server())
+        return;
+
+    QXmppRosterIq iq;
+    iq.setType(QXmppIq::Set);
+    iq.setTo(to);
+    iq.setVersion(versionString(version));
+    iq.addItem(item);
+
+    QByteArray data;
+    QXmlStreamWriter xmlStream(&data);
+    iq.toXml(&xmlStream);
+    q->server()->sendData(to, data);
+}
+
+/// Returns the opaque version string sent to clients (XEP-0237).
+
+QString QXmppRosterExtensionPrivate::versionString(int version) const
+{
+    return epoch + QLatin1Char('-') + QString::number(version);
+}
+
+/// Parses a version string sent by a client.
+///
+/// Returns false if the version is invalid or belongs to another epoch.
+
+bool QXmppRosterExtensionPrivate::parseVersion(const QString &ver, int &version) const
+{
+    const int pos = ver.indexOf(QLatin1Char('-'));
+    if (pos < 0 || ver.leftRef(pos) != epoch)
+        return false;
+
+    bool ok = false;
+    version = ver.mid(pos + 1).toInt(&ok);
+    return ok;
+}
+
+bool QXmppRosterExtensionPrivate::isLocal(const QString &jid) const
+{
+    return QXmppUtils::jidToDomain(jid) == q->server()->domain() &&
+           !QXmppUtils::jidToUser(jid).isEmpty();
+}
+
+void QXmppRosterExtensionPrivate::handleRosterIq(const QDomElement &element)
+{
+    QXmppRosterIq request;
+    request.parse(element);
+
+    const QString from = request.from();
+    const QString bareJid = QXmppUtils::jidToBareJid(from);
+    QXmppUserRoster &roster = rosters[bareJid];
+
+    if (request.type() == QXmppIq::Get) {
+        // if the client's roster is recent enough, send the changes only
+        int version = 0;
+        if (parseVersion(request.version(), version) &&
+            version >= roster.horizon && version <= roster.version) {
+            QXmppIq response(QXmppIq::Result);
+            response.setId(request.id());
+            response.setTo(from);
+            q->server()->sendPacket(response);
+
+            QMap<int, QXmppRosterIq::Item> changes;
+            foreach (const QXmppRosterEntry &entry, roster.entries) {
+                if (entry.version > version)
+                    changes.insert(entry.version, entryToItem(entry));
+            }
+            foreach (const QXmppRosterRemoval &removal, roster.removals) {
+                if (removal.version > version) {
+                    QXmppRosterIq::Item item;
+                    item.setBareJid(removal.jid);
+                    item.setSubscriptionType(QXmppRosterIq::Item::Remove);
+                    changes.insert(removal.version, item);
+                }
+            }
+            QMap<int, QXmppRosterIq::Item>::const_iterator it;
+            for (it = changes.constBegin(); it != changes.constEnd(); ++it)
+                push(from, it.value(), it.key());
+
+            q->updateCounter("roster.requests.delta", 1);
+            return;
+        }
+
+        QXmppRosterIq response;
+        response.setType(QXmppIq::Result);
+        response.setId(request.id());
+        response.setTo(from);
+        response.setVersion(versionString(roster.version));
+        foreach (const QXmppRosterEntry &entry, roster.entries)
+            response.addItem(entryToItem(entry));
+        q->server()->sendPacket(response);
+
+        q->updateCounter("roster.requests.full", 1);
+    }
+    else if (request.type() == QXmppIq::Set) {
+        const QList<QXmppRosterIq::Item> items = request.items();
+        const QString jid = items.size() == 1 ? QXmppUtils::jidToBareJid(items.first().bareJid()) : QString();
+        const int index = indexOf(roster, jid);
+
+        QXmppIq response(QXmppIq::Result);
+        response.setId(request.id());
+        response.setTo(from);
+
+        if (jid.isEmpty()) {
+            response.setType(QXmppIq::Error);
+            response.setError(QXmppStanza::Error(QXmppStanza::Error::Modify, QXmppStanza::Error::BadRequest));
+        } else if (items.first().subscriptionType() == QXmppRosterIq::Item::Remove) {
+            if (index < 0) {
+                response.setType(QXmppIq::Error);
+                response.setError(QXmppStanza::Error(QXmppStanza::Error::Cancel, QXmppStanza::Error::ItemNotFound));
+            } else {
+                // cancel the subscriptions
+                const QXmppRosterEntry entry = roster.entries.at(index);
+                if ((entry.subscription & subscriptionTo) || entry.ask)
+                    sendSubscription(bareJid, jid, QXmppPresence::Unsubscribe);
+                if (entry.subscription & subscriptionFrom) {
+                    sendSubscription(bareJid, jid, QXmppPresence::Unsubscribed);
+                    sendUnavailable(bareJid, jid);
+                }
+                removeEntry(bareJid, jid);
+            }
+        } else {
+            // the client cannot change the subscription state
+            QXmppRosterEntry entry;
+            if (index >= 0)
+                entry = roster.entries.at(index);
+            entry.jid = jid;
+            entry.name = items.first().name();
+            entry.groups = items.first().groups().toList();
+            updateEntry(bareJid, entry);
+        }
+        q->server()->sendPacket(response);
+    }
+}
+
+/// Handles a subscription request sent by the local user \a from.
+
+void QXmppRosterExtensionPrivate::handleOutboundSubscription(const QString &from, const QString &to, QXmppPresence::Type type)
+{
+    const QXmppUserRoster &roster = rosters[from];
+    const int index = indexOf(roster, to);
+    QXmppRosterEntry entry;
+    if (index >= 0)
+        entry = roster.entries.at(index);
+    entry.jid = to;
+
+    bool changed = false;
+    if (type == QXmppPresence::Subscribe) {
+        if (!(entry.subscription & subscriptionTo) && !entry.ask) {
+            entry.ask = true;
+            changed = true;
+        }
+    } else if (type == QXmppPresence::Subscribed) {
+        if (!(entry.subscription & subscriptionFrom)) {
+            entry.subscription |= subscriptionFrom;
+            changed = true;
+        }
+    } else if (type == QXmppPresence::Unsubscribe) {
+        if ((entry.subscription & subscriptionTo) || entry.ask) {
+            entry.subscription &= ~subscriptionTo;
+            entry.ask = false;
+            changed = true;
+        }
+    } else if (type == QXmppPresence::Unsubscribed) {
+        if (entry.subscription & subscriptionFrom) {
+            entry.subscription &= ~subscriptionFrom;
+            changed = true;
+        }
+    }
+    if (changed)
+        updateEntry(from, entry);
+
+    sendSubscription(from, to, type);
+    if (type == QXmppPresence::Subscribed)
+        sendPresences(from, to);
+    else if (type == QXmppPresence::Unsubscribed)
+        sendUnavailable(from, to);
+}
+
+/// Handles a subscription request sent to the local user \a to.
+
+void QXmppRosterExtensionPrivate::handleInboundSubscription(const QString &from, const QString &to, QXmppPresence::Type type)
+{
+    const QXmppUserRoster &roster = rosters[to];
+    const int index = indexOf(roster, from);
+    QXmppRosterEntry entry;
+    if (index >= 0)
+        entry = roster.entries.at(index);
+
+    if (type == QXmppPresence::Subscribe) {
+        // approve the request if the contact is already subscribed
+        if (entry.subscription & subscriptionFrom) {
+            sendSubscription(to, from, QXmppPresence::Subscribed);
+            return;
+        }
+    } else if (type == QXmppPresence::Subscribed) {
+        if (index < 0 || !entry.ask)
+            return;
+        entry.subscription |= subscriptionTo;
+        entry.ask = false;
+        updateEntry(to, entry);
+    } else if (type == QXmppPresence::Unsubscribe) {
+        if (!(entry.subscription & subscriptionFrom))
+            return;
+        entry.subscription &= ~subscriptionFrom;
+        updateEntry(to, entry);
+        sendUnavailable(to, from);
+    } else if (type == QXmppPresence::Unsubscribed) {
+        if (!(entry.subscription & subscriptionTo) && !entry.ask)
+            return;
+        entry.subscription &= ~subscriptionTo;
+        entry.ask = false;
+        updateEntry(to, entry);
+    }
+
+    // forward the request to the user's resources
+    QXmppPresence presence(type);
+    presence.setFrom(from);
+    presence.setTo(to);
+    q->server()->sendPacket(presence);
+}
+
+/// Sends a subscription request on behalf of the local user \a from.
+
+void QXmppRosterExtensionPrivate::sendSubscription(const QString &from, const QString &to, QXmppPresence::Type type)
+{
+    if (isLocal(to)) {
+        handleInboundSubscription(from, to, type);
+    } else {
+        QXmppPresence presence(type);
+        presence.setFrom(from);
+        presence.setTo(to);
+        q->server()->sendPacket(presence);
+    }
+}
+
+/// Broadcasts the presence of the local resource \a jid to the user's
+/// resources and to the contacts subscribed to the user.
+///
+/// Local recipients all share the same serialized presence.
+
+void QXmppRosterExtensionPrivate::broadcast(const QString &jid, const QXmppPresence &presence)
+{
+    const QString bareJid = QXmppUtils::jidToBareJid(jid);
+
+    QXmppResourcePresence current;
+    current.presence = presence;
+    current.presence.setFrom(jid);
+    current.presence.setTo(QString());
+    QXmlStreamWriter xmlStream(&current.data);
+    current.presence.toXml(&xmlStream);
+
+    bool initial = false;
+    if (presence.type() == QXmppPresence::Available) {
+        QHash<QString, QXmppResourcePresence> &resources = presences[bareJid];
+        initial = !resources.contains(jid);
+        resources.insert(jid, current);
+    } else {
+        QHash<QString, QHash<QString, QXmppResourcePresence> >::iterator it = presences.find(bareJid);
+        if (it == presences.end() || !it->remove(jid))
+            return;
+        if (it->isEmpty())
+            presences.erase(it);
+    }
+
+    // the user's resources, including the sender
+    q->server()->sendData(bareJid, current.data);
+
+    const QXmppUserRoster &roster = rosters[bareJid];
+    foreach (const QString &contact, roster.subscribers) {
+        if (isLocal(contact)) {
+            q->server()->sendData(contact, current.data);
+        } else {
+            QXmppPresence remote = current.presence;
+            remote.setTo(contact);
+            q->server()->sendPacket(remote);
+        }
+    }
+    q->updateCounter("roster.presence.broadcasts", 1);
+    q->updateCounter("roster.presence.fanout", roster.subscribers.size() + 1);
+
+    // on initial presence, retrieve the presence of the user's contacts
+    // and of the user's other resources
+    if (initial) {
+        foreach (const QString &contact, roster.subscriptions) {
+            if (isLocal(contact)) {
+                sendPresences(contact, jid);
+            } else {
+                QXmppPresence probe(QXmppPresence::Probe);
+                probe.setFrom(bareJid);
+                probe.setTo(contact);
+                q->server()->sendPacket(probe);
+            }
+        }
+        sendPresences(bareJid, jid);
+    }
+}
+
+/// Sends the presence of the local user's resources to \a to.
+
+void QXmppRosterExtensionPrivate::sendPresences(const QString &bareJid, const QString &to)
+{
+    const bool local = isLocal(to);
+    foreach (const QXmppResourcePresence &current, presences.value(bareJid)) {
+        if (current.presence.from() == to)
+            continue;
+        if (local) {
+            q->server()->sendData(to, current.data);
+        } else {
+            QXmppPresence remote = current.presence;
+            remote.setTo(to);
+            q->server()->sendPacket(remote);
+        }
+    }
+}
+
+/// Sends unavailable presence from the local user's resources to \a to.
+
+void QXmppRosterExtensionPrivate::sendUnavailable(const QString &bareJid, const QString &to)
+{
+    foreach (const QString &jid, presences.value(bareJid).keys()) {
+        QXmppPresence presence(QXmppPresence::Unavailable);
+        presence.setFrom(jid);
+        presence.setTo(to);
+        q->server()->sendPacket(presence);
+    }
+}
+
+/// Constructs a new roster extension.
+
+QXmppRosterExtension::QXmppRosterExtension()
+    : d(new QXmppRosterExtensionPrivate(this))
+{
+    setHandledStanzaTags(QStringList() << "iq" << "presence");
+}
+
+/// Destroys the roster extension.
+
+QXmppRosterExtension::~QXmppRosterExtension()
+{
+    delete d;
+}
+
+/// Returns the roster items of the given user.
+///
+/// \param bareJid
+
+QList<QXmppRosterIq::Item> QXmppRosterExtension::items(const QString &bareJid) const
+{
+    QList<QXmppRosterIq::Item> items;
+    foreach (const QXmppRosterEntry &entry, d->rosters.value(bareJid).entries)
+        items << entryToItem(entry);
+    return items;
+}
+
+/// Adds or updates an item in the roster of the given user, including
+/// its subscription state, and pushes it to the user's resources.
+///
+/// \param bareJid
+/// \param item
+
+void QXmppRosterExtension::setItem(const QString &bareJid, const QXmppRosterIq::Item &item)
+{
+    const QXmppRosterIq::Item::SubscriptionType type = item.subscriptionType();
+    if (type == QXmppRosterIq::Item::Remove) {
+        d->removeEntry(bareJid, item.bareJid());
+        return;
+    }
+
+    QXmppRosterEntry entry;
+    entry.jid = item.bareJid();
+    entry.name = item.name();
+    entry.groups = item.groups().toList();
+    entry.subscription = (type == QXmppRosterIq::Item::NotSet) ? 0 : type;
+    entry.ask = (item.subscriptionStatus() == QLatin1String("subscribe"));
+    d->updateEntry(bareJid, entry);
+}
+
+/// Removes an item from the roster of the given user, and pushes the
+/// removal to the user's resources.
+///
+/// \param bareJid
+/// \param contactJid
+
+void QXmppRosterExtension::removeItem(const QString &bareJid, const QString &contactJid)
+{
+    d->removeEntry(bareJid, contactJid);
+}
+
+/// Returns the current roster version of the given user (XEP-0237).
+///
+/// The version is opaque, and versions from a previous instance of the
+/// extension are never accepted, so clients receive their full roster
+/// after a restart.
+///
+/// \param bareJid
+
+QString QXmppRosterExtension::rosterVersion(const QString &bareJid) const
+{
+    return d->versionString(d->rosters.value(bareJid).version);
+}
+
+/// \cond
+QStringList QXmppRosterExtension::discoveryFeatures() const
+{
+    return QStringList() << ns_rosterver;
+}
+
+bool QXmppRosterExtension::handleStanza(const QDomElement &element)
+{
+    const QString from = element.attribute("from");
+    const QString to = element.attribute("to");
+
+    if (element.tagName() == QLatin1String("iq")) {
+        // only handle the local users' requests for their own roster
+        if (!QXmppRosterIq::isRosterIq(element) || !d->isLocal(from) ||
+            (!to.isEmpty() && to != server()->domain() && to != QXmppUtils::jidToBareJid(from)))
+            return false;
+
+        // answers to roster pushes need no processing
+        const QString type = element.attribute("type");
+        if (type == QLatin1String("get") || type == QLatin1String("set"))
+            d->handleRosterIq(element);
+        return true;
+    }
+    else if (element.tagName() == QLatin1String("presence")) {
+        QXmppPresence presence;
+        presence.parse(element);
+
+        switch (presence.type()) {
+        case QXmppPresence::Subscribe:
+        case QXmppPresence::Subscribed:
+        case QXmppPresence::Unsubscribe:
+        case QXmppPresence::Unsubscribed:
+            if (d->isLocal(from) && !to.isEmpty())
+                d->handleOutboundSubscription(QXmppUtils::jidToBareJid(from), QXmppUtils::jidToBareJid(to), presence.type());
+            else if (d->isLocal(to))
+                d->handleInboundSubscription(QXmppUtils::jidToBareJid(from), QXmppUtils::jidToBareJid(to), presence.type());
+            else
+                return false;
+            return true;
+
+        case QXmppPresence::Probe:
+            if (!d->isLocal(to))
+                return false;
+            if (d->rosters.value(QXmppUtils::jidToBareJid(to)).subscribers.contains(QXmppUtils::jidToBareJid(from)))
+                d->sendPresences(QXmppUtils::jidToBareJid(to), from);
+            return true;
+
+        case QXmppPresence::Available:
+        case QXmppPresence::Unavailable:
+            // directed presence is routed as usual
+            if (!to.isEmpty() || !d->isLocal(from))
+                return false;
+            d->broadcast(from, presence);
+            return true;
+
+        default:
+            return false;
+        }
+    }
+    return false;
+}
+
+QSet<QString> QXmppRosterExtension::presenceSubscribers(const QString &jid)
+{
+    return d->rosters.value(QXmppUtils::jidToBareJid(jid)).subscribers;
+}
+
+QSet<QString> QXmppRosterExtension::presenceSubscriptions(const QString &jid)
+{
+    return d->rosters.value(QXmppUtils::jidToBareJid(jid)).subscriptions;
+}
+
+bool QXmppRosterExtension::start()
+{
+    bool check;
+    Q_UNUSED(check);
+
+    check = connect(server(), SIGNAL(clientDisconnected(QString)),
+                    this, SLOT(_q_clientDisconnected(QString)));
+    Q_ASSERT(check);
+    return true;
+}
+
+void QXmppRosterExtension::stop()
+{
+    disconnect(server(), SIGNAL(clientDisconnected(QString)),
+               this, SLOT(_q_clientDisconnected(QString)));
+    d->presences.clear();
+}
+/// \endcond
+
+void QXmppRosterExtension::_q_clientDisconnected(const QString &jid)
+{
+    // broadcast unavailable presence on behalf of the resource
+    if (d->presences.value(QXmppUtils::jidToBareJid(jid)).contains(jid))
+        d->broadcast(jid, QXmppPresence(QXmppPresence::Unavailable));
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef QXMPPROSTEREXTENSION_H
+#define QXMPPROSTEREXTENSION_H
+
+#include "QXmppRosterIq.h"
+#include "QXmppServerExtension.h"
+
+class QXmppRosterExtensionPrivate;
+
+/// \brief The QXmppRosterExtension class is a QXmppServer extension which
+/// manages the rosters of local users and broadcasts their presence.
+///
+/// It answers roster requests, handles presence subscriptions as
+/// described in RFC 6121, and sends the presence of each user's
+/// resources to the contacts subscribed to it.
+///
+/// Rosters are versioned (XEP-0237): a client which supplies the version
+/// of its cached roster only receives the changes since that version.
+/// Versions are only valid for the lifetime of the extension, so clients
+/// receive their full roster after the server restarts.
+///
+/// The rosters are held in memory. They can be populated with setItem(),
+/// for instance from a database when the server starts.
+///
+/// \ingroup Core
+
+class QXMPP_EXPORT QXmppRosterExtension : public QXmppServerExtension
+{
+    Q_OBJECT
+    Q_CLASSINFO("ExtensionName", "roster")
+
+public:
+    QXmppRosterExtension();
+    ~QXmppRosterExtension();
+
+    QList<QXmppRosterIq::Item> items(const QString &bareJid) const;
+    void setItem(const QString &bareJid, const QXmppRosterIq::Item &item);
+    void removeItem(const QString &bareJid, const QString &contactJid);
+
+    QString rosterVersion(const QString &bareJid) const;
+
+    /// \cond
+    QStringList discoveryFeatures() const;
+    bool handleStanza(const QDomElement &element);
+    QSet<QString> presenceSubscribers(const QString &jid);
+    QSet<QString> presenceSubscriptions(const QString &jid);
+    bool start();
+    void stop();
+    /// \endcond
+
+private slots:
+    void _q_clientDisconnected(const QString &jid);
+
+private:
+    QXmppRosterExtensionPrivate * const d;
+    friend class QXmppRosterExtensionPrivate;
+};
+
+#endif
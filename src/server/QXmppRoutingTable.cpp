@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QMutexLocker>
+#include <QReadLocker>
+#include <QThread>
+#include <QWriteLocker>
+
+#include "QXmppJid.h"
+#include "QXmppRoutingTable_p.h"
+#include "QXmppStream.h"
+
+/// Constructs an empty routing result.
+
+QXmppRoutingResult::QXmppRoutingResult()
+{
+}
+
+/// Removes all the streams from the result.
+
+void QXmppRoutingResult::clear()
+{
+    m_streams.clear();
+    m_threads.clear();
+}
+
+/// Returns the number of streams in the result.
+
+int QXmppRoutingResult::size() const
+{
+    return m_streams.size();
+}
+
+/// Returns true if no stream was found.
+
+bool QXmppRoutingResult::isEmpty() const
+{
+    return m_streams.isEmpty();
+}
+
+/// Returns the stream at index position \a i.
+///
+/// The stream is null if it was destroyed since the lookup.
+///
+/// \param i
+
+QPointer<QXmppStream> QXmppRoutingResult::at(int i) const
+{
+    return m_streams.at(i);
+}
+
+/// Returns the thread of the stream at index position \a i, as it was
+/// at the time of the lookup.
+///
+/// \param i
+
+QThread *QXmppRoutingResult::threadAt(int i) const
+{
+    return m_threads.at(i);
+}
+
+/// Constructs a new routing table.
+///
+/// \param shardCount The number of independently locked shards.
+/// \param parent
+
+QXmppRoutingTable::QXmppRoutingTable(int shardCount, QObject *parent)
+    : QXmppLoggable(parent)
+    , m_size(0)
+    , m_hits(0)
+    , m_misses(0)
+{
+    m_shards.resize(qMax(1, shardCount));
+    for (int i = 0; i < m_shards.size(); ++i)
+        m_shards[i] = new Shard;
+}
+
+/// Destroys the routing table.
+
+QXmppRoutingTable::~QXmppRoutingTable()
+{
+    foreach (Shard *shard, m_shards) {
+        qDeleteAll(shard->entries);
+        delete shard;
+    }
+}
+
+/// Adds the given full \a jid to the table.
+///
+/// Returns the stream which was previously registered for this JID,
+/// or 0 if there was none.
+///
+/// \param jid
+/// \param stream
+
+QXmppStream *QXmppRoutingTable::insert(const QString &jid, QXmppStream *stream)
+{
+    const QXmppJid parsed(jid);
+    const QStringRef node = parsed.user();
+    const QStringRef domain = parsed.domain();
+    const QStringRef resource = parsed.resource();
+    const uint hash = parsed.bareHash();
+    Shard *shard = m_shards[hash % m_shards.size()];
+
+    QXmppStream *previous = 0;
+    {
+        QWriteLocker locker(&shard->lock);
+        Entry *entry = findEntry(shard, hash, node, domain);
+        if (!entry) {
+            entry = new Entry;
+            entry->node = node.toString();
+            entry->domain = internDomain(domain);
+            shard->entries.insert(hash, entry);
+        }
+
+        for (int i = 0; i < entry->resources.size(); ++i) {
+            if (entry->resources[i].name == resource) {
+                previous = entry->resources[i].stream;
+                entry->resources[i].stream = stream;
+                break;
+            }
+        }
+        if (!previous) {
+            Resource res;
+            res.name = resource.toString();
+            res.stream = stream;
+            entry->resources << res;
+            m_size.ref();
+        }
+    }
+
+    updateGauge();
+    return previous;
+}
+
+/// Removes the given full \a jid from the table, if it is registered
+/// for the given \a stream.
+///
+/// Returns true if the entry was removed.
+///
+/// \param jid
+/// \param stream
+
+bool QXmppRoutingTable::remove(const QString &jid, QXmppStream *stream)
+{
+    const QXmppJid parsed(jid);
+    const QStringRef node = parsed.user();
+    const QStringRef domain = parsed.domain();
+    const QStringRef resource = parsed.resource();
+    const uint hash = parsed.bareHash();
+    Shard *shard = m_shards[hash % m_shards.size()];
+
+    bool removed = false;
+    {
+        QWriteLocker locker(&shard->lock);
+        Entry *entry = findEntry(shard, hash, node, domain);
+        if (!entry)
+            return false;
+
+        for (int i = 0; i < entry->resources.size(); ++i) {
+            if (entry->resources[i].name == resource && entry->resources[i].stream == stream) {
+                entry->resources.remove(i);
+                m_size.deref();
+                removed = true;
+                break;
+            }
+        }
+        if (entry->resources.isEmpty()) {
+            shard->entries.remove(hash, entry);
+            delete entry;
+        }
+    }
+
+    if (removed)
+        updateGauge();
+    return removed;
+}
+
+/// Looks up the streams for the given \a jid and stores them in
+/// \a result.
+///
+/// If \a jid is a bare JID, the streams for all its resources are
+/// returned. This method is thread-safe.
+///
+/// Returns the number of streams found.
+///
+/// \param jid
+/// \param result
+
+int QXmppRoutingTable::lookup(const QString &jid, QXmppRoutingResult &result) const
+{
+    const QXmppJid parsed(jid);
+    const QStringRef node = parsed.user();
+    const QStringRef domain = parsed.domain();
+    const QStringRef resource = parsed.resource();
+    const uint hash = parsed.bareHash();
+    Shard *shard = m_shards[hash % m_shards.size()];
+
+    result.clear();
+    {
+        // streams are removed from the table before they are destroyed,
+        // so they can safely be guarded while the shard is locked
+        QReadLocker locker(&shard->lock);
+        const Entry *entry = findEntry(shard, hash, node, domain);
+        if (entry) {
+            for (int i = 0; i < entry->resources.size(); ++i) {
+                if (resource.isEmpty() || entry->resources[i].name == resource) {
+                    QXmppStream *stream = entry->resources[i].stream;
+                    result.m_streams.append(QPointer<QXmppStream>(stream));
+                    result.m_threads.append(stream->thread());
+                }
+            }
+        }
+    }
+
+    QXmppRoutingTable *table = const_cast<QXmppRoutingTable*>(this);
+    if (result.m_streams.isEmpty()) {
+        m_misses.ref();
+        emit table->updateCounter("routing-table.misses");
+    } else {
+        m_hits.ref();
+        emit table->updateCounter("routing-table.hits");
+    }
+    return result.m_streams.size();
+}
+
+/// Returns the number of resources in the table.
+
+int QXmppRoutingTable::size() const
+{
+    return const_cast<QAtomicInt&>(m_size).fetchAndAddRelaxed(0);
+}
+
+/// Returns the number of successful lookups.
+
+int QXmppRoutingTable::hits() const
+{
+    return m_hits.fetchAndAddRelaxed(0);
+}
+
+/// Returns the number of lookups which did not find any stream.
+
+int QXmppRoutingTable::misses() const
+{
+    return m_misses.fetchAndAddRelaxed(0);
+}
+
+/// Reports the table's size.
+
+void QXmppRoutingTable::updateGauge()
+{
+    emit setGauge("routing-table.size", size());
+}
+
+QXmppRoutingTable::Entry *QXmppRoutingTable::findEntry(const Shard *shard, uint hash, const QStringRef &node, const QStringRef &domain) const
+{
+    QMultiHash<uint, Entry*>::const_iterator it = shard->entries.constFind(hash);
+    for (; it != shard->entries.constEnd() && it.key() == hash; ++it) {
+        Entry *entry = it.value();
+        if (entry->domain == domain && entry->node == node)
+            return entry;
+    }
+    return 0;
+}
+
+QString QXmppRoutingTable::internDomain(const QStringRef &domain)
+{
+    QMutexLocker locker(&m_domainsMutex);
+    const QString key = domain.toString();
+    QHash<QString, QString>::const_iterator it = m_domains.constFind(key);
+    if (it != m_domains.constEnd())
+        return it.value();
+    m_domains.insert(key, key);
+    return key;
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef QXMPPROUTINGTABLE_P_H
+#define QXMPPROUTINGTABLE_P_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutex>
+#include <QPointer>
+#include <QReadWriteLock>
+#include <QVarLengthArray>
+#include <QVector>
+
+#include "QXmppLogger.h"
+
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QXmpp API.  It exists for the convenience
+// of the QXmppServer class.
+//
+// This header file may change from version to version without notice,
+// or even be removed.
+//
+// We mean it.
+//
+
+class QThread;
+class QXmppStream;
+
+/// \brief The QXmppRoutingResult class holds the streams found by
+/// QXmppRoutingTable::lookup().
+///
+/// No lock is held once the lookup returns. The streams are guarded, and
+/// may be destroyed at any time by their own thread, so they must only
+/// be dereferenced from the thread returned by threadAt().
+
+class QXMPP_AUTOTEST_EXPORT QXmppRoutingResult
+{
+public:
+    QXmppRoutingResult();
+
+    void clear();
+    int size() const;
+    bool isEmpty() const;
+    QPointer<QXmppStream> at(int i) const;
+    QThread *threadAt(int i) const;
+
+private:
+    Q_DISABLE_COPY(QXmppRoutingResult)
+    friend class QXmppRoutingTable;
+
+    QVarLengthArray<QPointer<QXmppStream>, 8> m_streams;
+    QVarLengthArray<QThread*, 8> m_threads;
+};
+
+/// \brief The QXmppRoutingTable class maps the JIDs of connected
+/// resources to their streams.
+///
+/// Entries are grouped by bare JID and spread over several shards, each
+/// with its own lock, so that lookups can run concurrently from several
+/// threads. Bare JIDs and domains are interned, and lookups parse the
+/// JID in place using QXmppJid, so routing a stanza does not allocate
+/// memory.
+///
+/// The table reports its size through the "routing-table.size" gauge,
+/// and each lookup through the "routing-table.hits" or
+/// "routing-table.misses" counter.
+
+class QXMPP_AUTOTEST_EXPORT QXmppRoutingTable : public QXmppLoggable
+{
+    Q_OBJECT
+
+public:
+    QXmppRoutingTable(int shardCount = 16, QObject *parent = 0);
+    ~QXmppRoutingTable();
+
+    QXmppStream *insert(const QString &jid, QXmppStream *stream);
+    bool remove(const QString &jid, QXmppStream *stream);
+    int lookup(const QString &jid, QXmppRoutingResult &result) const;
+
+    int size() const;
+    int hits() const;
+    int misses() const;
+    void updateGauge();
+
+private:
+    struct Resource
+    {
+        QString name;
+        QXmppStream *stream;
+    };
+
+    struct Entry
+    {
+        QString node;
+        QString domain;
+        QVector<Resource> resources;
+    };
+
+    struct Shard
+    {
+        QReadWriteLock lock;
+        QMultiHash<uint, Entry*> entries;
+    };
+
+    Q_DISABLE_COPY(QXmppRoutingTable)
+    Entry *findEntry(const Shard *shard, uint hash, const QStringRef &node, const QStringRef &domain) const;
+    QString internDomain(const QStringRef &domain);
+
+    QVector<Shard*> m_shards;
+    QMutex m_domainsMutex;
+    QHash<QString, QString> m_domains;
+    QAtomicInt m_size;
+    mutable QAtomicInt m_hits;
+    mutable QAtomicInt m_misses;
+};
+
+#endif
@@ -22,23 +22,32 @@
  */
 
 #include <QCoreApplication>
+#include <QDateTime>
 #include <QDomElement>
+#include <QElapsedTimer>
 #include <QFileInfo>
 #include <QPluginLoader>
 #include <QSslCertificate>
 #include <QSslKey>
 #include <QSslSocket>
+#include <QThread>
+#include <QTimer>
+#include <QXmlStreamReader>
 
 #include "QXmppConstants_p.h"
 #include "QXmppDialback.h"
 #include "QXmppIq.h"
 #include "QXmppIncomingClient.h"
 #include "QXmppIncomingServer.h"
+#include "QXmppJid.h"
 #include "QXmppOutgoingServer.h"
 #include "QXmppPresence.h"
+#include "QXmppRoutingTable_p.h"
 #include "QXmppServer.h"
 #include "QXmppServerExtension.h"
 #include "QXmppServerPlugin.h"
+#include "QXmppServerWorker_p.h"
+#include "QXmppStanzaIndex_p.h"
 #include "QXmppUtils.h"
 
 static void helperToXmlAddDomElement(QXmlStreamWriter* stream, const QDomElement& element, const QStringList &omitNamespaces)
@@ -77,8 +86,19 @@ public:
     QXmppServerPrivate(QXmppServer *qq);
     void loadExtensions(QXmppServer *server);
     bool routeData(const QString &to, const QByteArray &data);
+    QXmppOutgoingServer *outgoingServer(const QString &remoteDomain);
+    void setOutgoingQueue(QXmppOutgoingServer *stream, int stanzas, qint64 bytes);
+    void sendData(const QPointer<QXmppStream> &stream, QThread *thread, const QByteArray &data);
+    void disconnectStream(QXmppStream *stream);
+    void removeResumable(QXmppIncomingClient *client);
+    QStringList rawStanzaTagNames() const;
+    int stanzaTarget(const QString &to) const;
+    void updateExtensionIndex();
     void startExtensions();
     void stopExtensions();
+    void startWorkers();
+    void stopWorkers();
+    QThread *nextWorkerThread() const;
 
     void info(const QString &message);
     void warning(const QString &message);
@@ -88,17 +108,73 @@ public:
     QXmppLogger *logger;
     QXmppPasswordChecker *passwordChecker;
 
-    // client-to-server
+    // the extensions interested in each kind of stanza target, see
+    // stanzaTarget()
+    QXmppStanzaIndex extensionIndex[3];
+
+    // client-to-server, with the JID each client is bound to
     QSet<QXmppIncomingClient*> incomingClients;
-    QHash<QString, QXmppIncomingClient*> incomingClientsByJid;
-    QHash<QString, QSet<QXmppIncomingClient*> > incomingClientsByBareJid;
+    QHash<QXmppIncomingClient*, QString> clientJids;
     QSet<QXmppSslServer*> serversForClients;
 
+    // the routing table is read from the worker threads, and
+    // modified from the server's thread
+    QXmppRoutingTable *routingTable;
+
+    // stream management (XEP-0198)
+    struct DetachedSession
+    {
+        DetachedSession() : client(0) {}
+
+        QXmppIncomingClient *client;
+        QString jid;
+        QDateTime expiry;
+    };
+    int resumptionTimeout;
+    QHash<QString, DetachedSession> detachedSessions;
+    QHash<QString, QXmppIncomingClient*> resumableClients;
+    QHash<QXmppIncomingClient*, QString> resumableIds;
+    QTimer *expiryTimer;
+
+    // rate limits for client connections
+    int clientBytesPerSecond;
+    int clientStanzasPerSecond;
+
+    // stream compression for client connections (XEP-0138)
+    int clientCompressionLevel;
+    int clientCompressionMemoryLevel;
+
+    // worker threads
+    int workerThreadCount;
+    QList<QThread*> workerThreads;
+    QHash<QThread*, int> workerLoad;
+    QHash<QThread*, QXmppServerWorker*> workers;
+
     // server-to-server
     QSet<QXmppIncomingServer*> incomingServers;
-    QSet<QXmppOutgoingServer*> outgoingServers;
     QSet<QXmppSslServer*> serversForServers;
 
+    // the pool of outgoing server-to-server streams, one per remote domain
+    struct OutgoingServer
+    {
+        OutgoingServer() : stream(0), lastUsed(0), queuedStanzas(0), queuedBytes(0) {}
+
+        QXmppOutgoingServer *stream;
+        qint64 lastUsed;
+        int queuedStanzas;
+        qint64 queuedBytes;
+    };
+    QHash<QString, OutgoingServer> outgoingServers;
+    int outgoingQueuedStanzas;
+    qint64 outgoingQueuedBytes;
+    QElapsedTimer outgoingClock;
+    QTimer *outgoingIdleTimer;
+    int outgoingIdleTimeout;
+    int outgoingMaximum;
+    int outgoingRate;
+    qint64 outgoingRateWindow;
+    int outgoingRateCount;
+
     // ssl
     QList<QSslCertificate> caCertificates;
     QSslCertificate localCertificate;
@@ -113,6 +189,22 @@ private:
 QXmppServerPrivate::QXmppServerPrivate(QXmppServer *qq)
     : logger(0),
     passwordChecker(0),
+    routingTable(0),
+    resumptionTimeout(0),
+    expiryTimer(0),
+    clientBytesPerSecond(0),
+    clientStanzasPerSecond(0),
+    clientCompressionLevel(0),
+    clientCompressionMemoryLevel(8),
+    workerThreadCount(0),
+    outgoingQueuedStanzas(0),
+    outgoingQueuedBytes(0),
+    outgoingIdleTimer(0),
+    outgoingIdleTimeout(600),
+    outgoingMaximum(0),
+    outgoingRate(0),
+    outgoingRateWindow(0),
+    outgoingRateCount(0),
     loaded(false),
     started(false),
     q(qq)
@@ -121,6 +213,12 @@ QXmppServerPrivate::QXmppServerPrivate(QXmppServer *qq)
 
 /// Routes XMPP data to the given recipient.
 ///
+/// The data is serialized once and shared by all the matching
+/// connections. Connections living in the current thread are written
+/// to directly, the others are reached through their thread's worker.
+///
+/// This method can be called from any thread.
+///
 /// \param to
 /// \param data
 ///
@@ -128,83 +226,270 @@ QXmppServerPrivate::QXmppServerPrivate(QXmppServer *qq)
 bool QXmppServerPrivate::routeData(const QString &to, const QByteArray &data)
 {
     // refuse to route packets to empty destination, own domain or sub-domains
-    const QString toDomain = QXmppUtils::jidToDomain(to);
-    if (to.isEmpty() || to == domain || toDomain.endsWith("." + domain))
+    const QXmppJid toJid(to);
+    const QStringRef toDomain = toJid.domain();
+    if (to.isEmpty() || to == domain)
+        return false;
+    if (toDomain.size() > domain.size() && toDomain.endsWith(domain) &&
+        toDomain.at(toDomain.size() - domain.size() - 1) == QLatin1Char('.'))
         return false;
 
     if (toDomain == domain) {
 
         // look for a client connection
-        QList<QXmppIncomingClient*> found;
-        if (QXmppUtils::jidToResource(to).isEmpty()) {
-            foreach (QXmppIncomingClient *conn, incomingClientsByBareJid.value(to))
-                found << conn;
-        } else {
-            QXmppIncomingClient *conn = incomingClientsByJid.value(to);
-            if (conn)
-                found << conn;
-        }
+        QXmppRoutingResult found;
+        if (!routingTable->lookup(to, found))
+            return false;
+
+        // send data, the buffer is shared by all the recipients
+        for (int i = 0; i < found.size(); ++i)
+            sendData(found.at(i), found.threadAt(i), data);
+        q->updateCounter("router.fanout.stanzas", found.size());
+        q->updateCounter("router.fanout.bytes", qint64(found.size()) * data.size());
+        return true;
+
+    } else if (QThread::currentThread() != q->thread()) {
 
-        // send data
-        foreach (QXmppStream *conn, found)
-            QMetaObject::invokeMethod(conn, "sendData", Q_ARG(QByteArray, data));
-        return !found.isEmpty();
+        // server-to-server connections are managed from the server's thread
+        QMetaObject::invokeMethod(q, "_q_routeData", Qt::QueuedConnection,
+                                  Q_ARG(QByteArray, data), Q_ARG(QString, to));
+        return true;
 
     } else if (!serversForServers.isEmpty()) {
 
-        bool check;
-        Q_UNUSED(check);
+        // look for an outgoing S2S connection, or establish one
+        QXmppOutgoingServer *conn = outgoingServer(toDomain.toString());
+        if (!conn)
+            return false;
 
-        // look for an outgoing S2S connection
-        foreach (QXmppOutgoingServer *conn, outgoingServers) {
-            if (conn->remoteDomain() == toDomain) {
-                // send or queue data
-                QMetaObject::invokeMethod(conn, "queueData", Q_ARG(QByteArray, data));
-                return true;
-            }
+        // send or queue data
+        conn->queueData(data);
+        q->updateCounter("router.fanout.stanzas", 1);
+        q->updateCounter("router.fanout.bytes", data.size());
+        return true;
+
+    } else {
+
+        // S2S is disabled, failed to route data
+        return false;
+
+    }
+}
+
+/// Returns the outgoing S2S stream for the given remote domain, creating
+/// it if needed.
+///
+/// Returns 0 if the stream cannot be created because there are too many
+/// outgoing streams, or too many were created in the last second.
+///
+/// This method must be called from the server's thread.
+///
+/// \param remoteDomain
+
+QXmppOutgoingServer *QXmppServerPrivate::outgoingServer(const QString &remoteDomain)
+{
+    bool check;
+    Q_UNUSED(check);
+
+    const qint64 now = outgoingClock.elapsed();
+    QHash<QString, OutgoingServer>::iterator it = outgoingServers.find(remoteDomain);
+    if (it != outgoingServers.end()) {
+        it->lastUsed = now;
+        return it->stream;
+    }
+
+    // protect against bursts of stanzas to many different domains
+    if (outgoingMaximum > 0 && outgoingServers.size() >= outgoingMaximum) {
+        q->updateCounter("outgoing-server.refused.maximum");
+        return 0;
+    }
+    if (outgoingRate > 0) {
+        if (now - outgoingRateWindow >= 1000) {
+            outgoingRateWindow = now;
+            outgoingRateCount = 0;
         }
+        if (outgoingRateCount >= outgoingRate) {
+            q->updateCounter("outgoing-server.refused.rate");
+            return 0;
+        }
+        outgoingRateCount++;
+    }
 
-        // if we did not find an outgoing server,
-        // we need to establish the S2S connection
-        QXmppOutgoingServer *conn = new QXmppOutgoingServer(domain, 0);
-        conn->setLocalStreamKey(QXmppUtils::generateStanzaHash().toLatin1());
-        conn->moveToThread(q->thread());
-        conn->setParent(q);
+    QXmppOutgoingServer *conn = new QXmppOutgoingServer(domain, q);
+    conn->setLoggedMessageTypes(QXmppLogger::loggedMessageTypes(logger));
+    conn->setLocalStreamKey(QXmppUtils::generateStanzaHash().toLatin1());
 
-        check = QObject::connect(conn, SIGNAL(disconnected()),
-                                 q, SLOT(_q_outgoingServerDisconnected()));
-        Q_UNUSED(check);
+    check = QObject::connect(conn, SIGNAL(disconnected()),
+                             q, SLOT(_q_outgoingServerDisconnected()));
+    Q_ASSERT(check);
 
-        // add stream
-        outgoingServers.insert(conn);
-        q->setGauge("outgoing-server.count", outgoingServers.size());
+    check = QObject::connect(conn, SIGNAL(queueChanged()),
+                             q, SLOT(_q_outgoingServerQueueChanged()));
+    Q_ASSERT(check);
 
-        // queue data and connect to remote server
-        QMetaObject::invokeMethod(conn, "queueData", Q_ARG(QByteArray, data));
-        QMetaObject::invokeMethod(conn, "connectToHost", Q_ARG(QString, toDomain));
-        return true;
+    check = QObject::connect(conn, SIGNAL(queuedDataDropped(QByteArray,QXmppStanza::Error::Condition)),
+                             q, SLOT(_q_outgoingServerDataDropped(QByteArray,QXmppStanza::Error::Condition)));
+    Q_ASSERT(check);
 
-    } else {
+    // add stream
+    OutgoingServer entry;
+    entry.stream = conn;
+    entry.lastUsed = now;
+    outgoingServers.insert(remoteDomain, entry);
+    q->setGauge("outgoing-server.count", outgoingServers.size());
+    q->updateCounter("outgoing-server.created");
+
+    if (outgoingIdleTimeout > 0 && !outgoingIdleTimer->isActive())
+        outgoingIdleTimer->start(qMax(1, outgoingIdleTimeout / 2) * 1000);
+
+    // the connection completes asynchronously, meanwhile data is queued
+    conn->connectToHost(remoteDomain);
+    return conn;
+}
 
-        // S2S is disabled, failed to route data
-        return false;
+/// Records the amount of data queued by the given outgoing S2S stream,
+/// and updates the totals for all the streams in the pool.
+///
+/// \param stream
+/// \param stanzas
+/// \param bytes
+
+void QXmppServerPrivate::setOutgoingQueue(QXmppOutgoingServer *stream, int stanzas, qint64 bytes)
+{
+    QHash<QString, OutgoingServer>::iterator it = outgoingServers.find(stream->remoteDomain());
+    if (it == outgoingServers.end() || it->stream != stream)
+        return;
+
+    outgoingQueuedStanzas += stanzas - it->queuedStanzas;
+    outgoingQueuedBytes += bytes - it->queuedBytes;
+    it->queuedStanzas = stanzas;
+    it->queuedBytes = bytes;
+    q->setGauge("outgoing-server.queue.stanzas", outgoingQueuedStanzas);
+    q->setGauge("outgoing-server.queue.bytes", outgoingQueuedBytes);
+}
+
+/// Sends data to the given stream from the current thread.
+///
+/// Data for streams living in a worker thread is batched.
+///
+/// \param stream
+/// \param data
 
+void QXmppServerPrivate::sendData(const QPointer<QXmppStream> &stream, QThread *thread, const QByteArray &data)
+{
+    // the stream may only be dereferenced from its own thread
+    if (thread == QThread::currentThread()) {
+        if (stream)
+            stream->sendStanzaData(data);
+        return;
     }
+
+    QXmppServerWorker *worker = workers.value(thread);
+    if (worker)
+        worker->queueData(stream, data);
+    else if (stream)
+        QMetaObject::invokeMethod(stream, "sendStanzaData", Q_ARG(QByteArray, data));
 }
 
-/// Handles an incoming XML element.
+/// Closes the given stream from the server's thread, waiting for the
+/// stream's thread to process the request.
 ///
-/// \param server
 /// \param stream
+
+void QXmppServerPrivate::disconnectStream(QXmppStream *stream)
+{
+    if (stream->thread() == QThread::currentThread())
+        stream->disconnectFromHost();
+    else
+        QMetaObject::invokeMethod(stream, "disconnectFromHost", Qt::BlockingQueuedConnection);
+}
+
+/// Forgets the resumable Stream Management session of the given client.
+///
+/// \param client
+
+void QXmppServerPrivate::removeResumable(QXmppIncomingClient *client)
+{
+    const QString id = resumableIds.take(client);
+    if (!id.isEmpty() && resumableClients.value(id) == client)
+        resumableClients.remove(id);
+}
+
+/// Returns the tag names of the stanzas which incoming clients can
+/// route without building a DOM tree, i.e. those which no extension
+/// wants to see.
+
+QStringList QXmppServerPrivate::rawStanzaTagNames() const
+{
+    QStringList tagNames;
+    tagNames << "message" << "presence";
+    foreach (QXmppServerExtension *extension, extensions) {
+        foreach (const QString &tagName, extension->handledStanzaTags())
+            tagNames.removeAll(tagName);
+    }
+    return tagNames;
+}
+
+/// Returns the position in extensionIndex of the stanzas addressed to
+/// the given JID.
+///
+/// \param to
+
+int QXmppServerPrivate::stanzaTarget(const QString &to) const
+{
+    if (to.isEmpty() || to == domain)
+        return 0;
+    else if (QXmppUtils::jidToDomain(to) == domain)
+        return 1;
+    else
+        return 2;
+}
+
+/// Rebuilds the index used to dispatch incoming stanzas to the
+/// extensions.
+
+void QXmppServerPrivate::updateExtensionIndex()
+{
+    const QXmppServerExtension::StanzaTarget targets[3] = {
+        QXmppServerExtension::ServerTarget,
+        QXmppServerExtension::LocalUserTarget,
+        QXmppServerExtension::RemoteTarget };
+
+    for (int target = 0; target < 3; ++target) {
+        extensionIndex[target].clear();
+        for (int i = 0; i < extensions.size(); ++i) {
+            QXmppServerExtension *extension = extensions.at(i);
+            if (extension->handledStanzaTargets() & targets[target])
+                extensionIndex[target].addHandler(i, extension->handledStanzaTags(), extension->handledStanzaNamespaces());
+        }
+    }
+}
+
+/// Returns the error type of the given condition.
+///
+/// Only a full queue or a timeout are temporary, other conditions such as
+/// an unreachable remote server are permanent.
+///
+/// \param condition
+
+static QXmppStanza::Error::Type errorType(QXmppStanza::Error::Condition condition)
+{
+    switch (condition) {
+    case QXmppStanza::Error::RemoteServerTimeout:
+    case QXmppStanza::Error::ResourceConstraint:
+        return QXmppStanza::Error::Wait;
+    default:
+        return QXmppStanza::Error::Cancel;
+    }
+}
+
+/// Handles an incoming XML element which no extension processed.
+///
+/// \param server
 /// \param element
 
 static void handleStanza(QXmppServer *server, const QDomElement &element)
 {
-    // try extensions
-    foreach (QXmppServerExtension *extension, server->extensions())
-        if (extension->handleStanza(element))
-            return;
-
     // default handlers
     const QString domain = server->domain();
     const QString to = element.attribute("to");
@@ -301,6 +586,76 @@ void QXmppServerPrivate::stopExtensions()
     }
 }
 
+/// Starts the worker threads.
+
+void QXmppServerPrivate::startWorkers()
+{
+    if (!workerThreads.isEmpty() || workerThreadCount <= 0)
+        return;
+
+    // the server's own thread also gets a worker, for data routed
+    // from the worker threads
+    workers.insert(q->thread(), new QXmppServerWorker(q));
+
+    for (int i = 0; i < workerThreadCount; ++i) {
+        QThread *thread = new QThread;
+        thread->setObjectName(QString("QXmppServer worker %1").arg(i));
+
+        QXmppServerWorker *worker = new QXmppServerWorker;
+        worker->moveToThread(thread);
+
+        workers.insert(thread, worker);
+        workerLoad.insert(thread, 0);
+        workerThreads << thread;
+        thread->start();
+    }
+    info(QString("Started %1 worker threads").arg(workerThreadCount));
+}
+
+/// Stops the worker threads, destroying the streams they still own.
+
+void QXmppServerPrivate::stopWorkers()
+{
+    if (workerThreads.isEmpty())
+        return;
+
+    // objects scheduled for deletion are destroyed when the thread finishes
+    foreach (QXmppIncomingClient *stream, incomingClients) {
+        if (workerLoad.contains(stream->thread())) {
+            incomingClients.remove(stream);
+            stream->deleteLater();
+        }
+    }
+
+    foreach (QThread *thread, workerThreads) {
+        workers.take(thread)->deleteLater();
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+    workerThreads.clear();
+    workerLoad.clear();
+
+    delete workers.take(q->thread());
+}
+
+/// Returns the least loaded worker thread, or 0 if there are no
+/// worker threads.
+
+QThread *QXmppServerPrivate::nextWorkerThread() const
+{
+    QThread *best = 0;
+    int bestLoad = 0;
+    foreach (QThread *thread, workerThreads) {
+        const int load = workerLoad.value(thread);
+        if (!best || load < bestLoad) {
+            best = thread;
+            bestLoad = load;
+        }
+    }
+    return best;
+}
+
 /// Constructs a new XMPP server instance.
 ///
 /// \param parent
@@ -310,6 +665,23 @@ QXmppServer::QXmppServer(QObject *parent)
     , d(new QXmppServerPrivate(this))
 {
     qRegisterMetaType<QDomElement>("QDomElement");
+
+    // the routing table's gauges are relayed to our logger
+    d->routingTable = new QXmppRoutingTable(16, this);
+
+    d->expiryTimer = new QTimer(this);
+    d->expiryTimer->setInterval(1000);
+    bool check;
+    Q_UNUSED(check);
+    check = connect(d->expiryTimer, SIGNAL(timeout()),
+                    this, SLOT(_q_expireSessions()));
+    Q_ASSERT(check);
+
+    d->outgoingClock.start();
+    d->outgoingIdleTimer = new QTimer(this);
+    check = connect(d->outgoingIdleTimer, SIGNAL(timeout()),
+                    this, SLOT(_q_reapOutgoingServers()));
+    Q_ASSERT(check);
 }
 
 /// Destroys an XMPP server instance.
@@ -318,6 +690,7 @@ QXmppServer::QXmppServer(QObject *parent)
 QXmppServer::~QXmppServer()
 {
     close();
+    d->stopWorkers();
     delete d;
 }
 
@@ -334,14 +707,21 @@ void QXmppServer::addExtension(QXmppServerExtension *extension)
     extension->setServer(this);
 
     // keep extensions sorted by priority
+    int index = d->extensions.size();
     for (int i = 0; i < d->extensions.size(); ++i) {
         QXmppServerExtension *other = d->extensions[i];
         if (other->extensionPriority() < extension->extensionPriority()) {
-            d->extensions.insert(i, extension);
-            return;
+            index = i;
+            break;
         }
     }
-    d->extensions << extension;
+    d->extensions.insert(index, extension);
+    d->updateExtensionIndex();
+
+    // update the stanzas which bypass the extensions
+    const QStringList tagNames = d->rawStanzaTagNames();
+    foreach (QXmppIncomingClient *stream, d->incomingClients)
+        QMetaObject::invokeMethod(stream, "setRawStanzaTagNames", Q_ARG(QStringList, tagNames));
 }
 
 /// Returns the list of loaded extensions.
@@ -435,9 +815,230 @@ QVariantMap QXmppServer::statistics() const
     stats["incoming-clients"] = d->incomingClients.size();
     stats["incoming-servers"] = d->incomingServers.size();
     stats["outgoing-servers"] = d->outgoingServers.size();
+    stats["worker-threads"] = d->workerThreads.size();
+    stats["routing-table-size"] = d->routingTable->size();
+    stats["routing-table-hits"] = d->routingTable->hits();
+    stats["routing-table-misses"] = d->routingTable->misses();
     return stats;
 }
 
+/// Returns the number of worker threads used for client connections.
+///
+
+int QXmppServer::workerThreadCount() const
+{
+    return d->workerThreadCount;
+}
+
+/// Sets the number of worker threads used for client connections.
+///
+/// By default all the streams live in the server's thread. If \a count
+/// is greater than zero, each new client connection is handed over to
+/// the least loaded of \a count threads running their own event loop,
+/// which allows TLS and XML processing to use several cores.
+///
+/// Stanzas which need to be processed by extensions are still handled
+/// in the server's thread, but the password checker is called from the
+/// worker threads and must be thread-safe.
+///
+/// This must be called before listenForClients().
+///
+/// \param count
+
+void QXmppServer::setWorkerThreadCount(int count)
+{
+    if (!d->workerThreads.isEmpty()) {
+        d->warning("Cannot change the number of worker threads once started");
+        return;
+    }
+    d->workerThreadCount = count;
+}
+
+/// Returns the number of seconds during which the session of a client
+/// which lost its connection is kept so that it can be resumed (XEP-0198).
+
+int QXmppServer::streamResumptionTimeout() const
+{
+    return d->resumptionTimeout;
+}
+
+/// Sets the number of seconds during which the session of a client which
+/// lost its connection is kept so that it can be resumed (XEP-0198).
+///
+/// While the session is detached, stanzas routed to the client are kept
+/// in its queue of unacknowledged stanzas, and they are sent once the
+/// client resumes the session.
+///
+/// If \a secs is 0, which is the default, Stream Management is not
+/// offered to clients.
+///
+/// \param secs
+
+void QXmppServer::setStreamResumptionTimeout(int secs)
+{
+    d->resumptionTimeout = secs;
+}
+
+/// Returns the maximum number of bytes per second read from each client
+/// connection.
+
+int QXmppServer::clientBytesPerSecond() const
+{
+    return d->clientBytesPerSecond;
+}
+
+/// Sets the maximum number of bytes per second read from each client
+/// connection.
+///
+/// Once a client exceeds its rate, reading from its socket pauses until
+/// the rate drops below the limit, so that a flooding client cannot
+/// monopolize the server. The data which was already read is handled. The number of throttled connections is reported
+/// as the "incoming-client.throttled" gauge.
+///
+/// If \a bytes is 0, which is the default, the rate is not limited. The
+/// limit applies to connections made after the call.
+///
+/// \param bytes
+
+void QXmppServer::setClientBytesPerSecond(int bytes)
+{
+    d->clientBytesPerSecond = bytes;
+}
+
+/// Returns the maximum number of stanzas per second handled for each
+/// client connection.
+
+int QXmppServer::clientStanzasPerSecond() const
+{
+    return d->clientStanzasPerSecond;
+}
+
+/// Sets the maximum number of stanzas per second handled for each client
+/// connection.
+///
+/// Once a client exceeds its rate, its stanzas are held back and reading
+/// from its socket pauses until the rate drops below the limit.
+///
+/// If \a stanzas is 0, which is the default, the rate is not limited. The
+/// limit applies to connections made after the call.
+///
+/// \param stanzas
+
+void QXmppServer::setClientStanzasPerSecond(int stanzas)
+{
+    d->clientStanzasPerSecond = stanzas;
+}
+
+/// Returns the zlib compression level offered to client connections.
+
+int QXmppServer::clientCompressionLevel() const
+{
+    return d->clientCompressionLevel;
+}
+
+/// Sets the zlib compression level offered to client connections
+/// (XEP-0138).
+///
+/// Authenticated clients are offered stream compression if \a level is
+/// between 1 and 9 and QXmpp was built with zlib support. If \a level
+/// is 0, which is the default, compression is not offered. The level
+/// applies to connections made after the call.
+///
+/// \param level
+
+void QXmppServer::setClientCompressionLevel(int level)
+{
+    d->clientCompressionLevel = level;
+}
+
+/// Returns the zlib memory level used for compressed client connections.
+
+int QXmppServer::clientCompressionMemoryLevel() const
+{
+    return d->clientCompressionMemoryLevel;
+}
+
+/// Sets the zlib memory level used for compressed client connections.
+///
+/// Levels range from 1, which uses the least memory per connection, to 9.
+/// The default is 8.
+///
+/// \param level
+
+void QXmppServer::setClientCompressionMemoryLevel(int level)
+{
+    d->clientCompressionMemoryLevel = level;
+}
+
+/// Returns the number of seconds after which an outgoing server-to-server
+/// connection which was not used is closed.
+
+int QXmppServer::outgoingServerIdleTimeout() const
+{
+    return d->outgoingIdleTimeout;
+}
+
+/// Sets the number of seconds after which an outgoing server-to-server
+/// connection which was not used is closed.
+///
+/// A connection is used whenever a stanza is routed to the remote domain.
+/// The default value is 600 seconds, 0 keeps connections open until the
+/// remote server closes them.
+///
+/// \param secs
+
+void QXmppServer::setOutgoingServerIdleTimeout(int secs)
+{
+    d->outgoingIdleTimeout = secs;
+    if (secs <= 0)
+        d->outgoingIdleTimer->stop();
+    else if (!d->outgoingServers.isEmpty())
+        d->outgoingIdleTimer->start(qMax(1, secs / 2) * 1000);
+}
+
+/// Returns the maximum number of outgoing server-to-server connections.
+
+int QXmppServer::maximumOutgoingServers() const
+{
+    return d->outgoingMaximum;
+}
+
+/// Sets the maximum number of outgoing server-to-server connections.
+///
+/// Once the limit is reached, stanzas to remote domains which are not
+/// connected yet cannot be routed. The default value of 0 means there
+/// is no limit.
+///
+/// \param count
+
+void QXmppServer::setMaximumOutgoingServers(int count)
+{
+    d->outgoingMaximum = count;
+}
+
+/// Returns the maximum number of outgoing server-to-server connections
+/// created per second.
+
+int QXmppServer::outgoingServerConnectionRate() const
+{
+    return d->outgoingRate;
+}
+
+/// Sets the maximum number of outgoing server-to-server connections
+/// created per second.
+///
+/// This prevents a burst of stanzas addressed to many different domains
+/// from opening as many sockets at once. Stanzas which would require an
+/// additional connection cannot be routed. The default value of 0 means
+/// there is no limit.
+///
+/// \param connections
+
+void QXmppServer::setOutgoingServerConnectionRate(int connections)
+{
+    d->outgoingRate = connections;
+}
+
 /// Sets the path for additional SSL CA certificates.
 ///
 /// \param path
@@ -546,6 +1147,8 @@ bool QXmppServer::listenForClients(const QHostAddress &address, quint16 port)
         return false;
     }
 
+    d->startWorkers();
+
     // create new server
     QXmppSslServer *server = new QXmppSslServer(this);
     server->addCaCertificates(d->caCertificates);
@@ -585,13 +1188,18 @@ void QXmppServer::close()
     // stop extensions
     d->stopExtensions();
 
+    // drop detached sessions
+    foreach (const QString &id, d->detachedSessions.keys())
+        d->detachedSessions[id].expiry = QDateTime();
+    _q_expireSessions();
+
     // close XMPP streams
     foreach (QXmppIncomingClient *stream, d->incomingClients)
-       stream->disconnectFromHost();
+       d->disconnectStream(stream);
     foreach (QXmppIncomingServer *stream, d->incomingServers)
        stream->disconnectFromHost();
-    foreach (QXmppOutgoingServer *stream, d->outgoingServers)
-       stream->disconnectFromHost();
+    foreach (const QXmppServerPrivate::OutgoingServer &entry, d->outgoingServers)
+       entry.stream->disconnectFromHost();
 }
 
 /// Listen for incoming XMPP server connections.
@@ -663,6 +1271,47 @@ bool QXmppServer::sendPacket(const QXmppStanza &packet)
     return d->routeData(packet.to(), data);
 }
 
+/// Route a serialized XMPP stanza.
+///
+/// \param to
+/// \param data
+
+bool QXmppServer::sendData(const QString &to, const QByteArray &data)
+{
+    return d->routeData(to, data);
+}
+
+/// Writes serialized XMPP stanzas to the stream of the client bound to
+/// the full JID \a to, and waits until they are written.
+///
+/// Returns the number of stanzas which were written, so that the caller
+/// can tell which ones reached the client.
+///
+/// This method must be called from the server's thread.
+///
+/// \param to
+/// \param stanzas
+
+int QXmppServer::deliverData(const QString &to, const QList<QByteArray> &stanzas)
+{
+    QXmppRoutingResult found;
+    if (QXmppUtils::jidToResource(to).isEmpty() || d->routingTable->lookup(to, found) != 1)
+        return 0;
+
+    QXmppServerWorker *worker = d->workers.value(found.threadAt(0));
+    if (worker)
+        return worker->writeData(found.at(0), stanzas);
+    else if (found.threadAt(0) != QThread::currentThread())
+        return 0;
+
+    // without worker threads, the streams live in the server's thread
+    QXmppStream *stream = found.at(0);
+    int written = 0;
+    while (stream && written < stanzas.size() && stream->sendStanzaData(stanzas.at(written)))
+        ++written;
+    return written;
+}
+
 /// Add a new incoming client \a stream.
 ///
 /// This method can be used for instance to implement BOSH support
@@ -673,10 +1322,25 @@ void QXmppServer::addIncomingClient(QXmppIncomingClient *stream)
     bool check;
     Q_UNUSED(check);
 
+    stream->setLoggedMessageTypes(QXmppLogger::loggedMessageTypes(d->logger));
     stream->setPasswordChecker(d->passwordChecker);
+    stream->setStreamResumptionTimeout(d->resumptionTimeout);
+    stream->setBytesPerSecond(d->clientBytesPerSecond);
+    stream->setStanzasPerSecond(d->clientStanzasPerSecond);
+    stream->setCompressionLevel(d->clientCompressionLevel);
+    stream->setCompressionMemoryLevel(d->clientCompressionMemoryLevel);
+
+    // advertise roster versioning if an extension supports it
+    foreach (QXmppServerExtension *extension, d->extensions) {
+        if (extension->discoveryFeatures().contains(ns_rosterver)) {
+            stream->setRosterVersioningEnabled(true);
+            break;
+        }
+    }
 
-    check = connect(stream, SIGNAL(connected()),
-                    this, SLOT(_q_clientConnected()));
+    // the JID is passed along as the stream may live in a worker thread
+    check = connect(stream, SIGNAL(resourceBound(QString)),
+                    this, SLOT(_q_clientConnected(QString)));
     Q_ASSERT(check);
 
     check = connect(stream, SIGNAL(disconnected()),
@@ -687,6 +1351,26 @@ void QXmppServer::addIncomingClient(QXmppIncomingClient *stream)
                     this, SLOT(handleElement(QDomElement)));
     Q_ASSERT(check);
 
+    check = connect(stream, SIGNAL(resumableChanged(QString)),
+                    this, SLOT(_q_clientResumableChanged(QString)));
+    Q_ASSERT(check);
+
+    check = connect(stream, SIGNAL(availablePresenceReceived(QString)),
+                    this, SIGNAL(clientAvailable(QString)));
+    Q_ASSERT(check);
+
+    check = connect(stream, SIGNAL(resumeRequested(QString,QString,uint)),
+                    this, SLOT(_q_clientResumeRequested(QString,QString,uint)));
+    Q_ASSERT(check);
+
+    // raw stanzas are routed from the stream's thread
+    check = connect(stream, SIGNAL(rawStanzaReceived(QByteArray,QString)),
+                    this, SLOT(_q_routeData(QByteArray,QString)),
+                    Qt::DirectConnection);
+    Q_ASSERT(check);
+
+    stream->setRawStanzaTagNames(d->rawStanzaTagNames());
+
     // add stream
     d->incomingClients.insert(stream);
     setGauge("incoming-client.count", d->incomingClients.size());
@@ -704,32 +1388,45 @@ void QXmppServer::_q_clientConnection(QSslSocket *socket)
         return;
     }
 
-    QXmppIncomingClient *stream = new QXmppIncomingClient(socket, d->domain, this);
+    QThread *thread = d->nextWorkerThread();
+    QXmppIncomingClient *stream = new QXmppIncomingClient(socket, d->domain, thread ? 0 : this);
     stream->setInactivityTimeout(120);
     socket->setParent(stream);
     addIncomingClient(stream);
+
+    // hand the connection over to a worker thread
+    if (thread) {
+        connect(stream, SIGNAL(logMessage(QXmppLogger::MessageType,QString)),
+                this, SIGNAL(logMessage(QXmppLogger::MessageType,QString)));
+        connect(stream, SIGNAL(setGauge(QString,double)),
+                this, SIGNAL(setGauge(QString,double)));
+        connect(stream, SIGNAL(updateCounter(QString,qint64)),
+                this, SIGNAL(updateCounter(QString,qint64)));
+
+        d->workerLoad[thread]++;
+        stream->moveToThread(thread);
+    }
 }
 
 /// Handle a successful stream connection for a client.
 ///
+/// \param jid The full JID the client is bound to.
 
-void QXmppServer::_q_clientConnected()
+void QXmppServer::_q_clientConnected(const QString &jid)
 {
     QXmppIncomingClient *client = qobject_cast<QXmppIncomingClient*>(sender());
     if (!client)
         return;
 
-    // FIXME: at this point the JID must contain a resource, assert it?
-    const QString jid = client->jid();
+    d->clientJids.insert(client, jid);
 
     // check whether the connection conflicts with another one
-    QXmppIncomingClient *old = d->incomingClientsByJid.value(jid);
+    QXmppStream *old = d->routingTable->insert(jid, client);
     if (old && old != client) {
-        old->sendData("<stream:error><conflict xmlns='urn:ietf:params:xml:ns:xmpp-streams'/><text xmlns='urn:ietf:params:xml:ns:xmpp-streams'>Replaced by new connection</text></stream:error>");
-        old->disconnectFromHost();
+        const QByteArray conflict("<stream:error><conflict xmlns='urn:ietf:params:xml:ns:xmpp-streams'/><text xmlns='urn:ietf:params:xml:ns:xmpp-streams'>Replaced by new connection</text></stream:error>");
+        QMetaObject::invokeMethod(old, "sendData", Q_ARG(QByteArray, conflict));
+        QMetaObject::invokeMethod(old, "disconnectFromHost");
     }
-    d->incomingClientsByJid.insert(jid, client);
-    d->incomingClientsByBareJid[QXmppUtils::jidToBareJid(jid)].insert(client);
 
     // emit signal
     emit clientConnected(jid);
@@ -740,33 +1437,144 @@ void QXmppServer::_q_clientConnected()
 void QXmppServer::_q_clientDisconnected()
 {
     QXmppIncomingClient *client  = qobject_cast<QXmppIncomingClient *>(sender());
-    if (!client)
+    if (!client || !d->incomingClients.contains(client))
+        return;
+
+    // the session may already have been detached, in which case the
+    // client stays around until it is resumed or expires
+    const QString id = d->resumableIds.value(client);
+    if (!id.isEmpty() && d->detachedSessions.contains(id))
+        return;
+
+    // keep the session of a resumable stream around, it stays in
+    // the routing tables so that stanzas are queued for the client
+    const QString jid = d->clientJids.value(client);
+    if (d->resumptionTimeout > 0 && !id.isEmpty()) {
+        QXmppServerPrivate::DetachedSession session;
+        session.client = client;
+        session.jid = jid;
+        session.expiry = QDateTime::currentDateTime().addSecs(d->resumptionTimeout);
+        d->detachedSessions.insert(id, session);
+        d->expiryTimer->start();
+        setGauge("incoming-client.detached.count", d->detachedSessions.size());
+        return;
+    }
+    d->incomingClients.remove(client);
+    d->clientJids.remove(client);
+    d->removeResumable(client);
+
+    // remove stream from routing tables
+    if (!jid.isEmpty())
+        d->routingTable->remove(jid, client);
+
+    // destroy client
+    if (d->workerLoad.contains(client->thread()))
+        d->workerLoad[client->thread()]--;
+    client->deleteLater();
+
+    // emit signal
+    if (!jid.isEmpty())
+        emit clientDisconnected(jid);
+
+    // update counter
+    setGauge("incoming-client.count", d->incomingClients.size());
+}
+
+/// Handle a client enabling or losing a resumable Stream Management
+/// session.
+///
+/// \param id
+
+void QXmppServer::_q_clientResumableChanged(const QString &id)
+{
+    QXmppIncomingClient *client = qobject_cast<QXmppIncomingClient *>(sender());
+    if (!client || !d->incomingClients.contains(client))
+        return;
+
+    d->removeResumable(client);
+    if (!id.isEmpty()) {
+        d->resumableIds.insert(client, id);
+        d->resumableClients.insert(id, client);
+    }
+}
+
+/// Handle a request from a client to resume a session.
+///
+/// The previous stream may already be detached, or still be connected
+/// if the server has not noticed yet that its connection is dead.
+///
+/// \param jid The JID the client authenticated as.
+/// \param previd
+/// \param h
+
+void QXmppServer::_q_clientResumeRequested(const QString &jid, const QString &previd, uint h)
+{
+    QXmppIncomingClient *client = qobject_cast<QXmppIncomingClient *>(sender());
+    if (!client || !d->incomingClients.contains(client))
         return;
 
-    if (d->incomingClients.remove(client)) {
+    // the session must belong to the same user
+    QXmppIncomingClient *old = d->resumableClients.value(previd);
+    const QString oldJid = d->clientJids.value(old);
+    if (!old || old == client || oldJid.isEmpty() || QXmppJid(oldJid).bareJid() != QXmppJid(jid).bareJid()) {
+        QMetaObject::invokeMethod(client, "rejectResume");
+        updateCounter("incoming-client.resume.failed", 1);
+        return;
+    }
+
+    // detach the previous stream
+    d->detachedSessions.remove(previd);
+    setGauge("incoming-client.detached.count", d->detachedSessions.size());
+    d->removeResumable(old);
+    d->clientJids.remove(old);
+    d->incomingClients.remove(old);
+    if (d->workerLoad.contains(old->thread()))
+        d->workerLoad[old->thread()]--;
+    setGauge("incoming-client.count", d->incomingClients.size());
+
+    // route the stanzas to the new stream, it holds them back until
+    // it has taken over the previous stream's queue
+    d->routingTable->insert(oldJid, client);
+    d->clientJids.insert(client, oldJid);
+
+    // the previous stream closes its connection if needed, and destroys
+    // itself once its state is exported
+    QMetaObject::invokeMethod(old, "exportSession", Qt::QueuedConnection,
+                              Q_ARG(QObject*, client), Q_ARG(uint, h));
+    updateCounter("incoming-client.resume.success", 1);
+}
+
+/// Drop the detached sessions which were not resumed in time.
+
+void QXmppServer::_q_expireSessions()
+{
+    const QDateTime now = QDateTime::currentDateTime();
+    foreach (const QString &id, d->detachedSessions.keys()) {
+        const QXmppServerPrivate::DetachedSession session = d->detachedSessions.value(id);
+        if (session.expiry.isValid() && session.expiry > now)
+            continue;
+        d->detachedSessions.remove(id);
+
         // remove stream from routing tables
-        const QString jid = client->jid();
-        if (!jid.isEmpty()) {
-            if (d->incomingClientsByJid.value(jid) == client)
-                d->incomingClientsByJid.remove(jid);
-            const QString bareJid = QXmppUtils::jidToBareJid(jid);
-            if (d->incomingClientsByBareJid.contains(bareJid)) {
-                d->incomingClientsByBareJid[bareJid].remove(client);
-                if (d->incomingClientsByBareJid[bareJid].isEmpty())
-                    d->incomingClientsByBareJid.remove(bareJid);
-            }
-        }
+        QXmppIncomingClient *client = session.client;
+        d->removeResumable(client);
+        d->clientJids.remove(client);
+        d->incomingClients.remove(client);
+        d->routingTable->remove(session.jid, client);
 
         // destroy client
+        if (d->workerLoad.contains(client->thread()))
+            d->workerLoad[client->thread()]--;
         client->deleteLater();
 
-        // emit signal
-        if (!jid.isEmpty())
-            emit clientDisconnected(jid);
-
-        // update counter
-        setGauge("incoming-client.count", d->incomingClients.size());
+        emit clientDisconnected(session.jid);
+        updateCounter("incoming-client.resume.expired", 1);
     }
+
+    if (d->detachedSessions.isEmpty())
+        d->expiryTimer->stop();
+    setGauge("incoming-client.detached.count", d->detachedSessions.size());
+    setGauge("incoming-client.count", d->incomingClients.size());
 }
 
 void QXmppServer::_q_dialbackRequestReceived(const QXmppDialback &dialback)
@@ -778,10 +1586,8 @@ void QXmppServer::_q_dialbackRequestReceived(const QXmppDialback &dialback)
     if (dialback.command() == QXmppDialback::Verify)
     {
         // handle a verify request
-        foreach (QXmppOutgoingServer *out, d->outgoingServers) {
-            if (out->remoteDomain() != dialback.from())
-                continue;
-
+        QXmppOutgoingServer *out = d->outgoingServers.value(dialback.from()).stream;
+        if (out) {
             bool isValid = dialback.key() == out->localStreamKey();
             QXmppDialback verify;
             verify.setCommand(QXmppDialback::Verify);
@@ -790,7 +1596,6 @@ void QXmppServer::_q_dialbackRequestReceived(const QXmppDialback &dialback)
             verify.setFrom(d->domain);
             verify.setType(isValid ? "valid" : "invalid");
             stream->sendPacket(verify);
-            return;
         }
     }
 }
@@ -799,6 +1604,12 @@ void QXmppServer::_q_dialbackRequestReceived(const QXmppDialback &dialback)
 
 void QXmppServer::handleElement(const QDomElement &element)
 {
+    // only offer the stanza to the extensions which asked for it
+    const QXmppStanzaIndex &index = d->extensionIndex[d->stanzaTarget(element.attribute("to"))];
+    foreach (int i, index.handlers(element))
+        if (d->extensions.at(i)->handleStanza(element))
+            return;
+
     handleStanza(this, element);
 }
 
@@ -810,12 +1621,88 @@ void QXmppServer::_q_outgoingServerDisconnected()
     if (!outgoing)
         return;
 
-    if (d->outgoingServers.remove(outgoing)) {
+    QHash<QString, QXmppServerPrivate::OutgoingServer>::iterator it = d->outgoingServers.find(outgoing->remoteDomain());
+    if (it != d->outgoingServers.end() && it->stream == outgoing) {
+        d->setOutgoingQueue(outgoing, 0, 0);
+        d->outgoingServers.erase(it);
         outgoing->deleteLater();
         setGauge("outgoing-server.count", d->outgoingServers.size());
     }
 }
 
+/// Handle data dropped from the queue of an outgoing server.
+///
+/// The senders of requests are told that they will not get a response,
+/// and whether retrying later may help (RFC 6120).
+
+void QXmppServer::_q_outgoingServerDataDropped(const QByteArray &data, QXmppStanza::Error::Condition condition)
+{
+    QXmlStreamReader reader(data);
+    if (!reader.readNextStartElement() || reader.name() != QLatin1String("iq"))
+        return;
+
+    const QXmlStreamAttributes attributes = reader.attributes();
+    const QStringRef type = attributes.value("type");
+    if (type != QLatin1String("get") && type != QLatin1String("set"))
+        return;
+
+    QXmppIq response(QXmppIq::Error);
+    response.setId(attributes.value("id").toString());
+    response.setFrom(attributes.value("to").toString());
+    response.setTo(attributes.value("from").toString());
+    QXmppStanza::Error error(errorType(condition), condition);
+    response.setError(error);
+    sendPacket(response);
+}
+
+/// Handle a change in the queue of an outgoing server.
+
+void QXmppServer::_q_outgoingServerQueueChanged()
+{
+    QXmppOutgoingServer *outgoing = qobject_cast<QXmppOutgoingServer *>(sender());
+    if (!outgoing)
+        return;
+
+    d->setOutgoingQueue(outgoing, outgoing->queuedStanzas(), outgoing->queuedBytes());
+}
+
+/// Disconnect the outgoing S2S streams which were not used recently.
+
+void QXmppServer::_q_reapOutgoingServers()
+{
+    const qint64 cutoff = d->outgoingClock.elapsed() - qint64(d->outgoingIdleTimeout) * 1000;
+    QHash<QString, QXmppServerPrivate::OutgoingServer>::iterator it = d->outgoingServers.begin();
+    while (it != d->outgoingServers.end()) {
+        if (it->lastUsed < cutoff) {
+            QXmppOutgoingServer *outgoing = it->stream;
+            d->setOutgoingQueue(outgoing, 0, 0);
+            it = d->outgoingServers.erase(it);
+            info(QString("Closing idle connection to %1").arg(outgoing->remoteDomain()));
+            updateCounter("outgoing-server.reaped");
+            outgoing->disconnectFromHost();
+            outgoing->deleteLater();
+        } else {
+            ++it;
+        }
+    }
+
+    if (d->outgoingServers.isEmpty())
+        d->outgoingIdleTimer->stop();
+    setGauge("outgoing-server.count", d->outgoingServers.size());
+}
+
+/// Route a stanza which was not turned into a DOM tree.
+///
+/// This slot can be invoked from any thread.
+///
+/// \param data
+/// \param to
+
+void QXmppServer::_q_routeData(const QByteArray &data, const QString &to)
+{
+    d->routeData(to, data);
+}
+
 /// Handle a new incoming TCP connection from a server.
 ///
 /// \param socket
@@ -832,6 +1719,7 @@ void QXmppServer::_q_serverConnection(QSslSocket *socket)
     }
 
     QXmppIncomingServer *stream = new QXmppIncomingServer(socket, d->domain, this);
+    stream->setLoggedMessageTypes(QXmppLogger::loggedMessageTypes(d->logger));
     socket->setParent(stream);
 
     check = connect(stream, SIGNAL(disconnected()),
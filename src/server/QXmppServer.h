@@ -28,6 +28,7 @@
 #include <QVariantMap>
 
 #include "QXmppLogger.h"
+#include "QXmppStanza.h"
 
 class QDomElement;
 class QSslCertificate;
@@ -42,7 +43,6 @@ class QXmppPresence;
 class QXmppServerExtension;
 class QXmppServerPrivate;
 class QXmppSslServer;
-class QXmppStanza;
 class QXmppStream;
 
 /// \brief The QXmppServer class represents an XMPP server.
@@ -79,6 +79,33 @@ public:
 
     QVariantMap statistics() const;
 
+    int workerThreadCount() const;
+    void setWorkerThreadCount(int count);
+
+    int streamResumptionTimeout() const;
+    void setStreamResumptionTimeout(int secs);
+
+    int clientBytesPerSecond() const;
+    void setClientBytesPerSecond(int bytes);
+
+    int clientStanzasPerSecond() const;
+    void setClientStanzasPerSecond(int stanzas);
+
+    int clientCompressionLevel() const;
+    void setClientCompressionLevel(int level);
+
+    int clientCompressionMemoryLevel() const;
+    void setClientCompressionMemoryLevel(int level);
+
+    int outgoingServerIdleTimeout() const;
+    void setOutgoingServerIdleTimeout(int secs);
+
+    int maximumOutgoingServers() const;
+    void setMaximumOutgoingServers(int count);
+
+    int outgoingServerConnectionRate() const;
+    void setOutgoingServerConnectionRate(int connections);
+
     void addCaCertificates(const QString &caCertificates);
     void setLocalCertificate(const QString &path);
     void setLocalCertificate(const QSslCertificate &certificate);
@@ -91,6 +118,8 @@ public:
 
     bool sendElement(const QDomElement &element);
     bool sendPacket(const QXmppStanza &stanza);
+    bool sendData(const QString &to, const QByteArray &data);
+    int deliverData(const QString &to, const QList<QByteArray> &stanzas);
 
     void addIncomingClient(QXmppIncomingClient *stream);
 
@@ -101,6 +130,11 @@ signals:
     /// This signal is emitted when a client has disconnected.
     void clientDisconnected(const QString &jid);
 
+    /// This signal is emitted when a client sends an available presence
+    /// with a non-negative priority, after which it accepts messages
+    /// addressed to its bare JID.
+    void clientAvailable(const QString &jid);
+
     /// This signal is emitted when the logger changes.
     void loggerChanged(QXmppLogger *logger);
 
@@ -109,10 +143,17 @@ public slots:
 
 private slots:
     void _q_clientConnection(QSslSocket *socket);
-    void _q_clientConnected();
+    void _q_clientConnected(const QString &jid);
     void _q_clientDisconnected();
+    void _q_clientResumableChanged(const QString &id);
+    void _q_clientResumeRequested(const QString &jid, const QString &previd, uint h);
     void _q_dialbackRequestReceived(const QXmppDialback &dialback);
+    void _q_expireSessions();
+    void _q_outgoingServerDataDropped(const QByteArray &data, QXmppStanza::Error::Condition condition);
     void _q_outgoingServerDisconnected();
+    void _q_outgoingServerQueueChanged();
+    void _q_reapOutgoingServers();
+    void _q_routeData(const QByteArray &data, const QString &to);
     void _q_serverConnection(QSslSocket *socket);
     void _q_serverDisconnected();
 
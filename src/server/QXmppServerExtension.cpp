@@ -33,12 +33,17 @@ class QXmppServerExtensionPrivate
 {
 public:
     QXmppServer *server;
+    QStringList handledStanzaTags;
+    QStringList handledStanzaNamespaces;
+    QXmppServerExtension::StanzaTargets handledStanzaTargets;
 };
 
 QXmppServerExtension::QXmppServerExtension()
     : d(new QXmppServerExtensionPrivate)
 {
     d->server = 0;
+    d->handledStanzaTags << "message" << "presence" << "iq";
+    d->handledStanzaTargets = AllTargets;
 }
 
 QXmppServerExtension::~QXmppServerExtension()
@@ -98,6 +103,82 @@ bool QXmppServerExtension::handleStanza(const QDomElement &stanza)
     return false;
 }
 
+/// Returns the tag names of the stanzas this extension wants to see in
+/// handleStanza().
+///
+/// By default the extension sees all stanzas.
+
+QStringList QXmppServerExtension::handledStanzaTags() const
+{
+    return d->handledStanzaTags;
+}
+
+/// Sets the tag names of the stanzas this extension wants to see in
+/// handleStanza().
+///
+/// Messages and presences sent by clients to users which no extension
+/// asks for are routed without being turned into a DOM tree.
+///
+/// The value is read when the extension is added to the server, so this
+/// should be called from the extension's constructor.
+///
+/// \param tags
+
+void QXmppServerExtension::setHandledStanzaTags(const QStringList &tags)
+{
+    d->handledStanzaTags = tags;
+}
+
+/// Returns the namespaces of the child elements of the stanzas this
+/// extension wants to see in handleStanza().
+///
+/// By default the list is empty, which requests stanzas regardless of
+/// their payload.
+
+QStringList QXmppServerExtension::handledStanzaNamespaces() const
+{
+    return d->handledStanzaNamespaces;
+}
+
+/// Sets the namespaces of the child elements of the stanzas this
+/// extension wants to see in handleStanza().
+///
+/// Stanzas without any child element and error stanzas are always
+/// offered to the extension.
+///
+/// The value is read when the extension is added to the server, so this
+/// should be called from the extension's constructor.
+///
+/// \param namespaces
+
+void QXmppServerExtension::setHandledStanzaNamespaces(const QStringList &namespaces)
+{
+    d->handledStanzaNamespaces = namespaces;
+}
+
+/// Returns the recipients of the stanzas this extension wants to see in
+/// handleStanza().
+///
+/// By default the extension sees stanzas for all recipients.
+
+QXmppServerExtension::StanzaTargets QXmppServerExtension::handledStanzaTargets() const
+{
+    return d->handledStanzaTargets;
+}
+
+/// Sets the recipients of the stanzas this extension wants to see in
+/// handleStanza().
+///
+/// The value is read when the extension is added to the server, so this
+/// should be called from the extension's constructor.
+///
+/// \param targets
+
+void QXmppServerExtension::setHandledStanzaTargets(StanzaTargets targets)
+{
+    d->handledStanzaTargets = targets;
+}
+
 /// Returns the list of subscribers for the given JID.
 ///
 /// \param jid
@@ -50,6 +50,17 @@ class QXMPP_EXPORT QXmppServerExtension : public QXmppLoggable
     Q_OBJECT
 
 public:
+    /// This enum describes the recipients of the stanzas an extension
+    /// wants to see.
+    enum StanzaTarget
+    {
+        ServerTarget = 1,       ///< Stanzas addressed to the server itself
+        LocalUserTarget = 2,    ///< Stanzas addressed to a local user
+        RemoteTarget = 4,       ///< Stanzas addressed to a remote JID
+        AllTargets = 7          ///< Any stanza
+    };
+    Q_DECLARE_FLAGS(StanzaTargets, StanzaTarget)
+
     QXmppServerExtension();
     ~QXmppServerExtension();
     virtual QString extensionName() const;
@@ -64,9 +75,17 @@ public:
     virtual bool start();
     virtual void stop();
 
+    QStringList handledStanzaTags() const;
+    QStringList handledStanzaNamespaces() const;
+    StanzaTargets handledStanzaTargets() const;
+
 protected:
     QXmppServer *server() const;
 
+    void setHandledStanzaTags(const QStringList &tags);
+    void setHandledStanzaNamespaces(const QStringList &namespaces);
+    void setHandledStanzaTargets(StanzaTargets targets);
+
 private:
     void setServer(QXmppServer *server);
     QXmppServerExtensionPrivate * const d;
@@ -74,4 +93,6 @@ private:
     friend class QXmppServer;
 };
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(QXmppServerExtension::StanzaTargets)
+
 #endif
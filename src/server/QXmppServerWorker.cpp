@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QMutexLocker>
+#include <QThread>
+
+#include "QXmppServerWorker_p.h"
+#include "QXmppStream.h"
+
+/// Constructs a new worker.
+///
+/// \param parent
+
+QXmppServerWorker::QXmppServerWorker(QObject *parent)
+    : QObject(parent)
+{
+}
+
+/// Queues \a data for delivery to the given \a stream.
+///
+/// This method is thread-safe, the data is written from the worker's
+/// thread, which must be the stream's thread.
+///
+/// \param stream
+/// \param data
+
+void QXmppServerWorker::queueData(const QPointer<QXmppStream> &stream, const QByteArray &data)
+{
+    bool schedule;
+    {
+        QMutexLocker locker(&m_mutex);
+        schedule = m_pending.isEmpty();
+        m_pending << qMakePair(stream, data);
+    }
+
+    // the first chunk of a batch schedules the delivery
+    if (schedule)
+        QMetaObject::invokeMethod(this, "_q_flush", Qt::QueuedConnection);
+}
+
+/// Writes \a stanzas to the given \a stream from the worker's thread,
+/// and waits until they are written.
+///
+/// Returns the number of stanzas the stream accepted, stopping at the
+/// first one it refused. The worker's thread must not be waiting for
+/// the calling thread.
+///
+/// \param stream
+/// \param stanzas
+
+int QXmppServerWorker::writeData(const QPointer<QXmppStream> &stream, const QList<QByteArray> &stanzas)
+{
+    if (thread() == QThread::currentThread())
+        return _q_writeData(stream, stanzas);
+
+    int written = 0;
+    QMetaObject::invokeMethod(this, "_q_writeData", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(int, written),
+                              Q_ARG(QPointer<QXmppStream>, stream),
+                              Q_ARG(QList<QByteArray>, stanzas));
+    return written;
+}
+
+void QXmppServerWorker::_q_flush()
+{
+    QList<QPair<QPointer<QXmppStream>, QByteArray> > pending;
+    {
+        QMutexLocker locker(&m_mutex);
+        pending.swap(m_pending);
+    }
+
+    // each stanza is handed over separately so that it is counted for
+    // Stream Management, the stream coalesces the writes itself
+    for (int i = 0; i < pending.size(); ++i) {
+        // the stream may have been destroyed in the meantime
+        QXmppStream *stream = pending[i].first;
+        if (stream)
+            stream->sendStanzaData(pending[i].second);
+    }
+}
+
+int QXmppServerWorker::_q_writeData(const QPointer<QXmppStream> &stream, const QList<QByteArray> &stanzas)
+{
+    // the stream may have been destroyed in the meantime
+    QXmppStream *target = stream;
+    int written = 0;
+    while (target && written < stanzas.size() && target->sendStanzaData(stanzas.at(written)))
+        ++written;
+    return written;
+}
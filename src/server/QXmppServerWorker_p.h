@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef QXMPPSERVERWORKER_P_H
+#define QXMPPSERVERWORKER_P_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QPair>
+#include <QPointer>
+
+#include "QXmppGlobal.h"
+
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QXmpp API.  It exists for the convenience
+// of the QXmppServer class.
+//
+// This header file may change from version to version without notice,
+// or even be removed.
+//
+// We mean it.
+//
+
+class QXmppStream;
+
+/// \brief The QXmppServerWorker class delivers routed data to the
+/// streams living in a given thread.
+///
+/// Data can be queued from any thread. All the data queued between two
+/// passes of the owning thread's event loop is delivered using a single
+/// queued call, and consecutive chunks for the same stream are written
+/// at once.
+
+class QXMPP_AUTOTEST_EXPORT QXmppServerWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    QXmppServerWorker(QObject *parent = 0);
+
+    void queueData(const QPointer<QXmppStream> &stream, const QByteArray &data);
+    int writeData(const QPointer<QXmppStream> &stream, const QList<QByteArray> &stanzas);
+
+private slots:
+    void _q_flush();
+    int _q_writeData(const QPointer<QXmppStream> &stream, const QList<QByteArray> &stanzas);
+
+private:
+    QMutex m_mutex;
+    QList<QPair<QPointer<QXmppStream>, QByteArray> > m_pending;
+};
+
+#endif
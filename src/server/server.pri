@@ -1,20 +1,35 @@
 # Headers
 INSTALL_HEADERS += \
+    server/QXmppAsyncPasswordChecker.h \
     server/QXmppDialback.h \
     server/QXmppIncomingClient.h \
     server/QXmppIncomingServer.h \
+    server/QXmppOfflineMessageStore.h \
     server/QXmppOutgoingServer.h \
     server/QXmppPasswordChecker.h \
+    server/QXmppRosterExtension.h \
     server/QXmppServer.h \
     server/QXmppServerExtension.h \
     server/QXmppServerPlugin.h
 
+HEADERS += \
+    server/QXmppAsyncPasswordChecker_p.h \
+    server/QXmppOfflineMessageLog_p.h \
+    server/QXmppRoutingTable_p.h \
+    server/QXmppServerWorker_p.h
+
 # Source files
 SOURCES += \
+    server/QXmppAsyncPasswordChecker.cpp \
     server/QXmppDialback.cpp \
     server/QXmppIncomingClient.cpp \
     server/QXmppIncomingServer.cpp \
+    server/QXmppOfflineMessageLog.cpp \
+    server/QXmppOfflineMessageStore.cpp \
     server/QXmppOutgoingServer.cpp \
     server/QXmppPasswordChecker.cpp \
+    server/QXmppRosterExtension.cpp \
+    server/QXmppRoutingTable.cpp \
     server/QXmppServer.cpp \
-    server/QXmppServerExtension.cpp
+    server/QXmppServerExtension.cpp \
+    server/QXmppServerWorker.cpp
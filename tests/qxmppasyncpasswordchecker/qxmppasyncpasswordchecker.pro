@@ -0,0 +1,3 @@
+include(../tests.pri)
+TARGET = tst_qxmppasyncpasswordchecker
+SOURCES += tst_qxmppasyncpasswordchecker.cpp
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QCryptographicHash>
+#include <QEventLoop>
+#include <QMutex>
+#include <QSemaphore>
+#include <QTimer>
+
+#include "QXmppAsyncPasswordChecker.h"
+#include "util.h"
+
+class TestAsyncPasswordChecker : public QXmppAsyncPasswordChecker
+{
+public:
+    TestAsyncPasswordChecker()
+        : m_lookups(0)
+    {
+    }
+
+    ~TestAsyncPasswordChecker()
+    {
+        waitForDone();
+    }
+
+    int lookups()
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_lookups;
+    }
+
+    QSemaphore gate;
+
+protected:
+    QXmppPasswordReply::Error getPassword(const QXmppPasswordRequest &request, QString &password)
+    {
+        gate.acquire();
+        {
+            QMutexLocker locker(&m_mutex);
+            m_lookups++;
+        }
+        if (request.username() == "testuser") {
+            password = "testpwd";
+            return QXmppPasswordReply::NoError;
+        }
+        return QXmppPasswordReply::AuthorizationError;
+    }
+
+private:
+    QMutex m_mutex;
+    int m_lookups;
+};
+
+static void waitForReply(QXmppPasswordReply *reply)
+{
+    if (reply->isFinished())
+        return;
+
+    QEventLoop loop;
+    QObject::connect(reply, SIGNAL(finished()), &loop, SLOT(quit()));
+    QTimer::singleShot(5000, &loop, SLOT(quit()));
+    loop.exec();
+}
+
+static QXmppPasswordRequest makeRequest(const QString &username, const QString &password = QString())
+{
+    QXmppPasswordRequest request;
+    request.setDomain("example.com");
+    request.setUsername(username);
+    request.setPassword(password);
+    return request;
+}
+
+class tst_QXmppAsyncPasswordChecker : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testCache();
+    void testCoalesce();
+    void testDeleteReply();
+    void testFailure();
+};
+
+void tst_QXmppAsyncPasswordChecker::testCache()
+{
+    TestAsyncPasswordChecker checker;
+    checker.gate.release(2);
+
+    QXmppPasswordReply *reply = checker.checkPassword(makeRequest("testuser", "testpwd"));
+    waitForReply(reply);
+    QVERIFY(reply->isFinished());
+    QCOMPARE(reply->error(), QXmppPasswordReply::NoError);
+    delete reply;
+    QCOMPARE(checker.lookups(), 1);
+
+    // the digest is computed from the cached password
+    reply = checker.getDigest(makeRequest("testuser"));
+    waitForReply(reply);
+    QVERIFY(reply->isFinished());
+    QCOMPARE(reply->error(), QXmppPasswordReply::NoError);
+    QCOMPARE(reply->digest(), QCryptographicHash::hash("testuser:example.com:testpwd", QCryptographicHash::Md5));
+    delete reply;
+    QCOMPARE(checker.lookups(), 1);
+
+    // a wrong password is checked against the cache too
+    reply = checker.checkPassword(makeRequest("testuser", "badpwd"));
+    waitForReply(reply);
+    QCOMPARE(reply->error(), QXmppPasswordReply::AuthorizationError);
+    delete reply;
+    QCOMPARE(checker.lookups(), 1);
+
+    // once the cache is cleared, the backend is queried again
+    checker.clearCache();
+    reply = checker.checkPassword(makeRequest("testuser", "testpwd"));
+    waitForReply(reply);
+    QCOMPARE(reply->error(), QXmppPasswordReply::NoError);
+    delete reply;
+    QCOMPARE(checker.lookups(), 2);
+}
+
+void tst_QXmppAsyncPasswordChecker::testCoalesce()
+{
+    TestAsyncPasswordChecker checker;
+
+    // the lookup is held back until all the requests are queued
+    QList<QXmppPasswordReply*> replies;
+    replies << checker.checkPassword(makeRequest("testuser", "testpwd"));
+    replies << checker.checkPassword(makeRequest("testuser", "badpwd"));
+    replies << checker.getDigest(makeRequest("testuser"));
+    checker.gate.release(1);
+
+    foreach (QXmppPasswordReply *reply, replies)
+        waitForReply(reply);
+    QCOMPARE(checker.lookups(), 1);
+
+    QVERIFY(replies[0]->isFinished());
+    QCOMPARE(replies[0]->error(), QXmppPasswordReply::NoError);
+    QVERIFY(replies[1]->isFinished());
+    QCOMPARE(replies[1]->error(), QXmppPasswordReply::AuthorizationError);
+    QVERIFY(replies[2]->isFinished());
+    QCOMPARE(replies[2]->error(), QXmppPasswordReply::NoError);
+    QCOMPARE(replies[2]->digest(), QCryptographicHash::hash("testuser:example.com:testpwd", QCryptographicHash::Md5));
+    qDeleteAll(replies);
+}
+
+void tst_QXmppAsyncPasswordChecker::testDeleteReply()
+{
+    TestAsyncPasswordChecker checker;
+
+    // the requester goes away while the lookup is in progress
+    QXmppPasswordReply *reply = checker.checkPassword(makeRequest("testuser", "testpwd"));
+    delete reply;
+    checker.gate.release(1);
+    checker.waitForDone();
+    QTest::qWait(100);
+    QCOMPARE(checker.lookups(), 1);
+
+    // the result was cached all the same
+    reply = checker.checkPassword(makeRequest("testuser", "testpwd"));
+    waitForReply(reply);
+    QVERIFY(reply->isFinished());
+    QCOMPARE(reply->error(), QXmppPasswordReply::NoError);
+    delete reply;
+    QCOMPARE(checker.lookups(), 1);
+}
+
+void tst_QXmppAsyncPasswordChecker::testFailure()
+{
+    TestAsyncPasswordChecker checker;
+    checker.gate.release(2);
+
+    // failed lookups are not cached
+    for (int i = 0; i < 2; ++i) {
+        QXmppPasswordReply *reply = checker.checkPassword(makeRequest("baduser", "testpwd"));
+        waitForReply(reply);
+        QVERIFY(reply->isFinished());
+        QCOMPARE(reply->error(), QXmppPasswordReply::AuthorizationError);
+        delete reply;
+    }
+    QCOMPARE(checker.lookups(), 2);
+}
+
+QTEST_MAIN(tst_QXmppAsyncPasswordChecker)
+#include "tst_qxmppasyncpasswordchecker.moc"
@@ -0,0 +1,3 @@
+include(../tests.pri)
+TARGET = tst_qxmppcompressor
+SOURCES += tst_qxmppcompressor.cpp
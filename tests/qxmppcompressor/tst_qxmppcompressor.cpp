@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QObject>
+
+#include "QXmppCompressor_p.h"
+#include "util.h"
+
+class tst_QXmppCompressor : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testCorrupt();
+    void testLimit();
+    void testRoundTrip();
+};
+
+void tst_QXmppCompressor::testCorrupt()
+{
+#ifdef QXMPP_USE_ZLIB
+    QXmppCompressor compressor;
+    QVERIFY(compressor.start(6, 8));
+
+    QByteArray output;
+    QVERIFY(!compressor.decompress(QByteArray("not zlib data"), output));
+    QVERIFY(!compressor.hasPendingData());
+    QVERIFY(!compressor.errorString().isEmpty());
+#endif
+}
+
+void tst_QXmppCompressor::testLimit()
+{
+#ifdef QXMPP_USE_ZLIB
+    QXmppCompressor sender;
+    QXmppCompressor receiver;
+    QVERIFY(sender.start(9, 8));
+    QVERIFY(receiver.start(9, 8));
+
+    // highly redundant data expands far beyond its compressed size
+    QByteArray compressed;
+    QVERIFY(sender.compress(QByteArray(1024 * 1024, 'a'), compressed));
+    QVERIFY(compressed.size() < 8192);
+
+    // it is decompressed in bounded chunks
+    QByteArray output;
+    QVERIFY(receiver.decompress(compressed, output, 65536));
+    QCOMPARE(output.size(), 65536);
+    QVERIFY(receiver.hasPendingData());
+
+    QByteArray decompressed = output;
+    while (receiver.hasPendingData()) {
+        QVERIFY(receiver.decompress(QByteArray(), output, 65536));
+        QVERIFY(output.size() <= 65536);
+        decompressed += output;
+    }
+    QCOMPARE(decompressed, QByteArray(1024 * 1024, 'a'));
+#endif
+}
+
+void tst_QXmppCompressor::testRoundTrip()
+{
+#ifdef QXMPP_USE_ZLIB
+    QXmppCompressor client;
+    QXmppCompressor server;
+    QVERIFY(!client.isActive());
+    QVERIFY(client.start(6, 8));
+    QVERIFY(server.start(6, 8));
+    QVERIFY(client.isActive());
+
+    // each chunk is decodable on its own thanks to the sync flush, and
+    // later chunks benefit from the history of earlier ones
+    const QByteArray stanza("<message to=\"bar@example.com\" type=\"chat\"><body>Hello</body></message>");
+    int firstSize = 0;
+    for (int i = 0; i < 3; ++i) {
+        QByteArray compressed;
+        QVERIFY(client.compress(stanza, compressed));
+        if (i == 0)
+            firstSize = compressed.size();
+        else
+            QVERIFY(compressed.size() < firstSize);
+
+        QByteArray output;
+        QVERIFY(server.decompress(compressed, output));
+        QCOMPARE(output, stanza);
+    }
+
+    client.stop();
+    QVERIFY(!client.isActive());
+#endif
+}
+
+QTEST_MAIN(tst_QXmppCompressor)
+#include "tst_qxmppcompressor.moc"
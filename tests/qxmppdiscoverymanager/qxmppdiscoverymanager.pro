@@ -0,0 +1,3 @@
+include(../tests.pri)
+TARGET = tst_qxmppdiscoverymanager
+SOURCES += tst_qxmppdiscoverymanager.cpp
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QDir>
+#include <QSignalSpy>
+
+#include "QXmppClient.h"
+#include "QXmppClientExtension.h"
+#include "QXmppDiscoveryIq.h"
+#include "QXmppDiscoveryManager.h"
+#include "QXmppRosterExtension.h"
+#include "QXmppServer.h"
+#include "util.h"
+
+static void removeDirectory(const QString &path)
+{
+    QDir dir(path);
+    foreach (const QString &name, dir.entryList(QDir::Files))
+        dir.remove(name);
+    dir.rmdir(path);
+}
+
+static QXmppRosterIq::Item makeItem(const QString &jid)
+{
+    QXmppRosterIq::Item item;
+    item.setBareJid(jid);
+    item.setSubscriptionType(QXmppRosterIq::Item::Both);
+    return item;
+}
+
+class TestExtension : public QXmppClientExtension
+{
+public:
+    QStringList discoveryFeatures() const
+    {
+        return QStringList() << "urn:example:test";
+    }
+
+    bool handleStanza(const QDomElement &stanza)
+    {
+        Q_UNUSED(stanza);
+        return false;
+    }
+};
+
+class tst_QXmppDiscoveryManager : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void testCapabilitiesCache();
+    void testLocalCapabilities();
+
+private:
+    void connectClient(QXmppClient *client, const QString &user, const QString &resource);
+
+    QString m_path;
+    QXmppServer *m_server;
+    TestPasswordChecker m_passwordChecker;
+};
+
+void tst_QXmppDiscoveryManager::init()
+{
+    m_path = QDir::temp().filePath("tst_qxmppdiscoverymanager");
+    removeDirectory(m_path);
+
+    m_passwordChecker.addCredentials("juliet", "testpwd");
+    m_passwordChecker.addCredentials("romeo", "testpwd");
+
+    QXmppRosterExtension *extension = new QXmppRosterExtension;
+    extension->setItem("juliet@localhost", makeItem("romeo@localhost"));
+    extension->setItem("romeo@localhost", makeItem("juliet@localhost"));
+
+    m_server = new QXmppServer;
+    m_server->setDomain("localhost");
+    m_server->setPasswordChecker(&m_passwordChecker);
+    m_server->addExtension(extension);
+    QVERIFY(m_server->listenForClients(QHostAddress::LocalHost, 12345));
+}
+
+void tst_QXmppDiscoveryManager::cleanup()
+{
+    delete m_server;
+    removeDirectory(m_path);
+}
+
+void tst_QXmppDiscoveryManager::connectClient(QXmppClient *client, const QString &user, const QString &resource)
+{
+    QXmppConfiguration config;
+    config.setDomain("localhost");
+    config.setHost(QHostAddress(QHostAddress::LocalHost).toString());
+    config.setPort(12345);
+    config.setUser(user);
+    config.setPassword("testpwd");
+    config.setResource(resource);
+
+    QEventLoop loop;
+    connect(client, SIGNAL(connected()), &loop, SLOT(quit()));
+    QTimer::singleShot(5000, &loop, SLOT(quit()));
+    client->connectToServer(config);
+    loop.exec();
+}
+
+void tst_QXmppDiscoveryManager::testCapabilitiesCache()
+{
+    QXmppClient juliet;
+    QXmppDiscoveryManager *julietDisco = juliet.findExtension<QXmppDiscoveryManager>();
+    QVERIFY(julietDisco);
+    QVERIFY(!julietDisco->isCapabilitiesCacheEnabled());
+    julietDisco->setCapabilitiesCacheEnabled(true);
+    julietDisco->setCapabilitiesCachePath(m_path);
+    QSignalSpy spy(julietDisco, SIGNAL(capabilitiesReceived(QString,QXmppDiscoveryIq)));
+    connectClient(&juliet, "juliet", "balcony");
+    QVERIFY(juliet.isConnected());
+
+    // two of romeo's resources advertise the same capabilities
+    QXmppClient romeoLaptop;
+    connectClient(&romeoLaptop, "romeo", "laptop");
+    QVERIFY(romeoLaptop.isConnected());
+    QXmppClient romeoPhone;
+    connectClient(&romeoPhone, "romeo", "phone");
+    QVERIFY(romeoPhone.isConnected());
+
+    const QByteArray ver = romeoLaptop.findExtension<QXmppDiscoveryManager>()->capabilities().verificationString();
+    QCOMPARE(romeoPhone.findExtension<QXmppDiscoveryManager>()->capabilities().verificationString(), ver);
+
+    QStringList jids;
+    for (int i = 0; i < 50 && jids.size() < 2; ++i) {
+        QTest::qWait(100);
+        jids.clear();
+        for (int j = 0; j < spy.size(); ++j) {
+            const QString jid = spy.at(j).at(0).toString();
+            if (jid.startsWith("romeo@localhost/"))
+                jids << jid;
+        }
+    }
+    jids.sort();
+    QCOMPARE(jids, QStringList() << "romeo@localhost/laptop" << "romeo@localhost/phone");
+
+    QVERIFY(julietDisco->hasCachedCapabilities(ver));
+    QVERIFY(julietDisco->cachedCapabilities(ver).features().contains("urn:xmpp:ping"));
+    QCOMPARE(julietDisco->cachedCapabilities(ver).verificationString(), ver);
+
+    // the capabilities were stored on disk
+    QXmppClient other;
+    QXmppDiscoveryManager *otherDisco = other.findExtension<QXmppDiscoveryManager>();
+    QVERIFY(!otherDisco->hasCachedCapabilities(ver));
+    otherDisco->setCapabilitiesCachePath(m_path);
+    QVERIFY(otherDisco->hasCachedCapabilities(ver));
+    QVERIFY(otherDisco->cachedCapabilities(ver).features().contains("urn:xmpp:ping"));
+
+    // tampered entries are discarded
+    const QStringList files = QDir(m_path).entryList(QDir::Files);
+    QCOMPARE(files.size(), 1);
+    QFile file(QDir(m_path).filePath(files.first()));
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QByteArray data = file.readAll();
+    data.replace("urn:xmpp:ping", "urn:example:forged");
+    QVERIFY(file.resize(0));
+    QVERIFY(file.seek(0));
+    QCOMPARE(file.write(data), qint64(data.size()));
+    file.close();
+
+    QXmppClient forged;
+    QXmppDiscoveryManager *forgedDisco = forged.findExtension<QXmppDiscoveryManager>();
+    forgedDisco->setCapabilitiesCachePath(m_path);
+    QVERIFY(!forgedDisco->hasCachedCapabilities(ver));
+    QCOMPARE(forgedDisco->cachedCapabilities(ver).features(), QStringList());
+    QVERIFY(!QFile::exists(file.fileName()));
+}
+
+void tst_QXmppDiscoveryManager::testLocalCapabilities()
+{
+    QXmppClient client;
+    QXmppDiscoveryManager *disco = client.findExtension<QXmppDiscoveryManager>();
+    const QByteArray ver = disco->capabilitiesVerificationString();
+    QCOMPARE(disco->capabilities().verificationString(), ver);
+    QVERIFY(!disco->capabilities().features().contains("urn:example:test"));
+
+    // adding an extension changes the capabilities
+    TestExtension *extension = new TestExtension;
+    QVERIFY(client.addExtension(extension));
+    QVERIFY(disco->capabilities().features().contains("urn:example:test"));
+    QVERIFY(disco->capabilitiesVerificationString() != ver);
+    QCOMPARE(disco->capabilities().verificationString(), disco->capabilitiesVerificationString());
+
+    // and so does removing it
+    QVERIFY(client.removeExtension(extension));
+    QVERIFY(!disco->capabilities().features().contains("urn:example:test"));
+    QCOMPARE(disco->capabilitiesVerificationString(), ver);
+
+    // as well as changing the client's identity
+    disco->setClientName("Test client");
+    QCOMPARE(disco->capabilities().identities().first().name(), QString("Test client"));
+    QVERIFY(disco->capabilitiesVerificationString() != ver);
+    QCOMPARE(disco->capabilities().verificationString(), disco->capabilitiesVerificationString());
+}
+
+QTEST_MAIN(tst_QXmppDiscoveryManager)
+#include "tst_qxmppdiscoverymanager.moc"
@@ -0,0 +1,3 @@
+include(../tests.pri)
+TARGET = tst_qxmppdnscache
+SOURCES += tst_qxmppdnscache.cpp
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QEventLoop>
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+
+#include "QXmppDnsCache_p.h"
+#include "util.h"
+
+class tst_QXmppDnsCache : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testCancel();
+    void testCoalesce();
+    void testNegativeCache();
+};
+
+class LookupThread : public QThread
+{
+public:
+    LookupThread(QXmppDnsCache *cache, const QString &name)
+        : m_cache(cache)
+        , m_name(name)
+    {
+    }
+
+protected:
+    void run()
+    {
+        // the thread exits without waiting for the result
+        QXmppDnsReply *reply = m_cache->lookup(QDnsLookup::SRV, m_name);
+        delete reply;
+    }
+
+private:
+    QXmppDnsCache *m_cache;
+    QString m_name;
+};
+
+static void waitForReply(QXmppDnsReply *reply)
+{
+    if (reply->isFinished())
+        return;
+
+    QEventLoop loop;
+    QObject::connect(reply, SIGNAL(finished()), &loop, SLOT(quit()));
+    QTimer::singleShot(30000, &loop, SLOT(quit()));
+    loop.exec();
+}
+
+void tst_QXmppDnsCache::testCancel()
+{
+    QXmppDnsCache cache;
+
+    // the query is sent from another thread which then exits
+    LookupThread thread(&cache, "_xmpp-client._tcp.example.invalid");
+    thread.start();
+    QVERIFY(thread.wait(5000));
+    QCOMPARE(cache.misses(), qint64(1));
+
+    // later lookups still get the result of the query, which may already
+    // have been cached
+    QXmppDnsReply *first = cache.lookup(QDnsLookup::SRV, "_xmpp-client._tcp.example.invalid");
+    QXmppDnsReply *second = cache.lookup(QDnsLookup::SRV, "_xmpp-client._tcp.example.invalid");
+    QVERIFY(first->source() != QXmppDnsReply::NetworkSource);
+    QVERIFY(second->source() != QXmppDnsReply::NetworkSource);
+
+    // deleting a reply does not affect the others
+    delete first;
+    waitForReply(second);
+    QVERIFY(second->isFinished());
+    QCOMPARE(cache.misses(), qint64(1));
+    delete second;
+}
+
+void tst_QXmppDnsCache::testCoalesce()
+{
+    QXmppDnsCache cache;
+
+    // identical lookups share a single query
+    QXmppDnsReply *first = cache.lookup(QDnsLookup::SRV, "_xmpp-server._tcp.example.invalid");
+    QXmppDnsReply *second = cache.lookup(QDnsLookup::SRV, "_xmpp-server._tcp.EXAMPLE.invalid");
+    QCOMPARE(first->source(), QXmppDnsReply::NetworkSource);
+    QCOMPARE(second->source(), QXmppDnsReply::PendingSource);
+    QCOMPARE(cache.misses(), qint64(1));
+    QCOMPARE(cache.coalesced(), qint64(1));
+
+    waitForReply(second);
+    QVERIFY(first->isFinished());
+    QVERIFY(second->isFinished());
+    QCOMPARE(second->error(), first->error());
+    QCOMPARE(second->name(), QString("_xmpp-server._tcp.EXAMPLE.invalid"));
+
+    // a different type is a different query
+    QXmppDnsReply *third = cache.lookup(QDnsLookup::A, "example.invalid");
+    QCOMPARE(third->source(), QXmppDnsReply::NetworkSource);
+    QCOMPARE(cache.misses(), qint64(2));
+    waitForReply(third);
+
+    delete first;
+    delete second;
+    delete third;
+}
+
+void tst_QXmppDnsCache::testNegativeCache()
+{
+    QXmppDnsCache cache;
+    QCOMPARE(cache.negativeTimeToLive(), 60);
+
+    QXmppDnsReply *reply = cache.lookup(QDnsLookup::SRV, "_xmpp-client._tcp.example.invalid");
+    waitForReply(reply);
+    QVERIFY(reply->isFinished());
+    QVERIFY(reply->serviceRecords().isEmpty());
+    QCOMPARE(cache.size(), 1);
+    delete reply;
+
+    // the failure is served from the cache
+    reply = cache.lookup(QDnsLookup::SRV, "_xmpp-client._tcp.example.invalid");
+    QCOMPARE(reply->source(), QXmppDnsReply::CacheSource);
+    QVERIFY(reply->isFinished());
+    QCOMPARE(cache.hits(), qint64(1));
+    QCOMPARE(cache.misses(), qint64(1));
+
+    // finished() is still emitted asynchronously
+    QEventLoop loop;
+    connect(reply, SIGNAL(finished()), &loop, SLOT(quit()));
+    QTimer::singleShot(5000, &loop, SLOT(quit()));
+    loop.exec();
+    delete reply;
+
+    // clearing the cache causes a new query
+    cache.clear();
+    QCOMPARE(cache.size(), 0);
+    reply = cache.lookup(QDnsLookup::SRV, "_xmpp-client._tcp.example.invalid");
+    QCOMPARE(reply->source(), QXmppDnsReply::NetworkSource);
+    QCOMPARE(cache.misses(), qint64(2));
+    waitForReply(reply);
+    delete reply;
+
+    // negative caching can be disabled
+    cache.clear();
+    cache.setNegativeTimeToLive(0);
+    reply = cache.lookup(QDnsLookup::SRV, "_xmpp-client._tcp.example.invalid");
+    waitForReply(reply);
+    QCOMPARE(cache.size(), 0);
+    delete reply;
+}
+
+QTEST_MAIN(tst_QXmppDnsCache)
+#include "tst_qxmppdnscache.moc"
@@ -0,0 +1,3 @@
+include(../tests.pri)
+TARGET = tst_qxmppjid
+SOURCES += tst_qxmppjid.cpp
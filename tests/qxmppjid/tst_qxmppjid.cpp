@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QObject>
+#include "QXmppJid.h"
+#include "util.h"
+
+class tst_QXmppJid : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testCompare();
+    void testHash();
+    void testParse_data();
+    void testParse();
+};
+
+void tst_QXmppJid::testCompare()
+{
+    const QXmppJid jid1("foo@example.com/res1");
+    const QXmppJid jid2("foo@example.com/res2");
+    const QXmppJid jid3("foo@example.com");
+    const QXmppJid jid4("bar@example.com/res1");
+
+    QVERIFY(jid1 == QXmppJid("foo@example.com/res1"));
+    QVERIFY(jid1 != jid2);
+
+    QVERIFY(jid1.isSameBareJid(jid2));
+    QVERIFY(jid1.isSameBareJid(jid3));
+    QVERIFY(!jid1.isSameBareJid(jid4));
+}
+
+void tst_QXmppJid::testHash()
+{
+    QHash<QXmppJid, int> hash;
+    hash.insert(QXmppJid("foo@example.com/res1"), 1);
+    hash.insert(QXmppJid("foo@example.com"), 2);
+
+    QCOMPARE(hash.value(QXmppJid("foo@example.com/res1")), 1);
+    QCOMPARE(hash.value(QXmppJid("foo@example.com")), 2);
+    QCOMPARE(hash.value(QXmppJid("foo@example.com/res2")), 0);
+
+    // the hash of a bare JID is its bare hash
+    const QXmppJid bare("foo@example.com");
+    QCOMPARE(bare.hash(), bare.bareHash());
+    QCOMPARE(QXmppJid("foo@example.com/res1").bareHash(), bare.bareHash());
+}
+
+void tst_QXmppJid::testParse_data()
+{
+    QTest::addColumn<QString>("jid");
+    QTest::addColumn<QString>("user");
+    QTest::addColumn<QString>("domain");
+    QTest::addColumn<QString>("resource");
+    QTest::addColumn<QString>("bareJid");
+    QTest::addColumn<bool>("isBare");
+
+    QTest::newRow("full") << "foo@example.com/resource" << "foo" << "example.com" << "resource" << "foo@example.com" << false;
+    QTest::newRow("bare") << "foo@example.com" << "foo" << "example.com" << "" << "foo@example.com" << true;
+    QTest::newRow("domain") << "example.com" << "" << "example.com" << "" << "example.com" << true;
+    QTest::newRow("domain-resource") << "example.com/res@ource" << "" << "example.com" << "res@ource" << "example.com" << false;
+    QTest::newRow("resource-slash") << "foo@example.com/res/ource" << "foo" << "example.com" << "res/ource" << "foo@example.com" << false;
+    QTest::newRow("empty") << "" << "" << "" << "" << "" << true;
+}
+
+void tst_QXmppJid::testParse()
+{
+    QFETCH(QString, jid);
+    QFETCH(QString, user);
+    QFETCH(QString, domain);
+    QFETCH(QString, resource);
+    QFETCH(QString, bareJid);
+    QFETCH(bool, isBare);
+
+    const QXmppJid parsed(jid);
+    QCOMPARE(parsed.toString(), jid);
+    QCOMPARE(parsed.user().toString(), user);
+    QCOMPARE(parsed.domain().toString(), domain);
+    QCOMPARE(parsed.resource().toString(), resource);
+    QCOMPARE(parsed.bareJid().toString(), bareJid);
+    QCOMPARE(parsed.isBare(), isBare);
+}
+
+QTEST_MAIN(tst_QXmppJid)
+#include "tst_qxmppjid.moc"
@@ -46,6 +46,9 @@ private slots:
     void testSubextensions();
     void testChatMarkers();
     void testPrivateMessage();
+    void testStreamReader_data();
+    void testStreamReader();
+    void testStreamReaderReuse();
 };
 
 void tst_QXmppMessage::testBasic_data()
@@ -569,5 +572,119 @@ void tst_QXmppMessage::testPrivateMessage()
     QVERIFY(!buffer.data().contains("private"));
 }
 
+void tst_QXmppMessage::testStreamReader_data()
+{
+    QTest::addColumn<QByteArray>("xml");
+
+    QTest::newRow("basic") << QByteArray(
+        "<message xmlns=\"jabber:client\" to=\"foo@example.com/QXmpp\" from=\"bar@example.com/QXmpp\" id=\"abc\" type=\"chat\">"
+        "<subject>some subject</subject>"
+        "<body>Hello &amp; goodbye</body>"
+        "<thread>some thread</thread>"
+        "</message>");
+    QTest::newRow("lang") << QByteArray(
+        "<message xmlns=\"jabber:client\" xml:lang=\"en\" type=\"chat\">"
+        "<body>Hello</body>"
+        "</message>");
+    QTest::newRow("state") << QByteArray(
+        "<message xmlns=\"jabber:client\" type=\"chat\">"
+        "<composing xmlns=\"http://jabber.org/protocol/chatstates\"/>"
+        "</message>");
+    QTest::newRow("receipt") << QByteArray(
+        "<message xmlns=\"jabber:client\" id=\"bi29sg183b4v\" type=\"normal\">"
+        "<received xmlns=\"urn:xmpp:receipts\" id=\"richard2-4.1.247\"/>"
+        "<request xmlns=\"urn:xmpp:receipts\"/>"
+        "</message>");
+    QTest::newRow("delay") << QByteArray(
+        "<message xmlns=\"jabber:client\" type=\"normal\">"
+        "<x xmlns=\"jabber:x:delay\" stamp=\"20100710T23:09:32\"/>"
+        "<delay xmlns=\"urn:xmpp:delay\" stamp=\"2010-06-29T08:23:06Z\"/>"
+        "</message>");
+    QTest::newRow("xhtml") << QByteArray(
+        "<message xmlns=\"jabber:client\" type=\"normal\">"
+        "<body>hi!</body>"
+        "<html xmlns=\"http://jabber.org/protocol/xhtml-im\">"
+        "<body xmlns=\"http://www.w3.org/1999/xhtml\">"
+        "<p style=\"font-weight:bold\">hi!</p>"
+        "</body>"
+        "</html>"
+        "</message>");
+    QTest::newRow("addresses") << QByteArray(
+        "<message xmlns=\"jabber:client\" to=\"multicast.jabber.org\" type=\"normal\">"
+        "<addresses xmlns=\"http://jabber.org/protocol/address\">"
+        "<address jid=\"hildjj@jabber.org/Work\" type=\"to\"/>"
+        "<address jid=\"jer@jabber.org/Home\" type=\"cc\"/>"
+        "</addresses>"
+        "</message>");
+    QTest::newRow("invitation") << QByteArray(
+        "<message xmlns=\"jabber:client\" to=\"hecate@shakespeare.lit\" type=\"normal\">"
+        "<x xmlns=\"jabber:x:conference\" jid=\"darkcave@macbeth.shakespeare.lit\" password=\"cauldronburn\" reason=\"Hey Hecate, this is the place for all good witches!\"/>"
+        "</message>");
+    QTest::newRow("markers") << QByteArray(
+        "<message xmlns=\"jabber:client\" id=\"message-2\" type=\"chat\">"
+        "<markable xmlns=\"urn:xmpp:chat-markers:0\"/>"
+        "<displayed xmlns=\"urn:xmpp:chat-markers:0\" id=\"message-1\" thread=\"sleeping\"/>"
+        "</message>");
+    QTest::newRow("extension") << QByteArray(
+        "<message xmlns=\"jabber:client\" id=\"aeb214\" type=\"normal\">"
+        "<result xmlns=\"urn:xmpp:mam:tmp\" id=\"5d398-28273-f7382\" queryid=\"f27\">"
+        "<forwarded xmlns=\"urn:xmpp:forward:0\">"
+        "<message from=\"juliet@capulet.lit/balcony\" id=\"8a54s\" type=\"chat\">"
+        "<body>What man art thou?</body>"
+        "</message>"
+        "</forwarded>"
+        "</result>"
+        "</message>");
+}
+
+void tst_QXmppMessage::testStreamReader()
+{
+    QFETCH(QByteArray, xml);
+
+    QXmppMessage domMessage;
+    parsePacket(domMessage, xml);
+
+    QXmppMessage readerMessage;
+    parsePacketFromReader(readerMessage, xml);
+
+    QCOMPARE(readerMessage.lang(), domMessage.lang());
+    QCOMPARE(readerMessage.body(), domMessage.body());
+    QCOMPARE(readerMessage.state(), domMessage.state());
+    QCOMPARE(readerMessage.isReceiptRequested(), domMessage.isReceiptRequested());
+    QCOMPARE(readerMessage.xhtml(), domMessage.xhtml());
+    QCOMPARE(readerMessage.stamp(), domMessage.stamp());
+    QCOMPARE(readerMessage.extensions().size(), domMessage.extensions().size());
+    QCOMPARE(packetToXml(readerMessage), packetToXml(domMessage));
+}
+
+void tst_QXmppMessage::testStreamReaderReuse()
+{
+    QXmppMessage message;
+    parsePacketFromReader(message, QByteArray(
+        "<message xmlns=\"jabber:client\" xml:lang=\"en\" type=\"chat\">"
+        "<body>Hello</body>"
+        "<composing xmlns=\"http://jabber.org/protocol/chatstates\"/>"
+        "<request xmlns=\"urn:xmpp:receipts\"/>"
+        "<attention xmlns=\"urn:xmpp:attention:0\"/>"
+        "<private xmlns=\"urn:xmpp:carbons:2\"/>"
+        "</message>"));
+    QCOMPARE(message.lang(), QLatin1String("en"));
+    QCOMPARE(message.body(), QLatin1String("Hello"));
+    QCOMPARE(message.state(), QXmppMessage::Composing);
+    QCOMPARE(message.isReceiptRequested(), true);
+    QCOMPARE(message.isAttentionRequested(), true);
+    QCOMPARE(message.isPrivate(), true);
+
+    // parsing another message must not keep the previous values
+    parsePacketFromReader(message, QByteArray(
+        "<message xmlns=\"jabber:client\" type=\"chat\"/>"));
+    QCOMPARE(message.lang(), QString());
+    QCOMPARE(message.body(), QString());
+    QCOMPARE(message.state(), QXmppMessage::None);
+    QCOMPARE(message.isReceiptRequested(), false);
+    QCOMPARE(message.isAttentionRequested(), false);
+    QCOMPARE(message.isPrivate(), false);
+}
+
 QTEST_MAIN(tst_QXmppMessage)
 #include "tst_qxmppmessage.moc"
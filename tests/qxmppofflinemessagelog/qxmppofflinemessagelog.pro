@@ -0,0 +1,3 @@
+include(../tests.pri)
+TARGET = tst_qxmppofflinemessagelog
+SOURCES += tst_qxmppofflinemessagelog.cpp
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QDir>
+#include <QObject>
+
+#include "QXmppOfflineMessageLog_p.h"
+#include "util.h"
+
+class tst_QXmppOfflineMessageLog : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void testAppend();
+    void testRecover();
+    void testRemove();
+    void testRemoveCount();
+    void testSegments();
+
+private:
+    QString m_path;
+};
+
+static void removeDirectory(const QString &path)
+{
+    QDir dir(path);
+    foreach (const QString &name, dir.entryList(QDir::Files))
+        dir.remove(name);
+    dir.rmdir(path);
+}
+
+void tst_QXmppOfflineMessageLog::init()
+{
+    m_path = QDir::temp().filePath("tst_qxmppofflinemessagelog");
+    removeDirectory(m_path);
+}
+
+void tst_QXmppOfflineMessageLog::cleanup()
+{
+    removeDirectory(m_path);
+}
+
+void tst_QXmppOfflineMessageLog::testAppend()
+{
+    QXmppOfflineMessageLog log;
+    QVERIFY(!log.isOpen());
+    QVERIFY(!log.append("juliet@example.com", "<message/>"));
+
+    QVERIFY(log.open(m_path));
+    QVERIFY(log.isOpen());
+    QCOMPARE(log.size(), 0);
+    QCOMPARE(log.segmentCount(), 1);
+
+    QVERIFY(log.append("juliet@example.com", "<message id=\"1\"/>"));
+    QVERIFY(log.append("romeo@example.net", "<message id=\"2\"/>"));
+    QVERIFY(log.append("juliet@example.com", "<message id=\"3\"/>"));
+    QCOMPARE(log.size(), 3);
+    QCOMPARE(log.count("juliet@example.com"), 2);
+    QCOMPARE(log.count("romeo@example.net"), 1);
+    QCOMPARE(log.count("nobody@example.com"), 0);
+
+    QCOMPARE(log.messages("juliet@example.com"), QList<QByteArray>()
+        << "<message id=\"1\"/>" << "<message id=\"3\"/>");
+    QCOMPARE(log.messages("romeo@example.net"), QList<QByteArray>()
+        << "<message id=\"2\"/>");
+}
+
+void tst_QXmppOfflineMessageLog::testRecover()
+{
+    QXmppOfflineMessageLog log;
+    QVERIFY(log.open(m_path));
+    QVERIFY(log.append("juliet@example.com", "<message id=\"1\"/>"));
+    QVERIFY(log.append("romeo@example.net", "<message id=\"2\"/>"));
+    log.close();
+    QCOMPARE(log.size(), 0);
+
+    // the index is rebuilt from the segments
+    QVERIFY(log.open(m_path));
+    QCOMPARE(log.size(), 2);
+    QCOMPARE(log.messages("juliet@example.com"), QList<QByteArray>() << "<message id=\"1\"/>");
+    QCOMPARE(log.messages("romeo@example.net"), QList<QByteArray>() << "<message id=\"2\"/>");
+
+    // new records follow the recovered ones
+    QVERIFY(log.append("juliet@example.com", "<message id=\"3\"/>"));
+    log.close();
+
+    // the output of an interrupted compaction is ignored
+    QFile tmp(QDir(m_path).filePath("00000001.tmp"));
+    QVERIFY(tmp.open(QIODevice::WriteOnly));
+    tmp.write(QByteArray(64, 'x'));
+    tmp.close();
+
+    QVERIFY(log.open(m_path));
+    QVERIFY(!tmp.exists());
+    QCOMPARE(log.messages("juliet@example.com"), QList<QByteArray>()
+        << "<message id=\"1\"/>" << "<message id=\"3\"/>");
+}
+
+void tst_QXmppOfflineMessageLog::testRemove()
+{
+    QXmppOfflineMessageLog log;
+    QVERIFY(log.open(m_path));
+    QVERIFY(log.append("juliet@example.com", "<message id=\"1\"/>"));
+    QVERIFY(log.append("romeo@example.net", "<message id=\"2\"/>"));
+
+    log.remove("juliet@example.com");
+    QCOMPARE(log.size(), 1);
+    QCOMPARE(log.count("juliet@example.com"), 0);
+    QCOMPARE(log.count("romeo@example.net"), 1);
+    log.close();
+
+    // removed messages stay removed
+    QVERIFY(log.open(m_path));
+    QCOMPARE(log.size(), 1);
+    QCOMPARE(log.count("juliet@example.com"), 0);
+    QCOMPARE(log.messages("romeo@example.net"), QList<QByteArray>() << "<message id=\"2\"/>");
+
+    // messages stored after a removal are kept
+    QVERIFY(log.append("juliet@example.com", "<message id=\"3\"/>"));
+    log.close();
+    QVERIFY(log.open(m_path));
+    QCOMPARE(log.messages("juliet@example.com"), QList<QByteArray>() << "<message id=\"3\"/>");
+}
+
+void tst_QXmppOfflineMessageLog::testRemoveCount()
+{
+    QXmppOfflineMessageLog log;
+    QVERIFY(log.open(m_path));
+    QVERIFY(log.append("juliet@example.com", "<message id=\"1\"/>"));
+    QVERIFY(log.append("juliet@example.com", "<message id=\"2\"/>"));
+    QVERIFY(log.append("juliet@example.com", "<message id=\"3\"/>"));
+
+    // only the oldest messages are removed
+    QVERIFY(log.remove("juliet@example.com", 2));
+    QCOMPARE(log.size(), 1);
+    QCOMPARE(log.messages("juliet@example.com"), QList<QByteArray>() << "<message id=\"3\"/>");
+    log.close();
+
+    QVERIFY(log.open(m_path));
+    QCOMPARE(log.size(), 1);
+    QCOMPARE(log.messages("juliet@example.com"), QList<QByteArray>() << "<message id=\"3\"/>");
+}
+
+void tst_QXmppOfflineMessageLog::testSegments()
+{
+    const QByteArray data(80, 'x');
+
+    QXmppOfflineMessageLog log;
+    log.setSegmentSize(256);
+    QVERIFY(log.open(m_path));
+
+    // two records fit in a segment
+    for (int i = 0; i < 4; ++i)
+        QVERIFY(log.append("juliet@example.com", data));
+    QVERIFY(log.append("romeo@example.net", data));
+    QCOMPARE(log.segmentCount(), 3);
+
+    // a large record gets a segment of its own
+    QVERIFY(log.append("romeo@example.net", QByteArray(1000, 'y')));
+    QCOMPARE(log.segmentCount(), 4);
+    QCOMPARE(log.messages("romeo@example.net").last(), QByteArray(1000, 'y'));
+
+    // once most of the log is discarded, the messages left are copied
+    // into a new segment
+    QVERIFY(log.remove("romeo@example.net"));
+    QCOMPARE(log.segmentCount(), 1);
+    QCOMPARE(log.messages("juliet@example.com"), QList<QByteArray>() << data << data << data << data);
+    log.close();
+
+    QVERIFY(log.open(m_path));
+    QCOMPARE(log.size(), 4);
+    QCOMPARE(log.segmentCount(), 1);
+    QCOMPARE(log.messages("juliet@example.com"), QList<QByteArray>() << data << data << data << data);
+
+    // emptied segments are deleted from the start of the log
+    QVERIFY(log.remove("juliet@example.com"));
+    QCOMPARE(log.segmentCount(), 1);
+    QCOMPARE(log.size(), 0);
+    log.close();
+
+    QVERIFY(log.open(m_path));
+    QCOMPARE(log.size(), 0);
+    QCOMPARE(log.segmentCount(), 1);
+}
+
+QTEST_MAIN(tst_QXmppOfflineMessageLog)
+#include "tst_qxmppofflinemessagelog.moc"
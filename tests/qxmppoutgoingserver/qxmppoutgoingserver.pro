@@ -0,0 +1,3 @@
+include(../tests.pri)
+TARGET = tst_qxmppoutgoingserver
+SOURCES += tst_qxmppoutgoingserver.cpp
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include "QXmppOutgoingServer.h"
+#include "util.h"
+
+static QByteArray stanza(const char *tagName, int size)
+{
+    QByteArray data = QByteArray("<") + tagName + "/>";
+    data += QByteArray(size - data.size(), ' ');
+    return data;
+}
+
+class tst_QXmppOutgoingServer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testQueueOverflow();
+    void testQueueTimeout();
+
+public slots:
+    void onQueuedDataDropped(const QByteArray &data, QXmppStanza::Error::Condition condition);
+
+private:
+    QList<QByteArray> m_dropped;
+    QList<QXmppStanza::Error::Condition> m_conditions;
+};
+
+void tst_QXmppOutgoingServer::onQueuedDataDropped(const QByteArray &data, QXmppStanza::Error::Condition condition)
+{
+    m_dropped << data;
+    m_conditions << condition;
+}
+
+void tst_QXmppOutgoingServer::testQueueOverflow()
+{
+    m_dropped.clear();
+    m_conditions.clear();
+
+    QXmppOutgoingServer server("localhost", 0);
+    server.setMaximumQueueSize(100);
+    connect(&server, SIGNAL(queuedDataDropped(QByteArray,QXmppStanza::Error::Condition)),
+            this, SLOT(onQueuedDataDropped(QByteArray,QXmppStanza::Error::Condition)));
+
+    const QByteArray presence1 = stanza("presence", 40);
+    const QByteArray message1 = stanza("message", 40);
+    const QByteArray presence2 = stanza("presence", 40);
+    const QByteArray message2 = stanza("message", 90);
+
+    server.queueData(presence1);
+    server.queueData(message1);
+    QCOMPARE(server.queuedStanzas(), 2);
+    QCOMPARE(server.queuedBytes(), qint64(80));
+    QVERIFY(m_dropped.isEmpty());
+
+    // the oldest presence makes room
+    server.queueData(presence2);
+    QCOMPARE(server.queuedStanzas(), 2);
+    QCOMPARE(server.queuedBytes(), qint64(80));
+    QCOMPARE(m_dropped, QList<QByteArray>() << presence1);
+
+    // without presences left, the new data is dropped
+    server.queueData(message2);
+    QCOMPARE(server.queuedStanzas(), 1);
+    QCOMPARE(server.queuedBytes(), qint64(40));
+    QCOMPARE(m_dropped, QList<QByteArray>() << presence1 << presence2 << message2);
+    foreach (QXmppStanza::Error::Condition condition, m_conditions)
+        QCOMPARE(condition, QXmppStanza::Error::ResourceConstraint);
+}
+
+void tst_QXmppOutgoingServer::testQueueTimeout()
+{
+    m_dropped.clear();
+    m_conditions.clear();
+
+    QXmppOutgoingServer server("localhost", 0);
+    server.setQueueTimeout(1);
+    connect(&server, SIGNAL(queuedDataDropped(QByteArray,QXmppStanza::Error::Condition)),
+            this, SLOT(onQueuedDataDropped(QByteArray,QXmppStanza::Error::Condition)));
+
+    const QByteArray iq = stanza("iq", 20);
+    server.queueData(iq);
+    QCOMPARE(server.queuedStanzas(), 1);
+
+    QTest::qWait(2500);
+    QCOMPARE(server.queuedStanzas(), 0);
+    QCOMPARE(server.queuedBytes(), qint64(0));
+    QCOMPARE(m_dropped, QList<QByteArray>() << iq);
+    QCOMPARE(m_conditions.first(), QXmppStanza::Error::RemoteServerTimeout);
+}
+
+QTEST_MAIN(tst_QXmppOutgoingServer)
+#include "tst_qxmppoutgoingserver.moc"
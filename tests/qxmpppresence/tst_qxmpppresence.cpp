@@ -40,6 +40,8 @@ private slots:
     void testPresenceWithMucItem();
     void testPresenceWithMucPassword();
     void testPresenceWithMucSupport();
+    void testStreamReader_data();
+    void testStreamReader();
 };
 
 void tst_QXmppPresence::testPresence_data()
@@ -231,5 +233,57 @@ void tst_QXmppPresence::testPresenceWithMucSupport()
     serializePacket(presence, xml);
 }
 
+void tst_QXmppPresence::testStreamReader_data()
+{
+    QTest::addColumn<QByteArray>("xml");
+
+    QTest::newRow("show") << QByteArray(
+        "<presence xmlns=\"jabber:client\" xml:lang=\"en\" from=\"foo@example.com/QXmpp\">"
+        "<show>dnd</show><status>In a meeting</status><priority>5</priority>"
+        "</presence>");
+    QTest::newRow("vcard-update") << QByteArray(
+        "<presence xmlns=\"jabber:client\">"
+        "<x xmlns=\"vcard-temp:x:update\"><photo>73b908bc</photo></x>"
+        "</presence>");
+    QTest::newRow("caps") << QByteArray(
+        "<presence xmlns=\"jabber:client\" to=\"foo@example.com/QXmpp\">"
+        "<c xmlns=\"http://jabber.org/protocol/caps\" hash=\"sha-1\" node=\"https://github.com/qxmpp-project/qxmpp\" ver=\"QgayPKawpkPSDYmwT/WM94uAlu0=\"/>"
+        "</presence>");
+    QTest::newRow("muc-item") << QByteArray(
+        "<presence xmlns=\"jabber:client\" from=\"pistol@shakespeare.lit/harfleur\" type=\"unavailable\">"
+        "<x xmlns=\"http://jabber.org/protocol/muc#user\">"
+        "<item affiliation=\"none\" jid=\"pistol@shakespeare.lit/harfleur\" role=\"none\"/>"
+        "<status code=\"307\"/>"
+        "</x>"
+        "</presence>");
+    QTest::newRow("muc-password") << QByteArray(
+        "<presence xmlns=\"jabber:client\" to=\"coven@chat.shakespeare.lit/thirdwitch\">"
+        "<x xmlns=\"http://jabber.org/protocol/muc\"><password>pass</password></x>"
+        "</presence>");
+    QTest::newRow("extension") << QByteArray(
+        "<presence xmlns=\"jabber:client\">"
+        "<nick xmlns=\"http://jabber.org/protocol/nick\">Romeo</nick>"
+        "</presence>");
+}
+
+void tst_QXmppPresence::testStreamReader()
+{
+    QFETCH(QByteArray, xml);
+
+    QXmppPresence domPresence;
+    parsePacket(domPresence, xml);
+
+    QXmppPresence readerPresence;
+    parsePacketFromReader(readerPresence, xml);
+
+    QCOMPARE(readerPresence.lang(), domPresence.lang());
+    QCOMPARE(readerPresence.availableStatusType(), domPresence.availableStatusType());
+    QCOMPARE(readerPresence.statusText(), domPresence.statusText());
+    QCOMPARE(readerPresence.priority(), domPresence.priority());
+    QCOMPARE(readerPresence.mucStatusCodes(), domPresence.mucStatusCodes());
+    QCOMPARE(readerPresence.extensions().size(), domPresence.extensions().size());
+    QCOMPARE(packetToXml(readerPresence), packetToXml(domPresence));
+}
+
 QTEST_MAIN(tst_QXmppPresence)
 #include "tst_qxmpppresence.moc"
@@ -0,0 +1,3 @@
+include(../tests.pri)
+TARGET = tst_qxmpprosterextension
+SOURCES += tst_qxmpprosterextension.cpp
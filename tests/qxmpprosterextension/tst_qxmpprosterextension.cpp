@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include "QXmppClient.h"
+#include "QXmppRosterCache.h"
+#include "QXmppRosterExtension.h"
+#include "QXmppRosterManager.h"
+#include "QXmppServer.h"
+#include "util.h"
+
+static void waitForResources(QXmppClient *client, const QString &bareJid, int count)
+{
+    for (int i = 0; i < 50 && client->rosterManager().getResources(bareJid).size() != count; ++i)
+        QTest::qWait(100);
+}
+
+static QXmppRosterIq::Item makeItem(const QString &jid, QXmppRosterIq::Item::SubscriptionType type)
+{
+    QXmppRosterIq::Item item;
+    item.setBareJid(jid);
+    item.setSubscriptionType(type);
+    return item;
+}
+
+class TestRosterCache : public QXmppRosterCache
+{
+public:
+    bool load(const QString &bareJid, QString &version, QList<QXmppRosterIq::Item> &items)
+    {
+        Q_UNUSED(bareJid);
+        version = this->version;
+        items = this->items;
+        return true;
+    }
+
+    bool save(const QString &bareJid, const QString &version, const QList<QXmppRosterIq::Item> &items)
+    {
+        Q_UNUSED(bareJid);
+        this->version = version;
+        this->items = items;
+        return true;
+    }
+
+    bool update(const QString &bareJid, const QString &version, const QList<QXmppRosterIq::Item> &items)
+    {
+        Q_UNUSED(bareJid);
+        Q_UNUSED(items);
+        this->version = version;
+        return true;
+    }
+
+    void clear(const QString &bareJid)
+    {
+        Q_UNUSED(bareJid);
+        version.clear();
+        items.clear();
+    }
+
+    QString version;
+    QList<QXmppRosterIq::Item> items;
+};
+
+class tst_QXmppRosterExtension : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void testPresence();
+    void testRoster();
+    void testVersion();
+    void testVersionEpoch();
+
+public slots:
+    void onIqReceived(const QXmppIq &iq);
+
+private:
+    void connectClient(QXmppClient *client, const QString &user);
+
+    QXmppServer *m_server;
+    QXmppRosterExtension *m_extension;
+    TestPasswordChecker m_passwordChecker;
+    QList<QXmppIq> m_iqs;
+};
+
+void tst_QXmppRosterExtension::onIqReceived(const QXmppIq &iq)
+{
+    m_iqs << iq;
+}
+
+void tst_QXmppRosterExtension::init()
+{
+    m_passwordChecker.addCredentials("juliet", "testpwd");
+    m_passwordChecker.addCredentials("romeo", "testpwd");
+
+    m_extension = new QXmppRosterExtension;
+    m_extension->setItem("juliet@localhost", makeItem("romeo@localhost", QXmppRosterIq::Item::Both));
+    m_extension->setItem("romeo@localhost", makeItem("juliet@localhost", QXmppRosterIq::Item::Both));
+
+    m_server = new QXmppServer;
+    m_server->setDomain("localhost");
+    m_server->setPasswordChecker(&m_passwordChecker);
+    m_server->addExtension(m_extension);
+    QVERIFY(m_server->listenForClients(QHostAddress::LocalHost, 12345));
+
+    m_iqs.clear();
+}
+
+void tst_QXmppRosterExtension::cleanup()
+{
+    delete m_server;
+}
+
+void tst_QXmppRosterExtension::connectClient(QXmppClient *client, const QString &user)
+{
+    QXmppConfiguration config;
+    config.setDomain("localhost");
+    config.setHost(QHostAddress(QHostAddress::LocalHost).toString());
+    config.setPort(12345);
+    config.setUser(user);
+    config.setPassword("testpwd");
+    config.setResource("QXmpp");
+
+    QEventLoop loop;
+    connect(&client->rosterManager(), SIGNAL(rosterReceived()), &loop, SLOT(quit()));
+    QTimer::singleShot(5000, &loop, SLOT(quit()));
+    client->connectToServer(config);
+    loop.exec();
+}
+
+void tst_QXmppRosterExtension::testPresence()
+{
+    QXmppClient juliet;
+    connectClient(&juliet, "juliet");
+    QVERIFY(juliet.isConnected());
+
+    // romeo's initial presence is sent to juliet, and juliet's to romeo
+    QXmppClient romeo;
+    connectClient(&romeo, "romeo");
+    QVERIFY(romeo.isConnected());
+
+    waitForResources(&juliet, "romeo@localhost", 1);
+    QCOMPARE(juliet.rosterManager().getResources("romeo@localhost"), QStringList() << "QXmpp");
+    waitForResources(&romeo, "juliet@localhost", 1);
+    QCOMPARE(romeo.rosterManager().getResources("juliet@localhost"), QStringList() << "QXmpp");
+
+    // juliet's departure is broadcast
+    juliet.disconnectFromServer();
+    waitForResources(&romeo, "juliet@localhost", 0);
+    QCOMPARE(romeo.rosterManager().getResources("juliet@localhost"), QStringList());
+}
+
+void tst_QXmppRosterExtension::testRoster()
+{
+    QXmppClient juliet;
+    connectClient(&juliet, "juliet");
+    QVERIFY(juliet.isConnected());
+    QCOMPARE(juliet.rosterManager().getRosterBareJids(), QStringList() << "romeo@localhost");
+    QCOMPARE(int(juliet.rosterManager().getRosterEntry("romeo@localhost").subscriptionType()),
+             int(QXmppRosterIq::Item::Both));
+
+    // changes are pushed to the client
+    QEventLoop loop;
+    connect(&juliet.rosterManager(), SIGNAL(itemAdded(QString)), &loop, SLOT(quit()));
+    QVERIFY(juliet.rosterManager().addItem("nurse@localhost", "Nurse"));
+    QTimer::singleShot(5000, &loop, SLOT(quit()));
+    loop.exec();
+    QCOMPARE(juliet.rosterManager().getRosterEntry("nurse@localhost").name(), QString("Nurse"));
+    QCOMPARE(int(m_extension->items("juliet@localhost").size()), 2);
+
+    connect(&juliet.rosterManager(), SIGNAL(itemRemoved(QString)), &loop, SLOT(quit()));
+    QVERIFY(juliet.rosterManager().removeItem("nurse@localhost"));
+    QTimer::singleShot(5000, &loop, SLOT(quit()));
+    loop.exec();
+    QCOMPARE(juliet.rosterManager().getRosterBareJids(), QStringList() << "romeo@localhost");
+}
+
+void tst_QXmppRosterExtension::testVersion()
+{
+    const QString version = m_extension->rosterVersion("juliet@localhost");
+    m_extension->setItem("juliet@localhost", makeItem("nurse@localhost", QXmppRosterIq::Item::None));
+    m_extension->removeItem("juliet@localhost", "nurse@localhost");
+    QVERIFY(m_extension->rosterVersion("juliet@localhost") != version);
+
+    QXmppClient juliet;
+    connectClient(&juliet, "juliet");
+    QVERIFY(juliet.isConnected());
+    connect(&juliet, SIGNAL(iqReceived(QXmppIq)), this, SLOT(onIqReceived(QXmppIq)));
+
+    // a client which knows the first version only receives the changes
+    // since
+    QEventLoop loop;
+    connect(&juliet, SIGNAL(iqReceived(QXmppIq)), &loop, SLOT(quit()));
+    QXmppRosterIq request;
+    request.setType(QXmppIq::Get);
+    request.setVersion(version);
+    QVERIFY(juliet.sendPacket(request));
+    QTimer::singleShot(5000, &loop, SLOT(quit()));
+    loop.exec();
+
+    QCOMPARE(m_iqs.size(), 1);
+    QCOMPARE(m_iqs[0].id(), request.id());
+    QCOMPARE(m_iqs[0].type(), QXmppIq::Result);
+
+    // the pushed removal leaves the roster unchanged
+    QTest::qWait(100);
+    QCOMPARE(juliet.rosterManager().getRosterBareJids(), QStringList() << "romeo@localhost");
+}
+
+void tst_QXmppRosterExtension::testVersionEpoch()
+{
+    // the client cached a roster under a version of a previous run
+    QXmppRosterExtension previous;
+    previous.setItem("juliet@localhost", makeItem("tybalt@localhost", QXmppRosterIq::Item::Both));
+    QVERIFY(previous.rosterVersion("juliet@localhost") != m_extension->rosterVersion("juliet@localhost"));
+
+    TestRosterCache cache;
+    cache.version = previous.rosterVersion("juliet@localhost");
+    cache.items << makeItem("tybalt@localhost", QXmppRosterIq::Item::Both);
+
+    // it receives the full roster instead of a delta
+    QXmppClient juliet;
+    juliet.rosterManager().setCache(&cache);
+    connectClient(&juliet, "juliet");
+    QVERIFY(juliet.isConnected());
+    QCOMPARE(juliet.rosterManager().getRosterBareJids(), QStringList() << "romeo@localhost");
+    QCOMPARE(cache.version, m_extension->rosterVersion("juliet@localhost"));
+}
+
+QTEST_MAIN(tst_QXmppRosterExtension)
+#include "tst_qxmpprosterextension.moc"
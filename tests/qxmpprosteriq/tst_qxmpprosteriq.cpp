@@ -32,6 +32,8 @@ class tst_QXmppRosterIq : public QObject
 private slots:
     void testItem_data();
     void testItem();
+    void testVersion_data();
+    void testVersion();
 };
 
 void tst_QXmppRosterIq::testItem_data()
@@ -87,5 +89,33 @@ void tst_QXmppRosterIq::testItem()
     serializePacket(item, xml);
 }
 
+void tst_QXmppRosterIq::testVersion_data()
+{
+    QTest::addColumn<QByteArray>("xml");
+    QTest::addColumn<QString>("version");
+
+    QTest::newRow("noversion")
+        << QByteArray("<iq id=\"r1\" type=\"get\"><query xmlns=\"jabber:iq:roster\"/></iq>")
+        << QString();
+    QTest::newRow("empty")
+        << QByteArray("<iq id=\"r1\" type=\"get\"><query xmlns=\"jabber:iq:roster\" ver=\"\"/></iq>")
+        << QString("");
+    QTest::newRow("version")
+        << QByteArray("<iq id=\"r1\" type=\"get\"><query xmlns=\"jabber:iq:roster\" ver=\"ver14\"/></iq>")
+        << QString("ver14");
+}
+
+void tst_QXmppRosterIq::testVersion()
+{
+    QFETCH(QByteArray, xml);
+    QFETCH(QString, version);
+
+    QXmppRosterIq iq;
+    parsePacket(iq, xml);
+    QCOMPARE(iq.version().isNull(), version.isNull());
+    QCOMPARE(iq.version(), version);
+    serializePacket(iq, xml);
+}
+
 QTEST_MAIN(tst_QXmppRosterIq)
 #include "tst_qxmpprosteriq.moc"
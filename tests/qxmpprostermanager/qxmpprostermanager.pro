@@ -0,0 +1,3 @@
+include(../tests.pri)
+TARGET = tst_qxmpprostermanager
+SOURCES += tst_qxmpprostermanager.cpp
@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QDir>
+#include <QSignalSpy>
+
+#include "QXmppClient.h"
+#include "QXmppRosterCache.h"
+#include "QXmppRosterExtension.h"
+#include "QXmppRosterManager.h"
+#include "QXmppServer.h"
+#include "util.h"
+
+static void removeDirectory(const QString &path)
+{
+    QDir dir(path);
+    foreach (const QString &name, dir.entryList(QDir::Files))
+        dir.remove(name);
+    dir.rmdir(path);
+}
+
+static void waitForBestResource(QXmppClient *client, const QString &bareJid, const QString &resource)
+{
+    for (int i = 0; i < 50 && client->rosterManager().getBestResource(bareJid) != resource; ++i)
+        QTest::qWait(100);
+}
+
+static QXmppRosterIq::Item makeItem(const QString &jid, QXmppRosterIq::Item::SubscriptionType type, const QString &name = QString())
+{
+    QXmppRosterIq::Item item;
+    item.setBareJid(jid);
+    item.setName(name);
+    item.setSubscriptionType(type);
+    return item;
+}
+
+class tst_QXmppRosterManager : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void testBestResource();
+    void testFileCache();
+    void testFileCacheCompact();
+    void testVersioning();
+
+private:
+    void connectClient(QXmppClient *client, const QString &user = "juliet",
+                       const QString &resource = "QXmpp",
+                       const QXmppPresence &presence = QXmppPresence());
+
+    QString m_path;
+};
+
+void tst_QXmppRosterManager::init()
+{
+    m_path = QDir::temp().filePath("tst_qxmpprostermanager");
+    removeDirectory(m_path);
+}
+
+void tst_QXmppRosterManager::cleanup()
+{
+    removeDirectory(m_path);
+}
+
+void tst_QXmppRosterManager::connectClient(QXmppClient *client, const QString &user, const QString &resource, const QXmppPresence &presence)
+{
+    QXmppConfiguration config;
+    config.setDomain("localhost");
+    config.setHost(QHostAddress(QHostAddress::LocalHost).toString());
+    config.setPort(12345);
+    config.setUser(user);
+    config.setPassword("testpwd");
+    config.setResource(resource);
+
+    QEventLoop loop;
+    connect(&client->rosterManager(), SIGNAL(rosterReceived()), &loop, SLOT(quit()));
+    QTimer::singleShot(5000, &loop, SLOT(quit()));
+    client->connectToServer(config, presence);
+    loop.exec();
+}
+
+void tst_QXmppRosterManager::testBestResource()
+{
+    TestPasswordChecker passwordChecker;
+    passwordChecker.addCredentials("juliet", "testpwd");
+    passwordChecker.addCredentials("romeo", "testpwd");
+
+    QXmppRosterExtension *extension = new QXmppRosterExtension;
+    extension->setItem("juliet@localhost", makeItem("romeo@localhost", QXmppRosterIq::Item::Both));
+    extension->setItem("romeo@localhost", makeItem("juliet@localhost", QXmppRosterIq::Item::Both));
+
+    QXmppServer server;
+    server.setDomain("localhost");
+    server.setPasswordChecker(&passwordChecker);
+    server.addExtension(extension);
+    QVERIFY(server.listenForClients(QHostAddress::LocalHost, 12345));
+
+    QXmppClient romeo;
+    connectClient(&romeo, "romeo");
+    QVERIFY(romeo.isConnected());
+    QCOMPARE(romeo.rosterManager().getBestResource("juliet@localhost"), QString());
+
+    QXmppPresence presence;
+    presence.setPriority(1);
+    QXmppClient julietLaptop;
+    connectClient(&julietLaptop, "juliet", "laptop", presence);
+    QVERIFY(julietLaptop.isConnected());
+    waitForBestResource(&romeo, "juliet@localhost", "laptop");
+    QCOMPARE(romeo.rosterManager().getBestResource("juliet@localhost"), QString("laptop"));
+
+    // a resource with a higher priority is preferred
+    presence.setPriority(5);
+    QXmppClient julietPhone;
+    connectClient(&julietPhone, "juliet", "phone", presence);
+    QVERIFY(julietPhone.isConnected());
+    waitForBestResource(&romeo, "juliet@localhost", "phone");
+    QCOMPARE(romeo.rosterManager().getBestResource("juliet@localhost"), QString("phone"));
+
+    // with equal priorities, the most available resource is preferred
+    presence.setPriority(1);
+    presence.setAvailableStatusType(QXmppPresence::Away);
+    julietPhone.setClientPresence(presence);
+    waitForBestResource(&romeo, "juliet@localhost", "laptop");
+    QCOMPARE(romeo.rosterManager().getBestResource("juliet@localhost"), QString("laptop"));
+
+    julietLaptop.disconnectFromServer();
+    waitForBestResource(&romeo, "juliet@localhost", "phone");
+    QCOMPARE(romeo.rosterManager().getBestResource("juliet@localhost"), QString("phone"));
+    QCOMPARE(romeo.rosterManager().getResources("juliet@localhost"), QStringList() << "phone");
+    QCOMPARE(romeo.rosterManager().getPresence("juliet@localhost", "phone").availableStatusType(), QXmppPresence::Away);
+
+    julietPhone.disconnectFromServer();
+    waitForBestResource(&romeo, "juliet@localhost", QString());
+    QCOMPARE(romeo.rosterManager().getBestResource("juliet@localhost"), QString());
+    QCOMPARE(romeo.rosterManager().getAllPresencesForBareJid("juliet@localhost").size(), 0);
+}
+
+void tst_QXmppRosterManager::testFileCache()
+{
+    QString version;
+    QList<QXmppRosterIq::Item> items;
+
+    // nothing is stored yet
+    QXmppRosterFileCache cache(m_path);
+    QVERIFY(!cache.load("juliet@localhost", version, items));
+    QVERIFY(!cache.update("juliet@localhost", "2", items));
+
+    QSet<QString> groups;
+    groups << "Montague" << "Friends";
+    QXmppRosterIq::Item romeo = makeItem("romeo@localhost", QXmppRosterIq::Item::Both, QString::fromUtf8("Roméo"));
+    romeo.setGroups(groups);
+    QVERIFY(cache.save("juliet@localhost", "1", QList<QXmppRosterIq::Item>() << romeo));
+
+    // pushes are applied on top of the snapshot
+    QVERIFY(cache.update("juliet@localhost", "2", QList<QXmppRosterIq::Item>()
+        << makeItem("nurse@localhost", QXmppRosterIq::Item::None, "Nurse")));
+    QVERIFY(cache.update("juliet@localhost", "3", QList<QXmppRosterIq::Item>()
+        << makeItem("tybalt@localhost", QXmppRosterIq::Item::To)));
+    QVERIFY(cache.update("juliet@localhost", "4", QList<QXmppRosterIq::Item>()
+        << makeItem("tybalt@localhost", QXmppRosterIq::Item::Remove)));
+
+    QXmppRosterFileCache other(m_path);
+    QVERIFY(other.load("juliet@localhost", version, items));
+    QCOMPARE(version, QString("4"));
+    QCOMPARE(items.size(), 2);
+    QCOMPARE(items[0].bareJid(), QString("nurse@localhost"));
+    QCOMPARE(items[0].name(), QString("Nurse"));
+    QCOMPARE(int(items[0].subscriptionType()), int(QXmppRosterIq::Item::None));
+    QCOMPARE(items[1].bareJid(), QString("romeo@localhost"));
+    QCOMPARE(items[1].name(), QString::fromUtf8("Roméo"));
+    QCOMPARE(items[1].groups(), groups);
+    QCOMPARE(int(items[1].subscriptionType()), int(QXmppRosterIq::Item::Both));
+
+    // other accounts are not affected
+    QVERIFY(!other.load("romeo@localhost", version, items));
+
+    other.clear("juliet@localhost");
+    QVERIFY(!other.load("juliet@localhost", version, items));
+}
+
+void tst_QXmppRosterManager::testFileCacheCompact()
+{
+    QString version;
+    QList<QXmppRosterIq::Item> items;
+
+    QXmppRosterFileCache cache(m_path);
+    QVERIFY(cache.save("juliet@localhost", "1", QList<QXmppRosterIq::Item>()
+        << makeItem("romeo@localhost", QXmppRosterIq::Item::Both)));
+    QVERIFY(cache.update("juliet@localhost", "2", QList<QXmppRosterIq::Item>()
+        << makeItem("nurse@localhost", QXmppRosterIq::Item::None)));
+    QVERIFY(cache.update("juliet@localhost", "3", QList<QXmppRosterIq::Item>()
+        << makeItem("nurse@localhost", QXmppRosterIq::Item::From)));
+
+    const QStringList files = QDir(m_path).entryList(QDir::Files);
+    QCOMPARE(files.size(), 1);
+    QFile file(QDir(m_path).filePath(files.first()));
+    const qint64 journaledSize = file.size();
+
+    // the journal outgrew the snapshot, loading folds it
+    QVERIFY(cache.load("juliet@localhost", version, items));
+    QCOMPARE(version, QString("3"));
+    QCOMPARE(items.size(), 2);
+    QVERIFY(file.size() < journaledSize);
+    QCOMPARE(QDir(m_path).entryList(QDir::Files), files);
+
+    // a truncated record is ignored
+    QVERIFY(cache.update("juliet@localhost", "4", QList<QXmppRosterIq::Item>()
+        << makeItem("tybalt@localhost", QXmppRosterIq::Item::To)));
+    QVERIFY(file.resize(file.size() - 4));
+    QVERIFY(cache.load("juliet@localhost", version, items));
+    QCOMPARE(version, QString("3"));
+    QCOMPARE(items.size(), 2);
+
+    // and further updates are not lost
+    QVERIFY(cache.update("juliet@localhost", "5", QList<QXmppRosterIq::Item>()
+        << makeItem("tybalt@localhost", QXmppRosterIq::Item::To)));
+    QVERIFY(cache.load("juliet@localhost", version, items));
+    QCOMPARE(version, QString("5"));
+    QCOMPARE(items.size(), 3);
+}
+
+void tst_QXmppRosterManager::testVersioning()
+{
+    TestPasswordChecker passwordChecker;
+    passwordChecker.addCredentials("juliet", "testpwd");
+
+    QXmppRosterExtension *extension = new QXmppRosterExtension;
+    extension->setItem("juliet@localhost", makeItem("romeo@localhost", QXmppRosterIq::Item::Both));
+
+    QXmppServer server;
+    server.setDomain("localhost");
+    server.setPasswordChecker(&passwordChecker);
+    server.addExtension(extension);
+    QVERIFY(server.listenForClients(QHostAddress::LocalHost, 12345));
+
+    QXmppRosterFileCache cache(m_path);
+    QXmppClient client;
+    client.rosterManager().setCache(&cache);
+
+    // the first login fetches the whole roster and stores it
+    connectClient(&client);
+    QVERIFY(client.isConnected());
+    QVERIFY(client.isRosterVersioningSupported());
+    QCOMPARE(client.rosterManager().rosterVersion(), QString("1"));
+    QCOMPARE(client.rosterManager().getRosterBareJids(), QStringList() << "romeo@localhost");
+
+    QString version;
+    QList<QXmppRosterIq::Item> items;
+    QVERIFY(cache.load("juliet@localhost", version, items));
+    QCOMPARE(version, QString("1"));
+
+    client.disconnectFromServer();
+    for (int i = 0; i < 50 && client.state() != QXmppClient::DisconnectedState; ++i)
+        QTest::qWait(100);
+    QCOMPARE(client.state(), QXmppClient::DisconnectedState);
+    QCOMPARE(client.rosterManager().getRosterBareJids(), QStringList());
+
+    // the next login only receives the changes as pushes
+    extension->setItem("juliet@localhost", makeItem("nurse@localhost", QXmppRosterIq::Item::None, "Nurse"));
+    QSignalSpy addedSpy(&client.rosterManager(), SIGNAL(itemAdded(QString)));
+    connectClient(&client);
+    QVERIFY(client.isConnected());
+    for (int i = 0; i < 50 && client.rosterManager().rosterVersion() != "2"; ++i)
+        QTest::qWait(100);
+    QCOMPARE(client.rosterManager().rosterVersion(), QString("2"));
+    QCOMPARE(client.rosterManager().getRosterBareJids(), QStringList() << "nurse@localhost" << "romeo@localhost");
+    QCOMPARE(addedSpy.size(), 1);
+    QCOMPARE(addedSpy.at(0).at(0).toString(), QString("nurse@localhost"));
+
+    QVERIFY(cache.load("juliet@localhost", version, items));
+    QCOMPARE(version, QString("2"));
+    QCOMPARE(items.size(), 2);
+}
+
+QTEST_MAIN(tst_QXmppRosterManager)
+#include "tst_qxmpprostermanager.moc"
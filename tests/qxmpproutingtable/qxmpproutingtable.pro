@@ -0,0 +1,3 @@
+include(../tests.pri)
+TARGET = tst_qxmpproutingtable
+SOURCES += tst_qxmpproutingtable.cpp
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QObject>
+#include <QThread>
+#include "QXmppRoutingTable_p.h"
+#include "QXmppStream.h"
+#include "util.h"
+
+class TestStream : public QXmppStream
+{
+public:
+    TestStream() : QXmppStream(0) {}
+
+protected:
+    void handleStanza(const QDomElement &) {}
+    void handleStream(const QDomElement &) {}
+};
+
+class tst_QXmppRoutingTable : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testInsert();
+    void testLookup();
+    void testRemove();
+};
+
+void tst_QXmppRoutingTable::testInsert()
+{
+    TestStream stream1, stream2;
+    QXmppRoutingTable table;
+
+    QCOMPARE(table.insert("foo@example.com/res1", &stream1), (QXmppStream*)0);
+    QCOMPARE(table.size(), 1);
+
+    // replacing a resource returns the previous stream
+    QCOMPARE(table.insert("foo@example.com/res1", &stream2), (QXmppStream*)&stream1);
+    QCOMPARE(table.size(), 1);
+
+    QXmppRoutingResult result;
+    QCOMPARE(table.lookup("foo@example.com/res1", result), 1);
+    QCOMPARE(result.at(0).data(), (QXmppStream*)&stream2);
+}
+
+void tst_QXmppRoutingTable::testLookup()
+{
+    TestStream stream1, stream2, stream3;
+    QXmppRoutingTable table(4);
+    table.insert("foo@example.com/res1", &stream1);
+    table.insert("foo@example.com/res2", &stream2);
+    table.insert("bar@example.com/res1", &stream3);
+    QCOMPARE(table.size(), 3);
+
+    QXmppRoutingResult result;
+
+    // full JID
+    QCOMPARE(table.lookup("foo@example.com/res2", result), 1);
+    QCOMPARE(result.at(0).data(), (QXmppStream*)&stream2);
+    QCOMPARE(result.threadAt(0), QThread::currentThread());
+    result.clear();
+
+    // bare JID
+    QCOMPARE(table.lookup("foo@example.com", result), 2);
+    QCOMPARE(result.at(0).data(), (QXmppStream*)&stream1);
+    QCOMPARE(result.at(1).data(), (QXmppStream*)&stream2);
+    result.clear();
+
+    // unknown JIDs
+    QCOMPARE(table.lookup("foo@example.com/res3", result), 0);
+    QVERIFY(result.isEmpty());
+    QCOMPARE(table.lookup("foo@example.org/res1", result), 0);
+    QCOMPARE(table.lookup("baz@example.com", result), 0);
+
+    QCOMPARE(table.hits(), 2);
+    QCOMPARE(table.misses(), 3);
+}
+
+void tst_QXmppRoutingTable::testRemove()
+{
+    TestStream stream1, stream2;
+    QXmppRoutingTable table;
+    table.insert("foo@example.com/res1", &stream1);
+    table.insert("foo@example.com/res2", &stream2);
+
+    // the stream must match
+    QCOMPARE(table.remove("foo@example.com/res1", &stream2), false);
+    QCOMPARE(table.size(), 2);
+
+    QCOMPARE(table.remove("foo@example.com/res1", &stream1), true);
+    QCOMPARE(table.size(), 1);
+
+    QXmppRoutingResult result;
+    QCOMPARE(table.lookup("foo@example.com", result), 1);
+    QCOMPARE(result.at(0).data(), (QXmppStream*)&stream2);
+    result.clear();
+
+    QCOMPARE(table.remove("foo@example.com/res2", &stream2), true);
+    QCOMPARE(table.size(), 0);
+    QCOMPARE(table.lookup("foo@example.com", result), 0);
+}
+
+QTEST_MAIN(tst_QXmppRoutingTable)
+#include "tst_qxmpproutingtable.moc"
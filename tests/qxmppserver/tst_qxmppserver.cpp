@@ -21,19 +21,137 @@
  *
  */
 
+#include <QTcpSocket>
+
 #include "QXmppClient.h"
+#include "QXmppMessage.h"
 #include "QXmppServer.h"
+#include "QXmppServerExtension.h"
 #include "util.h"
 
+/// A client which speaks raw XML, to control Stream Management precisely.
+
+class TestRawClient
+{
+public:
+    bool connectToServer(const QHostAddress &host, quint16 port)
+    {
+        m_socket.connectToHost(host, port);
+        for (int i = 0; i < 50 && m_socket.state() != QAbstractSocket::ConnectedState; ++i)
+            QTest::qWait(100);
+        return m_socket.state() == QAbstractSocket::ConnectedState;
+    }
+
+    void abort()
+    {
+        m_socket.abort();
+        m_buffer.clear();
+    }
+
+    void send(const QByteArray &data)
+    {
+        m_socket.write(data);
+        m_socket.flush();
+    }
+
+    /// Returns the data received up to and including \a pattern, or an
+    /// empty array if it was not received in time.
+    QByteArray waitFor(const QByteArray &pattern)
+    {
+        for (int i = 0; i < 500; ++i) {
+            m_buffer += m_socket.readAll();
+            const int pos = m_buffer.indexOf(pattern);
+            if (pos >= 0) {
+                const QByteArray data = m_buffer.left(pos + pattern.size());
+                m_buffer.remove(0, pos + pattern.size());
+                return data;
+            }
+            QTest::qWait(10);
+        }
+        return QByteArray();
+    }
+
+    bool login(const QString &user)
+    {
+        const QByteArray header = "<?xml version='1.0'?><stream:stream to='localhost' "
+            "xmlns='jabber:client' xmlns:stream='http://etherx.jabber.org/streams' version='1.0'>";
+        send(header);
+        if (waitFor("</stream:features>").isEmpty())
+            return false;
+
+        const QByteArray credentials = QByteArray(1, '\0') + user.toUtf8() + QByteArray(1, '\0') + "testpwd";
+        send("<auth xmlns='urn:ietf:params:xml:ns:xmpp-sasl' mechanism='PLAIN'>" + credentials.toBase64() + "</auth>");
+        if (waitFor("<success").isEmpty())
+            return false;
+
+        send(header);
+        return !waitFor("</stream:features>").isEmpty();
+    }
+
+private:
+    QTcpSocket m_socket;
+    QByteArray m_buffer;
+};
+
+class TestExtension : public QXmppServerExtension
+{
+    Q_OBJECT
+
+public:
+    TestExtension(int priority, const QStringList &namespaces,
+                  QXmppServerExtension::StanzaTargets targets, bool accept)
+        : m_priority(priority), m_accept(accept)
+    {
+        setHandledStanzaNamespaces(namespaces);
+        setHandledStanzaTargets(targets);
+    }
+
+    int extensionPriority() const
+    {
+        return m_priority;
+    }
+
+    bool handleStanza(const QDomElement &stanza)
+    {
+        m_ids << stanza.attribute("id");
+        return m_accept;
+    }
+
+    QStringList m_ids;
+
+private:
+    int m_priority;
+    bool m_accept;
+};
+
 class tst_QXmppServer : public QObject
 {
     Q_OBJECT
 
 private slots:
+    void testCompression();
     void testConnect_data();
     void testConnect();
+    void testExtensionDispatch();
+    void testOutgoingServerLimits();
+    void testRateLimit();
+    void testByteRateLimit();
+    void testRouteMessage_data();
+    void testRouteMessage();
+    void testStreamResumption();
+
+public slots:
+    void onMessageReceived(const QXmppMessage &message);
+
+private:
+    QList<QXmppMessage> m_messages;
 };
 
+void tst_QXmppServer::onMessageReceived(const QXmppMessage &message)
+{
+    m_messages << message;
+}
+
 void tst_QXmppServer::testConnect_data()
 {
     QTest::addColumn<QString>("username");
@@ -96,5 +214,415 @@ void tst_QXmppServer::testConnect()
     QCOMPARE(client.isConnected(), connected);
 }
 
+void tst_QXmppServer::testCompression()
+{
+    const QString testDomain("localhost");
+    const QHostAddress testHost(QHostAddress::LocalHost);
+    const quint16 testPort = 12345;
+
+    // prepare server
+    TestPasswordChecker passwordChecker;
+    passwordChecker.addCredentials("sender", "testpwd");
+    passwordChecker.addCredentials("receiver", "testpwd");
+
+    QXmppServer server;
+    server.setDomain(testDomain);
+    server.setPasswordChecker(&passwordChecker);
+    server.setClientCompressionLevel(6);
+    QCOMPARE(server.clientCompressionLevel(), 6);
+    QVERIFY(server.listenForClients(testHost, testPort));
+
+    // connect clients, without zlib support they fall back to plain streams
+    QXmppConfiguration config;
+    config.setDomain(testDomain);
+    config.setHost(testHost.toString());
+    config.setPort(testPort);
+    config.setPassword("testpwd");
+    config.setResource("QXmpp");
+    config.setStreamCompressionLevel(6);
+
+    QXmppClient sender;
+    QXmppClient receiver;
+    QEventLoop loop;
+    connect(&sender, SIGNAL(connected()), &loop, SLOT(quit()));
+    connect(&receiver, SIGNAL(connected()), &loop, SLOT(quit()));
+
+    config.setUser("sender");
+    sender.connectToServer(config);
+    loop.exec();
+    QVERIFY(sender.isConnected());
+
+    config.setUser("receiver");
+    receiver.connectToServer(config);
+    loop.exec();
+    QVERIFY(receiver.isConnected());
+
+    // messages survive the round trip through both compressed streams
+    m_messages.clear();
+    connect(&receiver, SIGNAL(messageReceived(QXmppMessage)), this, SLOT(onMessageReceived(QXmppMessage)));
+
+    for (int i = 0; i < 3; ++i)
+        QVERIFY(sender.sendPacket(QXmppMessage(QString(), "receiver@localhost/QXmpp", QString::number(i))));
+
+    QElapsedTimer timer;
+    timer.start();
+    while (m_messages.size() < 3 && timer.elapsed() < 10000)
+        QTest::qWait(100);
+
+    QCOMPARE(m_messages.size(), 3);
+    QCOMPARE(m_messages.last().body(), QString("2"));
+}
+
+void tst_QXmppServer::testExtensionDispatch()
+{
+    QXmppServer server;
+    server.setDomain("localhost");
+
+    // catches whatever the other extensions leave so nothing gets routed
+    TestExtension *fallback = new TestExtension(-1, QStringList(), QXmppServerExtension::AllTargets, true);
+    server.addExtension(fallback);
+
+    TestExtension *serverVersion = new TestExtension(1, QStringList() << "jabber:iq:version", QXmppServerExtension::ServerTarget, false);
+    server.addExtension(serverVersion);
+
+    TestExtension *localUsers = new TestExtension(2, QStringList(), QXmppServerExtension::LocalUserTarget, false);
+    server.addExtension(localUsers);
+
+    const QStringList stanzas = QStringList()
+        << "<iq id=\"1\" to=\"localhost\" type=\"get\"><query xmlns=\"jabber:iq:version\"/></iq>"
+        << "<iq id=\"2\" type=\"get\"><query xmlns=\"jabber:iq:version\"/></iq>"
+        << "<iq id=\"3\" to=\"localhost\" type=\"get\"><query xmlns=\"jabber:iq:roster\"/></iq>"
+        << "<iq id=\"4\" to=\"foo@localhost\" type=\"get\"><query xmlns=\"jabber:iq:version\"/></iq>"
+        << "<message id=\"5\" to=\"foo@localhost/QXmpp\"><body>hello</body></message>"
+        << "<message id=\"6\" to=\"bar@example.com\"><body>hello</body></message>"
+        << "<iq id=\"7\" to=\"localhost\" type=\"error\"/>";
+
+    foreach (const QString &stanza, stanzas) {
+        QDomDocument doc;
+        QVERIFY(doc.setContent(stanza, true));
+        server.handleElement(doc.documentElement());
+    }
+
+    QCOMPARE(serverVersion->m_ids, QStringList() << "1" << "2" << "7");
+    QCOMPARE(localUsers->m_ids, QStringList() << "4" << "5");
+    QCOMPARE(fallback->m_ids, QStringList() << "1" << "2" << "3" << "4" << "5" << "6" << "7");
+}
+
+void tst_QXmppServer::testOutgoingServerLimits()
+{
+    QXmppServer server;
+    server.setDomain("localhost");
+    server.setMaximumOutgoingServers(2);
+    QVERIFY(server.listenForServers(QHostAddress::LocalHost, 12346));
+
+    // streams are reused for the same domain
+    QVERIFY(server.sendPacket(QXmppMessage("localhost", "foo@a.invalid", "hello")));
+    QVERIFY(server.sendPacket(QXmppMessage("localhost", "bar@a.invalid", "hello")));
+    QVERIFY(server.sendPacket(QXmppMessage("localhost", "foo@b.invalid", "hello")));
+    QCOMPARE(server.statistics().value("outgoing-servers").toInt(), 2);
+
+    // the number of streams is capped
+    QVERIFY(!server.sendPacket(QXmppMessage("localhost", "foo@c.invalid", "hello")));
+    QVERIFY(server.sendPacket(QXmppMessage("localhost", "foo@b.invalid", "hello")));
+    QCOMPARE(server.statistics().value("outgoing-servers").toInt(), 2);
+
+    // so is the rate at which they are created
+    server.setMaximumOutgoingServers(0);
+    server.setOutgoingServerConnectionRate(1);
+    QVERIFY(server.sendPacket(QXmppMessage("localhost", "foo@c.invalid", "hello")));
+    QVERIFY(!server.sendPacket(QXmppMessage("localhost", "foo@d.invalid", "hello")));
+    QCOMPARE(server.statistics().value("outgoing-servers").toInt(), 3);
+}
+
+void tst_QXmppServer::testRateLimit()
+{
+    const QString testDomain("localhost");
+    const QHostAddress testHost(QHostAddress::LocalHost);
+    const quint16 testPort = 12345;
+
+    // prepare server
+    TestPasswordChecker passwordChecker;
+    passwordChecker.addCredentials("sender", "testpwd");
+    passwordChecker.addCredentials("receiver", "testpwd");
+
+    QXmppServer server;
+    server.setDomain(testDomain);
+    server.setPasswordChecker(&passwordChecker);
+    server.setClientStanzasPerSecond(10);
+    QCOMPARE(server.clientStanzasPerSecond(), 10);
+    QVERIFY(server.listenForClients(testHost, testPort));
+
+    // connect clients
+    QXmppConfiguration config;
+    config.setDomain(testDomain);
+    config.setHost(testHost.toString());
+    config.setPort(testPort);
+    config.setPassword("testpwd");
+    config.setResource("QXmpp");
+
+    QXmppClient sender;
+    QXmppClient receiver;
+    QEventLoop loop;
+    connect(&sender, SIGNAL(connected()), &loop, SLOT(quit()));
+    connect(&receiver, SIGNAL(connected()), &loop, SLOT(quit()));
+
+    config.setUser("sender");
+    sender.connectToServer(config);
+    loop.exec();
+    QVERIFY(sender.isConnected());
+
+    config.setUser("receiver");
+    receiver.connectToServer(config);
+    loop.exec();
+    QVERIFY(receiver.isConnected());
+
+    // a burst of messages is slowed down, but none is dropped
+    m_messages.clear();
+    connect(&receiver, SIGNAL(messageReceived(QXmppMessage)), this, SLOT(onMessageReceived(QXmppMessage)));
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < 30; ++i)
+        QVERIFY(sender.sendPacket(QXmppMessage(QString(), "receiver@localhost/QXmpp", QString::number(i))));
+
+    while (m_messages.size() < 30 && timer.elapsed() < 10000)
+        QTest::qWait(100);
+
+    QCOMPARE(m_messages.size(), 30);
+    QCOMPARE(m_messages.last().body(), QString("29"));
+    QVERIFY(timer.elapsed() >= 1500);
+}
+
+void tst_QXmppServer::testByteRateLimit()
+{
+    const QString testDomain("localhost");
+    const QHostAddress testHost(QHostAddress::LocalHost);
+    const quint16 testPort = 12345;
+
+    // prepare server
+    TestPasswordChecker passwordChecker;
+    passwordChecker.addCredentials("sender", "testpwd");
+    passwordChecker.addCredentials("receiver", "testpwd");
+
+    QXmppServer server;
+    server.setDomain(testDomain);
+    server.setPasswordChecker(&passwordChecker);
+    server.setClientBytesPerSecond(4096);
+    QCOMPARE(server.clientBytesPerSecond(), 4096);
+    QVERIFY(server.listenForClients(testHost, testPort));
+
+    // connect clients
+    QXmppConfiguration config;
+    config.setDomain(testDomain);
+    config.setHost(testHost.toString());
+    config.setPort(testPort);
+    config.setPassword("testpwd");
+    config.setResource("QXmpp");
+
+    QXmppClient sender;
+    QXmppClient receiver;
+    QEventLoop loop;
+    connect(&sender, SIGNAL(connected()), &loop, SLOT(quit()));
+    connect(&receiver, SIGNAL(connected()), &loop, SLOT(quit()));
+
+    config.setUser("sender");
+    sender.connectToServer(config);
+    loop.exec();
+    QVERIFY(sender.isConnected());
+
+    config.setUser("receiver");
+    receiver.connectToServer(config);
+    loop.exec();
+    QVERIFY(receiver.isConnected());
+
+    // the stanzas of a burst of data are all handled at the byte rate,
+    // including those which were read before the rate was exceeded
+    m_messages.clear();
+    connect(&receiver, SIGNAL(messageReceived(QXmppMessage)), this, SLOT(onMessageReceived(QXmppMessage)));
+
+    const QString padding(500, QLatin1Char('x'));
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < 30; ++i)
+        QVERIFY(sender.sendPacket(QXmppMessage(QString(), "receiver@localhost/QXmpp", QString::number(i) + padding)));
+
+    while (m_messages.size() < 30 && timer.elapsed() < 20000)
+        QTest::qWait(100);
+
+    QCOMPARE(m_messages.size(), 30);
+    QCOMPARE(m_messages.last().body(), QString("29") + padding);
+    QVERIFY(sender.isConnected());
+    QVERIFY(timer.elapsed() >= 2000);
+}
+
+void tst_QXmppServer::testRouteMessage_data()
+{
+    QTest::addColumn<int>("workerThreads");
+    QTest::addColumn<int>("resumptionTimeout");
+
+    QTest::newRow("single-thread") << 0 << 0;
+    QTest::newRow("worker-threads") << 2 << 0;
+    QTest::newRow("stream-management") << 0 << 60;
+    QTest::newRow("stream-management-worker-threads") << 2 << 60;
+}
+
+void tst_QXmppServer::testRouteMessage()
+{
+    QFETCH(int, workerThreads);
+    QFETCH(int, resumptionTimeout);
+
+    const QString testDomain("localhost");
+    const QHostAddress testHost(QHostAddress::LocalHost);
+    const quint16 testPort = 12345;
+
+    // prepare server
+    TestPasswordChecker passwordChecker;
+    passwordChecker.addCredentials("sender", "testpwd");
+    passwordChecker.addCredentials("receiver", "testpwd");
+
+    QXmppServer server;
+    server.setDomain(testDomain);
+    server.setPasswordChecker(&passwordChecker);
+    server.setWorkerThreadCount(workerThreads);
+    server.setStreamResumptionTimeout(resumptionTimeout);
+    QVERIFY(server.listenForClients(testHost, testPort));
+    QCOMPARE(server.statistics().value("worker-threads").toInt(), workerThreads);
+    QSignalSpy connectedSpy(&server, SIGNAL(clientConnected(QString)));
+
+    // connect clients
+    QXmppConfiguration config;
+    config.setDomain(testDomain);
+    config.setHost(testHost.toString());
+    config.setPort(testPort);
+    config.setPassword("testpwd");
+    config.setResource("QXmpp");
+
+    QXmppClient sender;
+    QXmppClient receiver;
+    QEventLoop loop;
+    connect(&sender, SIGNAL(connected()), &loop, SLOT(quit()));
+    connect(&receiver, SIGNAL(connected()), &loop, SLOT(quit()));
+
+    config.setUser("sender");
+    sender.connectToServer(config);
+    loop.exec();
+    QVERIFY(sender.isConnected());
+
+    config.setUser("receiver");
+    receiver.connectToServer(config);
+    loop.exec();
+    QVERIFY(receiver.isConnected());
+
+    // send a message
+    m_messages.clear();
+    connect(&receiver, SIGNAL(messageReceived(QXmppMessage)), this, SLOT(onMessageReceived(QXmppMessage)));
+    connect(&receiver, SIGNAL(messageReceived(QXmppMessage)), &loop, SLOT(quit()));
+    QVERIFY(sender.sendPacket(QXmppMessage(QString(), "receiver@localhost/QXmpp", "hello")));
+    QTimer::singleShot(5000, &loop, SLOT(quit()));
+    loop.exec();
+
+    QCOMPARE(m_messages.size(), 1);
+    QCOMPARE(m_messages[0].from(), QString("sender@localhost/QXmpp"));
+    QCOMPARE(m_messages[0].body(), QString("hello"));
+
+    // the server reports the full JIDs of the clients
+    QCOMPARE(connectedSpy.size(), 2);
+    QCOMPARE(connectedSpy[0][0].toString(), QString("sender@localhost/QXmpp"));
+    QCOMPARE(connectedSpy[1][0].toString(), QString("receiver@localhost/QXmpp"));
+}
+
+void tst_QXmppServer::testStreamResumption()
+{
+    const QString testDomain("localhost");
+    const QHostAddress testHost(QHostAddress::LocalHost);
+    const quint16 testPort = 12345;
+    const QRegExp hRegex("h=[\"'](\\d+)[\"']");
+    const QRegExp idRegex("id=[\"']([^\"']+)[\"']");
+
+    // prepare server
+    TestPasswordChecker passwordChecker;
+    passwordChecker.addCredentials("sender", "testpwd");
+    passwordChecker.addCredentials("receiver", "testpwd");
+
+    QXmppServer server;
+    server.setDomain(testDomain);
+    server.setPasswordChecker(&passwordChecker);
+    server.setStreamResumptionTimeout(2);
+    QVERIFY(server.listenForClients(testHost, testPort));
+
+    QXmppConfiguration config;
+    config.setDomain(testDomain);
+    config.setHost(testHost.toString());
+    config.setPort(testPort);
+    config.setUser("sender");
+    config.setPassword("testpwd");
+    config.setResource("QXmpp");
+
+    QXmppClient sender;
+    QEventLoop loop;
+    connect(&sender, SIGNAL(connected()), &loop, SLOT(quit()));
+    sender.connectToServer(config);
+    loop.exec();
+    QVERIFY(sender.isConnected());
+    m_messages.clear();
+    connect(&sender, SIGNAL(messageReceived(QXmppMessage)), this, SLOT(onMessageReceived(QXmppMessage)));
+
+    // the receiver enables resumable Stream Management
+    TestRawClient receiver;
+    QVERIFY(receiver.connectToServer(testHost, testPort));
+    QVERIFY(receiver.login("receiver"));
+    receiver.send("<iq type='set' id='bind1'><bind xmlns='urn:ietf:params:xml:ns:xmpp-bind'><resource>raw</resource></bind></iq>");
+    QVERIFY(!receiver.waitFor("</iq>").isEmpty());
+    receiver.send("<enable xmlns='urn:xmpp:sm:3' resume='true'/>");
+    QVERIFY(!receiver.waitFor("<enabled").isEmpty());
+    QVERIFY(idRegex.indexIn(receiver.waitFor("/>")) >= 0);
+    const QString id = idRegex.cap(1);
+
+    // it sends one stanza, and receives one which it does not acknowledge
+    receiver.send("<message to='sender@localhost/QXmpp' type='chat'><body>hi</body></message>");
+    for (int i = 0; i < 50 && m_messages.isEmpty(); ++i)
+        QTest::qWait(100);
+    QCOMPARE(m_messages.size(), 1);
+    QCOMPARE(m_messages[0].from(), QString("receiver@localhost/raw"));
+
+    QVERIFY(sender.sendPacket(QXmppMessage(QString(), "receiver@localhost/raw", "hello")));
+    QVERIFY(!receiver.waitFor("hello").isEmpty());
+
+    // the connection drops
+    receiver.abort();
+    QTest::qWait(200);
+
+    // an unknown session cannot be resumed
+    QVERIFY(receiver.connectToServer(testHost, testPort));
+    QVERIFY(receiver.login("receiver"));
+    receiver.send("<resume xmlns='urn:xmpp:sm:3' previd='unknown' h='0'/>");
+    QVERIFY(!receiver.waitFor("<failed").isEmpty());
+    receiver.abort();
+
+    // the session is resumed, and the unacknowledged stanza is sent again
+    QVERIFY(receiver.connectToServer(testHost, testPort));
+    QVERIFY(receiver.login("receiver"));
+    receiver.send("<resume xmlns='urn:xmpp:sm:3' previd='" + id.toUtf8() + "' h='0'/>");
+    QVERIFY(!receiver.waitFor("<resumed").isEmpty());
+    QVERIFY(hRegex.indexIn(receiver.waitFor("/>")) >= 0);
+    QCOMPARE(hRegex.cap(1), QString("1"));
+    QVERIFY(!receiver.waitFor("hello").isEmpty());
+
+    // once it expires, the detached session is cleaned up
+    QSignalSpy disconnectedSpy(&server, SIGNAL(clientDisconnected(QString)));
+    receiver.abort();
+    for (int i = 0; i < 50 && disconnectedSpy.isEmpty(); ++i)
+        QTest::qWait(100);
+    QCOMPARE(disconnectedSpy.size(), 1);
+    QCOMPARE(disconnectedSpy.at(0).at(0).toString(), QString("receiver@localhost/raw"));
+
+    // and can no longer be resumed
+    QVERIFY(receiver.connectToServer(testHost, testPort));
+    QVERIFY(receiver.login("receiver"));
+    receiver.send("<resume xmlns='urn:xmpp:sm:3' previd='" + id.toUtf8() + "' h='1'/>");
+    QVERIFY(!receiver.waitFor("<failed").isEmpty());
+    receiver.abort();
+}
+
 QTEST_MAIN(tst_QXmppServer)
 #include "tst_qxmppserver.moc"
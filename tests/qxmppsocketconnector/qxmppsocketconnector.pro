@@ -0,0 +1,3 @@
+include(../tests.pri)
+TARGET = tst_qxmppsocketconnector
+SOURCES += tst_qxmppsocketconnector.cpp
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QEventLoop>
+#include <QObject>
+#include <QSslSocket>
+#include <QTcpServer>
+#include <QTimer>
+
+#include "QXmppSocketConnector_p.h"
+#include "util.h"
+
+// Records the outcome of a QXmppSocketConnector.
+class TestReceiver : public QObject
+{
+    Q_OBJECT
+
+public:
+    TestReceiver()
+        : connectedSocket(0), failedSocket(0), finished(false)
+    {
+    }
+
+    ~TestReceiver()
+    {
+        delete connectedSocket;
+        delete failedSocket;
+    }
+
+    QSslSocket *connectedSocket;
+    QSslSocket *failedSocket;
+    bool finished;
+
+signals:
+    void done();
+
+public slots:
+    void onConnected(QSslSocket *socket)
+    {
+        connectedSocket = socket;
+        finished = true;
+        emit done();
+    }
+
+    void onFailed(QSslSocket *socket)
+    {
+        failedSocket = socket;
+        finished = true;
+        emit done();
+    }
+};
+
+static quint16 closedPort()
+{
+    QTcpServer server;
+    server.listen(QHostAddress::LocalHost);
+    const quint16 port = server.serverPort();
+    server.close();
+    return port;
+}
+
+static void run(QXmppSocketConnector *connector, TestReceiver *receiver)
+{
+    QObject::connect(connector, SIGNAL(connected(QSslSocket*)),
+                     receiver, SLOT(onConnected(QSslSocket*)));
+    QObject::connect(connector, SIGNAL(failed(QSslSocket*)),
+                     receiver, SLOT(onFailed(QSslSocket*)));
+
+    QEventLoop loop;
+    QObject::connect(receiver, SIGNAL(done()), &loop, SLOT(quit()));
+    QTimer::singleShot(10000, &loop, SLOT(quit()));
+    connector->start();
+    if (!receiver->finished)
+        loop.exec();
+}
+
+class tst_QXmppSocketConnector : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testLatencyBucket_data();
+    void testLatencyBucket();
+    void testConnect();
+    void testFallback();
+    void testFailed();
+    void testAbort();
+};
+
+void tst_QXmppSocketConnector::testLatencyBucket_data()
+{
+    QTest::addColumn<qint64>("msecs");
+    QTest::addColumn<QString>("bucket");
+
+    QTest::newRow("0") << qint64(0) << "50";
+    QTest::newRow("50") << qint64(50) << "50";
+    QTest::newRow("51") << qint64(51) << "100";
+    QTest::newRow("3000") << qint64(3000) << "5000";
+    QTest::newRow("10000") << qint64(10000) << "10000";
+    QTest::newRow("10001") << qint64(10001) << "inf";
+}
+
+void tst_QXmppSocketConnector::testLatencyBucket()
+{
+    QFETCH(qint64, msecs);
+    QFETCH(QString, bucket);
+
+    QCOMPARE(QXmppSocketConnector::latencyBucket(msecs), bucket);
+}
+
+void tst_QXmppSocketConnector::testConnect()
+{
+    QTcpServer server;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+
+    QXmppSocketConnector connector;
+    TestReceiver receiver;
+    connector.addTarget("127.0.0.1", server.serverPort());
+    run(&connector, &receiver);
+
+    QVERIFY(receiver.connectedSocket);
+    QVERIFY(!receiver.connectedSocket->parent());
+    QCOMPARE(receiver.connectedSocket->state(), QAbstractSocket::ConnectedState);
+    QCOMPARE(receiver.connectedSocket->peerPort(), server.serverPort());
+    QCOMPARE(connector.attempts(), 1);
+    QVERIFY(!connector.isRunning());
+}
+
+void tst_QXmppSocketConnector::testFallback()
+{
+    QTcpServer server;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+
+    // the first target refuses the connection, which starts the next
+    // attempt without waiting for the attempt delay
+    QXmppSocketConnector connector;
+    connector.setAttemptDelay(60000);
+    TestReceiver receiver;
+    connector.addTarget("127.0.0.1", closedPort());
+    connector.addTarget("127.0.0.1", server.serverPort());
+    run(&connector, &receiver);
+
+    QVERIFY(receiver.connectedSocket);
+    QCOMPARE(receiver.connectedSocket->peerPort(), server.serverPort());
+    QCOMPARE(connector.attempts(), 2);
+}
+
+void tst_QXmppSocketConnector::testFailed()
+{
+    QXmppSocketConnector connector;
+    TestReceiver receiver;
+    connector.addTarget("127.0.0.1", closedPort());
+    run(&connector, &receiver);
+
+    QVERIFY(!receiver.connectedSocket);
+    QVERIFY(receiver.failedSocket);
+    QCOMPARE(receiver.failedSocket->error(), QAbstractSocket::ConnectionRefusedError);
+    QCOMPARE(connector.attempts(), 1);
+    QVERIFY(!connector.isRunning());
+}
+
+void tst_QXmppSocketConnector::testAbort()
+{
+    QXmppSocketConnector connector;
+    TestReceiver receiver;
+    QObject::connect(&connector, SIGNAL(connected(QSslSocket*)),
+                     &receiver, SLOT(onConnected(QSslSocket*)));
+    QObject::connect(&connector, SIGNAL(failed(QSslSocket*)),
+                     &receiver, SLOT(onFailed(QSslSocket*)));
+
+    connector.addTarget("example.invalid", 5222);
+    connector.start();
+    QVERIFY(connector.isRunning());
+    connector.abort();
+    QVERIFY(!connector.isRunning());
+
+    QEventLoop loop;
+    QTimer::singleShot(100, &loop, SLOT(quit()));
+    loop.exec();
+    QVERIFY(!receiver.finished);
+}
+
+QTEST_MAIN(tst_QXmppSocketConnector)
+#include "tst_qxmppsocketconnector.moc"
@@ -0,0 +1,3 @@
+include(../tests.pri)
+TARGET = tst_qxmppstanzaindex
+SOURCES += tst_qxmppstanzaindex.cpp
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QObject>
+
+#include "QXmppStanzaIndex_p.h"
+#include "util.h"
+
+Q_DECLARE_METATYPE(QList<int>)
+
+static QDomElement parseElement(QDomDocument &doc, const QByteArray &xml)
+{
+    doc.setContent(xml, true);
+    return doc.documentElement();
+}
+
+// Mimics the checks a client extension performs in handleStanza().
+class TestHandler
+{
+public:
+    TestHandler(const QString &tagName, const QString &ns)
+        : m_tagName(tagName), m_namespace(ns)
+    {
+    }
+
+    bool handleStanza(const QDomElement &element) const
+    {
+        return element.tagName() == m_tagName &&
+               element.firstChildElement("query").namespaceURI() == m_namespace;
+    }
+
+    QString namespaceURI() const
+    {
+        return m_namespace;
+    }
+
+private:
+    QString m_tagName;
+    QString m_namespace;
+};
+
+class tst_QXmppStanzaIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testHandlers_data();
+    void testHandlers();
+    void benchmarkDispatch_data();
+    void benchmarkDispatch();
+};
+
+void tst_QXmppStanzaIndex::testHandlers_data()
+{
+    QTest::addColumn<QByteArray>("xml");
+    QTest::addColumn<QList<int> >("handlers");
+
+    QTest::newRow("iq-a")
+        << QByteArray("<iq type=\"get\"><query xmlns=\"urn:example:a\"/></iq>")
+        << (QList<int>() << 0 << 1 << 2);
+    QTest::newRow("iq-b")
+        << QByteArray("<iq type=\"set\"><query xmlns=\"urn:example:b\"/></iq>")
+        << (QList<int>() << 1 << 2);
+    QTest::newRow("iq-unknown")
+        << QByteArray("<iq type=\"get\"><query xmlns=\"urn:example:x\"/></iq>")
+        << (QList<int>() << 1);
+    QTest::newRow("iq-empty-result")
+        << QByteArray("<iq type=\"result\"/>")
+        << (QList<int>() << 0 << 1 << 2);
+    QTest::newRow("iq-error")
+        << QByteArray("<iq type=\"error\"><query xmlns=\"urn:example:b\"/><error type=\"cancel\"/></iq>")
+        << (QList<int>() << 0 << 1 << 2);
+    QTest::newRow("message-c")
+        << QByteArray("<message xmlns=\"jabber:client\"><body>hi</body><x xmlns=\"urn:example:c\"/></message>")
+        << (QList<int>() << 1 << 3 << 4);
+    QTest::newRow("message-a-c")
+        << QByteArray("<message xmlns=\"jabber:client\"><x xmlns=\"urn:example:c\"/><y xmlns=\"urn:example:a\"/></message>")
+        << (QList<int>() << 1 << 3 << 4);
+    QTest::newRow("message-body")
+        << QByteArray("<message xmlns=\"jabber:client\"><body>hi</body></message>")
+        << (QList<int>() << 1);
+    QTest::newRow("presence")
+        << QByteArray("<presence/>")
+        << QList<int>();
+}
+
+void tst_QXmppStanzaIndex::testHandlers()
+{
+    QFETCH(QByteArray, xml);
+    QFETCH(QList<int>, handlers);
+
+    QXmppStanzaIndex index;
+    index.addHandler(0, QStringList() << "iq", QStringList() << "urn:example:a");
+    index.addHandler(1, QStringList() << "iq" << "message", QStringList());
+    index.addHandler(2, QStringList() << "iq", QStringList() << "urn:example:b" << "urn:example:a");
+    index.addHandler(3, QStringList() << "message", QStringList() << "urn:example:c");
+    index.addHandler(4, QStringList() << "message", QStringList() << "urn:example:a" << "urn:example:c");
+
+    QDomDocument doc;
+    QCOMPARE(index.handlers(parseElement(doc, xml)), handlers);
+
+    index.clear();
+    QCOMPARE(index.handlers(parseElement(doc, xml)), QList<int>());
+}
+
+void tst_QXmppStanzaIndex::benchmarkDispatch_data()
+{
+    QTest::addColumn<bool>("indexed");
+
+    QTest::newRow("linear") << false;
+    QTest::newRow("indexed") << true;
+}
+
+void tst_QXmppStanzaIndex::benchmarkDispatch()
+{
+    QFETCH(bool, indexed);
+
+    // as many handlers as a client with all its managers loaded
+    QList<TestHandler> handlers;
+    QXmppStanzaIndex index;
+    for (int i = 0; i < 16; ++i) {
+        handlers << TestHandler("iq", QString("urn:example:%1").arg(i));
+        index.addHandler(i, QStringList() << "iq", QStringList() << handlers.last().namespaceURI());
+    }
+
+    // a stanza for the last handler is the worst case for a linear scan
+    QDomDocument doc;
+    const QDomElement element = parseElement(doc, "<iq type=\"get\"><query xmlns=\"urn:example:15\"/></iq>");
+
+    int handled = -1;
+    if (indexed) {
+        QBENCHMARK {
+            foreach (int i, index.handlers(element)) {
+                if (handlers.at(i).handleStanza(element)) {
+                    handled = i;
+                    break;
+                }
+            }
+        }
+    } else {
+        QBENCHMARK {
+            for (int i = 0; i < handlers.size(); ++i) {
+                if (handlers.at(i).handleStanza(element)) {
+                    handled = i;
+                    break;
+                }
+            }
+        }
+    }
+    QCOMPARE(handled, 15);
+}
+
+QTEST_MAIN(tst_QXmppStanzaIndex)
+#include "tst_qxmppstanzaindex.moc"
@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QObject>
+#include <QSslSocket>
+#include <QTcpServer>
+#include "QXmppMessage.h"
+#include "QXmppStream.h"
+#include "util.h"
+
+static const QByteArray ackRequest("<r xmlns=\"urn:xmpp:sm:3\"/>");
+
+// Records every chunk of data the stream writes.
+class TestSocket : public QSslSocket
+{
+public:
+    QList<QByteArray> writes;
+
+protected:
+    qint64 writeData(const char *data, qint64 len)
+    {
+        writes << QByteArray(data, len);
+        return QSslSocket::writeData(data, len);
+    }
+};
+
+class TestStream : public QXmppStream
+{
+public:
+    TestStream()
+        : QXmppStream(0)
+    {
+    }
+
+    void enableStreamManagement()
+    {
+        QXmppStream::enableStreamManagement(true);
+    }
+
+    void setSocket(QSslSocket *socket)
+    {
+        QXmppStream::setSocket(socket);
+    }
+
+protected:
+    void handleStanza(const QDomElement &element)
+    {
+        Q_UNUSED(element);
+    }
+
+    void handleStream(const QDomElement &element)
+    {
+        Q_UNUSED(element);
+    }
+};
+
+class tst_QXmppStream : public QObject
+{
+    Q_OBJECT
+
+public slots:
+    void onLogMessage(QXmppLogger::MessageType type, const QString &text);
+
+private slots:
+    void init();
+    void cleanup();
+
+    void testCoalescing();
+    void testAckRequestDefault();
+    void testAckRequestThreshold();
+    void testAckRequestInterval();
+    void testLogSplitCharacter();
+
+private:
+    void sendMessages(int count);
+
+    QTcpServer *server;
+    QTcpSocket *peer;
+    TestSocket *socket;
+    TestStream *stream;
+    QString received;
+};
+
+void tst_QXmppStream::onLogMessage(QXmppLogger::MessageType type, const QString &text)
+{
+    if (type == QXmppLogger::ReceivedMessage)
+        received += text;
+}
+
+void tst_QXmppStream::init()
+{
+    server = new QTcpServer;
+    QVERIFY(server->listen(QHostAddress::LocalHost));
+
+    socket = new TestSocket;
+    socket->connectToHost(server->serverAddress(), server->serverPort());
+    QVERIFY(socket->waitForConnected());
+    QVERIFY(server->waitForNewConnection(1000));
+    peer = server->nextPendingConnection();
+    QVERIFY(peer);
+
+    received.clear();
+    stream = new TestStream;
+    stream->setSocket(socket);
+
+    bool check;
+    Q_UNUSED(check);
+    check = connect(stream, SIGNAL(logMessage(QXmppLogger::MessageType,QString)),
+                    this, SLOT(onLogMessage(QXmppLogger::MessageType,QString)));
+    Q_ASSERT(check);
+    QVERIFY(stream->isConnected());
+}
+
+void tst_QXmppStream::cleanup()
+{
+    delete stream;
+    delete socket;
+    delete server;
+}
+
+void tst_QXmppStream::sendMessages(int count)
+{
+    for (int i = 0; i < count; ++i) {
+        QXmppMessage message("juliet@example.com/balcony", "romeo@example.net",
+                             QString("message %1").arg(i));
+        QVERIFY(stream->sendPacket(message));
+    }
+}
+
+void tst_QXmppStream::testCoalescing()
+{
+    sendMessages(3);
+
+    // nothing is written until control returns to the event loop
+    QVERIFY(socket->writes.isEmpty());
+
+    QCoreApplication::processEvents();
+    QCOMPARE(socket->writes.size(), 1);
+    const QByteArray data = socket->writes.first();
+    QVERIFY(data.contains("message 0"));
+    QVERIFY(data.contains("message 1"));
+    QVERIFY(data.contains("message 2"));
+    QVERIFY(!data.contains(ackRequest));
+
+    // the peer receives the whole batch
+    QByteArray received;
+    while (received.size() < data.size() && peer->waitForReadyRead(1000))
+        received += peer->readAll();
+    QCOMPARE(received, data);
+}
+
+void tst_QXmppStream::testAckRequestDefault()
+{
+    stream->enableStreamManagement();
+    sendMessages(3);
+    QCoreApplication::processEvents();
+
+    // a single request ends the batch
+    QCOMPARE(socket->writes.size(), 1);
+    const QByteArray data = socket->writes.first();
+    QCOMPARE(data.count(ackRequest), 1);
+    QVERIFY(data.endsWith(ackRequest));
+    QVERIFY(data.contains("message 2"));
+}
+
+void tst_QXmppStream::testAckRequestThreshold()
+{
+    stream->setAckRequestThreshold(3);
+    stream->setAckRequestInterval(10000);
+    stream->enableStreamManagement();
+
+    // below the threshold, no request is sent
+    sendMessages(2);
+    QCoreApplication::processEvents();
+    QCOMPARE(socket->writes.size(), 1);
+    QCOMPARE(socket->writes.last().count(ackRequest), 0);
+
+    // reaching the threshold sends a request with the batch
+    sendMessages(1);
+    QCoreApplication::processEvents();
+    QCOMPARE(socket->writes.size(), 2);
+    QCOMPARE(socket->writes.last().count(ackRequest), 1);
+    QVERIFY(socket->writes.last().endsWith(ackRequest));
+
+    // the counter starts again after the request
+    sendMessages(2);
+    QCoreApplication::processEvents();
+    QCOMPARE(socket->writes.size(), 3);
+    QCOMPARE(socket->writes.last().count(ackRequest), 0);
+}
+
+void tst_QXmppStream::testAckRequestInterval()
+{
+    stream->setAckRequestThreshold(10);
+    stream->setAckRequestInterval(100);
+    stream->enableStreamManagement();
+
+    sendMessages(1);
+    QCoreApplication::processEvents();
+    QCOMPARE(socket->writes.size(), 1);
+    QCOMPARE(socket->writes.last().count(ackRequest), 0);
+
+    // the request is not sent before the interval elapses
+    QTest::qWait(30);
+    QCOMPARE(socket->writes.size(), 1);
+
+    // once it elapses, the request is sent on its own
+    QTest::qWait(200);
+    QCOMPARE(socket->writes.size(), 2);
+    QCOMPARE(socket->writes.last(), ackRequest);
+}
+
+void tst_QXmppStream::testLogSplitCharacter()
+{
+    const QByteArray data = QByteArray(
+        "<stream:stream xmlns='jabber:client' xmlns:stream='http://etherx.jabber.org/streams' version='1.0'>"
+        "<message><body>caf\xc3\xa9</body></message>");
+
+    // split the data in the middle of the last character of the body
+    const int split = data.indexOf("</body>") - 1;
+    peer->write(data.left(split));
+    peer->flush();
+    for (int i = 0; i < 100 && received.isEmpty(); ++i)
+        QTest::qWait(10);
+    QVERIFY(!received.isEmpty());
+
+    peer->write(data.mid(split));
+    peer->flush();
+    for (int i = 0; i < 100 && !received.contains("</message>"); ++i)
+        QTest::qWait(10);
+    QVERIFY(received.contains(QString::fromUtf8("<body>caf\xc3\xa9</body>")));
+}
+
+QTEST_MAIN(tst_QXmppStream)
+#include "tst_qxmppstream.moc"
@@ -43,6 +43,7 @@ void tst_QXmppStreamFeatures::testEmpty()
     QCOMPARE(features.sessionMode(), QXmppStreamFeatures::Disabled);
     QCOMPARE(features.nonSaslAuthMode(), QXmppStreamFeatures::Disabled);
     QCOMPARE(features.tlsMode(), QXmppStreamFeatures::Disabled);
+    QCOMPARE(features.rosterVersioningMode(), QXmppStreamFeatures::Disabled);
     QCOMPARE(features.authMechanisms(), QStringList());
     QCOMPARE(features.compressionMethods(), QStringList());
     serializePacket(features, xml);
@@ -55,6 +56,7 @@ void tst_QXmppStreamFeatures::testFull()
         "<session xmlns=\"urn:ietf:params:xml:ns:xmpp-session\"/>"
         "<auth xmlns=\"http://jabber.org/features/iq-auth\"/>"
         "<starttls xmlns=\"urn:ietf:params:xml:ns:xmpp-tls\"/>"
+        "<ver xmlns=\"urn:xmpp:features:rosterver\"/>"
         "<compression xmlns=\"http://jabber.org/features/compress\"><method>zlib</method></compression>"
         "<mechanisms xmlns=\"urn:ietf:params:xml:ns:xmpp-sasl\"><mechanism>PLAIN</mechanism></mechanisms>"
         "</stream:features>");
@@ -65,6 +67,7 @@ void tst_QXmppStreamFeatures::testFull()
     QCOMPARE(features.sessionMode(), QXmppStreamFeatures::Enabled);
     QCOMPARE(features.nonSaslAuthMode(), QXmppStreamFeatures::Enabled);
     QCOMPARE(features.tlsMode(), QXmppStreamFeatures::Enabled);
+    QCOMPARE(features.rosterVersioningMode(), QXmppStreamFeatures::Enabled);
     QCOMPARE(features.authMechanisms(), QStringList() << "PLAIN");
     QCOMPARE(features.compressionMethods(), QStringList() << "zlib");
     serializePacket(features, xml);
@@ -0,0 +1,3 @@
+include(../tests.pri)
+TARGET = tst_qxmppstreammanagementqueue
+SOURCES += tst_qxmppstreammanagementqueue.cpp
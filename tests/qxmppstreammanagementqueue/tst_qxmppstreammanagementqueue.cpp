@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QObject>
+#include "QXmppStreamManagement_p.h"
+#include "util.h"
+
+class tst_QXmppStreamManagementQueue : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testAcknowledge();
+    void testLimits();
+    void testResend();
+    void testWrap();
+};
+
+void tst_QXmppStreamManagementQueue::testAcknowledge()
+{
+    QXmppStreamManagementQueue queue;
+    QVERIFY(queue.isEmpty());
+
+    queue.append("<message id='1'/>");
+    queue.append("<message id='2'/>");
+    queue.append("<message id='3'/>");
+    QCOMPARE(queue.size(), 3);
+    QCOMPARE(queue.bytes(), qint64(51));
+    QCOMPARE(queue.firstSequenceNumber(), 1u);
+    QCOMPARE(queue.lastSequenceNumber(), 3u);
+
+    QCOMPARE(queue.acknowledge(2), 2);
+    QCOMPARE(queue.size(), 1);
+    QCOMPARE(queue.bytes(), qint64(17));
+    QCOMPARE(queue.at(0), QByteArray("<message id='3'/>"));
+    QCOMPARE(queue.firstSequenceNumber(), 3u);
+
+    // stale acknowledgement
+    QCOMPARE(queue.acknowledge(1), 0);
+    QCOMPARE(queue.size(), 1);
+
+    // acknowledgement for stanzas which were never sent
+    QCOMPARE(queue.acknowledge(5), 1);
+    QVERIFY(queue.isEmpty());
+    QCOMPARE(queue.bytes(), qint64(0));
+    QCOMPARE(queue.peakBytes(), qint64(51));
+}
+
+void tst_QXmppStreamManagementQueue::testLimits()
+{
+    QXmppStreamManagementQueue queue;
+    queue.setMaxCount(2);
+    queue.append("a");
+    QVERIFY(!queue.isFull());
+    queue.append("b");
+    QVERIFY(queue.isFull());
+    queue.acknowledge(1);
+    QVERIFY(!queue.isFull());
+
+    queue.setMaxCount(0);
+    queue.setMaxBytes(4);
+    queue.append("cde");
+    QVERIFY(queue.isFull());
+    queue.acknowledge(3);
+    QVERIFY(!queue.isFull());
+}
+
+void tst_QXmppStreamManagementQueue::testResend()
+{
+    QXmppStreamManagementQueue queue;
+    queue.append("a");
+    queue.append("bc");
+    queue.acknowledge(1);
+
+    // a new stream renumbers the stanzas
+    queue.resetSequenceNumbers();
+    QCOMPARE(queue.firstSequenceNumber(), 1u);
+    QCOMPARE(queue.lastSequenceNumber(), 1u);
+
+    queue.recordResend();
+    QCOMPARE(queue.resentStanzas(), qint64(1));
+    QCOMPARE(queue.resentBytes(), qint64(2));
+}
+
+void tst_QXmppStreamManagementQueue::testWrap()
+{
+    QXmppStreamManagementQueue queue;
+
+    // start right below the point where sequence numbers wrap around
+    const unsigned start = 0xffffffcfu;
+    queue.setLastSequenceNumber(start);
+
+    // go around the ring buffer several times, growing it on the way,
+    // while the sequence numbers go past 2^32
+    unsigned acked = start;
+    int ackedCount = 0;
+    for (int i = 0; i < 100; ++i) {
+        queue.append(QByteArray::number(i));
+        if (i % 3 == 2) {
+            acked += 2;
+            ackedCount += 2;
+            QCOMPARE(queue.acknowledge(acked), 2);
+        }
+    }
+
+    QCOMPARE(queue.lastSequenceNumber(), start + 100u);
+    QVERIFY(queue.lastSequenceNumber() < start);
+    QCOMPARE(queue.firstSequenceNumber(), acked + 1);
+    QCOMPARE(queue.size(), 100 - ackedCount);
+    for (int i = 0; i < queue.size(); ++i)
+        QCOMPARE(queue.at(i), QByteArray::number(ackedCount + i));
+
+    // a stale acknowledgement from before the wrap removes nothing
+    QCOMPARE(queue.acknowledge(start + 1), 0);
+
+    // an acknowledgement past the wrap removes everything
+    QCOMPARE(queue.acknowledge(start + 100u), 100 - ackedCount);
+    QVERIFY(queue.isEmpty());
+}
+
+QTEST_MAIN(tst_QXmppStreamManagementQueue)
+#include "tst_qxmppstreammanagementqueue.moc"
@@ -0,0 +1,3 @@
+include(../tests.pri)
+TARGET = tst_qxmppstreamparser
+SOURCES += tst_qxmppstreamparser.cpp
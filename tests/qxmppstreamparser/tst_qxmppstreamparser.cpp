@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2008-2014 The QXmpp developers
+ *
+ * Source:
+ *  https://github.com/qxmpp-project/qxmpp
+ *
+ * This file is a part of QXmpp library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <QObject>
+#include "QXmppStreamParser_p.h"
+#include "util.h"
+
+static const QByteArray streamXml(
+    "<?xml version='1.0'?>"
+    "<stream:stream xmlns='jabber:client' xmlns:stream='http://etherx.jabber.org/streams' from='example.com' id='abc' version='1.0'>"
+    "<message from='juliet@example.com/balcony' to='romeo@example.net' type='chat'>"
+        "<body>Wherefore art thou, Romeo?</body>"
+    "</message>"
+    " "
+    "<iq id='ping1' type='get'><ping xmlns='urn:xmpp:ping'/></iq>"
+    "</stream:stream>");
+
+class tst_QXmppStreamParser : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testFragmented_data();
+    void testFragmented();
+    void testInvalid();
+    void testLimits_data();
+    void testLimits();
+    void testBufferLimit();
+    void testRawStanza();
+    void testRestart();
+};
+
+void tst_QXmppStreamParser::testFragmented_data()
+{
+    QTest::addColumn<int>("chunkSize");
+
+    QTest::newRow("1") << 1;
+    QTest::newRow("7") << 7;
+    QTest::newRow("64") << 64;
+    QTest::newRow("whole") << streamXml.size();
+}
+
+void tst_QXmppStreamParser::testFragmented()
+{
+    QFETCH(int, chunkSize);
+
+    QXmppStreamParser parser;
+    QList<QXmppStreamParser::Event> events;
+    QList<QDomElement> elements;
+    for (int i = 0; i < streamXml.size(); i += chunkSize) {
+        parser.addData(streamXml.mid(i, chunkSize));
+        QXmppStreamParser::Event event;
+        while ((event = parser.readNext()) != QXmppStreamParser::NoEvent) {
+            events << event;
+            elements << parser.element();
+        }
+    }
+    QVERIFY(!parser.hasError());
+
+    QCOMPARE(events.size(), 4);
+    QCOMPARE(events[0], QXmppStreamParser::StreamStart);
+    QCOMPARE(elements[0].attribute("from"), QString("example.com"));
+    QCOMPARE(elements[0].attribute("id"), QString("abc"));
+
+    QCOMPARE(events[1], QXmppStreamParser::Stanza);
+    QCOMPARE(elements[1].tagName(), QString("message"));
+    QCOMPARE(elements[1].namespaceURI(), QString("jabber:client"));
+    QCOMPARE(elements[1].attribute("to"), QString("romeo@example.net"));
+    QCOMPARE(elements[1].firstChildElement("body").text(), QString("Wherefore art thou, Romeo?"));
+
+    QCOMPARE(events[2], QXmppStreamParser::Stanza);
+    QCOMPARE(elements[2].tagName(), QString("iq"));
+    QCOMPARE(elements[2].firstChildElement("ping").namespaceURI(), QString("urn:xmpp:ping"));
+
+    QCOMPARE(events[3], QXmppStreamParser::StreamEnd);
+}
+
+void tst_QXmppStreamParser::testInvalid()
+{
+    QXmppStreamParser parser;
+    parser.addData("<stream:stream xmlns='jabber:client' xmlns:stream='http://etherx.jabber.org/streams'>");
+    QCOMPARE(parser.readNext(), QXmppStreamParser::StreamStart);
+    QCOMPARE(parser.readNext(), QXmppStreamParser::NoEvent);
+    QVERIFY(!parser.hasError());
+
+    parser.addData("<message><body></message>");
+    QCOMPARE(parser.readNext(), QXmppStreamParser::Error);
+    QVERIFY(parser.hasError());
+}
+
+void tst_QXmppStreamParser::testLimits_data()
+{
+    QTest::addColumn<QByteArray>("xml");
+    QTest::addColumn<int>("chunkSize");
+    QTest::addColumn<int>("limit");
+
+    const QByteArray header("<stream:stream xmlns='jabber:client' xmlns:stream='http://etherx.jabber.org/streams'>");
+    QTest::newRow("within-limits")
+        << streamXml << 7 << int(QXmppStreamParser::NoLimit);
+    QTest::newRow("stanza-size")
+        << header + "<message><body>" + QByteArray(200, 'a') + "</body></message>" << 1024 << int(QXmppStreamParser::StanzaSizeLimit);
+    QTest::newRow("stanza-size-fragmented")
+        << header + "<message><body>" + QByteArray(200, 'a') + "</body></message>" << 7 << int(QXmppStreamParser::StanzaSizeLimit);
+    QTest::newRow("depth")
+        << header + "<message><a><b><c/></b></a></message>" << 1024 << int(QXmppStreamParser::DepthLimit);
+    QTest::newRow("unclosed-tag")
+        << header + "<message to='" + QByteArray(1000, 'a') << 64 << int(QXmppStreamParser::BufferSizeLimit);
+}
+
+void tst_QXmppStreamParser::testLimits()
+{
+    QFETCH(QByteArray, xml);
+    QFETCH(int, chunkSize);
+    QFETCH(int, limit);
+
+    QXmppStreamParser parser;
+    parser.setMaximumStanzaSize(150);
+    parser.setMaximumDepth(3);
+    parser.setMaximumBufferSize(400);
+
+    QList<QXmppStreamParser::Event> events;
+    for (int i = 0; i < xml.size(); i += chunkSize) {
+        parser.addData(xml.mid(i, chunkSize));
+        QXmppStreamParser::Event event;
+        while ((event = parser.readNext()) != QXmppStreamParser::NoEvent) {
+            events << event;
+            if (event == QXmppStreamParser::LimitExceeded)
+                break;
+        }
+        if (parser.hasError())
+            break;
+    }
+
+    QCOMPARE(int(parser.exceededLimit()), limit);
+    if (limit == QXmppStreamParser::NoLimit) {
+        QVERIFY(!parser.hasError());
+        QCOMPARE(events.size(), 4);
+    } else {
+        QVERIFY(parser.hasError());
+        QCOMPARE(events.last(), QXmppStreamParser::LimitExceeded);
+        QVERIFY(!events.contains(QXmppStreamParser::Stanza));
+
+        // the parser refuses further input
+        parser.addData("<iq/>");
+        QCOMPARE(parser.readNext(), QXmppStreamParser::LimitExceeded);
+
+        // until it is reset
+        parser.clear();
+        QCOMPARE(int(parser.exceededLimit()), int(QXmppStreamParser::NoLimit));
+        QVERIFY(!parser.hasError());
+    }
+}
+
+void tst_QXmppStreamParser::testBufferLimit()
+{
+    const QByteArray header("<stream:stream xmlns='jabber:client' xmlns:stream='http://etherx.jabber.org/streams'>");
+    QByteArray stanzas;
+    for (int i = 0; i < 100; ++i)
+        stanzas += "<iq type='get' id='" + QByteArray::number(i) + "'/>";
+
+    QXmppStreamParser parser;
+    parser.setMaximumBufferSize(400);
+
+    // a burst of complete stanzas is larger than the buffer
+    parser.addData(header + stanzas);
+    int count = 0;
+    QXmppStreamParser::Event event;
+    while ((event = parser.readNext()) != QXmppStreamParser::NoEvent) {
+        if (event == QXmppStreamParser::Stanza)
+            count++;
+    }
+    QVERIFY(!parser.hasError());
+    QCOMPARE(count, 100);
+
+    // the unfinished stanza following complete ones is counted
+    parser.addData(stanzas + "<message to='" + QByteArray(500, 'a'));
+    count = 0;
+    while ((event = parser.readNext()) != QXmppStreamParser::NoEvent) {
+        if (event == QXmppStreamParser::Stanza)
+            count++;
+        else if (event == QXmppStreamParser::LimitExceeded)
+            break;
+    }
+    QCOMPARE(count, 100);
+    QCOMPARE(int(parser.exceededLimit()), int(QXmppStreamParser::BufferSizeLimit));
+}
+
+void tst_QXmppStreamParser::testRawStanza()
+{
+    QXmppStreamParser parser;
+    parser.setRawTagNames(QSet<QString>() << "message");
+
+    QList<QXmppStreamParser::Event> events;
+    QList<QByteArray> rawStanzas;
+    for (int i = 0; i < streamXml.size(); i += 7) {
+        parser.addData(streamXml.mid(i, 7));
+        QXmppStreamParser::Event event;
+        while ((event = parser.readNext()) != QXmppStreamParser::NoEvent) {
+            events << event;
+            rawStanzas << parser.rawStanza();
+        }
+    }
+    QVERIFY(!parser.hasError());
+
+    QCOMPARE(events.size(), 4);
+    QCOMPARE(events[0], QXmppStreamParser::StreamStart);
+    QCOMPARE(events[1], QXmppStreamParser::RawStanza);
+    QCOMPARE(rawStanzas[1], QByteArray(
+        "<message xmlns=\"jabber:client\" from=\"juliet@example.com/balcony\" to=\"romeo@example.net\" type=\"chat\">"
+        "<body>Wherefore art thou, Romeo?</body>"
+        "</message>"));
+    QCOMPARE(events[2], QXmppStreamParser::Stanza);
+    QCOMPARE(events[3], QXmppStreamParser::StreamEnd);
+
+    // the raw stanza can be parsed on its own
+    QXmlStreamReader reader(rawStanzas[1]);
+    QCOMPARE(reader.readNextStartElement(), true);
+    QCOMPARE(reader.namespaceUri().toString(), QString("jabber:client"));
+    QCOMPARE(reader.attributes().value("to").toString(), QString("romeo@example.net"));
+}
+
+void tst_QXmppStreamParser::testRestart()
+{
+    QXmppStreamParser parser;
+    parser.addData("<?xml version='1.0'?><stream:stream xmlns='jabber:client' xmlns:stream='http://etherx.jabber.org/streams'>"
+                   "<success xmlns='urn:ietf:params:xml:ns:xmpp-sasl'/>");
+    QCOMPARE(parser.readNext(), QXmppStreamParser::StreamStart);
+    QCOMPARE(parser.readNext(), QXmppStreamParser::Stanza);
+    QCOMPARE(parser.element().namespaceURI(), QString("urn:ietf:params:xml:ns:xmpp-sasl"));
+
+    // a new stream header, including the XML declaration, follows
+    parser.clear();
+    parser.addData("<?xml version='1.0'?><stream:stream xmlns='jabber:client' xmlns:stream='http://etherx.jabber.org/streams' id='def'>");
+    QCOMPARE(parser.readNext(), QXmppStreamParser::StreamStart);
+    QCOMPARE(parser.element().attribute("id"), QString("def"));
+    QCOMPARE(parser.readNext(), QXmppStreamParser::NoEvent);
+    QVERIFY(!parser.hasError());
+}
+
+QTEST_MAIN(tst_QXmppStreamParser)
+#include "tst_qxmppstreamparser.moc"
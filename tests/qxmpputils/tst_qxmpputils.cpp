@@ -71,6 +71,7 @@ void tst_QXmppUtils::testJid()
     QCOMPARE(QXmppUtils::jidToDomain("foo@example.com"), QLatin1String("example.com"));
     QCOMPARE(QXmppUtils::jidToDomain("example.com"), QLatin1String("example.com"));
     QCOMPARE(QXmppUtils::jidToDomain(QString()), QString());
+    QCOMPARE(QXmppUtils::jidToDomain("foo@bar@example.com/resource"), QLatin1String("example.com"));
 
     QCOMPARE(QXmppUtils::jidToResource("foo@example.com/resource"), QLatin1String("resource"));
     QCOMPARE(QXmppUtils::jidToResource("foo@example.com"), QString());
@@ -1,23 +1,29 @@
 TEMPLATE = subdirs
 SUBDIRS = \
     qxmpparchiveiq \
+    qxmppasyncpasswordchecker \
     qxmppbindiq \
     qxmppcallmanager \
     qxmppcarbonmanager \
     qxmppdataform \
     qxmppdiscoveryiq \
+    qxmppdiscoverymanager \
     qxmppentitytimeiq \
     qxmppiceconnection \
     qxmppiq \
+    qxmppjid \
     qxmppjingleiq \
     qxmppmammanager \
     qxmppmessage \
     qxmppnonsaslauthiq \
+    qxmppoutgoingserver \
     qxmpppresence \
     qxmpppubsubiq \
     qxmppregisteriq \
     qxmppresultset \
+    qxmpprosterextension \
     qxmpprosteriq \
+    qxmpprostermanager \
     qxmpprpciq \
     qxmpprtcppacket \
     qxmpprtppacket \
@@ -25,6 +31,7 @@ SUBDIRS = \
     qxmppsessioniq \
     qxmppsocks \
     qxmppstanza \
+    qxmppstream \
     qxmppstreamfeatures \
     qxmppstunmessage \
     qxmpptransfermanager \
@@ -34,6 +41,14 @@ SUBDIRS = \
 
 !isEmpty(QXMPP_AUTOTEST_INTERNAL) {
     SUBDIRS += qxmppcodec
+    SUBDIRS += qxmppcompressor
+    SUBDIRS += qxmppdnscache
+    SUBDIRS += qxmppofflinemessagelog
+    SUBDIRS += qxmpproutingtable
     SUBDIRS += qxmppsasl
+    SUBDIRS += qxmppsocketconnector
+    SUBDIRS += qxmppstanzaindex
     SUBDIRS += qxmppstreaminitiationiq
+    SUBDIRS += qxmppstreammanagementqueue
+    SUBDIRS += qxmppstreamparser
 }
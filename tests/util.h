@@ -36,6 +36,26 @@ static void parsePacket(T &packet, const QByteArray &xml)
     packet.parse(element);
 }
 
+template <class T>
+static void parsePacketFromReader(T &packet, const QByteArray &xml)
+{
+    QXmlStreamReader reader(xml);
+    QCOMPARE(reader.readNextStartElement(), true);
+    packet.parse(reader);
+    QCOMPARE(reader.isEndElement(), true);
+    QCOMPARE(reader.hasError(), false);
+}
+
+template <class T>
+static QByteArray packetToXml(const T &packet)
+{
+    QBuffer buffer;
+    buffer.open(QIODevice::ReadWrite);
+    QXmlStreamWriter writer(&buffer);
+    packet.toXml(&writer);
+    return buffer.data();
+}
+
 template <class T>
 static void serializePacket(T &packet, const QByteArray &xml)
 {